@@ -0,0 +1,208 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace ob
+{
+#if defined(__linux__)
+    static constexpr std::size_t kHugePage = std::size_t { 2 } << 20;
+
+    // maps the first chunk, explicit huge pages need a reserved pool so they fall back to a plain mapping
+    static std::byte* map_chunk(std::size_t& size, bool huge, ArenaPages& pages)
+    {
+        if (huge)
+        {
+            const std::size_t rounded = (size + kHugePage - 1) & ~(kHugePage - 1);
+            void* p = ::mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                size = rounded;
+                pages = ArenaPages::Explicit;
+                return static_cast<std::byte*>(p);
+            }
+        }
+
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        pages = ArenaPages::Normal;
+        if (huge && ::madvise(p, size, MADV_HUGEPAGE) == 0)
+        {
+            pages = ArenaPages::Transparent;
+        }
+        return static_cast<std::byte*>(p);
+    }
+#endif
+
+    Arena::Arena(std::size_t initial_bytes, const ArenaOptions& opts)
+    {
+        Chunk c {};
+        c.size = std::max(initial_bytes, kSmallMax);
+
+#if defined(__linux__)
+        if (opts.prefault || opts.huge_pages || opts.lock)
+        {
+            c.data = map_chunk(c.size, opts.huge_pages, pages_);
+            c.mapped = c.data != nullptr;
+        }
+#endif
+        if (c.data == nullptr)
+        {
+            c.data = new std::byte[c.size];
+        }
+
+        // writing one byte per page is enough, zeroing the whole chunk also settles huge page promotion
+        if (opts.prefault)
+        {
+            std::memset(c.data, 0, c.size);
+        }
+#if defined(__linux__)
+        if (opts.lock)
+        {
+            locked_ = ::mlock(c.data, c.size) == 0;
+        }
+#endif
+
+        chunks_.push_back(c);
+        reset();
+    }
+
+    Arena::~Arena()
+    {
+        for (const auto& c : chunks_)
+        {
+#if defined(__linux__)
+            if (c.mapped)
+            {
+                ::munmap(c.data, c.size);
+                continue;
+            }
+#endif
+            delete[] c.data;
+        }
+    }
+
+    void Arena::reset()
+    {
+        current_ = 0;
+        cur_ = chunks_[0].data;
+        end_ = cur_ + chunks_[0].size;
+        used_before_ = 0;
+        free_ = {};
+    }
+
+    std::size_t Arena::used_bytes() const
+    {
+        return used_before_ + static_cast<std::size_t>(cur_ - chunks_[current_].data);
+    }
+
+    std::size_t Arena::reserved_bytes() const
+    {
+        std::size_t total { 0 };
+        for (const auto& c : chunks_)
+        {
+            total += c.size;
+        }
+        return total;
+    }
+
+    void* Arena::bump(std::size_t bytes, std::size_t align)
+    {
+        while (true)
+        {
+            const auto at = reinterpret_cast<std::uintptr_t>(cur_);
+            const std::uintptr_t aligned = (at + align - 1) & ~(static_cast<std::uintptr_t>(align) - 1);
+            const std::size_t pad = static_cast<std::size_t>(aligned - at);
+            if (pad + bytes <= static_cast<std::size_t>(end_ - cur_))
+            {
+                std::byte* p = cur_ + pad;
+                cur_ = p + bytes;
+                return p;
+            }
+
+            // the tail of the current chunk is abandoned until the next reset
+            used_before_ += chunks_[current_].size;
+            ++current_;
+            if (current_ == chunks_.size() || chunks_[current_].size < bytes + align)
+            {
+                Chunk c {};
+                c.size = std::max(chunks_.back().size * 2, bytes + align);
+                c.data = new std::byte[c.size];
+                chunks_.insert(chunks_.begin() + static_cast<std::ptrdiff_t>(current_), c);
+            }
+            cur_ = chunks_[current_].data;
+            end_ = cur_ + chunks_[current_].size;
+        }
+    }
+
+    void* Arena::do_allocate(std::size_t bytes, std::size_t align)
+    {
+        if (bytes <= kSmallMax && align <= kGrain)
+        {
+            const std::size_t cls = (std::max<std::size_t>(bytes, 1) + kGrain - 1) / kGrain - 1;
+            if (FreeBlock* b = free_[cls])
+            {
+                free_[cls] = b->next;
+                return b;
+            }
+            return bump((cls + 1) * kGrain, kGrain);
+        }
+        return bump(bytes, align);
+    }
+
+    void Arena::do_deallocate(void* p, std::size_t bytes, std::size_t align)
+    {
+        if (bytes <= kSmallMax && align <= kGrain)
+        {
+            const std::size_t cls = (std::max<std::size_t>(bytes, 1) + kGrain - 1) / kGrain - 1;
+            free_[cls] = ::new (p) FreeBlock { free_[cls] };
+        }
+    }
+
+    bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        return this == &other;
+    }
+
+    void* LockedResource::do_allocate(std::size_t bytes, std::size_t align)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return upstream_->allocate(bytes, align);
+    }
+
+    void LockedResource::do_deallocate(void* p, std::size_t bytes, std::size_t align)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        upstream_->deallocate(p, bytes, align);
+    }
+
+    bool LockedResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        return this == &other;
+    }
+
+    const char* arena_pages_to_string(ArenaPages p)
+    {
+        switch (p)
+        {
+        case ArenaPages::Heap:
+            return "heap";
+        case ArenaPages::Normal:
+            return "normal";
+        case ArenaPages::Transparent:
+            return "transparent";
+        case ArenaPages::Explicit:
+            return "explicit";
+        }
+        return "heap";
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace ob
+{
+    // how the arena's first chunk is backed, later chunks always come from the heap
+    struct ArenaOptions
+    {
+        // touch every page up front so the hot path never faults one in
+        bool prefault { false };
+
+        // try explicit huge pages, then ask for transparent ones (linux only)
+        bool huge_pages { false };
+
+        // mlock the first chunk, failure is reported by locked() and is not fatal
+        bool lock { false };
+    };
+
+    enum class ArenaPages
+    {
+        Heap,        // plain new, no page control
+        Normal,      // anonymous mapping with normal pages
+        Transparent, // mapping advised for transparent huge pages
+        Explicit     // hugetlbfs pages
+    };
+
+    // bump arena for book nodes, freed small blocks go on per size free lists and are reused
+    // within a run, reset rewinds to the first chunk instead of freeing node by node
+    // single threaded like the book it backs
+    class Arena : public std::pmr::memory_resource
+    {
+    public:
+        // initial_bytes is reserved up front, further chunks come from the heap and are kept across resets
+        explicit Arena(std::size_t initial_bytes = std::size_t { 1 } << 20, const ArenaOptions& opts = {});
+        ~Arena() override;
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        // resource to build a book or engine on
+        std::pmr::memory_resource* resource()
+        {
+            return this;
+        }
+
+        // drops every allocation, books built on the arena must be destroyed first
+        void reset();
+
+        // bytes handed out since the last reset, including blocks now on free lists
+        std::size_t used_bytes() const;
+
+        // bytes held in chunks
+        std::size_t reserved_bytes() const;
+
+        // chunks added past the first one, non zero means the reservation was too small
+        std::size_t overflow_chunks() const
+        {
+            return chunks_.size() - 1;
+        }
+
+        ArenaPages pages() const
+        {
+            return pages_;
+        }
+
+        bool locked() const
+        {
+            return locked_;
+        }
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t align) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t align) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        // carves from the current chunk, moving to the next or a new one when it runs out
+        void* bump(std::size_t bytes, std::size_t align);
+
+        static constexpr std::size_t kGrain = 16;
+        static constexpr std::size_t kSmallMax = 512;
+
+        struct Chunk
+        {
+            std::byte* data { nullptr };
+            std::size_t size { 0 };
+            bool mapped { false }; // mmap backed, else new[]
+        };
+
+        struct FreeBlock
+        {
+            FreeBlock* next { nullptr };
+        };
+
+        std::vector<Chunk> chunks_;
+        std::size_t current_ { 0 };
+        std::byte* cur_ { nullptr };
+        std::byte* end_ { nullptr };
+
+        // bytes in chunks before current_, used_bytes adds the current chunk's offset
+        std::size_t used_before_ { 0 };
+
+        // one list per kGrain size class, large blocks are only reclaimed by reset
+        std::array<FreeBlock*, kSmallMax / kGrain> free_ {};
+
+        ArenaPages pages_ { ArenaPages::Heap };
+        bool locked_ { false };
+    };
+
+    const char* arena_pages_to_string(ArenaPages p);
+
+    // serialises every call into an upstream resource, so one arena can back books on several threads
+    // the upstream must outlive it
+    class LockedResource : public std::pmr::memory_resource
+    {
+    public:
+        explicit LockedResource(std::pmr::memory_resource* upstream)
+            : upstream_(upstream)
+        {
+        }
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t align) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t align) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        std::pmr::memory_resource* upstream_;
+        std::mutex mu_;
+    };
+}
@@ -0,0 +1,80 @@
+#include "auction.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace ob
+{
+    std::optional<Equilibrium> find_equilibrium(const std::vector<PriceTicks>& prices, const std::vector<Qty>& bid_qty, const std::vector<Qty>& ask_qty, std::optional<PriceTicks> reference)
+    {
+        assert(prices.size() == bid_qty.size() && prices.size() == ask_qty.size());
+
+        const std::size_t n = prices.size();
+        if (n == 0)
+        {
+            return std::nullopt;
+        }
+
+        // both curves as plain prefix sums over contiguous arrays
+        // demand at i is every bid at or above prices[i], so it is the bid total less the prefix before i
+        std::vector<Qty> bid_before(n);
+        std::vector<Qty> supply(n);
+
+        Qty bid_run { 0 };
+        Qty ask_run { 0 };
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bid_before[i] = bid_run;
+            bid_run += bid_qty[i];
+            ask_run += ask_qty[i];
+            supply[i] = ask_run;
+        }
+
+        // branch free passes the compiler can vectorize, volume then imbalance per price
+        std::vector<Qty> volume(n);
+        std::vector<Qty> imbalance(n);
+        Qty best_volume { 0 };
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Qty demand = bid_run - bid_before[i];
+            volume[i] = std::min(demand, supply[i]);
+            imbalance[i] = std::max(demand, supply[i]) - volume[i];
+            best_volume = std::max(best_volume, volume[i]);
+        }
+
+        if (best_volume == 0)
+        {
+            return std::nullopt;
+        }
+
+        Qty best_imbalance = std::numeric_limits<Qty>::max();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Qty candidate = (volume[i] == best_volume) ? imbalance[i] : std::numeric_limits<Qty>::max();
+            best_imbalance = std::min(best_imbalance, candidate);
+        }
+
+        // the few remaining ties are settled in one scalar pass, lowest price first
+        std::optional<Equilibrium> out;
+        PriceTicks best_distance = std::numeric_limits<PriceTicks>::max();
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (volume[i] != best_volume || imbalance[i] != best_imbalance)
+            {
+                continue;
+            }
+
+            const PriceTicks distance = reference.has_value() ? ((prices[i] > *reference) ? prices[i] - *reference : *reference - prices[i]) : 0;
+            if (!out.has_value() || distance < best_distance)
+            {
+                out = Equilibrium { prices[i], best_volume, best_imbalance };
+                best_distance = distance;
+            }
+        }
+
+        return out;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "order.h"
+
+#include <optional>
+#include <vector>
+
+namespace ob
+{
+    // outcome of an equilibrium search
+    struct Equilibrium
+    {
+        PriceTicks price_ticks { 0 };
+        Qty volume { 0 };
+        Qty imbalance { 0 };
+    };
+
+    // finds the uncross price over a level grid sorted low to high
+    // bid_qty and ask_qty hold the qty resting at each grid price, either may be zero
+    // picks max executable volume, then min imbalance, then closest to reference, then lowest price
+    // empty when nothing crosses
+    std::optional<Equilibrium> find_equilibrium(const std::vector<PriceTicks>& prices, const std::vector<Qty>& bid_qty, const std::vector<Qty>& ask_qty, std::optional<PriceTicks> reference);
+}
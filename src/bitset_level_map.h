@@ -0,0 +1,425 @@
+#pragma once
+
+#include "flat_id_map.h"
+#include "order.h"
+#include "price_bitset.h"
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ob
+{
+    // ordered map for one side of the book over positive prices, the subset of std::map the book uses
+    // a PriceBitset orders the prices and finds the next one in a word per tier, an id map holds the
+    // payloads, so an insert or erase never moves a level and a walk skips empty prices a word at a time
+    // values live in their own node, references and iterators survive everything but their own erase
+    template <typename K, typename V, typename Compare = std::less<K>>
+    class BitsetLevelMap
+    {
+        static_assert(std::is_same_v<K, PriceTicks>, "keys are prices");
+        static_assert(std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::greater<K>>, "ordered one way or the other");
+
+        static constexpr bool kAscending = std::is_same_v<Compare, std::less<K>>;
+        static constexpr K kMaxKey = std::numeric_limits<K>::max();
+
+        // the key sits next to the value so a reference into a node needs nothing else alive
+        struct Node
+        {
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            Node(K k, const allocator_type& alloc)
+                : key(k), value(std::make_obj_using_allocator<V>(alloc))
+            {
+            }
+            Node(K k, V&& v, const allocator_type& alloc)
+                : key(k), value(std::make_obj_using_allocator<V>(alloc, std::move(v)))
+            {
+            }
+
+            K key;
+            V value;
+        };
+
+        // what an iterator yields, shaped like the pair std::map hands out
+        template <bool Const>
+        struct basic_ref
+        {
+            const K& first;
+            std::conditional_t<Const, const V&, V&> second;
+        };
+
+        template <bool Const>
+        class basic_iterator
+        {
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = std::pair<const K, V>;
+            using difference_type = std::ptrdiff_t;
+            using reference = basic_ref<Const>;
+            using owner = std::conditional_t<Const, const BitsetLevelMap*, BitsetLevelMap*>;
+
+            // operator-> hands out a pointer to a reference held by value
+            struct pointer
+            {
+                reference ref;
+
+                const reference* operator->() const
+                {
+                    return &ref;
+                }
+            };
+
+            basic_iterator() = default;
+
+            basic_iterator(owner m, Node* n)
+                : m_(m), n_(n)
+            {
+            }
+
+            operator basic_iterator<true>() const
+            {
+                return basic_iterator<true>(m_, n_);
+            }
+
+            reference operator*() const
+            {
+                return reference { n_->key, n_->value };
+            }
+            pointer operator->() const
+            {
+                return pointer { **this };
+            }
+
+            basic_iterator& operator++()
+            {
+                n_ = m_->after(n_->key);
+                return *this;
+            }
+            basic_iterator operator++(int)
+            {
+                basic_iterator old = *this;
+                ++*this;
+                return old;
+            }
+            basic_iterator& operator--()
+            {
+                n_ = (n_ == nullptr) ? m_->worst() : m_->before(n_->key);
+                return *this;
+            }
+            basic_iterator operator--(int)
+            {
+                basic_iterator old = *this;
+                --*this;
+                return old;
+            }
+
+            bool operator==(const basic_iterator& other) const
+            {
+                return n_ == other.n_;
+            }
+
+        private:
+            friend class BitsetLevelMap;
+
+            owner m_ { nullptr };
+
+            // null is end
+            Node* n_ { nullptr };
+        };
+
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        explicit BitsetLevelMap(const allocator_type& alloc = {})
+            : alloc_(alloc), nodes_(alloc), prices_(1, kMaxKey, alloc)
+        {
+        }
+
+        BitsetLevelMap(const BitsetLevelMap& other) = delete;
+        BitsetLevelMap& operator=(const BitsetLevelMap& other) = delete;
+
+        // the moved from map gets a fresh bitset, which allocates
+        BitsetLevelMap(BitsetLevelMap&& other)
+            : alloc_(other.alloc_), nodes_(std::move(other.nodes_)), prices_(std::move(other.prices_)), best_(other.best_)
+        {
+            other.prices_ = PriceBitset(1, kMaxKey, other.alloc_);
+            other.best_ = nullptr;
+        }
+
+        // like a pmr container, values are only stolen when both sides share a resource
+        BitsetLevelMap& operator=(BitsetLevelMap&& other)
+        {
+            clear();
+            if (alloc_ == other.alloc_)
+            {
+                std::swap(nodes_, other.nodes_);
+                std::swap(prices_, other.prices_);
+                std::swap(best_, other.best_);
+                return *this;
+            }
+
+            nodes_.reserve(other.nodes_.size());
+            for (const auto& kv : other.nodes_)
+            {
+                Node* n = alloc_.template new_object<Node>(kv.first, std::move(kv.second->value));
+                nodes_.emplace(kv.first, n);
+                prices_.insert(kv.first);
+            }
+            best_ = (other.best_ == nullptr) ? nullptr : node_at(other.best_->key);
+            other.clear();
+            return *this;
+        }
+
+        ~BitsetLevelMap()
+        {
+            delete_nodes();
+        }
+
+        iterator begin()
+        {
+            return iterator(this, best_);
+        }
+        iterator end()
+        {
+            return iterator(this, nullptr);
+        }
+        const_iterator begin() const
+        {
+            return const_iterator(this, best_);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(this, nullptr);
+        }
+        reverse_iterator rbegin()
+        {
+            return reverse_iterator(end());
+        }
+        reverse_iterator rend()
+        {
+            return reverse_iterator(begin());
+        }
+        const_reverse_iterator rbegin() const
+        {
+            return const_reverse_iterator(end());
+        }
+        const_reverse_iterator rend() const
+        {
+            return const_reverse_iterator(begin());
+        }
+
+        std::size_t size() const
+        {
+            return nodes_.size();
+        }
+        bool empty() const
+        {
+            return nodes_.empty();
+        }
+
+        // sizes the id map so up to n keys insert without growing it, values still allocate one each
+        void reserve(std::size_t n)
+        {
+            nodes_.reserve(n);
+        }
+
+        // a node plus its id map slot, bitset words left out since a word covers many prices
+        static constexpr std::size_t kEntryBytes = sizeof(Node) + FlatIdMap<K, Node*>::kEntryBytes;
+
+        // nodes and every bitset tier as used, empty id map slots as reserved
+        void memory_usage(std::size_t& used, std::size_t& reserved) const
+        {
+            nodes_.memory_usage(used, reserved);
+            used += nodes_.size() * sizeof(Node) + prices_.memory_bytes();
+        }
+
+        // first key not ordered before k, and first key ordered after k
+        iterator lower_bound(K k)
+        {
+            return iterator(this, not_before(k));
+        }
+        const_iterator lower_bound(K k) const
+        {
+            return const_iterator(this, not_before(k));
+        }
+        iterator upper_bound(K k)
+        {
+            return iterator(this, after(k));
+        }
+        const_iterator upper_bound(K k) const
+        {
+            return const_iterator(this, after(k));
+        }
+
+        iterator find(K k)
+        {
+            return iterator(this, (k > 0) ? node_at(k) : nullptr);
+        }
+        const_iterator find(K k) const
+        {
+            return const_iterator(this, (k > 0) ? node_at(k) : nullptr);
+        }
+
+        // value at k, built with the map's allocator when k is new
+        std::pair<iterator, bool> try_emplace(K k)
+        {
+            if (Node* n = node_at(k); n != nullptr)
+            {
+                return { iterator(this, n), false };
+            }
+
+            Node* n = alloc_.template new_object<Node>(k);
+            nodes_.emplace(k, n);
+            prices_.insert(k);
+            if (best_ == nullptr || comp_(k, best_->key))
+            {
+                best_ = n;
+            }
+            return { iterator(this, n), true };
+        }
+
+        V& operator[](K k)
+        {
+            return try_emplace(k).first->second;
+        }
+
+        iterator erase(const_iterator it)
+        {
+            Node* next = after(it.n_->key);
+            drop(it.n_, next);
+            return iterator(this, next);
+        }
+
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            while (first != last)
+            {
+                first = erase(first);
+            }
+            return iterator(this, last.n_);
+        }
+
+        std::size_t erase(K k)
+        {
+            const auto it = find(k);
+            if (it == end())
+            {
+                return 0;
+            }
+            erase(it);
+            return 1;
+        }
+
+        void clear()
+        {
+            delete_nodes();
+            nodes_ = FlatIdMap<K, Node*>(alloc_);
+            prices_ = PriceBitset(1, kMaxKey, alloc_);
+            best_ = nullptr;
+        }
+
+    private:
+        Node* node_at(K k) const
+        {
+            const auto it = nodes_.find(k);
+            return (it == nodes_.end()) ? nullptr : it->second;
+        }
+
+        Node* node_or_null(std::optional<K> k) const
+        {
+            return k.has_value() ? node_at(*k) : nullptr;
+        }
+
+        // first key not ordered before k
+        Node* not_before(K k) const
+        {
+            if constexpr (kAscending)
+            {
+                return node_or_null(prices_.next_at_or_above(k));
+            }
+            else
+            {
+                return node_or_null(prices_.prev_at_or_below(k));
+            }
+        }
+
+        // first key ordered after k
+        Node* after(K k) const
+        {
+            if constexpr (kAscending)
+            {
+                return (k == kMaxKey) ? nullptr : node_or_null(prices_.next_at_or_above(k + 1));
+            }
+            else
+            {
+                return (k <= 1) ? nullptr : node_or_null(prices_.prev_at_or_below(k - 1));
+            }
+        }
+
+        // last key ordered before k
+        Node* before(K k) const
+        {
+            if constexpr (kAscending)
+            {
+                return (k <= 1) ? nullptr : node_or_null(prices_.prev_at_or_below(k - 1));
+            }
+            else
+            {
+                return (k == kMaxKey) ? nullptr : node_or_null(prices_.next_at_or_above(k + 1));
+            }
+        }
+
+        Node* worst() const
+        {
+            if constexpr (kAscending)
+            {
+                return node_or_null(prices_.prev_at_or_below(kMaxKey));
+            }
+            else
+            {
+                return node_or_null(prices_.next_at_or_above(1));
+            }
+        }
+
+        void delete_nodes()
+        {
+            for (const auto& kv : nodes_)
+            {
+                alloc_.delete_object(kv.second);
+            }
+        }
+
+        // next is the node after n, already looked up by the caller
+        void drop(Node* n, Node* next)
+        {
+            if (best_ == n)
+            {
+                best_ = next;
+            }
+            prices_.erase(n->key);
+            nodes_.erase(n->key);
+            alloc_.delete_object(n);
+        }
+
+        allocator_type alloc_;
+        Compare comp_ {};
+        FlatIdMap<K, Node*> nodes_;
+        PriceBitset prices_;
+
+        // begin, kept so the touch costs no search
+        Node* best_ { nullptr };
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "command.h"
+#include "event.h"
+
+#include <utility>
+#include <vector>
+
+namespace ob
+{
+    // applies one command straight to a book of any instrument or policy, without logs or journals
+    // expiry due at the command time happens before the command itself
+    template <typename Book>
+    std::vector<Event> execute_command(Book& book, const Command& cmd)
+    {
+        std::vector<Event> events;
+
+        if (cmd.timestamp > book.now())
+        {
+            events = book.advance_time(cmd.timestamp);
+        }
+
+        const OrderOptions opts { cmd.tif, cmd.participant, cmd.stp_group, cmd.stp_mode, cmd.expire_at };
+
+        auto append = [&events](std::vector<Event> more)
+        {
+            if (events.empty())
+            {
+                events = std::move(more);
+                return;
+            }
+            events.insert(events.end(), more.begin(), more.end());
+        };
+
+        // dispatch on command type
+        switch (cmd.type)
+        {
+        case CommandType::AddLimit:
+            append(book.add_limit(cmd.id, cmd.side, cmd.price_ticks, cmd.qty, opts));
+            break;
+        case CommandType::Cancel:
+            append(book.cancel(cmd.id));
+            break;
+        case CommandType::AddStop:
+            append(book.add_stop(cmd.id, cmd.side, cmd.stop_price_ticks, cmd.price_ticks, cmd.qty, opts));
+            break;
+        case CommandType::Modify:
+            append(book.modify(cmd.id, cmd.price_ticks, cmd.qty));
+            break;
+        case CommandType::MassCancel:
+            if (cmd.scope == MassCancelScope::All)
+            {
+                append(book.cancel_all());
+            }
+            else if (cmd.scope == MassCancelScope::Side)
+            {
+                append(book.cancel_side(cmd.side));
+            }
+            else if (cmd.scope == MassCancelScope::PriceRange)
+            {
+                append(book.cancel_range(cmd.side, cmd.price_ticks, cmd.max_price_ticks));
+            }
+            else
+            {
+                append(book.cancel_participant(cmd.participant));
+            }
+            break;
+        case CommandType::AdvanceTime:
+            // the clock already moved above
+            break;
+        case CommandType::BeginAuction:
+            book.begin_auction();
+            break;
+        case CommandType::Uncross:
+            append(book.uncross());
+            break;
+        }
+
+        return events;
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "bitset_level_map.h"
+#include "chunk_fifo.h"
+#include "fenwick_queue.h"
+#include "flat_id_map.h"
+#include "flat_level_map.h"
+
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+
+namespace ob
+{
+    // container choices behind a book, each policy names a template the book fills with its own types
+    // levels: fifo of orders at one price, order addresses and iterators survive pushes and other erases
+    // sides: price ordered map from the best price, a level's address survives until it is erased
+    // index: order id to locator, iterators only need to live until the next index mutation
+    // queue: what each level keeps so queue_position need not walk it
+
+    // node per order, o(1) splice when an order is requeued
+    struct ListLevels
+    {
+        template <typename T>
+        using type = std::pmr::list<T>;
+
+        static constexpr const char* name = "list";
+    };
+
+    // orders packed in deque chunks, cancels leave holes that are compacted away
+    struct ChunkLevels
+    {
+        template <typename T>
+        using type = ChunkFifo<T>;
+
+        static constexpr const char* name = "chunk";
+    };
+
+    // red black tree, o(log n) anywhere
+    struct TreeSides
+    {
+        template <typename K, typename V, typename Compare>
+        using type = std::pmr::map<K, V, Compare>;
+
+        static constexpr const char* name = "tree";
+    };
+
+    // sorted vector with the best price at the back, cheap near the touch and linear far from it
+    struct FlatSides
+    {
+        template <typename K, typename V, typename Compare>
+        using type = FlatLevelMap<K, V, Compare>;
+
+        static constexpr const char* name = "flat";
+    };
+
+    // hierarchical bitset over prices plus an id map of level nodes, a level never moves and the next
+    // price is a word per tier away however sparse the side is
+    struct BitsetSides
+    {
+        template <typename K, typename V, typename Compare>
+        using type = BitsetLevelMap<K, V, Compare>;
+
+        static constexpr const char* name = "bitset";
+    };
+
+    // node hash, stable nodes and one allocation per order
+    struct HashIndex
+    {
+        template <typename K, typename V>
+        using type = std::pmr::unordered_map<K, V>;
+
+        static constexpr const char* name = "hash";
+    };
+
+    // open addressed table, no allocation per order
+    struct FlatIndex
+    {
+        template <typename K, typename V>
+        using type = FlatIdMap<K, V>;
+
+        static constexpr const char* name = "flat";
+    };
+
+    // nothing kept, queue_position walks the level from its head
+    struct WalkQueue
+    {
+        using type = UntrackedQueue;
+
+        static constexpr const char* name = "walk";
+    };
+
+    // a fenwick tree per level updated on every rest, fill, reduce and removal, queue_position in o(log n)
+    struct FenwickQueues
+    {
+        using type = FenwickQueue;
+
+        static constexpr const char* name = "fenwick";
+    };
+
+    template <typename Levels, typename Sides, typename Index, typename Queue = WalkQueue>
+    struct BookPolicy
+    {
+        using levels = Levels;
+        using sides = Sides;
+        using index = Index;
+        using queue = Queue;
+    };
+
+    // what OrderBook has always been built from
+    using DefaultBookPolicy = BookPolicy<ListLevels, TreeSides, HashIndex>;
+
+    // the default containers with queue positions kept up to date
+    using QueueTrackedPolicy = BookPolicy<ListLevels, TreeSides, HashIndex, FenwickQueues>;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ob
+{
+    // little endian fixed width helpers shared by the wire protocol, the command journal and snapshots
+    // byte by byte so the format does not depend on host order
+    inline void put_u8(std::vector<char>& out, std::uint8_t v)
+    {
+        out.push_back(static_cast<char>(v));
+    }
+
+    inline void put_u32(std::vector<char>& out, std::uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+    }
+
+    inline void put_u64(std::vector<char>& out, std::uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+    }
+
+    inline void put_i64(std::vector<char>& out, std::int64_t v)
+    {
+        put_u64(out, static_cast<std::uint64_t>(v));
+    }
+
+    // bounds checked little endian reader, any overrun clears ok and reads zero from then on
+    struct ByteReader
+    {
+        const unsigned char* p { nullptr };
+        std::size_t left { 0 };
+        bool ok { true };
+
+        std::uint64_t take(std::size_t n)
+        {
+            if (n > left)
+            {
+                ok = false;
+                left = 0;
+                return 0;
+            }
+
+            std::uint64_t v { 0 };
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+            }
+            p += n;
+            left -= n;
+            return v;
+        }
+
+        std::uint8_t u8() { return static_cast<std::uint8_t>(take(1)); }
+        std::uint32_t u32() { return static_cast<std::uint32_t>(take(4)); }
+        std::uint64_t u64() { return take(8); }
+        std::int64_t i64() { return static_cast<std::int64_t>(take(8)); }
+    };
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+
+namespace ob
+{
+    // fifo of values in deque chunks, a drop in for the few std::list operations a level uses
+    // values never move while they are queued, erase leaves a hole that is dropped once it reaches an end
+    // iterators are absolute positions, so pushes and pops at the ends keep them valid
+    // compact() is the only thing that moves values, it reports each move so outside pointers can follow
+    template <typename T>
+    class ChunkFifo
+    {
+        struct Slot
+        {
+            T value;
+            bool live { true };
+        };
+
+        using Slots = std::pmr::deque<Slot>;
+
+        template <bool Const>
+        class basic_iterator
+        {
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const T*, T*>;
+            using reference = std::conditional_t<Const, const T&, T&>;
+            using owner = std::conditional_t<Const, const ChunkFifo*, ChunkFifo*>;
+
+            basic_iterator() = default;
+
+            basic_iterator(owner q, std::size_t pos)
+                : q_(q), pos_(pos)
+            {
+            }
+
+            // a mutable iterator converts to a const one
+            operator basic_iterator<true>() const
+            {
+                return basic_iterator<true>(q_, pos_);
+            }
+
+            reference operator*() const
+            {
+                return q_->slots_[pos_ - q_->base_].value;
+            }
+            pointer operator->() const
+            {
+                return &**this;
+            }
+
+            basic_iterator& operator++()
+            {
+                pos_ = q_->next_live(pos_ + 1);
+                return *this;
+            }
+            basic_iterator operator++(int)
+            {
+                basic_iterator old = *this;
+                ++*this;
+                return old;
+            }
+            basic_iterator& operator--()
+            {
+                do
+                {
+                    --pos_;
+                } while (!q_->slots_[pos_ - q_->base_].live);
+                return *this;
+            }
+            basic_iterator operator--(int)
+            {
+                basic_iterator old = *this;
+                --*this;
+                return old;
+            }
+
+            bool operator==(const basic_iterator& other) const
+            {
+                return pos_ == other.pos_;
+            }
+
+        private:
+            friend class ChunkFifo;
+
+            owner q_ { nullptr };
+            std::size_t pos_ { 0 };
+        };
+
+    public:
+        using value_type = T;
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+
+        explicit ChunkFifo(const allocator_type& alloc = {})
+            : slots_(alloc)
+        {
+        }
+
+        ChunkFifo(const ChunkFifo& other, const allocator_type& alloc)
+            : slots_(other.slots_, alloc), base_(other.base_), live_(other.live_)
+        {
+        }
+
+        ChunkFifo(ChunkFifo&& other, const allocator_type& alloc)
+            : slots_(std::move(other.slots_), alloc), base_(other.base_), live_(other.live_)
+        {
+            other.clear();
+        }
+
+        ChunkFifo(const ChunkFifo&) = default;
+        ChunkFifo& operator=(const ChunkFifo&) = default;
+
+        ChunkFifo(ChunkFifo&& other) noexcept
+            : slots_(std::move(other.slots_)), base_(other.base_), live_(other.live_)
+        {
+            other.clear();
+        }
+
+        ChunkFifo& operator=(ChunkFifo&& other) noexcept
+        {
+            slots_ = std::move(other.slots_);
+            base_ = other.base_;
+            live_ = other.live_;
+            other.clear();
+            return *this;
+        }
+
+        iterator begin()
+        {
+            return iterator(this, base_);
+        }
+        iterator end()
+        {
+            return iterator(this, base_ + slots_.size());
+        }
+        const_iterator begin() const
+        {
+            return const_iterator(this, base_);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(this, base_ + slots_.size());
+        }
+
+        // live values, holes not counted
+        std::size_t size() const
+        {
+            return live_;
+        }
+        bool empty() const
+        {
+            return live_ == 0;
+        }
+
+        // erased values still holding a slot between live ones
+        std::size_t holes() const
+        {
+            return slots_.size() - live_;
+        }
+
+        // bytes one more value takes once its chunk exists
+        static constexpr std::size_t kEntryBytes = sizeof(Slot);
+
+        // live slots as used, holes, the unfilled ends of the chunks and the chunk map as reserved
+        // libstdc++ chunks are 512 bytes or one slot, a deque keeps one even when empty and a map of at least 8
+        void memory_usage(std::size_t& used, std::size_t& reserved) const
+        {
+            constexpr std::size_t per_chunk = (sizeof(Slot) < 512) ? 512 / sizeof(Slot) : 1;
+            const std::size_t chunks = (slots_.size() + per_chunk - 1) / per_chunk + 1;
+
+            used = live_ * sizeof(Slot);
+            reserved = chunks * per_chunk * sizeof(Slot) + std::max<std::size_t>(8, chunks + 2) * sizeof(void*) - used;
+        }
+
+        // the ends are never holes, so front and back are plain slot reads
+        T& front()
+        {
+            return slots_.front().value;
+        }
+        const T& front() const
+        {
+            return slots_.front().value;
+        }
+
+        void push_back(const T& value)
+        {
+            slots_.push_back(Slot { value, true });
+            ++live_;
+        }
+
+        // marks the slot a hole and trims holes off both ends, returns the next live value
+        iterator erase(const_iterator it)
+        {
+            slots_[it.pos_ - base_].live = false;
+            --live_;
+
+            while (!slots_.empty() && !slots_.back().live)
+            {
+                slots_.pop_back();
+            }
+            while (!slots_.empty() && !slots_.front().live)
+            {
+                slots_.pop_front();
+                ++base_;
+            }
+            const std::size_t next = std::clamp(it.pos_ + 1, base_, base_ + slots_.size());
+            return iterator(this, next_live(next));
+        }
+
+        void clear()
+        {
+            slots_.clear();
+            live_ = 0;
+        }
+
+        // copies the live values into fresh chunks in order, calling moved(from, to, at) for each one while
+        // the old value is still readable, a value is copied only after every earlier one was reported
+        // at is only usable once compact returns, positions keep rising so old iterators never name a new value
+        template <typename F>
+        void compact(F&& moved)
+        {
+            Slots fresh(slots_.get_allocator());
+            const std::size_t fresh_base = base_ + slots_.size();
+
+            for (Slot& s : slots_)
+            {
+                if (!s.live)
+                {
+                    continue;
+                }
+                fresh.push_back(Slot { s.value, true });
+                moved(s.value, fresh.back().value, iterator(this, fresh_base + fresh.size() - 1));
+            }
+
+            slots_ = std::move(fresh);
+            base_ = fresh_base;
+        }
+
+    private:
+        // first live position at or after pos, end when none
+        std::size_t next_live(std::size_t pos) const
+        {
+            const std::size_t end = base_ + slots_.size();
+            while (pos < end && !slots_[pos - base_].live)
+            {
+                ++pos;
+            }
+            return pos;
+        }
+
+        Slots slots_;
+
+        // absolute position of slots_.front()
+        std::size_t base_ { 0 };
+
+        std::size_t live_ { 0 };
+    };
+}
@@ -8,7 +8,22 @@ namespace ob
     enum class CommandType
     {
         AddLimit,
-        Cancel
+        Cancel,
+        Modify,
+        MassCancel,
+        AddStop,
+        AdvanceTime,
+        BeginAuction,
+        Uncross
+    };
+
+    // which resting orders a mass cancel removes
+    enum class MassCancelScope
+    {
+        All,
+        Side,
+        PriceRange,
+        Participant
     };
 
     // command is an input record to the engine
@@ -16,16 +31,32 @@ namespace ob
     {
         CommandType type { CommandType::AddLimit };
 
+        // logical time the command happens at, zero leaves the clock where it is
+        // the engine expires everything due up to it before applying the command
+        LogicalTime timestamp { 0 };
+
         // common field
         OrderId id { 0 };
 
-        // add limit fields
+        // add limit fields, modify reuses price and qty as the new values
         Side side { Side::Buy };
         PriceTicks price_ticks { 0 };
         Qty qty { 0 };
+        TimeInForce tif { TimeInForce::Gtc };
+        ParticipantId participant { 0 };
+        StpGroup stp_group { 0 };
+        StpMode stp_mode { StpMode::None };
+        LogicalTime expire_at { 0 };
+
+        // stop trigger, a stop with price_ticks zero enters as a market ioc
+        PriceTicks stop_price_ticks { 0 };
+
+        // mass cancel fields, a range is price_ticks through max_price_ticks inclusive
+        MassCancelScope scope { MassCancelScope::All };
+        PriceTicks max_price_ticks { 0 };
 
         // builds an add limit command
-        static Command add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty)
+        static Command add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty, TimeInForce tif = TimeInForce::Gtc, ParticipantId participant = 0)
         {
             Command c {};
             c.type = CommandType::AddLimit;
@@ -33,6 +64,84 @@ namespace ob
             c.side = side;
             c.price_ticks = price_ticks;
             c.qty = qty;
+            c.tif = tif;
+            c.participant = participant;
+            return c;
+        }
+
+        // builds a stop market order that enters as an ioc taker once triggered
+        static Command stop(OrderId id, Side side, PriceTicks stop_price_ticks, Qty qty)
+        {
+            Command c {};
+            c.type = CommandType::AddStop;
+            c.id = id;
+            c.side = side;
+            c.stop_price_ticks = stop_price_ticks;
+            c.qty = qty;
+            return c;
+        }
+
+        // builds a stop limit order that enters as a limit at price_ticks once triggered
+        static Command stop_limit(OrderId id, Side side, PriceTicks stop_price_ticks, PriceTicks price_ticks, Qty qty, TimeInForce tif = TimeInForce::Gtc)
+        {
+            Command c {};
+            c.type = CommandType::AddStop;
+            c.id = id;
+            c.side = side;
+            c.stop_price_ticks = stop_price_ticks;
+            c.price_ticks = price_ticks;
+            c.qty = qty;
+            c.tif = tif;
+            return c;
+        }
+
+        // returns a copy with self trade prevention set
+        Command with_stp(StpGroup group, StpMode mode) const
+        {
+            Command c = *this;
+            c.stp_group = group;
+            c.stp_mode = mode;
+            return c;
+        }
+
+        // returns a copy that expires at a logical time, the order is cancelled once the clock reaches it
+        Command with_expiry(LogicalTime expire_at) const
+        {
+            Command c = *this;
+            c.expire_at = expire_at;
+            return c;
+        }
+
+        // returns a copy stamped with a logical time
+        Command at(LogicalTime timestamp) const
+        {
+            Command c = *this;
+            c.timestamp = timestamp;
+            return c;
+        }
+
+        // builds a clock only command that just runs expiry
+        static Command advance_time(LogicalTime timestamp)
+        {
+            Command c {};
+            c.type = CommandType::AdvanceTime;
+            c.timestamp = timestamp;
+            return c;
+        }
+
+        // builds a command that switches the book to auction accumulation
+        static Command begin_auction()
+        {
+            Command c {};
+            c.type = CommandType::BeginAuction;
+            return c;
+        }
+
+        // builds a command that uncrosses the auction and resumes continuous matching
+        static Command uncross()
+        {
+            Command c {};
+            c.type = CommandType::Uncross;
             return c;
         }
 
@@ -44,5 +153,57 @@ namespace ob
             c.id = id;
             return c;
         }
+
+        // builds a modify command with the new price and new remaining qty
+        static Command modify(OrderId id, PriceTicks price_ticks, Qty qty)
+        {
+            Command c {};
+            c.type = CommandType::Modify;
+            c.id = id;
+            c.price_ticks = price_ticks;
+            c.qty = qty;
+            return c;
+        }
+
+        // builds a mass cancel of every resting order
+        static Command mass_cancel_all()
+        {
+            Command c {};
+            c.type = CommandType::MassCancel;
+            c.scope = MassCancelScope::All;
+            return c;
+        }
+
+        // builds a mass cancel of one side
+        static Command mass_cancel_side(Side side)
+        {
+            Command c {};
+            c.type = CommandType::MassCancel;
+            c.scope = MassCancelScope::Side;
+            c.side = side;
+            return c;
+        }
+
+        // builds a mass cancel of one side within an inclusive price range
+        static Command mass_cancel_range(Side side, PriceTicks min_price_ticks, PriceTicks max_price_ticks)
+        {
+            Command c {};
+            c.type = CommandType::MassCancel;
+            c.scope = MassCancelScope::PriceRange;
+            c.side = side;
+            c.price_ticks = min_price_ticks;
+            c.max_price_ticks = max_price_ticks;
+            return c;
+        }
+
+        // builds a mass cancel of every order owned by one participant
+        static Command mass_cancel_participant(ParticipantId participant)
+        {
+            Command c {};
+            c.type = CommandType::MassCancel;
+            c.scope = MassCancelScope::Participant;
+            c.participant = participant;
+            return c;
+        }
     };
 }
@@ -1,21 +1,86 @@
 #include "engine.h"
 
+#include "book_commands.h"
 #include "event_io.h"
+#include "wal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
 
 namespace ob
 {
+    // events that leave resting qty different at their own side and price
+    static bool changes_level(EventType t)
+    {
+        switch (t)
+        {
+        case EventType::OrderResting:
+        case EventType::MakerCompleted:
+        case EventType::OrderCancelled:
+        case EventType::OrderModified:
+        case EventType::SelfTradePrevented:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    Engine::Engine(std::pmr::memory_resource* mr)
+        : book_(mr)
+    {
+    }
+
+    // the wheel, stops and participants are not part of the estimate, a quarter more covers them
+    static std::size_t capacity_bytes(const CapacityOptions& cap)
+    {
+        const std::size_t book = OrderBook::reserve_bytes(cap.max_live_orders, cap.expected_levels);
+        return book + book / 4 + (std::size_t { 4 } << 20);
+    }
+
+    Engine::Engine(const CapacityOptions& cap)
+        : arena_(std::make_unique<Arena>(capacity_bytes(cap), cap.arena)), book_(arena_->resource()), cap_(cap)
+    {
+        book_.reserve(cap_.max_live_orders, cap_.expected_levels);
+    }
+
+    std::vector<Event> Engine::execute(const Command& cmd)
+    {
+        return execute_command(book_, cmd);
+    }
+
     std::vector<Event> Engine::apply(const Command& cmd)
     {
-        std::vector<Event> events;
+        // the command is staged in the write ahead journal before the book sees it
+        if (wal_)
+        {
+            wal_record_.clear();
+            encode_wal_record(cmd, applied_ + 1, wal_record_);
+            wal_->append(wal_record_.data(), wal_record_.size(), applied_ + 1);
+        }
 
-        // dispatch on command type
-        if (cmd.type == CommandType::AddLimit)
+        // a requeue leaves its old level without saying where it was, remember it for market data
+        std::optional<Order> modified_before;
+        if (md_ != nullptr && cmd.type == CommandType::Modify)
         {
-            events = book_.add_limit(cmd.id, cmd.side, cmd.price_ticks, cmd.qty);
+            if (const Order* o = book_.find_order(cmd.id))
+            {
+                modified_before = *o;
+            }
         }
-        else
+
+        std::vector<Event> events = execute(cmd);
+
+        // goes out with the command that completes the interval so logs, journal and market data all see it
+        if (state_every_ != 0 && (applied_ + 1) % state_every_ == 0)
         {
-            events = book_.cancel(cmd.id);
+            Event e {};
+            e.type = EventType::StateCheckpoint;
+            e.id = applied_ + 1;
+            e.seq = book_.state_hash();
+            e.qty = static_cast<Qty>(book_.live_order_count());
+            e.reason = "checkpoint";
+            events.push_back(e);
         }
 
         // log if enabled
@@ -29,9 +94,106 @@ namespace ob
             log_->flush();
         }
 
+        ++applied_;
+        if (journal_)
+        {
+            // one append per command keeps the seq on the buffer that holds its last line
+            journal_lines_.clear();
+            for (const auto& e : events)
+            {
+                journal_lines_ += event_to_line(e);
+                journal_lines_ += '\n';
+            }
+            journal_->append(journal_lines_.data(), journal_lines_.size(), applied_);
+        }
+
+        if (hash_every_ != 0)
+        {
+            for (const auto& e : events)
+            {
+                hasher_.add(e);
+            }
+            hash_digests_.push_back(static_cast<std::uint16_t>(hasher_.value()));
+            if (applied_ % hash_every_ == 0)
+            {
+                checkpoint_event_hash();
+            }
+        }
+
+        if (md_ != nullptr)
+        {
+            publish_market_data(events, modified_before);
+        }
+
         return events;
     }
 
+    void Engine::publish_market_data(const std::vector<Event>& events, const std::optional<Order>& modified_before)
+    {
+        const std::uint64_t now_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+
+        // collected with repeats and made distinct once below, a sweep or mass cancel touches many levels
+        std::vector<std::pair<Side, PriceTicks>>& touched = md_touched_;
+        touched.clear();
+        auto touch = [&touched](Side side, PriceTicks px)
+        {
+            if (px > 0)
+            {
+                touched.emplace_back(side, px);
+            }
+        };
+
+        for (const auto& e : events)
+        {
+            MdRecord r = md_record_from_event(e);
+            r.publish_ns = now_ns;
+            md_->publish(r);
+
+            if (e.type == EventType::Trade)
+            {
+                // the event does not name the maker side, so both sides at the trade price are checked
+                touch(Side::Buy, e.trade_price_ticks);
+                touch(Side::Sell, e.trade_price_ticks);
+            }
+            else if (changes_level(e.type))
+            {
+                touch(e.side, e.price_ticks);
+            }
+        }
+
+        if (modified_before.has_value())
+        {
+            touch(modified_before->side, modified_before->price_ticks);
+        }
+
+        // partial fills without an event of their own, as in an uncross, can only be at the touch
+        if (!events.empty())
+        {
+            if (const auto bid = book_.best_bid_price())
+            {
+                touch(Side::Buy, *bid);
+            }
+            if (const auto ask = book_.best_ask_price())
+            {
+                touch(Side::Sell, *ask);
+            }
+        }
+
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        for (const auto& [side, px] : touched)
+        {
+            MdRecord r {};
+            r.kind = MdKind::Level;
+            r.side = side;
+            r.price_ticks = px;
+            r.qty = book_.total_qty_at(side, px);
+            r.publish_ns = now_ns;
+            md_->publish(r);
+        }
+    }
+
     std::vector<Event> Engine::apply_all(const std::vector<Command>& cmds)
     {
         std::vector<Event> out;
@@ -68,8 +230,223 @@ namespace ob
         log_.reset();
     }
 
+    bool Engine::start_journal(const std::string& path, const JournalOptions& opts)
+    {
+        auto j = std::make_unique<Journal>();
+        if (!j->open(path, opts))
+        {
+            return false;
+        }
+
+        journal_ = std::move(j);
+        return true;
+    }
+
+    void Engine::commit_journal()
+    {
+        if (journal_)
+        {
+            journal_->commit();
+        }
+    }
+
+    void Engine::sync_journal()
+    {
+        if (journal_)
+        {
+            journal_->sync();
+        }
+    }
+
+    std::uint64_t Engine::journal_durable_seq()
+    {
+        if (!journal_)
+        {
+            return 0;
+        }
+        journal_->poll();
+        return journal_->durable_seq();
+    }
+
+    void Engine::stop_journal()
+    {
+        if (journal_)
+        {
+            journal_->close();
+        }
+        journal_.reset();
+    }
+
+    const Journal* Engine::journal() const
+    {
+        return journal_.get();
+    }
+
+    bool Engine::start_command_journal(const std::string& path, const JournalOptions& opts)
+    {
+        auto j = std::make_unique<Journal>();
+        if (!j->open(path, opts))
+        {
+            return false;
+        }
+
+        // a resumed journal already holds everything applied so far
+        if (opts.resume_at.has_value())
+        {
+            j->append(nullptr, 0, applied_);
+            j->commit();
+        }
+
+        wal_ = std::move(j);
+        return true;
+    }
+
+    void Engine::sync_command_journal()
+    {
+        if (wal_)
+        {
+            wal_->sync();
+        }
+    }
+
+    std::uint64_t Engine::command_journal_durable_seq()
+    {
+        if (!wal_)
+        {
+            return 0;
+        }
+        wal_->poll();
+        return wal_->durable_seq();
+    }
+
+    void Engine::stop_command_journal()
+    {
+        if (wal_)
+        {
+            wal_->close();
+        }
+        wal_.reset();
+    }
+
+    bool Engine::save_snapshot(const std::string& path)
+    {
+        sync_command_journal();
+
+        std::vector<char> image;
+        book_.save_state(image);
+        return write_snapshot_file(path, applied_, image);
+    }
+
+    bool Engine::recover(const std::string& snapshot_path, const std::string& journal_path, RecoveryResult& out)
+    {
+        out = RecoveryResult {};
+
+        // the spec is engine configuration and never in the journal, the fresh book keeps it
+        const InstrumentSpec spec = book_.instrument();
+        book_ = OrderBook(book_.resource());
+        book_.set_instrument(spec);
+        book_.reserve(cap_.max_live_orders, cap_.expected_levels);
+        applied_ = 0;
+
+        if (!snapshot_path.empty())
+        {
+            std::vector<char> image;
+            std::uint64_t seq { 0 };
+            if (!read_snapshot_file(snapshot_path, seq, image) || !book_.load_state(image.data(), image.size()))
+            {
+                return false;
+            }
+            applied_ = seq;
+            out.snapshot_seq = seq;
+        }
+
+        WalReader reader;
+        if (!reader.open(journal_path))
+        {
+            return false;
+        }
+
+        Command cmd {};
+        std::uint64_t seq { 0 };
+        WalStatus st = WalStatus::Ok;
+        while ((st = reader.next(cmd, seq)) == WalStatus::Ok)
+        {
+            // records the snapshot already covers
+            if (seq <= applied_)
+            {
+                continue;
+            }
+            if (seq != applied_ + 1)
+            {
+                return false;
+            }
+
+            execute(cmd);
+            applied_ = seq;
+            ++out.replayed;
+        }
+
+        out.last_seq = applied_;
+        out.valid_bytes = reader.valid_bytes();
+        out.torn = st == WalStatus::Torn;
+        return true;
+    }
+
+    std::uint64_t Engine::applied_count() const
+    {
+        return applied_;
+    }
+
+    bool Engine::set_instrument(const InstrumentSpec& spec)
+    {
+        return book_.set_instrument(spec);
+    }
+
+    void Engine::set_state_checkpoints(std::uint64_t every)
+    {
+        state_every_ = every;
+    }
+
+    void Engine::start_event_hash(std::uint64_t checkpoint_every)
+    {
+        hasher_ = EventHasher {};
+        hash_every_ = checkpoint_every;
+        hash_checkpoints_.clear();
+        hash_digests_.clear();
+    }
+
+    void Engine::checkpoint_event_hash()
+    {
+        if (hash_every_ == 0 || (!hash_checkpoints_.empty() && hash_checkpoints_.back().command == applied_))
+        {
+            return;
+        }
+        hash_checkpoints_.push_back(HashCheckpoint { applied_, hasher_.count(), hasher_.value(), std::move(hash_digests_) });
+        hash_digests_.clear();
+    }
+
+    std::uint64_t Engine::event_hash() const
+    {
+        return hasher_.value();
+    }
+
+    const std::vector<HashCheckpoint>& Engine::hash_checkpoints() const
+    {
+        return hash_checkpoints_;
+    }
+
+    void Engine::attach_market_data(MdWriter* writer)
+    {
+        md_ = writer;
+    }
+
     const OrderBook& Engine::book() const
     {
         return book_;
     }
+
+    const Arena* Engine::arena() const
+    {
+        return arena_.get();
+    }
 }
@@ -1,20 +1,52 @@
 #pragma once
 
+#include "arena.h"
 #include "command.h"
 #include "event.h"
+#include "event_hash.h"
+#include "journal.h"
+#include "md_ring.h"
 #include "order_book.h"
 
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <vector>
 
 namespace ob
 {
+    // what a recovery found on disk
+    struct RecoveryResult
+    {
+        std::uint64_t snapshot_seq { 0 }; // commands covered by the snapshot, zero without one
+        std::uint64_t replayed { 0 };     // journal records applied on top of it
+        std::uint64_t last_seq { 0 };     // apply count the engine now stands at
+        std::uint64_t valid_bytes { 0 };  // journal prefix that passed its checks
+        bool torn { false };              // the journal ended in a partial or corrupt record
+    };
+
+    // startup reservation, the engine then owns an arena sized for this shape
+    struct CapacityOptions
+    {
+        std::size_t max_live_orders { 0 };
+        std::size_t expected_levels { 0 };
+        ArenaOptions arena { true, false, false }; // prefault on, huge pages and mlock opt in
+    };
+
     // engine is the command in and event out boundary
     class Engine
     {
     public:
+        // the book allocates from mr, an arena resource must outlive the engine
+        explicit Engine(std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+        // builds the book on an owned arena with every page touched up front and the id index
+        // reserved, so a book within the capacity never page faults or rehashes on the hot path
+        explicit Engine(const CapacityOptions& cap);
+
         // applies one command and returns produced events
         std::vector<Event> apply(const Command& cmd);
 
@@ -27,14 +59,121 @@ namespace ob
         // stop event logging
         void stop_event_log();
 
+        // writes the same event lines to a journal that syncs in groups instead of per command
+        // each command's lines carry its 1 based apply count on this engine as the journal seq
+        bool start_journal(const std::string& path, const JournalOptions& opts = {});
+
+        // hands staged lines to the disk now, a gateway calls this once per wakeup
+        void commit_journal();
+
+        // blocks until every command applied so far is durable
+        void sync_journal();
+
+        // commands up to this apply count are on disk, 0 when nothing is or no journal is open
+        std::uint64_t journal_durable_seq();
+
+        // syncs and closes the journal
+        void stop_journal();
+
+        // the open journal for stats, null when none
+        const Journal* journal() const;
+
+        // write ahead command journal, each command is staged with a crc before the book sees it
+        // and reaches disk with group commit, to resume after a recovery set opts.resume_at to its valid bytes
+        bool start_command_journal(const std::string& path, const JournalOptions& opts = {});
+
+        // blocks until every command applied so far is in the command journal on disk
+        void sync_command_journal();
+
+        // commands up to this apply count can be recovered
+        std::uint64_t command_journal_durable_seq();
+
+        // syncs and closes the command journal
+        void stop_command_journal();
+
+        // writes the book and the apply count it covers, after syncing the command journal
+        // so the journal never lags a snapshot
+        bool save_snapshot(const std::string& path);
+
+        // rebuilds a fresh engine from a snapshot, or an empty book when snapshot_path is empty,
+        // then replays newer journal records straight into the book with no logging or publishing
+        // a torn tail is where the crash hit and ends the replay, a gap after the snapshot fails it
+        // the instrument spec set on this engine carries over, set it to the live engine's before recovering
+        bool recover(const std::string& snapshot_path, const std::string& journal_path, RecoveryResult& out);
+
+        // commands applied so far, including recovered ones
+        std::uint64_t applied_count() const;
+
+        // tick, lot, band and max qty checks for the runtime configured book, false when the spec is invalid
+        bool set_instrument(const InstrumentSpec& spec);
+
+        // appends a state checkpoint event carrying the book state hash after every n-th command, zero stops them
+        void set_state_checkpoints(std::uint64_t every);
+
+        // folds every emitted event into a rolling hash and records a checkpoint every n commands
+        void start_event_hash(std::uint64_t checkpoint_every);
+
+        // adds a checkpoint at the latest command unless one is already there, closes a partial interval
+        void checkpoint_event_hash();
+
+        std::uint64_t event_hash() const;
+        const std::vector<HashCheckpoint>& hash_checkpoints() const;
+
+        // publishes every event and the levels it touched to a market data ring, null detaches
+        // the writer is not owned and must outlive the engine or be detached first
+        void attach_market_data(MdWriter* writer);
+
         // read only book access for tests
         const OrderBook& book() const;
 
+        // the owned arena of a capacity engine, null otherwise
+        const Arena* arena() const;
+
     private:
+        // set by the capacity constructor, declared first so it outlives the book
+        std::unique_ptr<Arena> arena_;
+
         // book state for this engine instance
         OrderBook book_;
 
+        // reservation to restore after recovery replaces the book, zero without one
+        CapacityOptions cap_ {};
+
         // event log stream if enabled
         std::optional<std::ofstream> log_;
+
+        // durable event journal if enabled
+        std::unique_ptr<Journal> journal_;
+
+        // commands applied so far, the journal seq of the latest one
+        std::uint64_t applied_ { 0 };
+
+        // reused per command so journaling does not allocate once warm
+        std::string journal_lines_;
+
+        // write ahead command journal if enabled, and its record scratch
+        std::unique_ptr<Journal> wal_;
+        std::vector<char> wal_record_;
+
+        // state checkpoint interval, zero means off
+        std::uint64_t state_every_ { 0 };
+
+        // rolling event hash if enabled, zero interval means off
+        EventHasher hasher_;
+        std::uint64_t hash_every_ { 0 };
+        std::vector<HashCheckpoint> hash_checkpoints_;
+        std::vector<std::uint16_t> hash_digests_;
+
+        // market data ring if attached
+        MdWriter* md_ { nullptr };
+
+        // levels the current command touched, reused so publishing does not allocate once warm
+        std::vector<std::pair<Side, PriceTicks>> md_touched_;
+
+        // runs one command against the book, no journaling, logging or publishing
+        std::vector<Event> execute(const Command& cmd);
+
+        // events first, then one level record per distinct side and price they touched
+        void publish_market_data(const std::vector<Event>& events, const std::optional<Order>& modified_before);
     };
 }
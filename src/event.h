@@ -21,7 +21,26 @@ namespace ob
         MakerCompleted,
 
         OrderCancelled,
-        CancelRejected
+        CancelRejected,
+
+        // ioc remainder removed after matching
+        RemainderCancelled,
+
+        // fok that could not fully fill, book untouched
+        OrderKilled,
+
+        OrderModified,
+        ModifyRejected,
+
+        // one event per order touched by self trade prevention
+        SelfTradePrevented,
+
+        // stop lifecycle, px carries the trigger price
+        StopAccepted,
+        StopTriggered,
+
+        // periodic book state hash, id is the apply count, seq the hash and qty the live order count
+        StateCheckpoint
     };
 
     // event is emitted by the engine and can be logged and replayed
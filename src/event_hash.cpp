@@ -0,0 +1,184 @@
+#include "event_hash.h"
+
+#include "wire.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+
+namespace ob
+{
+    // one multiply and shift per word, plenty to tell two streams apart
+    static std::uint64_t fold(std::uint64_t h, std::uint64_t w)
+    {
+        h ^= w;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        return h;
+    }
+
+    void EventHasher::add(const Event& e)
+    {
+        scratch_.clear();
+        encode_event(e, scratch_);
+
+        // the frame starts with its own length so event boundaries are part of the hash
+        std::size_t i = 0;
+        for (; i + 8 <= scratch_.size(); i += 8)
+        {
+            std::uint64_t w { 0 };
+            for (std::size_t k = 0; k < 8; ++k)
+            {
+                w |= static_cast<std::uint64_t>(static_cast<unsigned char>(scratch_[i + k])) << (8 * k);
+            }
+            hash_ = fold(hash_, w);
+        }
+
+        std::uint64_t tail { 0 };
+        for (std::size_t k = 0; i + k < scratch_.size(); ++k)
+        {
+            tail |= static_cast<std::uint64_t>(static_cast<unsigned char>(scratch_[i + k])) << (8 * k);
+        }
+        hash_ = fold(hash_, tail ^ (static_cast<std::uint64_t>(scratch_.size()) << 56));
+
+        ++count_;
+    }
+
+    std::uint64_t EventHasher::value() const
+    {
+        return hash_;
+    }
+
+    std::uint64_t EventHasher::count() const
+    {
+        return count_;
+    }
+
+    bool write_hash_checkpoints(const std::string& path, std::uint64_t every, std::uint64_t state_every, const std::vector<HashCheckpoint>& cps)
+    {
+        std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!out)
+        {
+            return false;
+        }
+
+        out << "event_hash every=" << every << " state_every=" << state_every << "\n";
+        char hex[17] {};
+        std::string digests;
+        for (const auto& cp : cps)
+        {
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(cp.hash));
+            out << "cmd=" << cp.command << " events=" << cp.events << " hash=" << hex;
+
+            // four hex digits per command of the interval
+            digests.clear();
+            for (const std::uint16_t d : cp.digests)
+            {
+                std::snprintf(hex, sizeof(hex), "%04x", static_cast<unsigned>(d));
+                digests += hex;
+            }
+            if (!digests.empty())
+            {
+                out << " digests=" << digests;
+            }
+            out << "\n";
+        }
+        return static_cast<bool>(out.flush());
+    }
+
+    bool read_hash_checkpoints(const std::string& path, std::uint64_t& every, std::uint64_t& state_every, std::vector<HashCheckpoint>& cps)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string line;
+        unsigned long long interval { 0 };
+        unsigned long long state_interval { 0 };
+
+        // a header without state_every comes from a run that had no state checkpoints
+        if (!in || !std::getline(in, line) || std::sscanf(line.c_str(), "event_hash every=%llu state_every=%llu", &interval, &state_interval) < 1)
+        {
+            return false;
+        }
+        every = interval;
+        state_every = state_interval;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+
+            unsigned long long cmd { 0 };
+            unsigned long long events { 0 };
+            unsigned long long hash { 0 };
+            if (std::sscanf(line.c_str(), "cmd=%llu events=%llu hash=%llx", &cmd, &events, &hash) != 3)
+            {
+                return false;
+            }
+            HashCheckpoint cp { cmd, events, hash, {} };
+
+            const std::size_t at = line.find(" digests=");
+            if (at != std::string::npos)
+            {
+                const std::string_view hexes = std::string_view(line).substr(at + 9);
+                if (hexes.size() % 4 != 0)
+                {
+                    return false;
+                }
+                cp.digests.reserve(hexes.size() / 4);
+                for (std::size_t i = 0; i < hexes.size(); i += 4)
+                {
+                    std::uint16_t d { 0 };
+                    const auto r = std::from_chars(hexes.data() + i, hexes.data() + i + 4, d, 16);
+                    if (r.ec != std::errc {} || r.ptr != hexes.data() + i + 4)
+                    {
+                        return false;
+                    }
+                    cp.digests.push_back(d);
+                }
+            }
+            cps.push_back(std::move(cp));
+        }
+        return true;
+    }
+
+    bool same_checkpoint(const HashCheckpoint& a, const HashCheckpoint& b)
+    {
+        return a.command == b.command && a.events == b.events && a.hash == b.hash;
+    }
+
+    std::size_t first_divergent_checkpoint(const std::vector<HashCheckpoint>& expected, const std::vector<HashCheckpoint>& actual)
+    {
+        const std::size_t n = std::min(expected.size(), actual.size());
+        std::size_t i = 0;
+        while (i < n && same_checkpoint(expected[i], actual[i]))
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    std::uint64_t first_divergent_command(const HashCheckpoint& expected, const HashCheckpoint& actual)
+    {
+        if (expected.digests.empty() || actual.digests.empty())
+        {
+            return 0;
+        }
+
+        // both intervals start right after the last checkpoint the runs agreed on
+        const std::size_t n = std::min(expected.digests.size(), actual.digests.size());
+        const std::uint64_t first = expected.command - expected.digests.size() + 1;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (expected.digests[i] != actual.digests[i])
+            {
+                return first + i;
+            }
+        }
+
+        // one run stopped early, the first command only the other one has
+        return (expected.digests.size() != actual.digests.size()) ? first + n : 0;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "event.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ob
+{
+    // chained hash of the event stream after a given command
+    struct HashCheckpoint
+    {
+        std::uint64_t command { 0 }; // apply count the hash covers
+        std::uint64_t events { 0 };  // events hashed up to then
+        std::uint64_t hash { 0 };
+
+        // low 16 bits of the hash after each command since the previous checkpoint,
+        // so a diverged interval can name its first divergent command
+        std::vector<std::uint16_t> digests;
+    };
+
+    // rolling 64 bit hash over the wire encoding of each event in emission order
+    // every event folds into the running value, so once two streams differ they never agree again
+    class EventHasher
+    {
+    public:
+        void add(const Event& e);
+
+        std::uint64_t value() const;
+        std::uint64_t count() const;
+
+    private:
+        std::uint64_t hash_ { 0x6f625f6576656e74ULL };
+        std::uint64_t count_ { 0 };
+
+        // reused encode buffer
+        std::vector<char> scratch_;
+    };
+
+    // sidecar file: a header line with the interval and the state checkpoint interval of the run, which
+    // adds events to the hashed stream, then one line per checkpoint
+    bool write_hash_checkpoints(const std::string& path, std::uint64_t every, std::uint64_t state_every, const std::vector<HashCheckpoint>& cps);
+    bool read_hash_checkpoints(const std::string& path, std::uint64_t& every, std::uint64_t& state_every, std::vector<HashCheckpoint>& cps);
+
+    // same command, event count and hash, the digests are not compared
+    bool same_checkpoint(const HashCheckpoint& a, const HashCheckpoint& b);
+
+    // index of the first checkpoint where the two lists disagree, or the common size when one is a prefix of the other
+    std::size_t first_divergent_checkpoint(const std::vector<HashCheckpoint>& expected, const std::vector<HashCheckpoint>& actual);
+
+    // apply count of the first command whose digest differs between two checkpoints of the same interval,
+    // or the first one only the longer interval has, zero when the digests agree or either side has none
+    // a 16 bit digest can match by chance, so once in 65536 a later command in the interval is named
+    std::uint64_t first_divergent_command(const HashCheckpoint& expected, const HashCheckpoint& actual);
+}
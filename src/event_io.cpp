@@ -35,6 +35,22 @@ namespace ob
             return "order_cancelled";
         case EventType::CancelRejected:
             return "cancel_rejected";
+        case EventType::RemainderCancelled:
+            return "remainder_cancelled";
+        case EventType::OrderKilled:
+            return "order_killed";
+        case EventType::OrderModified:
+            return "order_modified";
+        case EventType::ModifyRejected:
+            return "modify_rejected";
+        case EventType::SelfTradePrevented:
+            return "self_trade_prevented";
+        case EventType::StopAccepted:
+            return "stop_accepted";
+        case EventType::StopTriggered:
+            return "stop_triggered";
+        case EventType::StateCheckpoint:
+            return "state_checkpoint";
         }
         return "unknown";
     }
@@ -49,7 +65,15 @@ namespace ob
             { "order_completed", EventType::OrderCompleted },
             { "maker_completed", EventType::MakerCompleted },
             { "order_cancelled", EventType::OrderCancelled },
-            { "cancel_rejected", EventType::CancelRejected }
+            { "cancel_rejected", EventType::CancelRejected },
+            { "remainder_cancelled", EventType::RemainderCancelled },
+            { "order_killed", EventType::OrderKilled },
+            { "order_modified", EventType::OrderModified },
+            { "modify_rejected", EventType::ModifyRejected },
+            { "self_trade_prevented", EventType::SelfTradePrevented },
+            { "stop_accepted", EventType::StopAccepted },
+            { "stop_triggered", EventType::StopTriggered },
+            { "state_checkpoint", EventType::StateCheckpoint }
         };
 
         auto it = map.find(s);
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "order.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace ob
+{
+    // what sits ahead of one resting order at its price
+    struct QueuePosition
+    {
+        Qty qty_ahead { 0 };
+        std::size_t orders_ahead { 0 };
+    };
+
+    // a level that keeps no queue index, the book walks the level from its head instead
+    struct UntrackedQueue
+    {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        static constexpr bool kTracked = false;
+
+        explicit UntrackedQueue(const allocator_type& = {})
+        {
+        }
+        UntrackedQueue(const UntrackedQueue&, const allocator_type&)
+        {
+        }
+    };
+
+    // fenwick tree over the arrival slots of one level, each node holds a qty sum and an order count
+    // slots are handed out in fifo order and never reused, so the prefix below a slot is what is ahead of it
+    // once every slot is used the owner grows the tree when most slots are live, or else resets it and pushes
+    // its live orders again from slot zero
+    class FenwickQueue
+    {
+        struct Node
+        {
+            Qty qty { 0 };
+            std::int64_t orders { 0 };
+        };
+
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        static constexpr bool kTracked = true;
+
+        explicit FenwickQueue(const allocator_type& alloc = {})
+            : nodes_(alloc)
+        {
+        }
+
+        FenwickQueue(const FenwickQueue& other, const allocator_type& alloc)
+            : nodes_(other.nodes_, alloc), next_(other.next_)
+        {
+        }
+
+        FenwickQueue(FenwickQueue&& other, const allocator_type& alloc)
+            : nodes_(std::move(other.nodes_), alloc), next_(other.next_)
+        {
+        }
+
+        FenwickQueue(const FenwickQueue&) = default;
+        FenwickQueue(FenwickQueue&&) = default;
+        FenwickQueue& operator=(const FenwickQueue&) = default;
+        FenwickQueue& operator=(FenwickQueue&&) = default;
+
+        static constexpr std::size_t kSlotBytes = sizeof(Node);
+
+        // slots handed out as used, the rest of the tree as reserved
+        void memory_usage(std::size_t& used, std::size_t& reserved) const
+        {
+            used = next_ * sizeof(Node);
+            reserved = (nodes_.capacity() - next_) * sizeof(Node);
+        }
+
+        // true when the next push needs a reset first, also true for a level that never had one
+        bool full() const
+        {
+            return next_ == nodes_.size();
+        }
+
+        // drops every slot and sizes the tree for live orders with three times as many to spare, so a level
+        // that churns in place renumbers rarely
+        void reset(std::size_t live)
+        {
+            nodes_.assign(std::bit_ceil(std::max<std::size_t>(16, 4 * live + 4)), Node {});
+            next_ = 0;
+        }
+
+        // doubles the slots and keeps every order where it is, the new top node sums the old tree and the
+        // nodes between cover only new slots
+        void grow()
+        {
+            const std::size_t n = nodes_.size();
+            const QueuePosition all = ahead(static_cast<std::uint32_t>(n));
+            nodes_.resize(2 * n, Node {});
+            nodes_.back() = Node { all.qty_ahead, static_cast<std::int64_t>(all.orders_ahead) };
+        }
+
+        // the next slot, behind every order pushed before it
+        std::uint32_t push(Qty qty)
+        {
+            const std::uint32_t slot = next_++;
+            add(slot, qty, 1);
+            return slot;
+        }
+
+        // a fill or reduction that leaves the order at its slot
+        void reduce(std::uint32_t slot, Qty by)
+        {
+            add(slot, -by, 0);
+        }
+
+        // the order leaves, qty is whatever it still had
+        void remove(std::uint32_t slot, Qty qty)
+        {
+            add(slot, -qty, -1);
+        }
+
+        // sums over every slot below this one
+        QueuePosition ahead(std::uint32_t slot) const
+        {
+            Node sum {};
+            for (std::size_t i = slot; i > 0; i &= i - 1)
+            {
+                sum.qty += nodes_[i - 1].qty;
+                sum.orders += nodes_[i - 1].orders;
+            }
+            return QueuePosition { sum.qty, static_cast<std::size_t>(sum.orders) };
+        }
+
+        // slot of the live order with this many live orders ahead of it, a walk from the head knows that count
+        // so it finds its order's slot by one descent and needs no lookup by id
+        std::uint32_t slot_at(std::size_t ahead) const
+        {
+            std::size_t pos { 0 };
+            std::int64_t left = static_cast<std::int64_t>(ahead);
+            for (std::size_t step = nodes_.size(); step > 0; step >>= 1)
+            {
+                if (pos + step <= nodes_.size() && nodes_[pos + step - 1].orders <= left)
+                {
+                    pos += step;
+                    left -= nodes_[pos - 1].orders;
+                }
+            }
+            return static_cast<std::uint32_t>(pos);
+        }
+
+        std::size_t capacity() const
+        {
+            return nodes_.size();
+        }
+
+    private:
+        void add(std::uint32_t slot, Qty qty, std::int64_t orders)
+        {
+            for (std::size_t i = slot + 1; i <= nodes_.size(); i += i & (~i + 1))
+            {
+                nodes_[i - 1].qty += qty;
+                nodes_[i - 1].orders += orders;
+            }
+        }
+
+        std::pmr::vector<Node> nodes_;
+        std::uint32_t next_ { 0 };
+    };
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace ob
+{
+    // open addressed id map with linear probing, the subset of std::unordered_map the book uses
+    // key zero marks an empty slot, order ids are never zero
+    // erase shifts later entries of the probe run back, so erase and a growing emplace invalidate
+    // every iterator and reference, finds do not
+    template <typename K, typename V>
+    class FlatIdMap
+    {
+        using Slot = std::pair<K, V>;
+
+        template <bool Const>
+        class basic_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Slot;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const Slot*, Slot*>;
+            using reference = std::conditional_t<Const, const Slot&, Slot&>;
+
+            basic_iterator() = default;
+
+            basic_iterator(pointer at, pointer end)
+                : at_(at), end_(end)
+            {
+            }
+
+            operator basic_iterator<true>() const
+            {
+                return basic_iterator<true>(at_, end_);
+            }
+
+            reference operator*() const
+            {
+                return *at_;
+            }
+            pointer operator->() const
+            {
+                return at_;
+            }
+
+            basic_iterator& operator++()
+            {
+                do
+                {
+                    ++at_;
+                } while (at_ != end_ && at_->first == K {});
+                return *this;
+            }
+            basic_iterator operator++(int)
+            {
+                basic_iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const basic_iterator& other) const
+            {
+                return at_ == other.at_;
+            }
+
+        private:
+            friend class FlatIdMap;
+
+            pointer at_ { nullptr };
+            pointer end_ { nullptr };
+        };
+
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using value_type = Slot;
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+
+        explicit FlatIdMap(const allocator_type& alloc = {})
+            : slots_(alloc)
+        {
+        }
+
+        FlatIdMap(FlatIdMap&& other) noexcept
+            : slots_(std::move(other.slots_)), size_(other.size_), mask_(other.mask_), shift_(other.shift_)
+        {
+            other.slots_.clear();
+            other.size_ = 0;
+        }
+
+        FlatIdMap& operator=(FlatIdMap&& other)
+        {
+            slots_ = std::move(other.slots_);
+            size_ = other.size_;
+            mask_ = other.mask_;
+            shift_ = other.shift_;
+            other.slots_.clear();
+            other.size_ = 0;
+            return *this;
+        }
+
+        iterator begin()
+        {
+            return skip_empty(iterator(slots_.data(), slots_.data() + slots_.size()));
+        }
+        iterator end()
+        {
+            return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size());
+        }
+        const_iterator begin() const
+        {
+            return skip_empty(const_iterator(slots_.data(), slots_.data() + slots_.size()));
+        }
+        const_iterator end() const
+        {
+            return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size());
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        // slots, to line up with the bucket count of a node hash
+        std::size_t bucket_count() const
+        {
+            return slots_.size();
+        }
+
+        static constexpr std::size_t kEntryBytes = sizeof(Slot);
+
+        // empty slots are reserved, the table never shrinks
+        void memory_usage(std::size_t& used, std::size_t& reserved) const
+        {
+            used = size_ * sizeof(Slot);
+            reserved = (slots_.size() - size_) * sizeof(Slot);
+        }
+
+        iterator find(K k)
+        {
+            const std::size_t s = probe(k);
+            return (s == kMissing) ? end() : iterator(slots_.data() + s, slots_.data() + slots_.size());
+        }
+        const_iterator find(K k) const
+        {
+            const std::size_t s = probe(k);
+            return (s == kMissing) ? end() : const_iterator(slots_.data() + s, slots_.data() + slots_.size());
+        }
+
+        std::size_t count(K k) const
+        {
+            return (probe(k) == kMissing) ? 0 : 1;
+        }
+
+        std::pair<iterator, bool> emplace(K k, const V& v)
+        {
+            if (const std::size_t s = probe(k); s != kMissing)
+            {
+                return { iterator(slots_.data() + s, slots_.data() + slots_.size()), false };
+            }
+
+            // grows at three quarters full, so a probe run stays short
+            if ((size_ + 1) * 4 > slots_.size() * 3)
+            {
+                rehash(std::max<std::size_t>(16, slots_.size() * 2));
+            }
+
+            std::size_t s = home(k);
+            while (slots_[s].first != K {})
+            {
+                s = (s + 1) & mask_;
+            }
+            slots_[s] = Slot { k, v };
+            ++size_;
+            return { iterator(slots_.data() + s, slots_.data() + slots_.size()), true };
+        }
+
+        std::size_t erase(K k)
+        {
+            const std::size_t s = probe(k);
+            if (s == kMissing)
+            {
+                return 0;
+            }
+            erase_slot(s);
+            return 1;
+        }
+
+        void erase(const_iterator it)
+        {
+            erase_slot(static_cast<std::size_t>(it.at_ - slots_.data()));
+        }
+
+        // sizes the table so n entries fit without growing
+        void reserve(std::size_t n)
+        {
+            std::size_t want = 16;
+            while (want * 3 < n * 4)
+            {
+                want *= 2;
+            }
+            if (want > slots_.size())
+            {
+                rehash(want);
+            }
+        }
+
+    private:
+        static constexpr std::size_t kMissing = ~std::size_t { 0 };
+
+        std::size_t home(K k) const
+        {
+            return static_cast<std::size_t>((static_cast<std::uint64_t>(k) * 0x9E3779B97F4A7C15ULL) >> shift_) & mask_;
+        }
+
+        std::size_t probe(K k) const
+        {
+            if (size_ == 0)
+            {
+                return kMissing;
+            }
+            for (std::size_t s = home(k);; s = (s + 1) & mask_)
+            {
+                if (slots_[s].first == k)
+                {
+                    return s;
+                }
+                if (slots_[s].first == K {})
+                {
+                    return kMissing;
+                }
+            }
+        }
+
+        // backward shift: pull later entries of the run into the hole while that keeps them reachable
+        void erase_slot(std::size_t hole)
+        {
+            std::size_t s = hole;
+            while (true)
+            {
+                s = (s + 1) & mask_;
+                if (slots_[s].first == K {})
+                {
+                    break;
+                }
+                const std::size_t h = home(slots_[s].first);
+                if (((s - h) & mask_) >= ((s - hole) & mask_))
+                {
+                    slots_[hole] = slots_[s];
+                    hole = s;
+                }
+            }
+            slots_[hole] = Slot {};
+            --size_;
+        }
+
+        void rehash(std::size_t n)
+        {
+            std::pmr::vector<Slot> old(n, slots_.get_allocator());
+            old.swap(slots_);
+            mask_ = n - 1;
+            shift_ = 64 - static_cast<unsigned>(std::countr_zero(n));
+
+            for (const Slot& e : old)
+            {
+                if (e.first == K {})
+                {
+                    continue;
+                }
+                std::size_t s = home(e.first);
+                while (slots_[s].first != K {})
+                {
+                    s = (s + 1) & mask_;
+                }
+                slots_[s] = e;
+            }
+        }
+
+        template <typename It>
+        static It skip_empty(It it)
+        {
+            if (it.at_ != it.end_ && it.at_->first == K {})
+            {
+                ++it;
+            }
+            return it;
+        }
+
+        std::pmr::vector<Slot> slots_;
+        std::size_t size_ { 0 };
+        std::size_t mask_ { 0 };
+        unsigned shift_ { 64 };
+    };
+}
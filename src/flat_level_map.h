@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace ob
+{
+    // ordered map for one side of the book as a sorted vector of (key, value pointer), the subset of
+    // std::map the book uses, iterated in Compare order from the best key
+    // the vector is stored worst first so the best key sits at the back, where most inserts and erases land
+    // values live in their own allocation so references survive inserts, iterators do not
+    template <typename K, typename V, typename Compare = std::less<K>>
+    class FlatLevelMap
+    {
+        struct Entry
+        {
+            K key;
+            V* value;
+        };
+
+        // what an iterator yields, shaped like the pair std::map hands out
+        template <bool Const>
+        struct basic_ref
+        {
+            const K& first;
+            std::conditional_t<Const, const V&, V&> second;
+        };
+
+        template <bool Const>
+        class basic_iterator
+        {
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = std::pair<const K, V>;
+            using difference_type = std::ptrdiff_t;
+            using reference = basic_ref<Const>;
+            using owner = std::conditional_t<Const, const FlatLevelMap*, FlatLevelMap*>;
+
+            // operator-> hands out a pointer to a reference held by value
+            struct pointer
+            {
+                reference ref;
+
+                const reference* operator->() const
+                {
+                    return &ref;
+                }
+            };
+
+            basic_iterator() = default;
+
+            basic_iterator(owner m, std::ptrdiff_t rank)
+                : m_(m), rank_(rank)
+            {
+            }
+
+            operator basic_iterator<true>() const
+            {
+                return basic_iterator<true>(m_, rank_);
+            }
+
+            reference operator*() const
+            {
+                const Entry& e = m_->at_rank(rank_);
+                return reference { e.key, *e.value };
+            }
+            pointer operator->() const
+            {
+                return pointer { **this };
+            }
+
+            basic_iterator& operator++()
+            {
+                ++rank_;
+                return *this;
+            }
+            basic_iterator operator++(int)
+            {
+                basic_iterator old = *this;
+                ++rank_;
+                return old;
+            }
+            basic_iterator& operator--()
+            {
+                --rank_;
+                return *this;
+            }
+            basic_iterator operator--(int)
+            {
+                basic_iterator old = *this;
+                --rank_;
+                return old;
+            }
+
+            bool operator==(const basic_iterator& other) const
+            {
+                return rank_ == other.rank_;
+            }
+
+        private:
+            friend class FlatLevelMap;
+
+            owner m_ { nullptr };
+
+            // distance from the best key, size() is end
+            std::ptrdiff_t rank_ { 0 };
+        };
+
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        explicit FlatLevelMap(const allocator_type& alloc = {})
+            : alloc_(alloc), entries_(alloc)
+        {
+        }
+
+        FlatLevelMap(const FlatLevelMap& other) = delete;
+        FlatLevelMap& operator=(const FlatLevelMap& other) = delete;
+
+        FlatLevelMap(FlatLevelMap&& other) noexcept
+            : alloc_(other.alloc_), entries_(std::move(other.entries_), other.alloc_)
+        {
+            other.entries_.clear();
+        }
+
+        // like a pmr container, values are only stolen when both sides share a resource
+        FlatLevelMap& operator=(FlatLevelMap&& other)
+        {
+            clear();
+            if (alloc_ == other.alloc_)
+            {
+                entries_.swap(other.entries_);
+                return *this;
+            }
+
+            entries_.reserve(other.entries_.size());
+            for (const Entry& e : other.entries_)
+            {
+                entries_.push_back(Entry { e.key, alloc_.template new_object<V>(std::move(*e.value)) });
+            }
+            other.clear();
+            return *this;
+        }
+
+        ~FlatLevelMap()
+        {
+            clear();
+        }
+
+        iterator begin()
+        {
+            return iterator(this, 0);
+        }
+        iterator end()
+        {
+            return iterator(this, rank_end());
+        }
+        const_iterator begin() const
+        {
+            return const_iterator(this, 0);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(this, rank_end());
+        }
+        reverse_iterator rbegin()
+        {
+            return reverse_iterator(end());
+        }
+        reverse_iterator rend()
+        {
+            return reverse_iterator(begin());
+        }
+        const_reverse_iterator rbegin() const
+        {
+            return const_reverse_iterator(end());
+        }
+        const_reverse_iterator rend() const
+        {
+            return const_reverse_iterator(begin());
+        }
+
+        std::size_t size() const
+        {
+            return entries_.size();
+        }
+        bool empty() const
+        {
+            return entries_.empty();
+        }
+
+        // sizes the key vector so up to n keys insert without growing it, values still allocate one each
+        void reserve(std::size_t n)
+        {
+            entries_.reserve(n);
+        }
+        std::size_t capacity() const
+        {
+            return entries_.capacity();
+        }
+
+        // a key entry plus its boxed value
+        static constexpr std::size_t kEntryBytes = sizeof(Entry) + sizeof(V);
+
+        // spare key vector capacity is reserved
+        void memory_usage(std::size_t& used, std::size_t& reserved) const
+        {
+            used = entries_.size() * kEntryBytes;
+            reserved = (entries_.capacity() - entries_.size()) * sizeof(Entry);
+        }
+
+        // first key not ordered before k, and first key ordered after k
+        iterator lower_bound(const K& k)
+        {
+            return iterator(this, rank_of(slot_not_before(k)));
+        }
+        const_iterator lower_bound(const K& k) const
+        {
+            return const_iterator(this, rank_of(slot_not_before(k)));
+        }
+        iterator upper_bound(const K& k)
+        {
+            return iterator(this, rank_of(slot_after(k)));
+        }
+        const_iterator upper_bound(const K& k) const
+        {
+            return const_iterator(this, rank_of(slot_after(k)));
+        }
+
+        iterator find(const K& k)
+        {
+            const std::size_t s = slot_not_before(k);
+            return (s > 0 && !comp_(k, entries_[s - 1].key)) ? iterator(this, rank_of(s)) : end();
+        }
+        const_iterator find(const K& k) const
+        {
+            const std::size_t s = slot_not_before(k);
+            return (s > 0 && !comp_(k, entries_[s - 1].key)) ? const_iterator(this, rank_of(s)) : end();
+        }
+
+        // value at k, built with the map's allocator when k is new
+        std::pair<iterator, bool> try_emplace(const K& k)
+        {
+            const std::size_t s = slot_not_before(k);
+            if (s > 0 && !comp_(k, entries_[s - 1].key))
+            {
+                return { iterator(this, rank_of(s)), false };
+            }
+
+            V* v = alloc_.template new_object<V>();
+            entries_.insert(entries_.begin() + static_cast<std::ptrdiff_t>(s), Entry { k, v });
+            return { iterator(this, rank_of(s + 1)), true };
+        }
+
+        V& operator[](const K& k)
+        {
+            return try_emplace(k).first->second;
+        }
+
+        // the next key keeps the erased rank, so the returned iterator is the one passed in
+        iterator erase(const_iterator it)
+        {
+            return erase(it, std::next(it));
+        }
+
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            const auto lo = entries_.begin() + (rank_end() - last.rank_);
+            const auto hi = entries_.begin() + (rank_end() - first.rank_);
+            for (auto e = lo; e != hi; ++e)
+            {
+                alloc_.delete_object(e->value);
+            }
+            entries_.erase(lo, hi);
+            return iterator(this, first.rank_);
+        }
+
+        std::size_t erase(const K& k)
+        {
+            const auto it = find(k);
+            if (it == end())
+            {
+                return 0;
+            }
+            erase(it);
+            return 1;
+        }
+
+        void clear()
+        {
+            for (const Entry& e : entries_)
+            {
+                alloc_.delete_object(e.value);
+            }
+            entries_.clear();
+        }
+
+    private:
+        std::ptrdiff_t rank_end() const
+        {
+            return static_cast<std::ptrdiff_t>(entries_.size());
+        }
+
+        const Entry& at_rank(std::ptrdiff_t rank) const
+        {
+            return entries_[entries_.size() - 1 - static_cast<std::size_t>(rank)];
+        }
+
+        // rank of the entry just below vector slot s, the slot count is the worst first boundary
+        std::ptrdiff_t rank_of(std::size_t s) const
+        {
+            return rank_end() - static_cast<std::ptrdiff_t>(s);
+        }
+
+        // vector slot past the last entry not ordered before k, the rank walk starts just below it
+        std::size_t slot_not_before(const K& k) const
+        {
+            const auto it = std::partition_point(entries_.begin(), entries_.end(), [&](const Entry& e) { return !comp_(e.key, k); });
+            return static_cast<std::size_t>(it - entries_.begin());
+        }
+
+        // vector slot past the last entry ordered after k
+        std::size_t slot_after(const K& k) const
+        {
+            const auto it = std::partition_point(entries_.begin(), entries_.end(), [&](const Entry& e) { return comp_(k, e.key); });
+            return static_cast<std::size_t>(it - entries_.begin());
+        }
+
+        allocator_type alloc_;
+        Compare comp_ {};
+
+        // worst key first, best at the back
+        std::pmr::vector<Entry> entries_;
+    };
+}
@@ -0,0 +1,412 @@
+#include "engine.h"
+
+#include "md_shm.h"
+#include "net.h"
+#include "wire.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one connected client, events for its commands only ever go back to it
+struct Session
+{
+    int fd { -1 };
+
+    // bytes read but not yet decoded into whole frames
+    std::vector<char> in;
+
+    // encoded output the socket has not taken yet, capped so a client that stops reading is dropped
+    std::vector<char> pending;
+    std::size_t pending_off { 0 };
+    bool want_out { false };
+};
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void on_signal(int)
+{
+    g_stop = 1;
+}
+
+static void print_usage()
+{
+    std::cout << "usage:\n";
+    std::cout << "  ob_gateway --unix <path> [--events <event_log>] [--journal <path>] [--md <shm_name>] [--md-slots <n>] [--max-pending-mib <n>]\n";
+    std::cout << "  ob_gateway --tcp <port> [--events <event_log>] [--journal <path>] [--md <shm_name>] [--md-slots <n>] [--max-pending-mib <n>]\n";
+}
+
+static bool set_interest(int epfd, Session& s, bool want_out)
+{
+    if (s.want_out == want_out)
+    {
+        return true;
+    }
+
+    epoll_event ev {};
+    ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0u);
+    ev.data.fd = s.fd;
+    s.want_out = want_out;
+    return ::epoll_ctl(epfd, EPOLL_CTL_MOD, s.fd, &ev) == 0;
+}
+
+// writes what was left over plus the new batch in one writev, no copy to join them
+// returns false when the peer is gone or its unsent output would pass max_pending bytes
+static bool flush(int epfd, Session& s, std::vector<char>& batch, std::size_t max_pending)
+{
+    // how much of the batch the socket already took, the batch is only copied if the socket fills
+    std::size_t batch_off { 0 };
+
+    while (true)
+    {
+        iovec iov[2] {};
+        int n_iov = 0;
+
+        const std::size_t old_len = s.pending.size() - s.pending_off;
+        if (old_len > 0)
+        {
+            iov[n_iov].iov_base = s.pending.data() + s.pending_off;
+            iov[n_iov].iov_len = old_len;
+            ++n_iov;
+        }
+        if (batch_off < batch.size())
+        {
+            iov[n_iov].iov_base = batch.data() + batch_off;
+            iov[n_iov].iov_len = batch.size() - batch_off;
+            ++n_iov;
+        }
+        if (n_iov == 0)
+        {
+            s.pending.clear();
+            s.pending_off = 0;
+            return set_interest(epfd, s, false);
+        }
+
+        const ssize_t w = ::writev(s.fd, iov, n_iov);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+
+            // socket is full, keep the rest and wait for epollout
+            // the sent prefix goes first so the buffer only ever holds unsent bytes
+            s.pending.erase(s.pending.begin(), s.pending.begin() + static_cast<std::ptrdiff_t>(s.pending_off));
+            s.pending_off = 0;
+            s.pending.insert(s.pending.end(), batch.begin() + static_cast<std::ptrdiff_t>(batch_off), batch.end());
+            batch.clear();
+            if (s.pending.size() > max_pending)
+            {
+                std::cerr << "session fd=" << s.fd << " dropped, pending_bytes=" << s.pending.size() << "\n";
+                return false;
+            }
+            return set_interest(epfd, s, true);
+        }
+
+        // consume the written bytes from the old tail first, then from the batch
+        const std::size_t written = static_cast<std::size_t>(w);
+        const std::size_t from_old = std::min(written, old_len);
+        s.pending_off += from_old;
+        batch_off += written - from_old;
+
+        if (s.pending_off == s.pending.size())
+        {
+            s.pending.clear();
+            s.pending_off = 0;
+        }
+    }
+}
+
+// decodes every whole frame in the input buffer and applies them in arrival order
+// returns false on a malformed frame, the session is then dropped
+static bool process_input(ob::Engine& eng, Session& s, std::vector<char>& batch)
+{
+    std::size_t off { 0 };
+    ob::WireMessage msg {};
+
+    while (off < s.in.size())
+    {
+        std::size_t used { 0 };
+        const ob::WireStatus st = ob::decode_frame(s.in.data() + off, s.in.size() - off, msg, used);
+        if (st == ob::WireStatus::Incomplete)
+        {
+            break;
+        }
+        if (st == ob::WireStatus::Malformed || msg.kind != ob::WireKind::Command)
+        {
+            return false;
+        }
+        off += used;
+
+        const auto events = eng.apply(msg.command);
+        for (const auto& e : events)
+        {
+            ob::encode_event(e, batch);
+        }
+        ob::encode_ack(msg.tag, static_cast<std::uint32_t>(events.size()), batch);
+    }
+
+    s.in.erase(s.in.begin(), s.in.begin() + static_cast<std::ptrdiff_t>(off));
+    return true;
+}
+
+// reads until the socket is drained, returns false once the peer closed
+static bool drain_socket(Session& s)
+{
+    char buf[64 * 1024];
+    while (true)
+    {
+        const ssize_t r = ::read(s.fd, buf, sizeof(buf));
+        if (r > 0)
+        {
+            s.in.insert(s.in.end(), buf, buf + r);
+            continue;
+        }
+        if (r == 0)
+        {
+            return false;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ob::Endpoint ep {};
+    std::string events_path;
+    std::string journal_path;
+    std::string md_name;
+    std::size_t md_slots { 1 << 16 };
+    std::size_t max_pending_mib { 64 };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string a = argv[i];
+
+        if ((a == "--unix" || a == "--tcp") && ob::parse_endpoint_arg(argc, argv, i, ep))
+        {
+            continue;
+        }
+        if (a == "--events" && i + 1 < argc)
+        {
+            events_path = argv[++i];
+            continue;
+        }
+        if (a == "--journal" && i + 1 < argc)
+        {
+            journal_path = argv[++i];
+            continue;
+        }
+        if (a == "--md" && i + 1 < argc)
+        {
+            md_name = argv[++i];
+            continue;
+        }
+        if (a == "--md-slots" && i + 1 < argc)
+        {
+            md_slots = static_cast<std::size_t>(std::stoull(argv[++i]));
+            continue;
+        }
+        if (a == "--max-pending-mib" && i + 1 < argc)
+        {
+            max_pending_mib = static_cast<std::size_t>(std::stoull(argv[++i]));
+            continue;
+        }
+
+        print_usage();
+        return 1;
+    }
+
+    if (ep.unix_path.empty() && ep.tcp_port == 0)
+    {
+        print_usage();
+        return 1;
+    }
+
+    ob::Engine eng;
+    if (!events_path.empty() && !eng.start_event_log(events_path))
+    {
+        std::cerr << "failed to open event log\n";
+        return 2;
+    }
+    if (!journal_path.empty() && !eng.start_journal(journal_path))
+    {
+        std::cerr << "failed to open journal\n";
+        return 2;
+    }
+
+    // the ring lives as long as the gateway, readers in other processes map it by name
+    ob::ShmRegion md_region;
+    std::optional<ob::MdWriter> md_writer;
+    if (!md_name.empty())
+    {
+        if (md_slots == 0 || (md_slots & (md_slots - 1)) != 0)
+        {
+            std::cerr << "md-slots must be a power of two\n";
+            return 1;
+        }
+        if (!md_region.create(md_name, ob::md_ring_bytes(md_slots)))
+        {
+            return 5;
+        }
+        md_writer.emplace(md_region.data(), md_slots);
+        eng.attach_market_data(&*md_writer);
+    }
+
+    const int listen_fd = ob::listen_endpoint(ep);
+    if (listen_fd < 0)
+    {
+        return 3;
+    }
+
+    const int epfd = ::epoll_create1(0);
+    if (epfd < 0)
+    {
+        std::cerr << "epoll_create1 failed\n";
+        return 4;
+    }
+
+    epoll_event lev {};
+    lev.events = EPOLLIN;
+    lev.data.fd = listen_fd;
+    ::epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &lev);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+    auto close_session = [&](int fd)
+    {
+        ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        sessions.erase(fd);
+    };
+
+    std::cout << "gateway listening" << (ep.unix_path.empty() ? " tcp=" + std::to_string(ep.tcp_port) : " unix=" + ep.unix_path) << std::endl;
+
+    // one engine, one thread, commands apply in the order their bytes are read
+    std::vector<epoll_event> ready(64);
+    std::vector<char> batch;
+    const std::size_t max_pending = max_pending_mib << 20;
+
+    while (g_stop == 0)
+    {
+        const int n = ::epoll_wait(epfd, ready.data(), static_cast<int>(ready.size()), 100);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "epoll_wait failed\n";
+            break;
+        }
+
+        for (int k = 0; k < n; ++k)
+        {
+            const int fd = ready[k].data.fd;
+
+            if (fd == listen_fd)
+            {
+                while (true)
+                {
+                    const int cfd = ::accept(listen_fd, nullptr, nullptr);
+                    if (cfd < 0)
+                    {
+                        break;
+                    }
+                    if (!ob::make_nonblocking(cfd))
+                    {
+                        ::close(cfd);
+                        continue;
+                    }
+
+                    auto s = std::make_unique<Session>();
+                    s->fd = cfd;
+
+                    epoll_event cev {};
+                    cev.events = EPOLLIN;
+                    cev.data.fd = cfd;
+                    ::epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
+                    sessions.emplace(cfd, std::move(s));
+                }
+                continue;
+            }
+
+            auto it = sessions.find(fd);
+            if (it == sessions.end())
+            {
+                continue;
+            }
+            Session& s = *it->second;
+
+            bool alive = true;
+            if (ready[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                // a closed peer may still have whole frames buffered, apply them first
+                alive = drain_socket(s);
+                batch.clear();
+                if (!process_input(eng, s, batch))
+                {
+                    alive = false;
+                }
+                else if (!flush(epfd, s, batch, max_pending))
+                {
+                    alive = false;
+                }
+            }
+            else if (ready[k].events & EPOLLOUT)
+            {
+                batch.clear();
+                alive = flush(epfd, s, batch, max_pending);
+            }
+
+            if (!alive)
+            {
+                close_session(fd);
+            }
+        }
+
+        // everything applied in this wakeup shares one write and one fdatasync
+        eng.commit_journal();
+    }
+
+    for (auto& kv : sessions)
+    {
+        ::close(kv.first);
+    }
+    ::close(listen_fd);
+    ::close(epfd);
+
+    if (!ep.unix_path.empty())
+    {
+        ::unlink(ep.unix_path.c_str());
+    }
+
+    eng.stop_event_log();
+    eng.stop_journal();
+    eng.attach_market_data(nullptr);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "order.h"
+
+#include <cstdint>
+#include <limits>
+
+namespace ob
+{
+    // trading constraints of one instrument, the defaults accept any positive price and qty
+    struct InstrumentSpec
+    {
+        PriceTicks tick { 1 }; // prices must be a multiple
+        Qty lot { 1 };         // quantities must be a multiple
+        PriceTicks min_price { 1 };
+        PriceTicks max_price { std::numeric_limits<PriceTicks>::max() };
+        Qty max_qty { std::numeric_limits<Qty>::max() };
+    };
+
+    // a spec the checks below can run on: positive tick and lot, a non empty positive band, a positive max qty
+    constexpr bool valid_spec(const InstrumentSpec& s)
+    {
+        return s.tick > 0 && s.lot > 0 && s.min_price > 0 && s.min_price <= s.max_price && s.max_qty > 0;
+    }
+
+    // reason token for a positive price or qty outside the spec, null when it fits
+    // a constant spec folds the unit tick and lot checks away entirely
+    constexpr const char* price_violation(const InstrumentSpec& s, PriceTicks price_ticks)
+    {
+        if (price_ticks < s.min_price || price_ticks > s.max_price)
+        {
+            return "price_band";
+        }
+        if (s.tick != 1 && price_ticks % s.tick != 0)
+        {
+            return "tick_size";
+        }
+        return nullptr;
+    }
+
+    constexpr const char* qty_violation(const InstrumentSpec& s, Qty qty)
+    {
+        if (qty > s.max_qty)
+        {
+            return "max_qty";
+        }
+        if (s.lot != 1 && qty % s.lot != 0)
+        {
+            return "lot_size";
+        }
+        return nullptr;
+    }
+
+    // runtime configured instrument, the book keeps its spec as data and stores full width values
+    struct GenericInstrument
+    {
+        using price_type = PriceTicks;
+        using qty_type = Qty;
+        static constexpr bool kFixed = false;
+    };
+
+    // compile time instrument, validation reads constants and orders store the declared widths
+    template <PriceTicks Tick, Qty Lot, PriceTicks MinPrice, PriceTicks MaxPrice, Qty MaxQty, typename Price = PriceTicks, typename Quantity = Qty>
+    struct FixedInstrument
+    {
+        static_assert(Tick > 0 && Lot > 0 && MinPrice > 0 && MinPrice <= MaxPrice && MaxQty >= Lot);
+        static_assert(MaxPrice <= std::numeric_limits<Price>::max(), "price band does not fit the price width");
+        static_assert(MaxQty <= std::numeric_limits<Quantity>::max(), "max qty does not fit the qty width");
+
+        using price_type = Price;
+        using qty_type = Quantity;
+        static constexpr bool kFixed = true;
+        static constexpr InstrumentSpec spec { Tick, Lot, MinPrice, MaxPrice, MaxQty };
+    };
+
+    // cash equity profile: unit ticks on a 1 to 10 million band, up to a million per order, 32 bit storage
+    using EquityInstrument = FixedInstrument<1, 1, 1, 10'000'000, 1'000'000, std::int32_t, std::int32_t>;
+
+    // futures profile: prices on a 5 tick grid, 32 bit storage
+    using FuturesInstrument = FixedInstrument<5, 1, 5, 2'000'000'000, 10'000, std::int32_t, std::int32_t>;
+}
@@ -0,0 +1,627 @@
+#include "journal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace ob
+{
+#if defined(__linux__)
+    static constexpr std::size_t kPage = 4096;
+
+    // the raw syscalls, liburing is not a dependency
+    static int uring_setup(unsigned entries, io_uring_params* p)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    // writes all of it at off, retrying short writes
+    static bool pwrite_all(int fd, const char* data, std::size_t size, std::uint64_t off)
+    {
+        while (size > 0)
+        {
+            const ssize_t w = ::pwrite(fd, data, size, static_cast<off_t>(off));
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += w;
+            size -= static_cast<std::size_t>(w);
+            off += static_cast<std::uint64_t>(w);
+        }
+        return true;
+    }
+
+    // fsyncs the directory holding path so a file just created there survives a crash
+    static bool sync_parent_dir(const std::string& path)
+    {
+        const std::size_t slash = path.find_last_of('/');
+        const std::string dir = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : path.substr(0, slash);
+        const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        const bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    // one submission and one completion queue shared with the kernel
+    struct Uring
+    {
+        int fd { -1 };
+
+        void* sq_map { nullptr };
+        std::size_t sq_map_bytes { 0 };
+        void* cq_map { nullptr };
+        std::size_t cq_map_bytes { 0 };
+        io_uring_sqe* sqes { nullptr };
+        std::size_t sqes_bytes { 0 };
+
+        unsigned* sq_tail { nullptr };
+        unsigned* sq_mask { nullptr };
+        unsigned* sq_array { nullptr };
+
+        unsigned* cq_head { nullptr };
+        unsigned* cq_tail { nullptr };
+        unsigned* cq_mask { nullptr };
+        io_uring_cqe* cqes { nullptr };
+
+        bool setup(unsigned entries)
+        {
+            io_uring_params p {};
+            fd = uring_setup(entries, &p);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            sq_map_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_map_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+            // newer kernels map both rings with one call
+            const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+            {
+                sq_map_bytes = std::max(sq_map_bytes, cq_map_bytes);
+            }
+
+            sq_map = ::mmap(nullptr, sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sq_map == MAP_FAILED)
+            {
+                sq_map = nullptr;
+                return false;
+            }
+
+            if (single)
+            {
+                cq_map = sq_map;
+            }
+            else
+            {
+                cq_map = ::mmap(nullptr, cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (cq_map == MAP_FAILED)
+                {
+                    cq_map = nullptr;
+                    return false;
+                }
+            }
+
+            sqes_bytes = p.sq_entries * sizeof(io_uring_sqe);
+            void* s = ::mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (s == MAP_FAILED)
+            {
+                return false;
+            }
+            sqes = static_cast<io_uring_sqe*>(s);
+
+            char* sq = static_cast<char*>(sq_map);
+            sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+            char* cq = static_cast<char*>(cq_map);
+            cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+            return true;
+        }
+
+        void teardown()
+        {
+            if (sqes != nullptr)
+            {
+                ::munmap(sqes, sqes_bytes);
+            }
+            if (cq_map != nullptr && cq_map != sq_map)
+            {
+                ::munmap(cq_map, cq_map_bytes);
+            }
+            if (sq_map != nullptr)
+            {
+                ::munmap(sq_map, sq_map_bytes);
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            *this = Uring {};
+        }
+
+        // fills the next free entry, the caller submits once per batch
+        io_uring_sqe* next_sqe()
+        {
+            const unsigned tail = *sq_tail;
+            const unsigned idx = tail & *sq_mask;
+            io_uring_sqe* sqe = &sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array[idx] = idx;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            return sqe;
+        }
+    };
+
+    struct StagingBuffer
+    {
+        char* data { nullptr };
+        std::size_t used { 0 };
+
+        // highest record seq whose last byte is in this buffer
+        std::uint64_t max_seq { 0 };
+
+        // set while its write and sync are with the kernel, pending counts the submitted ones not reaped yet
+        bool in_flight { false };
+        unsigned pending { 0 };
+        std::uint64_t file_off { 0 };
+        std::size_t written { 0 };
+        bool failed { false };
+    };
+
+    struct Journal::State
+    {
+        int fd { -1 };
+        JournalOptions opts {};
+        Uring ring {};
+        bool use_ring { false };
+        bool healthy { true };
+
+        StagingBuffer buf[2] {};
+        int active { 0 };
+
+        std::uint64_t file_off { 0 };
+        std::uint64_t durable_seq { 0 };
+        std::uint64_t syncs { 0 };
+
+        // the chain for buffer b failed part way, finish it the slow way and stop using the ring
+        void finish_by_hand(StagingBuffer& b)
+        {
+            use_ring = false;
+            const std::size_t done = b.failed ? 0 : b.written;
+            if (!pwrite_all(fd, b.data + done, b.used - done, b.file_off + done) || ::fdatasync(fd) != 0)
+            {
+                healthy = false;
+                return;
+            }
+            ++syncs;
+            durable_seq = std::max(durable_seq, b.max_seq);
+        }
+
+        void complete(StagingBuffer& b)
+        {
+            b.in_flight = false;
+            b.used = 0;
+            b.written = 0;
+            b.failed = false;
+        }
+
+        // consumes every completion already posted, user data is buffer index times two plus one for the sync
+        void reap()
+        {
+            unsigned head = *ring.cq_head;
+            const unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+            while (head != tail)
+            {
+                const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+                StagingBuffer& b = buf[cqe.user_data >> 1];
+                const bool is_sync = (cqe.user_data & 1) != 0;
+                --b.pending;
+
+                if (!is_sync)
+                {
+                    if (cqe.res < 0)
+                    {
+                        b.failed = true;
+                    }
+                    else
+                    {
+                        b.written = static_cast<std::size_t>(cqe.res);
+                    }
+                }
+                else
+                {
+                    // a short write cancels the linked sync too, both land here
+                    if (cqe.res == 0 && !b.failed && b.written == b.used)
+                    {
+                        durable_seq = std::max(durable_seq, b.max_seq);
+                    }
+                    else
+                    {
+                        finish_by_hand(b);
+                    }
+                    complete(b);
+                }
+                ++head;
+            }
+
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        // the ring failed with b's chain submitted, stop using it and write whatever b still lacks by hand
+        // submitted entries keep completing into the mapped queue without io_uring_enter, so they are
+        // drained first and the hand written part starts where the kernel's write ended
+        void abandon_ring(StagingBuffer& b)
+        {
+            for (int waited_ms = 0; b.pending > 0 && waited_ms < 10'000; ++waited_ms)
+            {
+                reap();
+                if (b.pending > 0)
+                {
+                    ::usleep(1000);
+                }
+            }
+            use_ring = false;
+            if (!b.in_flight)
+            {
+                // the sync completion arrived and reap settled the buffer
+                return;
+            }
+
+            // a write that never completed may still land, rewrite all of b so the file is right either way,
+            // the late write carries the same bytes to the same offset as long as this memory is never reused,
+            // so it is left to the kernel and b stages into a new buffer
+            const bool stuck = b.pending > 0;
+            if (stuck)
+            {
+                b.failed = true;
+            }
+            finish_by_hand(b);
+            complete(b);
+            if (stuck)
+            {
+                b.data = static_cast<char*>(std::aligned_alloc(kPage, opts.buffer_bytes));
+                b.pending = 0;
+                if (b.data == nullptr)
+                {
+                    healthy = false;
+                }
+            }
+        }
+
+        void wait_for(StagingBuffer& b)
+        {
+            while (b.in_flight)
+            {
+                reap();
+                if (!b.in_flight)
+                {
+                    break;
+                }
+                if (uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                {
+                    abandon_ring(b);
+                }
+            }
+        }
+
+        void commit()
+        {
+            StagingBuffer& b = buf[active];
+            if (!healthy || (b.used == 0 && b.max_seq <= durable_seq))
+            {
+                return;
+            }
+
+            // at most one buffer with the kernel, so a completed sync covers every earlier byte
+            StagingBuffer& other = buf[active ^ 1];
+            if (use_ring)
+            {
+                wait_for(other);
+            }
+
+            // records that wrote nothing are durable once everything before them is
+            if (b.used == 0)
+            {
+                durable_seq = std::max(durable_seq, b.max_seq);
+                return;
+            }
+
+            b.file_off = file_off;
+            file_off += b.used;
+
+            if (!use_ring)
+            {
+                finish_by_hand(b);
+                complete(b);
+                return;
+            }
+
+            const std::uint64_t tag = static_cast<std::uint64_t>(active) << 1;
+
+            io_uring_sqe* w = ring.next_sqe();
+            w->opcode = IORING_OP_WRITE;
+            w->flags = IOSQE_IO_LINK;
+            w->fd = fd;
+            w->addr = reinterpret_cast<std::uint64_t>(b.data);
+            w->len = static_cast<std::uint32_t>(b.used);
+            w->off = b.file_off;
+            w->user_data = tag;
+
+            io_uring_sqe* s = ring.next_sqe();
+            s->opcode = IORING_OP_FSYNC;
+            s->fd = fd;
+            s->fsync_flags = IORING_FSYNC_DATASYNC;
+            s->user_data = tag | 1;
+
+            b.in_flight = true;
+            ++syncs;
+
+            const int submitted = uring_enter(ring.fd, 2, 0, 0);
+            b.pending = (submitted > 0) ? static_cast<unsigned>(submitted) : 0;
+            if (submitted != 2)
+            {
+                // the write alone may be with the kernel, its sync never went
+                --syncs;
+                abandon_ring(b);
+            }
+
+            active ^= 1;
+        }
+
+        void append(const char* data, std::size_t size, std::uint64_t seq)
+        {
+            if (size == 0)
+            {
+                buf[active].max_seq = seq;
+                return;
+            }
+
+            while (size > 0 && healthy)
+            {
+                StagingBuffer& b = buf[active];
+                const std::size_t take = std::min(size, opts.buffer_bytes - b.used);
+                std::memcpy(b.data + b.used, data, take);
+                b.used += take;
+                data += take;
+                size -= take;
+
+                if (size == 0)
+                {
+                    b.max_seq = seq;
+                }
+                if (b.used == opts.buffer_bytes || (size == 0 && b.used >= opts.group_bytes))
+                {
+                    commit();
+                }
+            }
+        }
+    };
+
+    Journal::Journal() = default;
+
+    Journal::~Journal()
+    {
+        close();
+    }
+
+    bool Journal::open(const std::string& path, const JournalOptions& opts)
+    {
+        close();
+
+        auto st = std::make_unique<State>();
+        st->opts = opts;
+        st->opts.buffer_bytes = std::max<std::size_t>(kPage, (opts.buffer_bytes + kPage - 1) / kPage * kPage);
+        st->opts.group_bytes = std::min(std::max<std::size_t>(1, opts.group_bytes), st->opts.buffer_bytes);
+
+        const int trunc = opts.resume_at.has_value() ? 0 : O_TRUNC;
+        st->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | trunc | O_CLOEXEC, 0644);
+        if (st->fd < 0)
+        {
+            return false;
+        }
+
+        // the kept prefix is synced so it counts as durable before anything new lands behind it
+        if (opts.resume_at.has_value())
+        {
+            if (::ftruncate(st->fd, static_cast<off_t>(*opts.resume_at)) != 0 || ::fdatasync(st->fd) != 0)
+            {
+                ::close(st->fd);
+                return false;
+            }
+            st->file_off = *opts.resume_at;
+        }
+        else if (!sync_parent_dir(path))
+        {
+            // without the directory entry on disk fdatasync on the file promises nothing
+            ::close(st->fd);
+            return false;
+        }
+
+        for (auto& b : st->buf)
+        {
+            b.data = static_cast<char*>(std::aligned_alloc(kPage, st->opts.buffer_bytes));
+            if (b.data == nullptr)
+            {
+                state_ = std::move(st);
+                close();
+                return false;
+            }
+        }
+
+        // a kernel without io_uring or a sandbox that blocks it just means the pwrite path
+        if (opts.use_io_uring)
+        {
+            st->use_ring = st->ring.setup(8);
+            if (!st->use_ring)
+            {
+                st->ring.teardown();
+            }
+        }
+
+        state_ = std::move(st);
+        return true;
+    }
+
+    void Journal::append(const char* data, std::size_t size, std::uint64_t seq)
+    {
+        if (state_)
+        {
+            state_->append(data, size, seq);
+        }
+    }
+
+    void Journal::commit()
+    {
+        if (state_)
+        {
+            state_->commit();
+        }
+    }
+
+    void Journal::poll()
+    {
+        if (state_ && state_->use_ring)
+        {
+            state_->reap();
+        }
+    }
+
+    void Journal::sync()
+    {
+        if (!state_)
+        {
+            return;
+        }
+        state_->commit();
+        if (state_->use_ring)
+        {
+            state_->wait_for(state_->buf[0]);
+            state_->wait_for(state_->buf[1]);
+        }
+    }
+
+    std::uint64_t Journal::durable_seq() const
+    {
+        return state_ ? state_->durable_seq : 0;
+    }
+
+    std::uint64_t Journal::sync_count() const
+    {
+        return state_ ? state_->syncs : 0;
+    }
+
+    bool Journal::using_io_uring() const
+    {
+        return state_ && state_->use_ring;
+    }
+
+    bool Journal::healthy() const
+    {
+        return state_ && state_->healthy;
+    }
+
+    void Journal::close()
+    {
+        if (!state_)
+        {
+            return;
+        }
+
+        if (state_->fd >= 0)
+        {
+            sync();
+            ::close(state_->fd);
+        }
+        state_->ring.teardown();
+        for (auto& b : state_->buf)
+        {
+            std::free(b.data);
+        }
+        state_.reset();
+    }
+#else
+    // no io_uring or pwrite here, the journal never opens
+    struct Journal::State
+    {
+    };
+
+    Journal::Journal() = default;
+    Journal::~Journal() = default;
+
+    bool Journal::open(const std::string&, const JournalOptions&)
+    {
+        return false;
+    }
+
+    void Journal::append(const char*, std::size_t, std::uint64_t)
+    {
+    }
+
+    void Journal::commit()
+    {
+    }
+
+    void Journal::poll()
+    {
+    }
+
+    void Journal::sync()
+    {
+    }
+
+    std::uint64_t Journal::durable_seq() const
+    {
+        return 0;
+    }
+
+    std::uint64_t Journal::sync_count() const
+    {
+        return 0;
+    }
+
+    bool Journal::using_io_uring() const
+    {
+        return false;
+    }
+
+    bool Journal::healthy() const
+    {
+        return false;
+    }
+
+    void Journal::close()
+    {
+    }
+#endif
+}
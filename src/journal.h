@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace ob
+{
+    struct JournalOptions
+    {
+        // size of each of the two staging buffers, rounded up to whole 4 KiB pages
+        std::size_t buffer_bytes { 1 << 20 };
+
+        // staged bytes that start a group commit without waiting for commit()
+        std::size_t group_bytes { 256 << 10 };
+
+        // io_uring when the kernel allows it, otherwise pwrite and fdatasync
+        bool use_io_uring { true };
+
+        // keep an existing file and continue writing at this offset, anything past it such as a torn tail is cut
+        std::optional<std::uint64_t> resume_at;
+    };
+
+    // append only file writer with group commit and a durability watermark
+    // records are staged in one page aligned buffer while the other is written and synced,
+    // so many records share one fdatasync and the caller only waits when both buffers are busy
+    // linux only, open fails elsewhere
+    class Journal
+    {
+    public:
+        Journal();
+        ~Journal();
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        // truncates path and starts an empty journal, or resumes one when opts.resume_at is set
+        bool open(const std::string& path, const JournalOptions& opts = {});
+
+        // stages bytes belonging to record seq, seqs must not go down
+        void append(const char* data, std::size_t size, std::uint64_t seq);
+
+        // submits everything staged as one write plus fdatasync, returns without waiting
+        void commit();
+
+        // reaps finished syncs and advances the watermark, never blocks
+        void poll();
+
+        // commits and blocks until every appended record is durable
+        void sync();
+
+        // every record with seq at or below this is on disk
+        std::uint64_t durable_seq() const;
+
+        // fdatasync calls issued so far
+        std::uint64_t sync_count() const;
+
+        bool using_io_uring() const;
+
+        // false after any write or sync error, the watermark stops there
+        bool healthy() const;
+
+        // syncs then closes, safe to call twice
+        void close();
+
+    private:
+        struct State;
+        std::unique_ptr<State> state_;
+    };
+}
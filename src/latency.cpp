@@ -0,0 +1,29 @@
+#include "latency.h"
+
+#include <algorithm>
+
+namespace ob
+{
+    void print_latency(std::ostream& out, std::vector<std::uint64_t>& samples)
+    {
+        // nearest rank percentiles over every timed command
+        if (samples.empty())
+        {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        auto pct = [&samples](double p) -> std::uint64_t
+        {
+            const std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1));
+            return samples[rank];
+        };
+
+        out << "latency_ns p50=" << pct(0.50)
+            << " p99=" << pct(0.99)
+            << " p99.9=" << pct(0.999)
+            << " p99.99=" << pct(0.9999)
+            << " max=" << samples.back() << "\n";
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace ob
+{
+    // prints nearest rank p50 p99 p99.9 p99.99 and max in ns on one line, sorts samples in place
+    void print_latency(std::ostream& out, std::vector<std::uint64_t>& samples);
+}
@@ -0,0 +1,210 @@
+#include "latency.h"
+#include "net.h"
+#include "wire.h"
+#include "workload.h"
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void print_usage()
+{
+    std::cout << "usage:\n";
+    std::cout << "  ob_load --unix <path> [--workload <name>] [--size <n>] [--rate <msgs_per_sec>]\n";
+    std::cout << "  ob_load --tcp <port> [--workload <name>] [--size <n>] [--rate <msgs_per_sec>]\n";
+}
+
+int main(int argc, char** argv)
+{
+    ob::Endpoint ep {};
+    std::string workload_name = "match";
+    std::uint64_t size { 100'000 };
+    std::uint64_t rate { 50'000 };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string a = argv[i];
+
+        if ((a == "--unix" || a == "--tcp") && ob::parse_endpoint_arg(argc, argv, i, ep))
+        {
+            continue;
+        }
+        if (a == "--workload" && i + 1 < argc)
+        {
+            workload_name = argv[++i];
+        }
+        else if (a == "--size" && i + 1 < argc)
+        {
+            size = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--rate" && i + 1 < argc)
+        {
+            rate = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if ((ep.unix_path.empty() && ep.tcp_port == 0) || rate == 0)
+    {
+        print_usage();
+        return 1;
+    }
+
+    const auto cmds_opt = ob::make_workload(workload_name, size);
+    if (!cmds_opt.has_value())
+    {
+        std::cerr << "unknown workload name=" << workload_name << "\n";
+        return 31;
+    }
+    const std::vector<ob::Command>& cmds = *cmds_opt;
+
+    const int fd = ob::connect_endpoint(ep);
+    if (fd < 0)
+    {
+        return 3;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    // each command has a slot on a fixed schedule and latency runs from that slot, not from the
+    // moment it was written, so a stalled gateway shows up in the tail instead of slowing the sender
+    const auto interval = std::chrono::nanoseconds(1'000'000'000ULL / rate);
+
+    std::vector<std::uint64_t> samples;
+    samples.reserve(cmds.size());
+
+    std::vector<char> out;
+    std::size_t out_off { 0 };
+    std::vector<char> in;
+
+    std::size_t next { 0 };
+    std::size_t acked { 0 };
+    std::uint64_t events { 0 };
+
+    const auto start = clock::now();
+    auto last_progress = start;
+
+    while (acked < cmds.size())
+    {
+        const auto now = clock::now();
+
+        // send everything whose slot has arrived, a late loop catches up in one write
+        while (next < cmds.size() && start + interval * next <= now)
+        {
+            ob::encode_command(cmds[next], next, out);
+            ++next;
+        }
+
+        if (out_off < out.size())
+        {
+            const ssize_t w = ::write(fd, out.data() + out_off, out.size() - out_off);
+            if (w > 0)
+            {
+                out_off += static_cast<std::size_t>(w);
+            }
+            else if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                std::cerr << "write failed\n";
+                return 4;
+            }
+            if (out_off == out.size())
+            {
+                out.clear();
+                out_off = 0;
+            }
+        }
+
+        // wait for replies but never past the next send slot
+        timespec timeout {};
+        timeout.tv_nsec = 100'000'000;
+        if (next < cmds.size())
+        {
+            const auto until = start + interval * next - clock::now();
+            timeout.tv_nsec = std::max<long>(0, static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(until).count()));
+            timeout.tv_nsec = std::min<long>(timeout.tv_nsec, 999'999'999);
+        }
+
+        pollfd pfd {};
+        pfd.fd = fd;
+        pfd.events = POLLIN | ((out_off < out.size()) ? POLLOUT : 0);
+        ::ppoll(&pfd, 1, &timeout, nullptr);
+
+        char buf[64 * 1024];
+        while (true)
+        {
+            const ssize_t r = ::read(fd, buf, sizeof(buf));
+            if (r > 0)
+            {
+                in.insert(in.end(), buf, buf + r);
+                continue;
+            }
+            if (r == 0)
+            {
+                std::cerr << "gateway closed the session\n";
+                return 5;
+            }
+            break;
+        }
+
+        const auto recv_at = clock::now();
+
+        std::size_t off { 0 };
+        ob::WireMessage msg {};
+        while (off < in.size())
+        {
+            std::size_t used { 0 };
+            const ob::WireStatus st = ob::decode_frame(in.data() + off, in.size() - off, msg, used);
+            if (st == ob::WireStatus::Incomplete)
+            {
+                break;
+            }
+            if (st == ob::WireStatus::Malformed)
+            {
+                std::cerr << "malformed frame from gateway\n";
+                return 6;
+            }
+            off += used;
+
+            if (msg.kind == ob::WireKind::Event)
+            {
+                ++events;
+            }
+            else if (msg.kind == ob::WireKind::Ack && msg.tag < cmds.size())
+            {
+                const auto sent_slot = start + interval * msg.tag;
+                samples.push_back(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(recv_at - sent_slot).count()));
+                ++acked;
+                last_progress = recv_at;
+            }
+        }
+        in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(off));
+
+        if (next == cmds.size() && recv_at - last_progress > std::chrono::seconds(5))
+        {
+            std::cerr << "timed out waiting for acks acked=" << acked << "\n";
+            return 7;
+        }
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+    ::close(fd);
+
+    const double achieved = (elapsed > 0) ? static_cast<double>(cmds.size()) * 1e9 / static_cast<double>(elapsed) : 0.0;
+
+    std::cout << "workload=" << workload_name << " cmds=" << cmds.size() << " events=" << events << "\n";
+    std::cout << "target_rate=" << rate << " achieved_rate=" << static_cast<std::uint64_t>(achieved) << "\n";
+    ob::print_latency(std::cout, samples);
+
+    return 0;
+}
@@ -1,23 +1,94 @@
 #include "engine.h"
 
+#include "arena.h"
+#include "event_hash.h"
 #include "event_io.h"
+#include "latency.h"
 #include "script.h"
+#include "workload.h"
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
+#include <latch>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 static void print_usage()
 {
     std::cout << "usage:\n";
     std::cout << "  ob_sim --script <path>\n";
     std::cout << "  ob_sim --script <path> --record <event_log>\n";
+    std::cout << "  ob_sim --script <path> --hash <sidecar> [--hash-every <n>]\n";
+    std::cout << "  ob_sim --script <path> --state-every <n>\n";
     std::cout << "  ob_sim --replay <path> --events <event_log>\n";
-    std::cout << "  ob_sim --bench <path> --iters <n>\n";
+    std::cout << "  ob_sim --verify-hash <path> --hash <sidecar>\n";
+    std::cout << "  ob_sim --bench <path> --iters <n> [--latency] [--mem] [--arena <mib> | --reserve <orders> [--levels <n>] [--huge-pages] [--mlock]] [--journal <path>] [--wal <path> [--snapshot <path> --snapshot-every <n>]]\n";
+    std::cout << "  ob_sim --workload <name> --size <n> --iters <n> [--latency] [--mem] [--arena <mib> | --reserve <orders> [--levels <n>] [--huge-pages] [--mlock]] [--journal <path>] [--wal <path> [--snapshot <path> --snapshot-every <n>]]\n";
+    std::cout << "  ob_sim --bench <path> | --workload <name> --size <n>, then --iters <n> --threads <n> [--mr per-thread|shared|heap] [--arena <mib>] [--latency]\n";
+    std::cout << "  ob_sim --recover <wal> [--snapshot <path>]\n";
 }
 
+// outputs a plain script run can produce besides stdout
+struct RunOptions
+{
+    std::string record_path;
+
+    // event hash sidecar and its checkpoint interval
+    std::string hash_path;
+    std::uint64_t hash_every { 100'000 };
+
+    // book state checkpoint events every so many commands, zero for none
+    std::uint64_t state_every { 0 };
+};
+
+// where the engines of a threaded bench allocate
+enum class ThreadResource
+{
+    PerThread, // an arena each, built on its own thread
+    Shared,    // one arena behind a lock for every thread
+    Heap       // the default resource, malloc with its own per thread caches
+};
+
+// knobs shared by the script and workload benches
+struct BenchOptions
+{
+    std::uint64_t iters { 0 };
+    bool latency { false };
+
+    // report the book footprint at the end of the last run
+    bool mem { false };
+
+    // when set every run journals its events there with group commit
+    std::string journal_path;
+
+    // write ahead command journal, plus a snapshot rewritten every so many commands
+    std::string wal_path;
+    std::string snapshot_path;
+    std::uint64_t snapshot_every { 0 };
+
+    // when non zero every run builds its engine on one arena of this many MiB, reset between runs
+    std::size_t arena_mib { 0 };
+
+    // when set every run builds a capacity engine, reserved and prefaulted before its first command
+    bool reserve { false };
+    ob::CapacityOptions capacity {};
+
+    // when non zero that many engines run the commands at once, one per pinned thread
+    std::size_t threads { 0 };
+    ThreadResource thread_resource { ThreadResource::PerThread };
+};
+
 static std::string chomp_cr(std::string s)
 {
     // strips windows carriage return if present
@@ -49,7 +120,7 @@ static bool read_all_lines(const std::string& path, std::vector<std::string>& ou
     return true;
 }
 
-static int run_script(const std::string& script_path, const std::string& record_path)
+static int run_script(const std::string& script_path, const RunOptions& opt)
 {
     const auto cmds_opt = ob::load_script(script_path);
     if (!cmds_opt.has_value())
@@ -60,14 +131,19 @@ static int run_script(const std::string& script_path, const std::string& record_
 
     ob::Engine eng;
 
-    if (!record_path.empty())
+    if (!opt.record_path.empty())
     {
-        if (!eng.start_event_log(record_path))
+        if (!eng.start_event_log(opt.record_path))
         {
             std::cerr << "failed to open event log\n";
             return 11;
         }
     }
+    if (!opt.hash_path.empty())
+    {
+        eng.start_event_hash(opt.hash_every);
+    }
+    eng.set_state_checkpoints(opt.state_every);
 
     for (const auto& cmd : *cmds_opt)
     {
@@ -79,9 +155,103 @@ static int run_script(const std::string& script_path, const std::string& record_
     }
 
     eng.stop_event_log();
+
+    if (!opt.hash_path.empty())
+    {
+        eng.checkpoint_event_hash();
+        if (!ob::write_hash_checkpoints(opt.hash_path, opt.hash_every, opt.state_every, eng.hash_checkpoints()))
+        {
+            std::cerr << "failed to write hash sidecar\n";
+            return 13;
+        }
+    }
     return 0;
 }
 
+static int verify_hash(const std::string& script_path, const std::string& hash_path)
+{
+    const auto cmds_opt = ob::load_script(script_path);
+    if (!cmds_opt.has_value())
+    {
+        std::cerr << "failed to load script\n";
+        return 10;
+    }
+
+    std::uint64_t every { 0 };
+    std::uint64_t state_every { 0 };
+    std::vector<ob::HashCheckpoint> expected;
+    if (!ob::read_hash_checkpoints(hash_path, every, state_every, expected) || every == 0)
+    {
+        std::cerr << "failed to read hash sidecar\n";
+        return 14;
+    }
+
+    // checkpoints are compared as the rerun makes them and the rerun stops at the first that disagrees,
+    // everything before it matched so its interval holds the first divergent command
+    ob::Engine eng;
+    eng.start_event_hash(every);
+    eng.set_state_checkpoints(state_every);
+
+    std::size_t k = 0;
+    auto agrees = [&]()
+    {
+        const auto& actual = eng.hash_checkpoints();
+        for (; k < actual.size(); ++k)
+        {
+            if (k >= expected.size() || !ob::same_checkpoint(expected[k], actual[k]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool ok = true;
+    for (const auto& cmd : *cmds_opt)
+    {
+        eng.apply(cmd);
+        if (!agrees())
+        {
+            ok = false;
+            break;
+        }
+    }
+    if (ok)
+    {
+        eng.checkpoint_event_hash();
+        ok = agrees() && k == expected.size();
+    }
+    if (ok)
+    {
+        std::cout << "hash ok checkpoints=" << k << " events=" << eng.hash_checkpoints().back().events << "\n";
+        return 0;
+    }
+
+    const auto& actual = eng.hash_checkpoints();
+    const std::uint64_t after = (k > 0) ? expected[k - 1].command : 0;
+    std::cerr << "hash mismatch at checkpoint " << k;
+    if (k < expected.size() && k < actual.size())
+    {
+        const std::uint64_t cmd = ob::first_divergent_command(expected[k], actual[k]);
+        if (cmd != 0)
+        {
+            std::cerr << ", first divergent command is " << cmd << "\n";
+        }
+        else
+        {
+            std::cerr << ", first divergent command is in " << (after + 1) << ".." << expected[k].command << "\n";
+        }
+        std::cerr << "expected: cmd=" << expected[k].command << " events=" << expected[k].events << " hash=" << std::hex << expected[k].hash << std::dec << "\n";
+        std::cerr << "actual:   cmd=" << actual[k].command << " events=" << actual[k].events << " hash=" << std::hex << actual[k].hash << std::dec << "\n";
+    }
+    else
+    {
+        // one run has checkpoints past the other's last, the first command only one of them ran
+        std::cerr << ", first divergent command is " << (after + 1) << "\n";
+    }
+    return 22;
+}
+
 static int replay_script(const std::string& script_path, const std::string& events_path)
 {
     const auto cmds_opt = ob::load_script(script_path);
@@ -149,52 +319,425 @@ static int replay_script(const std::string& script_path, const std::string& even
     return 0;
 }
 
-static int bench_script(const std::string& script_path, std::uint64_t iters)
+// what one bench thread measured
+struct ThreadResult
 {
-    // benches apply_all using the same command list each run
-    const auto cmds_opt = ob::load_script(script_path);
-    if (!cmds_opt.has_value())
+    int cpu { -1 };
+    std::uint64_t events { 0 };
+    std::int64_t ns { 0 };
+    std::vector<std::uint64_t> samples;
+};
+
+// pins the calling thread to one cpu, -1 when pinning is unsupported or refused
+static int pin_thread(std::size_t index)
+{
+#if defined(__linux__)
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    const int cpu = static_cast<int>(index % cpus);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0) ? cpu : -1;
+#else
+    (void)index;
+    return -1;
+#endif
+}
+
+static const char* thread_resource_to_string(ThreadResource r)
+{
+    switch (r)
     {
-        std::cerr << "failed to load script\n";
-        return 10;
+    case ThreadResource::PerThread:
+        return "per-thread";
+    case ThreadResource::Shared:
+        return "shared";
+    case ThreadResource::Heap:
+        return "heap";
+    }
+    return "per-thread";
+}
+
+// independent engines on pinned threads, all released together so they contend for the whole run
+// arenas are never reset here, a finished engine's nodes go back on the arena free lists for the next
+static int bench_threads(const std::vector<ob::Command>& cmds, const BenchOptions& opt)
+{
+    if (opt.reserve || opt.mem || !opt.journal_path.empty() || !opt.wal_path.empty())
+    {
+        std::cerr << "--threads runs in memory engines only, drop --reserve, --mem, --journal and --wal\n";
+        return 37;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    const std::size_t arena_bytes = ((opt.arena_mib > 0) ? opt.arena_mib : 64) << 20;
+    const std::size_t n = opt.threads;
+
+    // the shared arena is built and touched by the main thread, which also only waits at the gate
+    std::unique_ptr<ob::Arena> shared_arena;
+    std::unique_ptr<ob::LockedResource> shared;
+    if (opt.thread_resource == ThreadResource::Shared)
+    {
+        shared_arena = std::make_unique<ob::Arena>(arena_bytes, ob::ArenaOptions { true, false, false });
+        shared = std::make_unique<ob::LockedResource>(shared_arena->resource());
+    }
+
+    std::vector<ThreadResult> results(n);
+    std::latch ready(static_cast<std::ptrdiff_t>(n + 1));
+    std::latch go(1);
+
+    auto body = [&](std::size_t t)
+    {
+        ThreadResult& r = results[t];
+        r.cpu = pin_thread(t);
+
+        // a per thread arena is built after pinning so its pages land near the cpu that uses them
+        std::unique_ptr<ob::Arena> own;
+        std::pmr::memory_resource* mr = std::pmr::get_default_resource();
+        if (opt.thread_resource == ThreadResource::PerThread)
+        {
+            own = std::make_unique<ob::Arena>(arena_bytes, ob::ArenaOptions { true, false, false });
+            mr = own->resource();
+        }
+        else if (opt.thread_resource == ThreadResource::Shared)
+        {
+            mr = shared.get();
+        }
+
+        if (opt.latency)
+        {
+            r.samples.reserve(cmds.size() * opt.iters);
+        }
+
+        ready.count_down();
+        go.wait();
+
+        const auto t0 = clock::now();
+        for (std::uint64_t i = 0; i < opt.iters; ++i)
+        {
+            ob::Engine eng(mr);
+            if (opt.latency)
+            {
+                for (const auto& c : cmds)
+                {
+                    const auto c0 = clock::now();
+                    const auto events = eng.apply(c);
+                    const auto c1 = clock::now();
+                    r.samples.push_back(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(c1 - c0).count()));
+                    r.events += static_cast<std::uint64_t>(events.size());
+                }
+            }
+            else
+            {
+                r.events += static_cast<std::uint64_t>(eng.apply_all(cmds).size());
+            }
+        }
+        r.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(n);
+    for (std::size_t t = 0; t < n; ++t)
+    {
+        pool.emplace_back(body, t);
+    }
+
+    ready.arrive_and_wait();
+    const auto t0 = clock::now();
+    go.count_down();
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+    const auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+
+    const std::uint64_t per_thread_cmds = static_cast<std::uint64_t>(cmds.size()) * opt.iters;
+    auto rate = [](std::uint64_t count, std::int64_t ns) { return (ns > 0) ? static_cast<std::uint64_t>(static_cast<double>(count) * 1e9 / static_cast<double>(ns)) : 0; };
+
+    std::cout << "bench threads=" << n << " mr=" << thread_resource_to_string(opt.thread_resource) << " iters=" << opt.iters
+              << " cpus=" << std::thread::hardware_concurrency() << "\n";
+
+    std::uint64_t total_events { 0 };
+    std::vector<std::uint64_t> all_samples;
+    for (std::size_t t = 0; t < n; ++t)
+    {
+        ThreadResult& r = results[t];
+        total_events += r.events;
+        std::cout << "thread=" << t << " cpu=" << r.cpu << " cmds_per_sec=" << rate(per_thread_cmds, r.ns)
+                  << " per_cmd_ns=" << ((per_thread_cmds > 0) ? static_cast<std::uint64_t>(r.ns) / per_thread_cmds : 0) << " events=" << r.events << "\n";
+        if (opt.latency)
+        {
+            all_samples.insert(all_samples.end(), r.samples.begin(), r.samples.end());
+            std::cout << "thread=" << t << " ";
+            ob::print_latency(std::cout, r.samples);
+        }
     }
 
+    // the aggregate rate is every command over the wall time until the last thread finished
+    std::cout << "aggregate cmds_per_sec=" << rate(per_thread_cmds * n, wall_ns) << " wall_ns=" << wall_ns << " events=" << total_events << "\n";
+    if (opt.latency)
+    {
+        std::cout << "aggregate ";
+        ob::print_latency(std::cout, all_samples);
+    }
+    return 0;
+}
+
+static int bench_commands(const std::vector<ob::Command>& cmds, const BenchOptions& opt)
+{
+    const std::uint64_t iters = opt.iters;
+    const bool latency = opt.latency;
+
+    // benches apply_all using the same command list each run
     if (iters == 0)
     {
         std::cerr << "iters must be > 0\n";
         return 30;
     }
+    if (opt.threads > 0)
+    {
+        return bench_threads(cmds, opt);
+    }
+    if (opt.reserve && opt.arena_mib > 0)
+    {
+        std::cerr << "--reserve builds its own arena, drop --arena\n";
+        return 36;
+    }
 
     using clock = std::chrono::high_resolution_clock;
 
     std::uint64_t total_events { 0 };
+    std::uint64_t total_syncs { 0 };
+    bool journal_uring = false;
+    std::uint64_t total_snapshots { 0 };
+    ob::MemoryUsage mem {};
+    std::size_t mem_live { 0 };
+
+    // how the last capacity engine's arena came out
+    struct
+    {
+        std::size_t bytes { 0 };
+        ob::ArenaPages pages { ob::ArenaPages::Heap };
+        bool locked { false };
+        std::size_t overflow_chunks { 0 };
+    } reserved;
+    const bool snapshots = !opt.snapshot_path.empty() && opt.snapshot_every > 0;
+
+    // per command timing adds clock reads so it is opt in
+    std::vector<std::uint64_t> samples;
+    if (latency)
+    {
+        samples.reserve(cmds.size() * iters);
+    }
+
+    // the arena buffer is allocated before the clock starts, engine construction and teardown are timed
+    std::unique_ptr<ob::Arena> arena;
+    if (opt.arena_mib > 0)
+    {
+        arena = std::make_unique<ob::Arena>(opt.arena_mib << 20);
+    }
+    std::pmr::memory_resource* mr = arena ? arena->resource() : std::pmr::get_default_resource();
 
     const auto t0 = clock::now();
     for (std::uint64_t i = 0; i < iters; ++i)
     {
-        ob::Engine eng;
+        // the previous run's engine is gone by now so its nodes can be dropped in one go
+        if (arena)
+        {
+            arena->reset();
+        }
 
-        const auto events = eng.apply_all(*cmds_opt);
-        total_events += static_cast<std::uint64_t>(events.size());
+        std::optional<ob::Engine> slot;
+        if (opt.reserve)
+        {
+            slot.emplace(opt.capacity);
+        }
+        else
+        {
+            slot.emplace(mr);
+        }
+        ob::Engine& eng = *slot;
+        if (!opt.journal_path.empty() && !eng.start_journal(opt.journal_path))
+        {
+            std::cerr << "failed to open journal\n";
+            return 32;
+        }
+        if (!opt.wal_path.empty() && !eng.start_command_journal(opt.wal_path))
+        {
+            std::cerr << "failed to open command journal\n";
+            return 34;
+        }
+
+        if (latency || snapshots)
+        {
+            std::uint64_t n { 0 };
+            for (const auto& c : cmds)
+            {
+                const auto c0 = clock::now();
+                const auto events = eng.apply(c);
+                const auto c1 = clock::now();
+
+                if (latency)
+                {
+                    samples.push_back(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(c1 - c0).count()));
+                }
+                total_events += static_cast<std::uint64_t>(events.size());
+
+                // snapshot time lands outside the per command samples
+                if (snapshots && ++n % opt.snapshot_every == 0)
+                {
+                    if (!eng.save_snapshot(opt.snapshot_path))
+                    {
+                        std::cerr << "failed to write snapshot\n";
+                        return 35;
+                    }
+                    ++total_snapshots;
+                }
+            }
+        }
+        else
+        {
+            const auto events = eng.apply_all(cmds);
+            total_events += static_cast<std::uint64_t>(events.size());
+        }
+
+        // the run only counts once every command is on disk
+        if (eng.journal() != nullptr)
+        {
+            eng.sync_journal();
+            if (eng.journal_durable_seq() != cmds.size())
+            {
+                std::cerr << "journal not durable durable_seq=" << eng.journal_durable_seq() << "\n";
+                return 33;
+            }
+            total_syncs += eng.journal()->sync_count();
+            journal_uring = eng.journal()->using_io_uring();
+        }
+        eng.sync_command_journal();
+
+        if (eng.arena() != nullptr && i + 1 == iters)
+        {
+            reserved.bytes = eng.arena()->reserved_bytes();
+            reserved.pages = eng.arena()->pages();
+            reserved.locked = eng.arena()->locked();
+            reserved.overflow_chunks = eng.arena()->overflow_chunks();
+        }
+
+        if (opt.mem && i + 1 == iters)
+        {
+            mem = eng.book().memory_usage();
+            mem_live = eng.book().live_order_count();
+        }
     }
     const auto t1 = clock::now();
 
     const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
 
+    const std::uint64_t total_cmds = static_cast<std::uint64_t>(cmds.size()) * iters;
+
     const double per_iter_ns = static_cast<double>(ns) / static_cast<double>(iters);
     const double per_event_ns = (total_events > 0) ? (static_cast<double>(ns) / static_cast<double>(total_events)) : 0.0;
+    const double per_cmd_ns = (total_cmds > 0) ? (static_cast<double>(ns) / static_cast<double>(total_cmds)) : 0.0;
 
     std::cout << "bench iters=" << iters << " total_ns=" << ns << "\n";
     std::cout << "per_iter_ns=" << static_cast<std::uint64_t>(per_iter_ns) << "\n";
     std::cout << "per_event_ns=" << static_cast<std::uint64_t>(per_event_ns) << "\n";
+    std::cout << "per_cmd_ns=" << static_cast<std::uint64_t>(per_cmd_ns) << "\n";
+
+    if (arena)
+    {
+        std::cout << "arena initial_mib=" << opt.arena_mib << "\n";
+    }
+    if (reserved.bytes > 0)
+    {
+        std::cout << "reserve bytes=" << reserved.bytes << " pages=" << ob::arena_pages_to_string(reserved.pages)
+                  << " locked=" << (reserved.locked ? 1 : 0) << " overflow_chunks=" << reserved.overflow_chunks << "\n";
+    }
+
+    if (!opt.journal_path.empty())
+    {
+        std::cout << "journal=" << (journal_uring ? "io_uring" : "pwrite") << " syncs=" << total_syncs
+                  << " cmds_per_sync=" << ((total_syncs > 0) ? total_cmds / total_syncs : 0) << "\n";
+    }
+
+    if (opt.mem)
+    {
+        const std::size_t live = mem_live;
+        std::cout << "mem orders=" << mem.orders << " levels=" << mem.levels << " index=" << mem.index << " stops=" << mem.stops
+                  << " other=" << mem.other << " slack=" << mem.slack << " total=" << mem.total() << "\n";
+        std::cout << "mem live_orders=" << live << " bytes_per_order=" << ((live > 0) ? mem.total() / live : 0) << "\n";
+        std::cout << "mem peak_live_orders=" << mem.peak_live_orders << " peak_levels=" << mem.peak_levels << " peak_bytes=" << mem.peak_bytes
+                  << " peak_bytes_per_order=" << ((mem.peak_live_orders > 0) ? mem.peak_bytes / mem.peak_live_orders : 0) << "\n";
+    }
+
+    if (!opt.wal_path.empty())
+    {
+        std::cout << "wal=" << opt.wal_path << " snapshots=" << total_snapshots << "\n";
+    }
+
+    ob::print_latency(std::cout, samples);
 
     return 0;
 }
 
+static int recover_engine(const std::string& wal_path, const std::string& snapshot_path)
+{
+    using clock = std::chrono::steady_clock;
+
+    ob::Engine eng;
+    ob::RecoveryResult res {};
+
+    const auto t0 = clock::now();
+    const bool ok = eng.recover(snapshot_path, wal_path, res);
+    const auto t1 = clock::now();
+
+    if (!ok)
+    {
+        std::cerr << "recovery failed\n";
+        return 40;
+    }
+
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    const double per_cmd_ns = (res.replayed > 0) ? static_cast<double>(ns) / static_cast<double>(res.replayed) : 0.0;
+
+    std::cout << "recovered snapshot_seq=" << res.snapshot_seq << " replayed=" << res.replayed << " last_seq=" << res.last_seq
+              << " valid_bytes=" << res.valid_bytes << " torn=" << (res.torn ? 1 : 0) << "\n";
+    std::cout << "live_orders=" << eng.book().live_order_count() << " pending_stops=" << eng.book().pending_stop_count() << "\n";
+    std::cout << "recovery_ns=" << ns << " per_cmd_ns=" << static_cast<std::uint64_t>(per_cmd_ns) << "\n";
+    return 0;
+}
+
+static int bench_script(const std::string& script_path, const BenchOptions& opt)
+{
+    const auto cmds_opt = ob::load_script(script_path);
+    if (!cmds_opt.has_value())
+    {
+        std::cerr << "failed to load script\n";
+        return 10;
+    }
+
+    return bench_commands(*cmds_opt, opt);
+}
+
+static int bench_workload(const std::string& name, std::uint64_t size, const BenchOptions& opt)
+{
+    // synthetic streams cover flows that are too big to keep as scripts
+    const auto cmds_opt = ob::make_workload(name, size);
+    if (!cmds_opt.has_value())
+    {
+        std::cerr << "unknown workload name=" << name << "\n";
+        return 31;
+    }
+
+    std::cout << "workload=" << name << " cmds=" << cmds_opt->size() << "\n";
+    return bench_commands(*cmds_opt, opt);
+}
+
 int main(int argc, char** argv)
 {
     std::string script_path;
-    std::string record_path;
+    RunOptions run_opt {};
+    std::string verify_hash_script_path;
 
     bool replay = false;
     std::string replay_script_path;
@@ -202,7 +745,12 @@ int main(int argc, char** argv)
 
     bool bench = false;
     std::string bench_script_path;
-    std::uint64_t bench_iters { 0 };
+    BenchOptions bench_opt {};
+
+    std::string recover_wal_path;
+
+    std::string workload_name;
+    std::uint64_t workload_size { 100'000 };
 
     for (int i = 1; i < argc; ++i)
     {
@@ -214,7 +762,23 @@ int main(int argc, char** argv)
         }
         else if (a == "--record" && i + 1 < argc)
         {
-            record_path = argv[++i];
+            run_opt.record_path = argv[++i];
+        }
+        else if (a == "--hash" && i + 1 < argc)
+        {
+            run_opt.hash_path = argv[++i];
+        }
+        else if (a == "--hash-every" && i + 1 < argc)
+        {
+            run_opt.hash_every = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--state-every" && i + 1 < argc)
+        {
+            run_opt.state_every = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--verify-hash" && i + 1 < argc)
+        {
+            verify_hash_script_path = argv[++i];
         }
         else if (a == "--replay" && i + 1 < argc)
         {
@@ -232,7 +796,83 @@ int main(int argc, char** argv)
         }
         else if (a == "--iters" && i + 1 < argc)
         {
-            bench_iters = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+            bench_opt.iters = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--latency")
+        {
+            bench_opt.latency = true;
+        }
+        else if (a == "--mem")
+        {
+            bench_opt.mem = true;
+        }
+        else if (a == "--reserve" && i + 1 < argc)
+        {
+            bench_opt.reserve = true;
+            bench_opt.capacity.max_live_orders = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--levels" && i + 1 < argc)
+        {
+            bench_opt.capacity.expected_levels = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--huge-pages")
+        {
+            bench_opt.capacity.arena.huge_pages = true;
+        }
+        else if (a == "--mlock")
+        {
+            bench_opt.capacity.arena.lock = true;
+        }
+        else if (a == "--arena" && i + 1 < argc)
+        {
+            bench_opt.arena_mib = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--journal" && i + 1 < argc)
+        {
+            bench_opt.journal_path = argv[++i];
+        }
+        else if (a == "--threads" && i + 1 < argc)
+        {
+            bench_opt.threads = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--mr" && i + 1 < argc && std::string(argv[i + 1]) == "per-thread")
+        {
+            bench_opt.thread_resource = ThreadResource::PerThread;
+            ++i;
+        }
+        else if (a == "--mr" && i + 1 < argc && std::string(argv[i + 1]) == "shared")
+        {
+            bench_opt.thread_resource = ThreadResource::Shared;
+            ++i;
+        }
+        else if (a == "--mr" && i + 1 < argc && std::string(argv[i + 1]) == "heap")
+        {
+            bench_opt.thread_resource = ThreadResource::Heap;
+            ++i;
+        }
+        else if (a == "--wal" && i + 1 < argc)
+        {
+            bench_opt.wal_path = argv[++i];
+        }
+        else if (a == "--snapshot" && i + 1 < argc)
+        {
+            bench_opt.snapshot_path = argv[++i];
+        }
+        else if (a == "--snapshot-every" && i + 1 < argc)
+        {
+            bench_opt.snapshot_every = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--recover" && i + 1 < argc)
+        {
+            recover_wal_path = argv[++i];
+        }
+        else if (a == "--workload" && i + 1 < argc)
+        {
+            workload_name = argv[++i];
+        }
+        else if (a == "--size" && i + 1 < argc)
+        {
+            workload_size = static_cast<std::uint64_t>(std::stoull(argv[++i]));
         }
         else
         {
@@ -241,14 +881,39 @@ int main(int argc, char** argv)
         }
     }
 
+    if (!verify_hash_script_path.empty())
+    {
+        if (run_opt.hash_path.empty())
+        {
+            print_usage();
+            return 1;
+        }
+        return verify_hash(verify_hash_script_path, run_opt.hash_path);
+    }
+
+    if (!recover_wal_path.empty())
+    {
+        return recover_engine(recover_wal_path, bench_opt.snapshot_path);
+    }
+
+    if (!workload_name.empty())
+    {
+        if (bench_opt.iters == 0)
+        {
+            print_usage();
+            return 1;
+        }
+        return bench_workload(workload_name, workload_size, bench_opt);
+    }
+
     if (bench)
     {
-        if (bench_script_path.empty() || bench_iters == 0)
+        if (bench_script_path.empty() || bench_opt.iters == 0)
         {
             print_usage();
             return 1;
         }
-        return bench_script(bench_script_path, bench_iters);
+        return bench_script(bench_script_path, bench_opt);
     }
 
     if (replay)
@@ -267,5 +932,10 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    return run_script(script_path, record_path);
+    if (run_opt.hash_every == 0)
+    {
+        print_usage();
+        return 1;
+    }
+    return run_script(script_path, run_opt);
 }
@@ -0,0 +1,173 @@
+#include "md_ring.h"
+
+#include <cassert>
+#include <new>
+
+namespace ob
+{
+    static constexpr std::uint64_t kMdMagic = 0x6f625f6d645f7631ULL; // "ob_md_v1"
+
+    // slots start on the first cache line after the header
+    static constexpr std::size_t kMdSlotsOffset = (sizeof(MdRingHeader) + 63) / 64 * 64;
+
+    MdRecord md_record_from_event(const Event& e)
+    {
+        MdRecord r {};
+        r.kind = MdKind::Event;
+        r.type = e.type;
+        r.side = e.side;
+
+        if (e.type == EventType::Trade)
+        {
+            r.id = e.maker_id;
+            r.other_id = e.taker_id;
+            r.price_ticks = e.trade_price_ticks;
+            r.qty = e.trade_qty;
+        }
+        else if (e.type == EventType::StateCheckpoint)
+        {
+            // the hash rides in other_id, records carry no seq
+            r.id = e.id;
+            r.other_id = e.seq;
+            r.qty = e.qty;
+        }
+        else
+        {
+            r.id = e.id;
+            r.price_ticks = e.price_ticks;
+            r.qty = e.qty;
+            r.aux = e.remaining_qty;
+        }
+
+        return r;
+    }
+
+    std::size_t md_ring_bytes(std::size_t slot_count)
+    {
+        return kMdSlotsOffset + slot_count * sizeof(MdSlot);
+    }
+
+    MdWriter::MdWriter(void* region, std::size_t slot_count)
+    {
+        assert(slot_count != 0 && (slot_count & (slot_count - 1)) == 0);
+
+        auto* base = static_cast<unsigned char*>(region);
+        header_ = new (base) MdRingHeader {};
+        slots_ = reinterpret_cast<MdSlot*>(base + kMdSlotsOffset);
+        for (std::size_t i = 0; i < slot_count; ++i)
+        {
+            new (&slots_[i]) MdSlot {};
+        }
+
+        mask_ = slot_count - 1;
+        header_->slot_count = slot_count;
+
+        // magic last so a reader never attaches to a half formatted ring
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = kMdMagic;
+    }
+
+    void MdWriter::publish(const MdRecord& r)
+    {
+        MdSlot& slot = slots_[next_ & mask_];
+
+        // odd marks the slot busy, the fence keeps the payload stores after it
+        slot.seq.store(2 * next_ - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const std::uint64_t w0 = static_cast<std::uint64_t>(r.kind)
+            | (static_cast<std::uint64_t>(r.type) << 8)
+            | (static_cast<std::uint64_t>(r.side) << 16);
+
+        slot.words[0].store(w0, std::memory_order_relaxed);
+        slot.words[1].store(r.id, std::memory_order_relaxed);
+        slot.words[2].store(static_cast<std::uint64_t>(r.price_ticks), std::memory_order_relaxed);
+        slot.words[3].store(static_cast<std::uint64_t>(r.qty), std::memory_order_relaxed);
+        slot.words[4].store(static_cast<std::uint64_t>(r.aux), std::memory_order_relaxed);
+        slot.words[5].store(r.other_id, std::memory_order_relaxed);
+        slot.words[6].store(r.publish_ns, std::memory_order_relaxed);
+
+        slot.seq.store(2 * next_, std::memory_order_release);
+        header_->published.store(next_, std::memory_order_release);
+        ++next_;
+    }
+
+    std::uint64_t MdWriter::published() const
+    {
+        return next_ - 1;
+    }
+
+    MdReader::MdReader(const void* region)
+    {
+        const auto* base = static_cast<const unsigned char*>(region);
+        header_ = reinterpret_cast<const MdRingHeader*>(base);
+        if (header_->magic != kMdMagic)
+        {
+            header_ = nullptr;
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        slots_ = reinterpret_cast<const MdSlot*>(base + kMdSlotsOffset);
+        mask_ = header_->slot_count - 1;
+        next_ = header_->published.load(std::memory_order_acquire) + 1;
+    }
+
+    bool MdReader::valid() const
+    {
+        return header_ != nullptr;
+    }
+
+    MdReadStatus MdReader::next(MdRecord& out, std::uint64_t& lost)
+    {
+        lost = 0;
+
+        while (true)
+        {
+            const MdSlot& slot = slots_[next_ & mask_];
+            const std::uint64_t want = 2 * next_;
+
+            const std::uint64_t s1 = slot.seq.load(std::memory_order_acquire);
+            if (s1 + 1 < want)
+            {
+                // slot still holds the previous lap, record next_ is not out yet
+                return MdReadStatus::Empty;
+            }
+            if (s1 + 1 == want)
+            {
+                // writer is inside this slot, it never blocks so the spin is short
+                continue;
+            }
+
+            if (s1 == want)
+            {
+                const std::uint64_t w0 = slot.words[0].load(std::memory_order_relaxed);
+                out.id = slot.words[1].load(std::memory_order_relaxed);
+                out.price_ticks = static_cast<PriceTicks>(slot.words[2].load(std::memory_order_relaxed));
+                out.qty = static_cast<Qty>(slot.words[3].load(std::memory_order_relaxed));
+                out.aux = static_cast<Qty>(slot.words[4].load(std::memory_order_relaxed));
+                out.other_id = slot.words[5].load(std::memory_order_relaxed);
+                out.publish_ns = slot.words[6].load(std::memory_order_relaxed);
+
+                // the copy only counts if the slot was not rewritten underneath it
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) == s1)
+                {
+                    out.kind = static_cast<MdKind>(w0 & 0xff);
+                    out.type = static_cast<EventType>((w0 >> 8) & 0xff);
+                    out.side = static_cast<Side>((w0 >> 16) & 0xff);
+                    out.seq = next_;
+                    ++next_;
+                    return MdReadStatus::Ok;
+                }
+            }
+
+            // lapped, skip to the oldest record that is still safely in the ring
+            const std::uint64_t newest = header_->published.load(std::memory_order_acquire);
+            const std::uint64_t resume = newest - mask_ / 2;
+            lost = resume - next_;
+            next_ = resume;
+            return MdReadStatus::Overrun;
+        }
+    }
+}
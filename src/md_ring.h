@@ -0,0 +1,103 @@
+#pragma once
+
+#include "event.h"
+#include "order.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ob
+{
+    // market data record kinds
+    enum class MdKind : std::uint8_t
+    {
+        Event = 1, // one engine event, trades carry maker in id and taker in other_id
+        Level = 2  // qty now resting at one price on one side, zero means the level is gone
+    };
+
+    // one record as readers see it
+    struct MdRecord
+    {
+        MdKind kind { MdKind::Event };
+        EventType type { EventType::OrderAccepted };
+        Side side { Side::Buy };
+        OrderId id { 0 };
+        PriceTicks price_ticks { 0 };
+        Qty qty { 0 };
+        Qty aux { 0 }; // remaining qty for events
+        OrderId other_id { 0 };
+        std::uint64_t publish_ns { 0 }; // steady clock at publish, comparable across processes on one host
+
+        // ring sequence, 1 for the first record ever published, set by the reader
+        std::uint64_t seq { 0 };
+    };
+
+    // maps an engine event onto a record
+    MdRecord md_record_from_event(const Event& e);
+
+    // single writer many reader broadcast ring laid out in one shared region
+    // each slot is a seqlock, the writer never waits and a reader that falls a lap behind sees an overrun
+    // the payload is stored as relaxed atomic words so torn reads are detected rather than undefined
+    struct MdRingHeader
+    {
+        std::uint64_t magic { 0 };
+        std::uint64_t slot_count { 0 };
+
+        // records published so far, readers start from here
+        alignas(64) std::atomic<std::uint64_t> published { 0 };
+    };
+
+    struct alignas(64) MdSlot
+    {
+        // 2n - 1 while record n is being written, 2n once it is complete
+        std::atomic<std::uint64_t> seq { 0 };
+        std::atomic<std::uint64_t> words[7];
+    };
+
+    // bytes needed for a ring of slot_count slots, slot_count must be a power of two
+    std::size_t md_ring_bytes(std::size_t slot_count);
+
+    class MdWriter
+    {
+    public:
+        // formats the region as an empty ring
+        MdWriter(void* region, std::size_t slot_count);
+
+        void publish(const MdRecord& r);
+
+        std::uint64_t published() const;
+
+    private:
+        MdRingHeader* header_ { nullptr };
+        MdSlot* slots_ { nullptr };
+        std::uint64_t mask_ { 0 };
+        std::uint64_t next_ { 1 };
+    };
+
+    enum class MdReadStatus
+    {
+        Ok,
+        Empty,   // nothing new yet
+        Overrun  // the writer lapped this reader, lost records were skipped
+    };
+
+    class MdReader
+    {
+    public:
+        // attaches to a ring formatted by a writer and starts at the next record published
+        explicit MdReader(const void* region);
+
+        // false when the region does not hold a ring
+        bool valid() const;
+
+        // reads the next record, on overrun lost is how many were skipped and the reader resumes at the newest
+        MdReadStatus next(MdRecord& out, std::uint64_t& lost);
+
+    private:
+        const MdRingHeader* header_ { nullptr };
+        const MdSlot* slots_ { nullptr };
+        std::uint64_t mask_ { 0 };
+        std::uint64_t next_ { 1 };
+    };
+}
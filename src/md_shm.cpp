@@ -0,0 +1,112 @@
+#include "md_shm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace ob
+{
+    ShmRegion::~ShmRegion()
+    {
+        close();
+    }
+
+    void ShmRegion::close()
+    {
+        if (data_ != nullptr)
+        {
+            ::munmap(data_, size_);
+            data_ = nullptr;
+        }
+        if (owner_)
+        {
+            ::shm_unlink(name_.c_str());
+            owner_ = false;
+        }
+        size_ = 0;
+    }
+
+    bool ShmRegion::create(const std::string& name, std::size_t bytes)
+    {
+        close();
+
+        // a region left by a crashed publisher is replaced, readers reattach by name
+        ::shm_unlink(name.c_str());
+        const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+        {
+            std::cerr << "shm_open failed name=" << name << " " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) < 0)
+        {
+            std::cerr << "ftruncate failed " << std::strerror(errno) << "\n";
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            std::cerr << "mmap failed " << std::strerror(errno) << "\n";
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+
+        data_ = p;
+        size_ = bytes;
+        name_ = name;
+        owner_ = true;
+        return true;
+    }
+
+    bool ShmRegion::open(const std::string& name)
+    {
+        close();
+
+        const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            std::cerr << "shm_open failed name=" << name << " " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) < 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            std::cerr << "mmap failed " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        data_ = p;
+        size_ = static_cast<std::size_t>(st.st_size);
+        name_ = name;
+        return true;
+    }
+
+    void* ShmRegion::data() const
+    {
+        return data_;
+    }
+
+    std::size_t ShmRegion::size() const
+    {
+        return size_;
+    }
+}
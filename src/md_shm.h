@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ob
+{
+    // posix shared memory mapping for the market data ring
+    // the creator owns the name and unlinks it on destruction, readers map it read only
+    class ShmRegion
+    {
+    public:
+        ShmRegion() = default;
+        ~ShmRegion();
+
+        ShmRegion(const ShmRegion&) = delete;
+        ShmRegion& operator=(const ShmRegion&) = delete;
+
+        // creates or replaces name with a zeroed region of bytes
+        bool create(const std::string& name, std::size_t bytes);
+
+        // maps an existing region read only
+        bool open(const std::string& name);
+
+        void* data() const;
+        std::size_t size() const;
+
+    private:
+        void close();
+
+        void* data_ { nullptr };
+        std::size_t size_ { 0 };
+        std::string name_;
+        bool owner_ { false };
+    };
+}
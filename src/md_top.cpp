@@ -0,0 +1,164 @@
+#include "latency.h"
+#include "md_ring.h"
+#include "md_shm.h"
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void on_signal(int)
+{
+    g_stop = 1;
+}
+
+// best price and its qty, zeros when the side is empty
+template <typename Levels>
+static std::pair<ob::PriceTicks, ob::Qty> top_of(const Levels& levels)
+{
+    if (levels.empty())
+    {
+        return { 0, 0 };
+    }
+    return { levels.begin()->first, levels.begin()->second };
+}
+
+static void print_usage()
+{
+    std::cout << "usage:\n";
+    std::cout << "  ob_md_top --shm <name> [--count <n>] [--quiet]\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string shm_name;
+    std::uint64_t count { 0 };
+    bool quiet = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string a = argv[i];
+
+        if (a == "--shm" && i + 1 < argc)
+        {
+            shm_name = argv[++i];
+        }
+        else if (a == "--count" && i + 1 < argc)
+        {
+            count = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--quiet")
+        {
+            quiet = true;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (shm_name.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    ob::ShmRegion region;
+    if (!region.open(shm_name))
+    {
+        return 2;
+    }
+
+    ob::MdReader reader(region.data());
+    if (!reader.valid())
+    {
+        std::cerr << "no market data ring in name=" << shm_name << "\n";
+        return 3;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    // level qty by price, the best of each side is the first key
+    std::map<ob::PriceTicks, ob::Qty, std::greater<ob::PriceTicks>> bids;
+    std::map<ob::PriceTicks, ob::Qty, std::less<ob::PriceTicks>> asks;
+
+    std::vector<std::uint64_t> samples;
+    std::uint64_t records { 0 };
+    std::uint64_t lost_total { 0 };
+
+    ob::MdRecord r {};
+    while (g_stop == 0 && (count == 0 || records < count))
+    {
+        std::uint64_t lost { 0 };
+        const ob::MdReadStatus st = reader.next(r, lost);
+
+        if (st == ob::MdReadStatus::Empty)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (st == ob::MdReadStatus::Overrun)
+        {
+            // levels seen before the gap may be stale, they are corrected as new level records arrive
+            lost_total += lost;
+            std::cerr << "overrun lost=" << lost << "\n";
+            continue;
+        }
+
+        const auto now_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        samples.push_back(now_ns - r.publish_ns);
+        ++records;
+
+        if (r.kind != ob::MdKind::Level)
+        {
+            continue;
+        }
+
+        const auto old_bid = top_of(bids);
+        const auto old_ask = top_of(asks);
+
+        if (r.side == ob::Side::Buy)
+        {
+            if (r.qty == 0)
+            {
+                bids.erase(r.price_ticks);
+            }
+            else
+            {
+                bids[r.price_ticks] = r.qty;
+            }
+        }
+        else
+        {
+            if (r.qty == 0)
+            {
+                asks.erase(r.price_ticks);
+            }
+            else
+            {
+                asks[r.price_ticks] = r.qty;
+            }
+        }
+
+        const auto bid = top_of(bids);
+        const auto ask = top_of(asks);
+
+        if (!quiet && (bid != old_bid || ask != old_ask))
+        {
+            std::cout << "seq=" << r.seq << " bid=" << bid.second << "@" << bid.first << " ask=" << ask.second << "@" << ask.first << "\n";
+        }
+    }
+
+    std::cout << "records=" << records << " lost=" << lost_total << "\n";
+    ob::print_latency(std::cout, samples);
+    return 0;
+}
@@ -0,0 +1,639 @@
+#include "book_commands.h"
+#include "event_hash.h"
+#include "latency.h"
+#include "order_book.h"
+#include "price_bitset.h"
+#include "soa_level.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+static void print_usage()
+{
+    std::cout << "usage:\n";
+    std::cout << "  ob_micro --levels [--depth <n>]\n";
+    std::cout << "  ob_micro --price-index [--count <n>] [--range <ticks>]\n";
+    std::cout << "  ob_micro --policies [--workload <name>] [--size <n>] [--runs <n>]\n";
+    std::cout << "  ob_micro --book-depth [--depth <levels>]\n";
+    std::cout << "  ob_micro --fill-estimate\n";
+    std::cout << "  ob_micro --queue-position [--depth <n>]\n";
+}
+
+using bench_clock = std::chrono::steady_clock;
+
+// keeps results alive so the timed loops are not folded away
+static volatile std::int64_t g_sink = 0;
+
+// ns per call of f over reps calls
+template <typename F>
+static double time_per_call(std::uint64_t reps, F&& f)
+{
+    const auto t0 = bench_clock::now();
+    for (std::uint64_t r = 0; r < reps; ++r)
+    {
+        g_sink = g_sink + static_cast<std::int64_t>(f());
+    }
+    const auto t1 = bench_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) / static_cast<double>(reps);
+}
+
+// one deep level held both ways, list nodes allocated back to back which is the list's best case
+static void bench_level(std::size_t depth)
+{
+    std::list<ob::Order> list;
+    ob::SoaLevel soa;
+
+    std::uint64_t x = 88172645463325252ULL;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        ob::Order o {};
+        o.id = i + 1;
+        o.seq = i + 1;
+        o.qty = 1 + static_cast<ob::Qty>(x % 100);
+        list.push_back(o);
+        soa.push_back(o.id, o.seq, o.qty);
+    }
+
+    // about 50m orders touched per measurement
+    const std::uint64_t reps = std::max<std::uint64_t>(1, 50'000'000 / depth);
+    const ob::Qty target = soa.total_qty() - 1;
+
+    const double list_sum = time_per_call(reps, [&]
+    {
+        ob::Qty s { 0 };
+        for (const auto& o : list)
+        {
+            s += o.qty;
+        }
+        return s;
+    });
+    const double scalar_sum = time_per_call(reps, [&] { return ob::sum_qty_scalar(soa.qty_data(), soa.span()); });
+    const double simd_sum = time_per_call(reps, [&] { return soa.sum(); });
+
+    const double list_fill = time_per_call(reps, [&]
+    {
+        ob::Qty s { 0 };
+        std::size_t i { 0 };
+        for (const auto& o : list)
+        {
+            s += o.qty;
+            if (s >= target)
+            {
+                break;
+            }
+            ++i;
+        }
+        return i;
+    });
+    const double scalar_fill = time_per_call(reps, [&] { return ob::fill_index_scalar(soa.qty_data(), soa.span(), target); });
+    const double simd_fill = time_per_call(reps, [&] { return soa.fill_slot(target); });
+
+    const double d = static_cast<double>(depth);
+    std::cout << "depth=" << depth << " ns_per_order"
+              << " sum list=" << list_sum / d << " soa_scalar=" << scalar_sum / d << " soa_" << ob::qty_kernels() << "=" << simd_sum / d
+              << " fill list=" << list_fill / d << " soa_scalar=" << scalar_fill / d << " soa_" << ob::qty_kernels() << "=" << simd_fill / d
+              << "\n";
+}
+
+// what a level keeps besides its orders, enough to make the payload lookups real
+struct LevelStub
+{
+    ob::Qty total_qty { 0 };
+    std::uint64_t orders { 0 };
+};
+
+static std::uint64_t next_random(std::uint64_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+// count active levels spread over range ticks, held in the book's std::map and in the bitset index
+static void bench_price_index(std::size_t count, ob::PriceTicks range)
+{
+    std::uint64_t x = 0x2545F4914F6CDD1DULL;
+    std::vector<ob::PriceTicks> prices;
+    prices.reserve(count);
+
+    std::map<ob::PriceTicks, LevelStub> tree;
+    ob::SparsePriceMap<LevelStub> sparse(0, range - 1);
+    sparse.reserve(count);
+
+    auto ns_since = [](bench_clock::time_point t0, std::size_t ops)
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t0).count();
+        return static_cast<double>(ns) / static_cast<double>(ops);
+    };
+
+    while (prices.size() < count)
+    {
+        const ob::PriceTicks p = static_cast<ob::PriceTicks>(next_random(x) % static_cast<std::uint64_t>(range));
+        if (tree.emplace(p, LevelStub {}).second)
+        {
+            prices.push_back(p);
+        }
+    }
+
+    auto t0 = bench_clock::now();
+    tree.clear();
+    for (const auto p : prices)
+    {
+        tree[p].orders = 1;
+    }
+    const double tree_insert = ns_since(t0, count);
+
+    t0 = bench_clock::now();
+    for (const auto p : prices)
+    {
+        sparse.get_or_create(p)->orders = 1;
+    }
+    const double sparse_insert = ns_since(t0, count);
+
+    // a sweep finds the first level at or past a random price, then walks the next ones in order
+    constexpr std::size_t kSweeps = 200'000;
+    constexpr int kSweepLevels = 8;
+    std::vector<ob::PriceTicks> starts(kSweeps);
+    for (auto& s : starts)
+    {
+        s = static_cast<ob::PriceTicks>(next_random(x) % static_cast<std::uint64_t>(range));
+    }
+
+    std::uint64_t sink { 0 };
+    t0 = bench_clock::now();
+    for (const auto s : starts)
+    {
+        auto it = tree.lower_bound(s);
+        for (int k = 0; k < kSweepLevels && it != tree.end(); ++k, ++it)
+        {
+            sink += it->second.orders;
+        }
+    }
+    const double tree_sweep = ns_since(t0, kSweeps * kSweepLevels);
+
+    t0 = bench_clock::now();
+    for (const auto s : starts)
+    {
+        auto p = sparse.prices().next_at_or_above(s);
+        for (int k = 0; k < kSweepLevels && p.has_value(); ++k)
+        {
+            sink += sparse.find(*p)->orders;
+            p = sparse.prices().next_at_or_above(*p + 1);
+        }
+    }
+    const double sparse_sweep = ns_since(t0, kSweeps * kSweepLevels);
+
+    // churn: a level empties, another appears, then the best price is read
+    constexpr std::size_t kChurn = 500'000;
+    std::vector<std::pair<ob::PriceTicks, ob::PriceTicks>> churn(kChurn);
+    std::vector<ob::PriceTicks> live = prices;
+    for (auto& c : churn)
+    {
+        const std::size_t i = static_cast<std::size_t>(next_random(x) % live.size());
+        c.first = live[i];
+        do
+        {
+            c.second = static_cast<ob::PriceTicks>(next_random(x) % static_cast<std::uint64_t>(range));
+        } while (tree.count(c.second) != 0);
+        tree.emplace(c.second, LevelStub {});
+        tree.erase(c.first);
+        live[i] = c.second;
+    }
+    tree.clear();
+    for (const auto p : prices)
+    {
+        tree[p].orders = 1;
+    }
+
+    t0 = bench_clock::now();
+    for (const auto& c : churn)
+    {
+        tree.erase(c.first);
+        tree[c.second].orders = 1;
+        sink += static_cast<std::uint64_t>(tree.begin()->first);
+    }
+    const double tree_churn = ns_since(t0, kChurn);
+
+    t0 = bench_clock::now();
+    for (const auto& c : churn)
+    {
+        sparse.erase(c.first);
+        sparse.get_or_create(c.second)->orders = 1;
+        sink += static_cast<std::uint64_t>(*sparse.prices().next_at_or_above(0));
+    }
+    const double sparse_churn = ns_since(t0, kChurn);
+    g_sink = g_sink + static_cast<std::int64_t>(sink);
+
+    // libstdc++ tree nodes carry four links ahead of the value, rounded to malloc chunks
+    const std::size_t tree_bytes = tree.size() * ((32 + sizeof(std::pair<const ob::PriceTicks, LevelStub>) + 8 + 15) & ~std::size_t { 15 });
+
+    std::cout << "levels=" << count << " range=" << range << "\n";
+    std::cout << "map    insert_ns=" << tree_insert << " sweep_ns_per_level=" << tree_sweep << " churn_ns=" << tree_churn
+              << " index_bytes=" << tree_bytes << "\n";
+    std::cout << "bitset insert_ns=" << sparse_insert << " sweep_ns_per_level=" << sparse_sweep << " churn_ns=" << sparse_churn
+              << " index_bytes=" << sparse.prices().memory_bytes() << " (payload hash separate)\n";
+}
+
+// one container combination over a workload, its event hash must equal the default book's
+struct PolicyRun
+{
+    std::string name;
+    double cmds_per_sec { 0 };
+    std::uint64_t events { 0 };
+    std::uint64_t hash { 0 };
+    std::vector<std::uint64_t> samples;
+};
+
+// times every command on a fresh book, each run starts a new book and the best throughput is kept
+template <typename Policy>
+static PolicyRun run_policy(const std::vector<ob::Command>& cmds, int runs)
+{
+    PolicyRun r {};
+    r.name = std::string(Policy::levels::name) + "/" + Policy::sides::name + "/" + Policy::index::name;
+    if constexpr (Policy::queue::type::kTracked)
+    {
+        r.name += std::string("+") + Policy::queue::name;
+    }
+    r.samples.reserve(cmds.size() * static_cast<std::size_t>(runs));
+
+    for (int run = 0; run < runs; ++run)
+    {
+        ob::BasicOrderBook<ob::GenericInstrument, Policy> book;
+        ob::EventHasher hasher;
+
+        const auto start = bench_clock::now();
+        for (const auto& c : cmds)
+        {
+            const auto t0 = bench_clock::now();
+            const auto events = ob::execute_command(book, c);
+            const auto t1 = bench_clock::now();
+            r.samples.push_back(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+
+            for (const auto& e : events)
+            {
+                hasher.add(e);
+            }
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+
+        r.cmds_per_sec = std::max(r.cmds_per_sec, static_cast<double>(cmds.size()) * 1e9 / static_cast<double>(std::max<std::int64_t>(ns, 1)));
+        r.events = hasher.count();
+        r.hash = hasher.value();
+    }
+    return r;
+}
+
+// every combination compiled into the library, the default first as the reference
+template <typename... Policies>
+static std::vector<PolicyRun> run_policies(const std::vector<ob::Command>& cmds, int runs)
+{
+    return { run_policy<Policies>(cmds, runs)... };
+}
+
+static int bench_policies(const std::string& workload, std::uint64_t size, int runs)
+{
+    const auto cmds = ob::make_workload(workload, size);
+    if (!cmds.has_value())
+    {
+        std::cerr << "unknown workload name=" << workload << "\n";
+        return 31;
+    }
+
+    using ob::BookPolicy;
+    auto rows = run_policies<ob::DefaultBookPolicy,
+                             BookPolicy<ob::ListLevels, ob::TreeSides, ob::FlatIndex>,
+                             BookPolicy<ob::ListLevels, ob::FlatSides, ob::HashIndex>,
+                             BookPolicy<ob::ListLevels, ob::FlatSides, ob::FlatIndex>,
+                             BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::HashIndex>,
+                             BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::FlatIndex>,
+                             BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::HashIndex>,
+                             BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex>,
+                             BookPolicy<ob::ListLevels, ob::BitsetSides, ob::FlatIndex>,
+                             BookPolicy<ob::ChunkLevels, ob::BitsetSides, ob::FlatIndex>,
+                             ob::QueueTrackedPolicy,
+                             BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex, ob::FenwickQueues>>(*cmds, runs);
+
+    std::cout << "workload=" << workload << " cmds=" << cmds->size() << " events=" << rows.front().events << " runs=" << runs << "\n";
+    std::cout << std::left << std::setw(28) << "levels/sides/index" << std::right << std::setw(12) << "cmds_per_sec" << "  latency\n";
+
+    bool same = true;
+    for (auto& r : rows)
+    {
+        const bool match = r.events == rows.front().events && r.hash == rows.front().hash;
+        same = same && match;
+        std::cout << std::left << std::setw(28) << r.name << std::right << std::setw(12) << static_cast<std::uint64_t>(r.cmds_per_sec) << "  "
+                  << (match ? "" : "EVENTS DIFFER ");
+        ob::print_latency(std::cout, r.samples);
+    }
+
+    if (!same)
+    {
+        std::cerr << "event streams differ between policies\n";
+        return 2;
+    }
+    return 0;
+}
+
+// 2000 levels a side with gaps of 1 to 4 ticks and 8 orders of 1 to 50 each
+static void build_depth_book(ob::OrderBook& book)
+{
+    std::uint64_t x = 0x9E3779B97F4A7C15ULL;
+    ob::OrderId id = 1;
+    ob::PriceTicks bid = 100'000;
+    ob::PriceTicks ask = 100'001;
+    for (int l = 0; l < 2000; ++l)
+    {
+        for (int k = 0; k < 8; ++k)
+        {
+            book.add_limit(id++, ob::Side::Buy, bid, 1 + static_cast<ob::Qty>(next_random(x) % 50));
+            book.add_limit(id++, ob::Side::Sell, ask, 1 + static_cast<ob::Qty>(next_random(x) % 50));
+        }
+        bid -= 1 + static_cast<ob::PriceTicks>(next_random(x) % 4);
+        ask += 1 + static_cast<ob::PriceTicks>(next_random(x) % 4);
+    }
+}
+
+// the depth book read the way a strategy would
+// probe walks prices from the touch with total_qty_at until it has top levels, copy takes them in one pass
+static void bench_book_depth(std::size_t top)
+{
+    ob::OrderBook book;
+    build_depth_book(book);
+
+    const std::uint64_t reps = 200'000;
+    std::vector<ob::DepthLevel> depth(top);
+
+    const double probe = time_per_call(reps, [&]
+    {
+        std::int64_t sum = 0;
+        for (const ob::Side side : { ob::Side::Buy, ob::Side::Sell })
+        {
+            const ob::PriceTicks step = (side == ob::Side::Buy) ? -1 : 1;
+            ob::PriceTicks px = (side == ob::Side::Buy) ? *book.best_bid_price() : *book.best_ask_price();
+            for (std::size_t found = 0; found < top; px += step)
+            {
+                const ob::Qty q = book.total_qty_at(side, px);
+                found += (q > 0) ? 1 : 0;
+                sum += q;
+            }
+        }
+        return sum;
+    });
+
+    const double copy = time_per_call(reps, [&]
+    {
+        std::int64_t sum = 0;
+        for (const ob::Side side : { ob::Side::Buy, ob::Side::Sell })
+        {
+            const std::size_t n = book.copy_depth(side, depth);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                sum += depth[i].total_qty;
+            }
+        }
+        return sum;
+    });
+
+    // the orders at the best bid, as a fresh vector and into a caller buffer
+    const ob::PriceTicks best = *book.best_bid_price();
+    std::vector<ob::OrderId> ids(64);
+    const double ids_vector = time_per_call(reps, [&] { return book.order_ids_at(ob::Side::Buy, best).size(); });
+    const double ids_span = time_per_call(reps, [&] { return book.copy_order_ids_at(ob::Side::Buy, best, ids); });
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "top=" << top << " probe_ns=" << probe << " copy_depth_ns=" << copy << " order_ids_at_ns=" << ids_vector
+              << " copy_order_ids_at_ns=" << ids_span << "\n";
+}
+
+// what buys of 1k to 8k would cost on the depth book, about 5 to 40 levels deep
+// probe walks prices with total_qty_at for each size, single calls estimate_fill per size, batch is one pass
+static void bench_fill_estimate()
+{
+    ob::OrderBook book;
+    build_depth_book(book);
+
+    std::vector<ob::Qty> qtys;
+    for (ob::Qty q = 1000; q <= 8000; q += 1000)
+    {
+        qtys.push_back(q);
+    }
+    std::vector<ob::FillEstimate> out(qtys.size());
+    const std::uint64_t reps = 50'000;
+
+    const double probe = time_per_call(reps, [&]
+    {
+        std::int64_t sum = 0;
+        for (const ob::Qty q : qtys)
+        {
+            ob::Qty filled = 0;
+            for (ob::PriceTicks px = *book.best_ask_price(); filled < q; ++px)
+            {
+                const ob::Qty take = std::min(book.total_qty_at(ob::Side::Sell, px), q - filled);
+                filled += take;
+                sum += px * take;
+            }
+        }
+        return sum;
+    });
+
+    const double single = time_per_call(reps, [&]
+    {
+        std::int64_t sum = 0;
+        for (const ob::Qty q : qtys)
+        {
+            sum += book.estimate_fill(ob::Side::Buy, q).notional;
+        }
+        return sum;
+    });
+
+    const double batch = time_per_call(reps, [&]
+    {
+        book.estimate_fills(ob::Side::Buy, qtys, out);
+        return out.back().notional;
+    });
+
+    const ob::FillEstimate deepest = book.estimate_fill(ob::Side::Buy, qtys.back());
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "sizes=" << qtys.size() << " deepest_levels=" << deepest.levels << " probe_ns=" << probe
+              << " estimate_fill_ns=" << single << " estimate_fills_ns=" << batch << "\n";
+}
+
+// one level of depth orders with every third one cancelled, then queue_position for random live orders
+// the default policy walks the level from its head, the tracked one that OrderBook uses reads two fenwick prefixes
+template <typename Book>
+static double time_queue_position(std::size_t depth)
+{
+    Book book;
+    std::uint64_t x = 0x2545F4914F6CDD1DULL;
+    std::vector<ob::OrderId> live;
+    for (std::size_t i = 1; i <= depth; ++i)
+    {
+        book.add_limit(i, ob::Side::Sell, 100, 1 + static_cast<ob::Qty>(next_random(x) % 50));
+        if (i % 3 == 0)
+        {
+            book.cancel(i);
+        }
+        else
+        {
+            live.push_back(i);
+        }
+    }
+
+    const std::uint64_t reps = std::max<std::uint64_t>(1000, 20'000'000 / std::max<std::size_t>(depth, 1));
+    return time_per_call(reps, [&] { return book.queue_position(live[next_random(x) % live.size()])->qty_ahead; });
+}
+
+static void bench_queue_position(std::size_t depth)
+{
+    const double walk = time_queue_position<ob::BasicOrderBook<ob::GenericInstrument, ob::DefaultBookPolicy>>(depth);
+    const double fenwick = time_queue_position<ob::OrderBook>(depth);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "depth=" << depth << " walk_ns=" << walk << " fenwick_ns=" << fenwick << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    bool levels = false;
+    std::size_t depth { 0 };
+    bool price_index = false;
+    std::size_t count { 1'000'000 };
+    ob::PriceTicks range { 1'000'000'000 };
+    bool policies = false;
+    std::string workload = "match";
+    std::uint64_t size { 200'000 };
+    int runs { 3 };
+    bool book_depth = false;
+    bool fill_estimate = false;
+    bool queue_position = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string a = argv[i];
+        if (a == "--levels")
+        {
+            levels = true;
+        }
+        else if (a == "--price-index")
+        {
+            price_index = true;
+        }
+        else if (a == "--count" && i + 1 < argc)
+        {
+            count = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--range" && i + 1 < argc)
+        {
+            range = static_cast<ob::PriceTicks>(std::stoll(argv[++i]));
+        }
+        else if (a == "--policies")
+        {
+            policies = true;
+        }
+        else if (a == "--book-depth")
+        {
+            book_depth = true;
+        }
+        else if (a == "--fill-estimate")
+        {
+            fill_estimate = true;
+        }
+        else if (a == "--queue-position")
+        {
+            queue_position = true;
+        }
+        else if (a == "--workload" && i + 1 < argc)
+        {
+            workload = argv[++i];
+        }
+        else if (a == "--size" && i + 1 < argc)
+        {
+            size = static_cast<std::uint64_t>(std::stoull(argv[++i]));
+        }
+        else if (a == "--runs" && i + 1 < argc)
+        {
+            runs = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (a == "--depth" && i + 1 < argc)
+        {
+            depth = static_cast<std::size_t>(std::stoull(argv[++i]));
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (levels)
+    {
+        if (depth > 0)
+        {
+            bench_level(depth);
+            return 0;
+        }
+        for (const std::size_t d : { 16, 256, 4096, 65536 })
+        {
+            bench_level(d);
+        }
+        return 0;
+    }
+
+    if (price_index)
+    {
+        if (count == 0 || range <= 0 || static_cast<std::uint64_t>(range) < 2 * count)
+        {
+            std::cerr << "range must be at least twice count\n";
+            return 1;
+        }
+        bench_price_index(count, range);
+        return 0;
+    }
+
+    if (policies)
+    {
+        return bench_policies(workload, size, runs);
+    }
+
+    if (book_depth)
+    {
+        bench_book_depth((depth > 0) ? depth : 10);
+        return 0;
+    }
+
+    if (fill_estimate)
+    {
+        bench_fill_estimate();
+        return 0;
+    }
+
+    if (queue_position)
+    {
+        if (depth > 0)
+        {
+            bench_queue_position(depth);
+            return 0;
+        }
+        for (const std::size_t d : { 16, 256, 4096, 65536 })
+        {
+            bench_queue_position(d);
+        }
+        return 0;
+    }
+
+    print_usage();
+    return 1;
+}
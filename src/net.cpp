@@ -0,0 +1,168 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace ob
+{
+    bool parse_endpoint_arg(int argc, char** argv, int& i, Endpoint& out)
+    {
+        const std::string a = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+
+        if (a == "--unix")
+        {
+            out.unix_path = argv[++i];
+            return true;
+        }
+        if (a == "--tcp")
+        {
+            const unsigned long port = std::stoul(argv[++i]);
+            if (port == 0 || port > 65535)
+            {
+                return false;
+            }
+            out.tcp_port = static_cast<std::uint16_t>(port);
+            return true;
+        }
+        return false;
+    }
+
+    bool make_nonblocking(int fd)
+    {
+        const int flags = ::fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        {
+            return false;
+        }
+
+        // small frames must not wait for nagle, fails harmlessly on unix sockets
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    static int fail(int fd, const char* what)
+    {
+        std::cerr << what << " failed errno=" << errno << " " << std::strerror(errno) << "\n";
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+
+    int listen_endpoint(const Endpoint& ep)
+    {
+        int fd = -1;
+
+        if (!ep.unix_path.empty())
+        {
+            sockaddr_un addr {};
+            addr.sun_family = AF_UNIX;
+            if (ep.unix_path.size() >= sizeof(addr.sun_path))
+            {
+                std::cerr << "unix path too long\n";
+                return -1;
+            }
+            std::memcpy(addr.sun_path, ep.unix_path.c_str(), ep.unix_path.size() + 1);
+
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+            {
+                return fail(fd, "socket");
+            }
+
+            // a stale socket file from an earlier run would make bind fail
+            ::unlink(ep.unix_path.c_str());
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            {
+                return fail(fd, "bind");
+            }
+        }
+        else
+        {
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(ep.tcp_port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+            {
+                return fail(fd, "socket");
+            }
+
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            {
+                return fail(fd, "bind");
+            }
+        }
+
+        if (::listen(fd, 64) < 0)
+        {
+            return fail(fd, "listen");
+        }
+        if (!make_nonblocking(fd))
+        {
+            return fail(fd, "fcntl");
+        }
+        return fd;
+    }
+
+    int connect_endpoint(const Endpoint& ep)
+    {
+        int fd = -1;
+
+        if (!ep.unix_path.empty())
+        {
+            sockaddr_un addr {};
+            addr.sun_family = AF_UNIX;
+            if (ep.unix_path.size() >= sizeof(addr.sun_path))
+            {
+                std::cerr << "unix path too long\n";
+                return -1;
+            }
+            std::memcpy(addr.sun_path, ep.unix_path.c_str(), ep.unix_path.size() + 1);
+
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            {
+                return fail(fd, "connect");
+            }
+        }
+        else
+        {
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(ep.tcp_port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            {
+                return fail(fd, "connect");
+            }
+        }
+
+        if (!make_nonblocking(fd))
+        {
+            return fail(fd, "fcntl");
+        }
+        return fd;
+    }
+}
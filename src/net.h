@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace ob
+{
+    // where the gateway listens, a unix socket path or a loopback tcp port
+    struct Endpoint
+    {
+        std::string unix_path;
+        std::uint16_t tcp_port { 0 };
+    };
+
+    // parses --unix <path> or --tcp <port> at argv[i], advancing i past the value
+    bool parse_endpoint_arg(int argc, char** argv, int& i, Endpoint& out);
+
+    // nonblocking listening socket, -1 on failure with the reason on stderr
+    int listen_endpoint(const Endpoint& ep);
+
+    // blocking connect then switched to nonblocking, -1 on failure
+    int connect_endpoint(const Endpoint& ep);
+
+    // sets O_NONBLOCK and for tcp also TCP_NODELAY
+    bool make_nonblocking(int fd);
+}
@@ -20,16 +20,65 @@ namespace ob
     // integer quantity
     using Qty = std::int64_t;
 
-    // stored resting order state in the book
-    struct Order
+    // deterministic logical clock carried on commands, only ever moves forward
+    using LogicalTime = std::uint64_t;
+
+    // owning participant, zero means unowned
+    using ParticipantId = std::uint32_t;
+
+    // self trade prevention group, zero means no group
+    using StpGroup = std::uint32_t;
+
+    // what the taker asks for when it would trade against its own stp group
+    enum class StpMode : std::uint8_t
+    {
+        None,
+        CancelResting, // cancel the resting maker and keep matching
+        CancelTaking,  // cancel the taker remainder and stop
+        CancelBoth,    // cancel the maker and the taker remainder
+        Decrement      // reduce both by the overlap and cancel whichever reaches zero
+    };
+
+    // time in force for incoming limit orders
+    enum class TimeInForce
+    {
+        Gtc, // remainder rests on the book
+        Ioc, // remainder is cancelled after matching
+        Fok  // fills completely or is killed without touching the book
+    };
+
+    // optional add limit attributes beyond the core fields
+    struct OrderOptions
+    {
+        TimeInForce tif { TimeInForce::Gtc };
+        ParticipantId participant { 0 };
+        StpGroup stp_group { 0 };
+        StpMode stp_mode { StpMode::None };
+        LogicalTime expire_at { 0 }; // zero never expires
+    };
+
+    // stored resting order state in the book, price and qty in the instrument's declared widths
+    // wide fields first and the enums last so narrow widths pack without holes
+    template <typename Price, typename Quantity>
+    struct BasicOrder
     {
         OrderId id {};
-        Side side { Side::Buy };
-        PriceTicks price_ticks { 0 };
-        Qty qty { 0 }; // remaining qty
         std::uint64_t seq { 0 }; // assigned by book
+        LogicalTime expire_at { 0 };
+        Price price_ticks { 0 };
+        Quantity qty { 0 }; // remaining qty
+        ParticipantId participant { 0 };
+        StpGroup stp_group { 0 };
+        Side side { Side::Buy };
+        StpMode stp_mode { StpMode::None };
+
+        // intrusive per participant chain, maintained by the book
+        BasicOrder* participant_prev { nullptr };
+        BasicOrder* participant_next { nullptr };
     };
 
+    using Order = BasicOrder<PriceTicks, Qty>;
+
     // validates caller supplied values for add limit
     inline bool is_valid_input(OrderId id, PriceTicks price_ticks, Qty qty)
     {
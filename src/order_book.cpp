@@ -1,11 +1,32 @@
 #include "order_book.h"
 
+#include "auction.h"
+#include "byte_io.h"
+
 #include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <limits>
+#include <type_traits>
 
 namespace ob
 {
-    bool OrderBook::crosses(Side taker_side, PriceTicks taker_px, PriceTicks maker_px) const
+    template <typename I, typename P>
+    BasicOrderBook<I, P>::BasicOrderBook(std::pmr::memory_resource* mr)
+        : resource_(mr),
+          bids_(mr),
+          asks_(mr),
+          index_(mr),
+          buy_stops_(mr),
+          sell_stops_(mr),
+          stop_index_(mr),
+          wheel_(mr),
+          participants_(mr)
+    {
+    }
+
+    template <typename I, typename P>
+    bool BasicOrderBook<I, P>::crosses(Side taker_side, PriceTicks taker_px, PriceTicks maker_px) const
     {
         // buy crosses when maker ask price is <= taker limit
         if (taker_side == Side::Buy)
@@ -17,7 +38,8 @@ namespace ob
         return maker_px >= taker_px;
     }
 
-    void OrderBook::remove_filled_maker(std::vector<Event>& events, const Order& maker)
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::remove_filled_maker(std::vector<Event>& events, const Order& maker)
     {
         // maker completion helps replay diffs and tests a lot
         Event e {};
@@ -32,36 +54,319 @@ namespace ob
         events.push_back(e);
     }
 
-    std::size_t OrderBook::recompute_live_count() const
+    template <typename I, typename P>
+    std::uint64_t BasicOrderBook<I, P>::order_key(const Order& o)
+    {
+        // stands in for a zobrist table, a strong mix of every field that identifies the resting state
+        std::uint64_t h = o.id * 0x9e3779b97f4a7c15ULL;
+        const std::uint64_t fields[] = { static_cast<std::uint64_t>(o.side), static_cast<std::uint64_t>(o.price_ticks), static_cast<std::uint64_t>(o.qty), o.seq };
+        for (const std::uint64_t f : fields)
+        {
+            h ^= f + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            h ^= h >> 31;
+            h *= 0xbf58476d1ce4e5b9ULL;
+        }
+        h ^= h >> 29;
+        return h;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::link_participant(Order& o)
+    {
+        if (o.participant == 0)
+        {
+            return;
+        }
+
+        // append so the chain keeps resting order
+        ParticipantOrders& chain = participants_[o.participant];
+        o.participant_prev = chain.tail;
+        o.participant_next = nullptr;
+
+        if (chain.tail != nullptr)
+        {
+            chain.tail->participant_next = &o;
+        }
+        else
+        {
+            chain.head = &o;
+        }
+        chain.tail = &o;
+        ++chain.count;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::unlink_participant(Order& o)
+    {
+        if (o.participant == 0)
+        {
+            return;
+        }
+
+        auto it = participants_.find(o.participant);
+        assert(it != participants_.end());
+        ParticipantOrders& chain = it->second;
+
+        if (o.participant_prev != nullptr)
+        {
+            o.participant_prev->participant_next = o.participant_next;
+        }
+        else
+        {
+            chain.head = o.participant_next;
+        }
+
+        if (o.participant_next != nullptr)
+        {
+            o.participant_next->participant_prev = o.participant_prev;
+        }
+        else
+        {
+            chain.tail = o.participant_prev;
+        }
+
+        o.participant_prev = nullptr;
+        o.participant_next = nullptr;
+
+        // drop empty chains so the map only holds active participants
+        if (--chain.count == 0)
+        {
+            participants_.erase(it);
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::erase_order(Index::iterator idx_it)
+    {
+        const Locator loc = idx_it->second;
+
+        unlink_participant(*loc.it);
+        state_hash_ ^= order_key(*loc.it);
+
+        // level aggregate and fifo list are reached through the locator
+        loc.level->total_qty -= loc.it->qty;
+        if constexpr (Queue::kTracked)
+        {
+            loc.level->queue.remove(loc.slot, loc.it->qty);
+        }
+        loc.level->orders.erase(loc.it);
+
+        // only an emptied level needs the map lookup
+        if (loc.level->orders.empty())
+        {
+            if (loc.side == Side::Buy)
+            {
+                bids_.erase(loc.price_ticks);
+            }
+            else
+            {
+                asks_.erase(loc.price_ticks);
+            }
+        }
+
+        index_.erase(idx_it);
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::relocate_order(const Order& from, Order& to)
+    {
+        if (from.participant == 0)
+        {
+            return;
+        }
+
+        // the neighbours still point at from, to carries the same links
+        ParticipantOrders& chain = participants_.find(from.participant)->second;
+        if (to.participant_prev != nullptr)
+        {
+            to.participant_prev->participant_next = &to;
+        }
+        else
+        {
+            chain.head = &to;
+        }
+
+        if (to.participant_next != nullptr)
+        {
+            to.participant_next->participant_prev = &to;
+        }
+        else
+        {
+            chain.tail = &to;
+        }
+    }
+
+    template <typename I, typename P>
+    typename BasicOrderBook<I, P>::OrderList::iterator BasicOrderBook<I, P>::move_to_tail(OrderList& from, OrderList& to, OrderList::iterator it)
+    {
+        if constexpr (requires { to.splice(to.end(), from, it); })
+        {
+            to.splice(to.end(), from, it);
+            return it;
+        }
+        else
+        {
+            to.push_back(*it);
+            const auto moved = std::prev(to.end());
+            relocate_order(*it, *moved);
+            from.erase(it);
+            return moved;
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::compact_level(PriceLevel& level)
+    {
+        if constexpr (requires { level.orders.holes(); })
+        {
+            // paid for by the cancels that made the holes, small levels are left alone
+            if (level.orders.holes() < 32 || level.orders.holes() < level.orders.size())
+            {
+                return;
+            }
+
+            level.orders.compact(
+                [this](const Order& from, Order& to, OrderList::iterator at)
+                {
+                    relocate_order(from, to);
+                    index_.find(to.id)->second.it = at;
+                });
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::queue_push(PriceLevel& level, Locator& loc)
+    {
+        if constexpr (Queue::kTracked)
+        {
+            if (level.queue.full() && level.queue.capacity() != 0 && 2 * level.orders.size() > level.queue.capacity())
+            {
+                // mostly live, so doubling keeps every slot and renumbers nothing
+                level.queue.grow();
+            }
+            else if (level.queue.full())
+            {
+                // mostly cancelled, every order ahead of the tail gets a fresh slot in fifo order, the tail goes
+                // last below
+                level.queue.reset(level.orders.size());
+                for (auto it = level.orders.begin(); it != loc.it; ++it)
+                {
+                    index_.find(it->id)->second.slot = level.queue.push(it->qty);
+                }
+            }
+            loc.slot = level.queue.push(loc.it->qty);
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::queue_reduce(PriceLevel& level, std::uint32_t slot, Qty by)
+    {
+        if constexpr (Queue::kTracked)
+        {
+            level.queue.reduce(slot, by);
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::queue_remove(PriceLevel& level, std::uint32_t slot, Qty qty)
+    {
+        if constexpr (Queue::kTracked)
+        {
+            level.queue.remove(slot, qty);
+        }
+    }
+
+    template <typename I, typename P>
+    std::uint32_t BasicOrderBook<I, P>::queue_head_slot(const PriceLevel& level) const
+    {
+        if constexpr (Queue::kTracked)
+        {
+            return level.queue.slot_at(0);
+        }
+        else
+        {
+            (void)level;
+            return 0;
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::erase_stop(StopIndex::iterator stop_it)
+    {
+        const StopLocator sl = stop_it->second;
+
+        if (sl.side == Side::Buy)
+        {
+            auto lvl_it = buy_stops_.find(sl.stop_price_ticks);
+            lvl_it->second.erase(sl.it);
+            if (lvl_it->second.empty())
+            {
+                buy_stops_.erase(lvl_it);
+            }
+        }
+        else
+        {
+            auto lvl_it = sell_stops_.find(sl.stop_price_ticks);
+            lvl_it->second.erase(sl.it);
+            if (lvl_it->second.empty())
+            {
+                sell_stops_.erase(lvl_it);
+            }
+        }
+
+        stop_index_.erase(stop_it);
+    }
+
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::recompute_live_count() const
     {
         // recompute live count from containers not from index
         std::size_t total { 0 };
 
         for (const auto& kv : bids_)
         {
-            total += kv.second.size();
+            total += kv.second.orders.size();
         }
 
         for (const auto& kv : asks_)
         {
-            total += kv.second.size();
+            total += kv.second.orders.size();
         }
 
         return total;
     }
 
-    void OrderBook::assert_invariants() const
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::assert_invariants() const
     {
+        // the walks are only dead code when the compiler can see through the side's iterators, so release
+        // builds skip them outright
+#ifndef NDEBUG
         // core size invariant
         assert(index_.size() == recompute_live_count());
 
+        // owned orders seen in the levels must all be on a chain
+        std::size_t owned { 0 };
+
+        // every order or stop with an expiry holds a wheel entry, stale entries may linger
+        std::size_t expiring { 0 };
+
+        // the incremental hash must equal one rebuilt from scratch
+        std::uint64_t hash { 0 };
+
         // validate all bid levels and index entries for them
         for (const auto& kv : bids_)
         {
-            assert(!kv.second.empty());
+            assert(!kv.second.orders.empty());
 
-            for (const auto& o : kv.second)
+            Qty level_qty { 0 };
+            std::size_t ahead { 0 };
+            for (const auto& o : kv.second.orders)
             {
+                level_qty += o.qty;
+                owned += (o.participant != 0) ? 1 : 0;
+                expiring += (o.expire_at != 0) ? 1 : 0;
+                hash ^= order_key(o);
                 assert(o.side == Side::Buy);
                 assert(o.price_ticks == kv.first);
                 assert(o.qty > 0);
@@ -74,16 +379,35 @@ namespace ob
                 assert(it->second.side == Side::Buy);
                 assert(it->second.price_ticks == kv.first);
                 assert(it->second.it->id == o.id);
+                assert(it->second.level == &kv.second);
+
+                // the queue tree must see exactly the orders before this one
+                if constexpr (Queue::kTracked)
+                {
+                    const QueuePosition pos = kv.second.queue.ahead(it->second.slot);
+                    assert(pos.qty_ahead == level_qty - o.qty);
+                    assert(pos.orders_ahead == ahead);
+                }
+                ++ahead;
             }
+
+            // cached aggregate must match the orders it summarises
+            assert(level_qty == kv.second.total_qty);
         }
 
         // validate all ask levels and index entries for them
         for (const auto& kv : asks_)
         {
-            assert(!kv.second.empty());
+            assert(!kv.second.orders.empty());
 
-            for (const auto& o : kv.second)
+            Qty level_qty { 0 };
+            std::size_t ahead { 0 };
+            for (const auto& o : kv.second.orders)
             {
+                level_qty += o.qty;
+                owned += (o.participant != 0) ? 1 : 0;
+                expiring += (o.expire_at != 0) ? 1 : 0;
+                hash ^= order_key(o);
                 assert(o.side == Side::Sell);
                 assert(o.price_ticks == kv.first);
                 assert(o.qty > 0);
@@ -95,325 +419,1477 @@ namespace ob
                 assert(it->second.side == Side::Sell);
                 assert(it->second.price_ticks == kv.first);
                 assert(it->second.it->id == o.id);
+                assert(it->second.level == &kv.second);
+
+                // the queue tree must see exactly the orders before this one
+                if constexpr (Queue::kTracked)
+                {
+                    const QueuePosition pos = kv.second.queue.ahead(it->second.slot);
+                    assert(pos.qty_ahead == level_qty - o.qty);
+                    assert(pos.orders_ahead == ahead);
+                }
+                ++ahead;
+            }
+
+            // cached aggregate must match the orders it summarises
+            assert(level_qty == kv.second.total_qty);
+        }
+
+        // each chain is linked both ways in seq order and its count matches its length
+        std::size_t chained { 0 };
+        for (const auto& kv : participants_)
+        {
+            std::size_t n { 0 };
+            const Order* prev = nullptr;
+            for (const Order* o = kv.second.head; o != nullptr; o = o->participant_next)
+            {
+                assert(o->participant == kv.first);
+                assert(o->participant_prev == prev);
+                assert(index_.find(o->id) != index_.end());
+                assert(prev == nullptr || prev->seq < o->seq);
+                prev = o;
+                ++n;
+            }
+            assert(prev == kv.second.tail);
+            (void)prev;
+            assert(n == kv.second.count && n > 0);
+            chained += n;
+        }
+        assert(chained == owned);
+        (void)owned;
+        (void)chained;
+
+        // stop index covers exactly the stops in the trigger maps
+        std::size_t stops { 0 };
+        for (const auto& kv : buy_stops_)
+        {
+            assert(!kv.second.empty());
+            stops += kv.second.size();
+            for (const auto& so : kv.second)
+            {
+                expiring += (so.opts.expire_at != 0) ? 1 : 0;
+            }
+        }
+        for (const auto& kv : sell_stops_)
+        {
+            assert(!kv.second.empty());
+            stops += kv.second.size();
+            for (const auto& so : kv.second)
+            {
+                expiring += (so.opts.expire_at != 0) ? 1 : 0;
             }
         }
+        assert(stops == stop_index_.size());
+        (void)stops;
+
+        assert(expiring <= wheel_.size());
+        (void)expiring;
+
+        assert(hash == state_hash_);
+        (void)hash;
+
+        // only an auction may leave the book crossed
+        assert(auction_ || bids_.empty() || asks_.empty() || bids_.begin()->first < asks_.begin()->first);
+#endif
     }
 
-    std::vector<Event> OrderBook::add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty)
+    template <typename I, typename P>
+    typename BasicOrderBook<I, P>::OrderList::iterator BasicOrderBook<I, P>::prevent_self_trade(PriceLevel& level, OrderList::iterator it, std::vector<Event>& events, Taker& t)
     {
-        std::vector<Event> events;
+        Order& taker = t.order;
+        const StpMode mode = taker.stp_mode;
 
-        // validate input from caller
-        if (!is_valid_input(id, price_ticks, qty))
+        // maker side record, qty is what stp removed and rem is what is left
+        Event e {};
+        e.type = EventType::SelfTradePrevented;
+        e.id = it->id;
+        e.seq = it->seq;
+        e.side = it->side;
+        e.price_ticks = it->price_ticks;
+        e.maker_id = it->id;
+        e.maker_seq = it->seq;
+        e.taker_id = taker.id;
+        e.taker_seq = taker.seq;
+
+        if (mode == StpMode::CancelTaking)
         {
-            Event e {};
-            e.type = EventType::OrderRejected;
-            e.id = id;
-            e.side = side;
-            e.price_ticks = price_ticks;
-            e.qty = qty;
-            e.reason = "invalid";
-            events.push_back(e);
-            return events;
+            // maker untouched, the caller cancels the taker remainder
+            t.stp_stopped = true;
+            return it;
         }
 
-        // reject duplicate live ids
-        if (index_.find(id) != index_.end())
+        if (mode == StpMode::Decrement)
         {
-            Event e {};
-            e.type = EventType::OrderRejected;
-            e.id = id;
-            e.side = side;
-            e.price_ticks = price_ticks;
-            e.qty = qty;
-            e.reason = "duplicate_id";
+            const Qty overlap = std::min(taker.qty, it->qty);
+
+            state_hash_ ^= order_key(*it);
+            it->qty -= overlap;
+            state_hash_ ^= order_key(*it);
+            level.total_qty -= overlap;
+            queue_reduce(level, queue_head_slot(level), overlap);
+            taker.qty -= overlap;
+
+            e.qty = overlap;
+            e.remaining_qty = it->qty;
+            e.reason = "stp_decrement";
             events.push_back(e);
-            return events;
-        }
 
-        // assign taker seq deterministically
-        const std::uint64_t taker_seq = next_seq_;
-        ++next_seq_;
+            Event te = e;
+            te.id = taker.id;
+            te.seq = taker.seq;
+            te.side = taker.side;
+            te.price_ticks = taker.price_ticks;
+            te.remaining_qty = taker.qty;
+            events.push_back(te);
 
-        // acceptance is always first
+            // a taker decremented to zero is finished with its event already out
+            t.stp_stopped = (taker.qty == 0);
+
+            if (it->qty > 0)
+            {
+                return std::next(it);
+            }
+        }
+        else
         {
-            Event e {};
-            e.type = EventType::OrderAccepted;
-            e.id = id;
-            e.seq = taker_seq;
-            e.side = side;
-            e.price_ticks = price_ticks;
-            e.qty = qty;
-            e.reason = "accepted";
+            e.qty = it->qty;
+            e.remaining_qty = 0;
+            e.reason = (mode == StpMode::CancelBoth) ? "stp_cancel_both" : "stp_cancel_resting";
             events.push_back(e);
+
+            level.total_qty -= it->qty;
+            t.stp_stopped = (mode == StpMode::CancelBoth);
         }
 
-        Qty remaining = qty;
+        // the maker leaves the book without a maker completion
+        queue_remove(level, queue_head_slot(level), it->qty);
+        unlink_participant(*it);
+        state_hash_ ^= order_key(*it);
+        index_.erase(it->id);
+        return level.orders.erase(it);
+    }
 
-        if (side == Side::Buy)
+    template <typename I, typename P>
+    template <typename Levels>
+    void BasicOrderBook<I, P>::match_against(Levels& levels, std::vector<Event>& events, Taker& t)
+    {
+        Order& taker = t.order;
+
+        // match while the best maker level crosses
+        while (taker.qty > 0 && !t.stp_stopped && !levels.empty() && crosses(taker.side, taker.price_ticks, levels.begin()->first))
         {
-            // match against asks while best ask crosses
-            while (remaining > 0 && !asks_.empty() && crosses(side, price_ticks, asks_.begin()->first))
-            {
-                auto lvl_it = asks_.begin();
-                const PriceTicks maker_px = lvl_it->first;
-                PriceLevel& level = lvl_it->second;
+            auto lvl_it = levels.begin();
+            const PriceTicks maker_px = lvl_it->first;
+            PriceLevel& level = lvl_it->second;
 
-                // walk fifo orders at this level
-                auto it = level.begin();
-                while (remaining > 0 && it != level.end())
+            // walk fifo orders at this level
+            // the maker is always the head: each one either leaves or is the last the taker touches
+            auto it = level.orders.begin();
+            while (taker.qty > 0 && it != level.orders.end())
+            {
+                // one compare per maker, the key never matches when the taker has no stp
+                if (it->stp_group == t.stp_key) [[unlikely]]
                 {
-                    const Qty fill = std::min(remaining, it->qty);
-
-                    // trade executes at maker price
-                    Event trade {};
-                    trade.type = EventType::Trade;
-                    trade.maker_id = it->id;
-                    trade.maker_seq = it->seq;
-                    trade.taker_id = id;
-                    trade.taker_seq = taker_seq;
-                    trade.trade_price_ticks = maker_px;
-                    trade.trade_qty = fill;
-                    trade.reason = "trade";
-                    events.push_back(trade);
-
-                    remaining -= fill;
-                    it->qty -= fill;
-
-                    if (it->qty == 0)
+                    it = prevent_self_trade(level, it, events, t);
+                    if (t.stp_stopped)
                     {
-                        // fully filled maker gets removed from book and index
-                        const Order filled_maker = *it;
-
-                        index_.erase(filled_maker.id);
-                        it = level.erase(it);
-
-                        remove_filled_maker(events, filled_maker);
-                    }
-                    else
-                    {
-                        ++it;
+                        break;
                     }
+                    continue;
                 }
 
-                if (level.empty())
-                {
-                    asks_.erase(lvl_it);
-                }
-            }
-        }
-        else
-        {
-            // match against bids while best bid crosses
-            while (remaining > 0 && !bids_.empty() && crosses(side, price_ticks, bids_.begin()->first))
-            {
-                auto lvl_it = bids_.begin();
-                const PriceTicks maker_px = lvl_it->first;
-                PriceLevel& level = lvl_it->second;
+                const Qty fill = std::min(taker.qty, it->qty);
 
-                auto it = level.begin();
-                while (remaining > 0 && it != level.end())
+                // trade executes at maker price
+                Event trade {};
+                trade.type = EventType::Trade;
+                trade.maker_id = it->id;
+                trade.maker_seq = it->seq;
+                trade.taker_id = taker.id;
+                trade.taker_seq = taker.seq;
+                trade.trade_price_ticks = maker_px;
+                trade.trade_qty = fill;
+                trade.reason = "trade";
+                events.push_back(trade);
+
+                last_trade_px_ = maker_px;
+
+                taker.qty -= fill;
+                state_hash_ ^= order_key(*it);
+                it->qty -= fill;
+                level.total_qty -= fill;
+
+                if (it->qty == 0)
                 {
-                    const Qty fill = std::min(remaining, it->qty);
-
-                    Event trade {};
-                    trade.type = EventType::Trade;
-                    trade.maker_id = it->id;
-                    trade.maker_seq = it->seq;
-                    trade.taker_id = id;
-                    trade.taker_seq = taker_seq;
-                    trade.trade_price_ticks = maker_px;
-                    trade.trade_qty = fill;
-                    trade.reason = "trade";
-                    events.push_back(trade);
-
-                    remaining -= fill;
-                    it->qty -= fill;
-
-                    if (it->qty == 0)
-                    {
-                        const Order filled_maker = *it;
+                    // fully filled maker gets removed from book and index
+                    const Order filled_maker = *it;
 
-                        index_.erase(filled_maker.id);
-                        it = level.erase(it);
+                    queue_remove(level, queue_head_slot(level), fill);
 
-                        remove_filled_maker(events, filled_maker);
-                    }
-                    else
-                    {
-                        ++it;
-                    }
-                }
+                    unlink_participant(*it);
+                    index_.erase(filled_maker.id);
+                    it = level.orders.erase(it);
 
-                if (level.empty())
+                    remove_filled_maker(events, filled_maker);
+                }
+                else
                 {
-                    bids_.erase(lvl_it);
+                    queue_reduce(level, queue_head_slot(level), fill);
+                    state_hash_ ^= order_key(*it);
+                    ++it;
                 }
             }
+
+            if (level.orders.empty())
+            {
+                levels.erase(lvl_it);
+            }
         }
+    }
 
-        if (remaining > 0)
-        {
-            // taker rests remaining qty at its own limit price
-            Order o {};
-            o.id = id;
-            o.side = side;
-            o.price_ticks = price_ticks;
-            o.qty = remaining;
-            o.seq = taker_seq;
+    template <typename I, typename P>
+    template <typename Levels>
+    Qty BasicOrderBook<I, P>::crossing_qty(const Levels& levels, Side taker_side, PriceTicks limit_px, Qty qty) const
+    {
+        // one add per level touched, stops early once qty is covered
+        Qty total { 0 };
 
-            if (side == Side::Buy)
+        for (auto it = levels.begin(); it != levels.end() && total < qty; ++it)
+        {
+            if (!crosses(taker_side, limit_px, it->first))
             {
-                auto [lvl_it, created] = bids_.try_emplace(price_ticks, PriceLevel {});
-                PriceLevel& level = lvl_it->second;
+                break;
+            }
+            total += it->second.total_qty;
+        }
 
-                // append to keep fifo for this level
-                level.push_back(o);
-                auto iter = std::prev(level.end());
+        return total;
+    }
 
-                const bool ok = index_.emplace(id, Locator { side, price_ticks, iter }).second;
-                assert(ok); // this should always be true
+    template <typename I, typename P>
+    template <typename Levels>
+    void BasicOrderBook<I, P>::estimate_fills_on(const Levels& levels, std::span<const Qty> qtys, std::span<FillEstimate> out)
+    {
+        // running sums over the levels before it, the walk only moves forward until a qty drops
+        auto it = levels.begin();
+        Qty qty_before { 0 };
+        std::int64_t notional_before { 0 };
+        std::size_t levels_before { 0 };
+        PriceTicks last_price { 0 };
+
+        const std::size_t n = std::min(qtys.size(), out.size());
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Qty qty = std::max<Qty>(qtys[i], 0);
+            if (qty < qty_before)
+            {
+                it = levels.begin();
+                qty_before = 0;
+                notional_before = 0;
+                levels_before = 0;
+                last_price = 0;
+            }
 
+            while (it != levels.end() && qty_before + it->second.total_qty < qty)
+            {
+                qty_before += it->second.total_qty;
+                notional_before += it->first * it->second.total_qty;
+                last_price = it->first;
+                ++levels_before;
+                ++it;
+            }
+
+            FillEstimate& e = out[i];
+            e = FillEstimate {};
+            e.filled_qty = qty_before;
+            e.notional = notional_before;
+            e.worst_price_ticks = last_price;
+            e.levels = levels_before;
+
+            // the rest comes out of the level the walk stopped at
+            const Qty part = (it != levels.end()) ? qty - qty_before : 0;
+            if (part > 0)
+            {
+                e.filled_qty += part;
+                e.notional += it->first * part;
+                e.worst_price_ticks = it->first;
+                ++e.levels;
+            }
+            if (e.filled_qty > 0)
+            {
+                e.vwap = static_cast<double>(e.notional) / static_cast<double>(e.filled_qty);
+            }
+        }
+    }
+
+    template <typename I, typename P>
+    template <typename Levels>
+    Qty BasicOrderBook<I, P>::stp_crossing_qty(const Levels& levels, const Taker& t, Qty qty) const
+    {
+        // own group makers never fill and where the first one sits decides how far the taker gets,
+        // which level totals cannot say, so this is the one fok path that walks orders
+        Qty total { 0 };
+
+        for (auto lvl_it = levels.begin(); lvl_it != levels.end() && total < qty; ++lvl_it)
+        {
+            if (!crosses(t.order.side, t.order.price_ticks, lvl_it->first))
+            {
+                break;
+            }
+
+            for (const auto& o : lvl_it->second.orders)
+            {
+                if (total >= qty)
+                {
+                    break;
+                }
+                if (o.stp_group != t.stp_key)
+                {
+                    total += o.qty;
+                }
+                else if (t.order.stp_mode != StpMode::CancelResting)
+                {
+                    // every other mode ends or shrinks the taker here without filling
+                    return total;
+                }
+            }
+        }
+
+        return total;
+    }
+
+    template <typename I, typename P>
+    template <typename Levels>
+    void BasicOrderBook<I, P>::rest_order(Levels& levels, const Order& o)
+    {
+        auto [lvl_it, created] = levels.try_emplace(o.price_ticks);
+        PriceLevel& level = lvl_it->second;
+        compact_level(level);
+
+        // append to keep fifo for this level
+        level.orders.push_back(o);
+        level.total_qty += o.qty;
+        auto iter = std::prev(level.orders.end());
+        state_hash_ ^= order_key(o);
+
+        peak_live_orders_ = std::max(peak_live_orders_, index_.size() + 1);
+        peak_levels_ = std::max(peak_levels_, bids_.size() + asks_.size());
+
+        link_participant(*iter);
+
+        Locator loc { o.side, 0, o.price_ticks, iter, &level };
+        queue_push(level, loc);
+        const bool ok = index_.emplace(o.id, loc).second;
+        assert(ok); // this should always be true
+        (void)ok;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::finish_taker(std::vector<Event>& events, Taker& t, TimeInForce tif)
+    {
+        const Order& o = t.order;
+
+        Event e {};
+        e.id = o.id;
+        e.seq = o.seq;
+        e.side = o.side;
+        e.price_ticks = o.price_ticks;
+        e.qty = t.qty;
+
+        if (t.stp_stopped)
+        {
+            // decrement to zero already reported the taker
+            if (o.qty == 0)
+            {
+                return;
+            }
+
+            e.type = EventType::SelfTradePrevented;
+            e.qty = o.qty;
+            e.remaining_qty = 0;
+            e.taker_id = o.id;
+            e.taker_seq = o.seq;
+            e.reason = (o.stp_mode == StpMode::CancelBoth) ? "stp_cancel_both" : "stp_cancel_taking";
+        }
+        else if (o.qty > 0 && tif == TimeInForce::Ioc)
+        {
+            // ioc never rests, the leftover is dropped here
+            e.type = EventType::RemainderCancelled;
+            e.remaining_qty = o.qty;
+            e.reason = "ioc";
+        }
+        else if (o.qty > 0)
+        {
+            // taker rests remaining qty at its own limit price
+            if (o.side == Side::Buy)
+            {
+                rest_order(bids_, o);
+            }
+            else
+            {
+                rest_order(asks_, o);
+            }
+
+            e.type = EventType::OrderResting;
+            e.remaining_qty = o.qty;
+            e.reason = "resting";
+        }
+        else
+        {
+            // taker fully filled immediately
+            e.type = EventType::OrderCompleted;
+            e.remaining_qty = 0;
+            e.reason = "filled";
+        }
+
+        events.push_back(e);
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty, const OrderOptions& opts)
+    {
+        std::vector<Event> events;
+
+        // validate input from caller, the all ones stp group is reserved
+        if (!is_valid_input(id, price_ticks, qty) || opts.stp_group == kNoStpKey)
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "invalid";
+            events.push_back(e);
+            return events;
+        }
+
+        // tick, lot, band and size limits of the instrument
+        if (const char* bad = spec_violation(price_ticks, qty))
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = bad;
+            events.push_back(e);
+            return events;
+        }
+
+        // reject duplicate live ids, pending stops included
+        if (index_.find(id) != index_.end() || stop_index_.find(id) != stop_index_.end())
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "duplicate_id";
+            events.push_back(e);
+            return events;
+        }
+
+        // an expiry at or before the clock could never rest
+        if (opts.expire_at != 0 && opts.expire_at <= wheel_.now())
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "expired";
+            events.push_back(e);
+            return events;
+        }
+
+        if (auction_ && opts.tif != TimeInForce::Gtc)
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "auction";
+            events.push_back(e);
+            return events;
+        }
+
+        Taker t {};
+        t.order.id = id;
+        t.order.side = side;
+        t.order.price_ticks = price_ticks;
+        t.order.qty = qty;
+        t.order.participant = opts.participant;
+        t.order.stp_group = opts.stp_group;
+        t.order.stp_mode = opts.stp_mode;
+        t.order.expire_at = opts.expire_at;
+        t.qty = qty;
+        t.stp_key = stp_key_for(opts.stp_group, opts.stp_mode);
+
+        // fok is decided up front so a kill never mutates the book, stp needs the orders and not just the totals
+        if (opts.tif == TimeInForce::Fok)
+        {
+            Qty fillable { 0 };
+            if (t.stp_key == kNoStpKey)
+            {
+                fillable = available_qty(side, price_ticks, qty);
+            }
+            else if (side == Side::Buy)
+            {
+                fillable = stp_crossing_qty(asks_, t, qty);
+            }
+            else
+            {
+                fillable = stp_crossing_qty(bids_, t, qty);
+            }
+
+            if (fillable < qty)
+            {
                 Event e {};
-                e.type = EventType::OrderResting;
+                e.type = EventType::OrderKilled;
                 e.id = id;
-                e.seq = taker_seq;
                 e.side = side;
                 e.price_ticks = price_ticks;
                 e.qty = qty;
-                e.remaining_qty = remaining;
-                e.reason = "resting";
+                e.remaining_qty = qty;
+                e.reason = "fok_unfilled";
                 events.push_back(e);
+                return events;
             }
-            else
+        }
+
+        execute_taker(events, t, opts.tif);
+
+        // only a remainder that rested needs a deadline, modify keeps the one it has
+        if (opts.expire_at != 0 && index_.find(id) != index_.end())
+        {
+            wheel_.schedule(opts.expire_at, id);
+        }
+
+        run_stop_cascade(events);
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::execute_taker(std::vector<Event>& events, Taker& t, TimeInForce tif)
+    {
+        // assign taker seq deterministically
+        t.order.seq = next_seq_;
+        ++next_seq_;
+
+        // acceptance is always first
+        {
+            Event e {};
+            e.type = EventType::OrderAccepted;
+            e.id = t.order.id;
+            e.seq = t.order.seq;
+            e.side = t.order.side;
+            e.price_ticks = t.order.price_ticks;
+            e.qty = t.qty;
+            e.reason = "accepted";
+            events.push_back(e);
+        }
+
+        if (auction_)
+        {
+            // orders only accumulate until the uncross
+        }
+        else if (t.order.side == Side::Buy)
+        {
+            // match against asks while best ask crosses
+            match_against(asks_, events, t);
+        }
+        else
+        {
+            // match against bids while best bid crosses
+            match_against(bids_, events, t);
+        }
+
+        finish_taker(events, t, tif);
+    }
+
+    template <typename I, typename P>
+    template <typename Stops>
+    void BasicOrderBook<I, P>::pop_triggered(Stops& stops, Side side, PriceTicks trade_px, std::deque<StopOrder>& pending)
+    {
+        // the map is ordered so only crossed trigger levels are visited
+        while (!stops.empty())
+        {
+            auto lvl_it = stops.begin();
+            const bool crossed = (side == Side::Buy) ? (lvl_it->first <= trade_px) : (lvl_it->first >= trade_px);
+            if (!crossed)
+            {
+                break;
+            }
+
+            for (auto& so : lvl_it->second)
             {
-                auto [lvl_it, created] = asks_.try_emplace(price_ticks, PriceLevel {});
-                PriceLevel& level = lvl_it->second;
+                stop_index_.erase(so.id);
+                pending.push_back(so);
+            }
+            stops.erase(lvl_it);
+        }
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::run_stop_cascade(std::vector<Event>& events)
+    {
+        // no trades happen in an auction, stops wait for the uncross
+        if (auction_ || !last_trade_px_.has_value() || (buy_stops_.empty() && sell_stops_.empty()))
+        {
+            return;
+        }
 
-                level.push_back(o);
-                auto iter = std::prev(level.end());
+        // breadth first, stops fired by one trade run before stops fired by their own trades
+        std::deque<StopOrder> pending;
+        PriceTicks checked_px = *last_trade_px_;
 
-                const bool ok = index_.emplace(id, Locator { side, price_ticks, iter }).second;
-                assert(ok); // inserton should not fail
+        pop_triggered(buy_stops_, Side::Buy, checked_px, pending);
+        pop_triggered(sell_stops_, Side::Sell, checked_px, pending);
 
+        while (!pending.empty())
+        {
+            const StopOrder so = pending.front();
+            pending.pop_front();
+
+            {
                 Event e {};
-                e.type = EventType::OrderResting;
-                e.id = id;
-                e.seq = taker_seq;
-                e.side = side;
-                e.price_ticks = price_ticks;
-                e.qty = qty;
-                e.remaining_qty = remaining;
-                e.reason = "resting";
+                e.type = EventType::StopTriggered;
+                e.id = so.id;
+                e.side = so.side;
+                e.price_ticks = so.stop_price_ticks;
+                e.qty = so.qty;
+                e.trade_price_ticks = checked_px;
+                e.reason = "stop_triggered";
                 events.push_back(e);
             }
+
+            // stop market takes any price in the instrument band on the opposite side and never rests
+            const bool market = (so.price_ticks == 0);
+
+            Taker t {};
+            t.order.id = so.id;
+            t.order.side = so.side;
+            t.order.price_ticks = market ? ((so.side == Side::Buy) ? instrument().max_price : instrument().min_price) : so.price_ticks;
+            t.order.qty = so.qty;
+            t.order.participant = so.opts.participant;
+            t.order.stp_group = so.opts.stp_group;
+            t.order.stp_mode = so.opts.stp_mode;
+            t.order.expire_at = so.opts.expire_at;
+            t.qty = so.qty;
+            t.stp_key = stp_key_for(so.opts.stp_group, so.opts.stp_mode);
+
+            execute_taker(events, t, market ? TimeInForce::Ioc : so.opts.tif);
+
+            if (*last_trade_px_ != checked_px)
+            {
+                checked_px = *last_trade_px_;
+                pop_triggered(buy_stops_, Side::Buy, checked_px, pending);
+                pop_triggered(sell_stops_, Side::Sell, checked_px, pending);
+            }
+        }
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::add_stop(OrderId id, Side side, PriceTicks stop_price_ticks, PriceTicks price_ticks, Qty qty, const OrderOptions& opts)
+    {
+        std::vector<Event> events;
+
+        // limit price may be zero for stop market, fok is not offered on stops
+        const bool valid = id != 0 && stop_price_ticks > 0 && price_ticks >= 0 && qty > 0 && opts.tif != TimeInForce::Fok && opts.stp_group != kNoStpKey;
+        if (!valid)
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = stop_price_ticks;
+            e.qty = qty;
+            e.reason = "invalid";
+            events.push_back(e);
+            return events;
+        }
+
+        // the trigger and any limit price sit on the instrument grid like a resting price
+        const char* bad = spec_violation(stop_price_ticks, qty);
+        if (bad == nullptr && price_ticks != 0)
+        {
+            bad = price_violation(instrument(), price_ticks);
+        }
+        if (bad != nullptr)
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = stop_price_ticks;
+            e.qty = qty;
+            e.reason = bad;
+            events.push_back(e);
+            return events;
+        }
+
+        if (index_.find(id) != index_.end() || stop_index_.find(id) != stop_index_.end())
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = stop_price_ticks;
+            e.qty = qty;
+            e.reason = "duplicate_id";
+            events.push_back(e);
+            return events;
+        }
+
+        if (opts.expire_at != 0 && opts.expire_at <= wheel_.now())
+        {
+            Event e {};
+            e.type = EventType::OrderRejected;
+            e.id = id;
+            e.side = side;
+            e.price_ticks = stop_price_ticks;
+            e.qty = qty;
+            e.reason = "expired";
+            events.push_back(e);
+            return events;
+        }
+
+        StopOrder so {};
+        so.id = id;
+        so.side = side;
+        so.stop_price_ticks = stop_price_ticks;
+        so.price_ticks = price_ticks;
+        so.qty = qty;
+        so.opts = opts;
+
+        // fifo within a trigger price like a book level
+        StopList* list = nullptr;
+        if (side == Side::Buy)
+        {
+            list = &buy_stops_[stop_price_ticks];
+        }
+        else
+        {
+            list = &sell_stops_[stop_price_ticks];
+        }
+        list->push_back(so);
+        stop_index_.emplace(id, StopLocator { side, stop_price_ticks, std::prev(list->end()) });
+
+        // one deadline covers the stop and the limit it may later rest as, both keep the id
+        if (opts.expire_at != 0)
+        {
+            wheel_.schedule(opts.expire_at, id);
+        }
+
+        Event e {};
+        e.type = EventType::StopAccepted;
+        e.id = id;
+        e.side = side;
+        e.price_ticks = stop_price_ticks;
+        e.qty = qty;
+        e.reason = "stop_accepted";
+        events.push_back(e);
+
+        // a stop already through the last trade fires straight away
+        run_stop_cascade(events);
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::cancel(OrderId id)
+    {
+        std::vector<Event> events;
+
+        // id zero is invalid input
+        if (id == 0)
+        {
+            Event e {};
+            e.type = EventType::CancelRejected;
+            e.id = id;
+            e.reason = "invalid";
+            events.push_back(e);
+            return events;
+        }
+
+        auto idx_it = index_.find(id);
+        if (idx_it == index_.end())
+        {
+            auto stop_it = stop_index_.find(id);
+            if (stop_it != stop_index_.end())
+            {
+                // pending stop leaves the trigger index, px is its trigger
+                const StopOrder so = *stop_it->second.it;
+                erase_stop(stop_it);
+
+                Event e {};
+                e.type = EventType::OrderCancelled;
+                e.id = so.id;
+                e.side = so.side;
+                e.price_ticks = so.stop_price_ticks;
+                e.qty = so.qty;
+                e.reason = "cancelled";
+                events.push_back(e);
+
+                assert_invariants();
+                return events;
+            }
+
+            Event e {};
+            e.type = EventType::CancelRejected;
+            e.id = id;
+            e.reason = "not_found";
+            events.push_back(e);
+            return events;
+        }
+
+        // capture state before erase
+        const Order snapshot = *idx_it->second.it;
+
+        erase_order(idx_it);
+
+        // cancellation event reports remaining qty that was removed
+        Event e {};
+        e.type = EventType::OrderCancelled;
+        e.id = snapshot.id;
+        e.seq = snapshot.seq;
+        e.side = snapshot.side;
+        e.price_ticks = snapshot.price_ticks;
+        e.qty = snapshot.qty;
+        e.remaining_qty = 0;
+        e.reason = "cancelled";
+        events.push_back(e);
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    template <typename Own, typename Opposite>
+    void BasicOrderBook<I, P>::requeue_order(Own& own, Opposite& opposite, std::vector<Event>& events, Index::iterator idx_it, PriceTicks price_ticks, Qty qty)
+    {
+        Locator& loc = idx_it->second;
+
+        // requeue loses time priority so it takes a fresh seq
+        const std::uint64_t seq = next_seq_;
+        ++next_seq_;
+
+        const Order before = *loc.it;
+
+        Event m {};
+        m.type = EventType::OrderModified;
+        m.id = before.id;
+        m.seq = seq;
+        m.side = before.side;
+        m.price_ticks = price_ticks;
+        m.qty = qty;
+        m.remaining_qty = qty;
+        m.reason = "requeued";
+
+        if (!auction_ && !opposite.empty() && crosses(before.side, price_ticks, opposite.begin()->first))
+        {
+            // new price crosses so the order leaves the book and matches as a taker
+            erase_order(idx_it);
+
+            events.push_back(m);
+
+            Taker t {};
+            t.order = before;
+            t.order.price_ticks = price_ticks;
+            t.order.qty = qty;
+            t.order.seq = seq;
+            t.order.participant_prev = nullptr;
+            t.order.participant_next = nullptr;
+            t.qty = qty;
+            t.stp_key = stp_key_for(before.stp_group, before.stp_mode);
+
+            match_against(opposite, events, t);
+            finish_taker(events, t, TimeInForce::Gtc);
+            return;
+        }
+
+        // passive requeue moves the order without touching the index entry, a list splices the same node
+        // the locator's level stays valid across the emplace where a side iterator might not
+        PriceLevel& old_level = *loc.level;
+        if constexpr (Queue::kTracked)
+        {
+            old_level.queue.remove(loc.slot, before.qty);
+        }
+        auto new_lvl = own.try_emplace(price_ticks).first;
+        PriceLevel& new_level = new_lvl->second;
+        loc.it = move_to_tail(old_level.orders, new_level.orders, loc.it);
+
+        old_level.total_qty -= before.qty;
+        new_level.total_qty += qty;
+
+        if (old_level.orders.empty())
+        {
+            own.erase(loc.price_ticks);
+        }
+
+        state_hash_ ^= order_key(*loc.it);
+        loc.it->price_ticks = price_ticks;
+        loc.it->qty = qty;
+        loc.it->seq = seq;
+        state_hash_ ^= order_key(*loc.it);
+        if (loc.it->participant_next != nullptr)
+        {
+            // the fresh seq puts it behind the rest of its participant's orders, keep the chain in seq order
+            unlink_participant(*loc.it);
+            link_participant(*loc.it);
+        }
+        loc.price_ticks = price_ticks;
+        loc.level = &new_level;
+        queue_push(new_level, loc);
+
+        events.push_back(m);
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::modify(OrderId id, PriceTicks price_ticks, Qty qty)
+    {
+        std::vector<Event> events;
+
+        if (id == 0 || price_ticks <= 0 || qty <= 0)
+        {
+            Event e {};
+            e.type = EventType::ModifyRejected;
+            e.id = id;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "invalid";
+            events.push_back(e);
+            return events;
+        }
+
+        if (const char* bad = spec_violation(price_ticks, qty))
+        {
+            Event e {};
+            e.type = EventType::ModifyRejected;
+            e.id = id;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = bad;
+            events.push_back(e);
+            return events;
+        }
+
+        auto idx_it = index_.find(id);
+        if (idx_it == index_.end())
+        {
+            Event e {};
+            e.type = EventType::ModifyRejected;
+            e.id = id;
+            e.price_ticks = price_ticks;
+            e.qty = qty;
+            e.reason = "not_found";
+            events.push_back(e);
+            return events;
+        }
+
+        Locator& loc = idx_it->second;
+        Order& o = *loc.it;
+
+        if (price_ticks == o.price_ticks && qty <= o.qty)
+        {
+            // reduction in place through the locator keeps fifo position
+            loc.level->total_qty -= o.qty - qty;
+            if constexpr (Queue::kTracked)
+            {
+                loc.level->queue.reduce(loc.slot, o.qty - qty);
+            }
+            state_hash_ ^= order_key(o);
+            o.qty = qty;
+            state_hash_ ^= order_key(o);
+
+            Event e {};
+            e.type = EventType::OrderModified;
+            e.id = o.id;
+            e.seq = o.seq;
+            e.side = o.side;
+            e.price_ticks = o.price_ticks;
+            e.qty = qty;
+            e.remaining_qty = qty;
+            e.reason = "reduced";
+            events.push_back(e);
+
+            assert_invariants();
+            return events;
+        }
+
+        if (loc.side == Side::Buy)
+        {
+            requeue_order(bids_, asks_, events, idx_it, price_ticks, qty);
+        }
+        else
+        {
+            requeue_order(asks_, bids_, events, idx_it, price_ticks, qty);
+        }
+
+        // a crossing requeue may have traded through pending stops
+        run_stop_cascade(events);
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    template <typename Levels>
+    void BasicOrderBook<I, P>::cancel_levels(Levels& levels, typename Levels::iterator first, typename Levels::iterator last, std::vector<Event>& events)
+    {
+        // size the output once so large sweeps do not regrow it
+        std::size_t count { 0 };
+        for (auto lvl_it = first; lvl_it != last; ++lvl_it)
+        {
+            count += lvl_it->second.orders.size();
+        }
+        events.reserve(events.size() + count);
+
+        for (auto lvl_it = first; lvl_it != last; ++lvl_it)
+        {
+            for (auto& o : lvl_it->second.orders)
+            {
+                unlink_participant(o);
+                index_.erase(o.id);
+                state_hash_ ^= order_key(o);
+
+                Event e {};
+                e.type = EventType::OrderCancelled;
+                e.id = o.id;
+                e.seq = o.seq;
+                e.side = o.side;
+                e.price_ticks = o.price_ticks;
+                e.qty = o.qty;
+                e.remaining_qty = 0;
+                e.reason = "mass_cancel";
+                events.push_back(e);
+            }
+        }
+
+        // one range erase releases every level and list node together
+        levels.erase(first, last);
+    }
+
+    template <typename I, typename P>
+    template <typename Stops>
+    void BasicOrderBook<I, P>::cancel_stops(Stops& stops, std::vector<Event>& events)
+    {
+        // pending stops go in trigger then fifo order after the resting orders
+        for (const auto& kv : stops)
+        {
+            for (const auto& so : kv.second)
+            {
+                stop_index_.erase(so.id);
+
+                Event e {};
+                e.type = EventType::OrderCancelled;
+                e.id = so.id;
+                e.side = so.side;
+                e.price_ticks = so.stop_price_ticks;
+                e.qty = so.qty;
+                e.reason = "mass_cancel";
+                events.push_back(e);
+            }
+        }
+        stops.clear();
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::cancel_all()
+    {
+        std::vector<Event> events;
+
+        cancel_levels(bids_, bids_.begin(), bids_.end(), events);
+        cancel_levels(asks_, asks_.begin(), asks_.end(), events);
+        cancel_stops(buy_stops_, events);
+        cancel_stops(sell_stops_, events);
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::cancel_side(Side side)
+    {
+        std::vector<Event> events;
+
+        if (side == Side::Buy)
+        {
+            cancel_levels(bids_, bids_.begin(), bids_.end(), events);
+            cancel_stops(buy_stops_, events);
+        }
+        else
+        {
+            cancel_levels(asks_, asks_.begin(), asks_.end(), events);
+            cancel_stops(sell_stops_, events);
+        }
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::cancel_range(Side side, PriceTicks min_price_ticks, PriceTicks max_price_ticks)
+    {
+        std::vector<Event> events;
+
+        if (min_price_ticks <= 0 || max_price_ticks < min_price_ticks)
+        {
+            Event e {};
+            e.type = EventType::CancelRejected;
+            e.side = side;
+            e.price_ticks = min_price_ticks;
+            e.reason = "invalid";
+            events.push_back(e);
+            return events;
+        }
+
+        if (side == Side::Buy)
+        {
+            // bids run high to low so the range starts at max
+            cancel_levels(bids_, bids_.lower_bound(max_price_ticks), bids_.upper_bound(min_price_ticks), events);
+        }
+        else
+        {
+            cancel_levels(asks_, asks_.lower_bound(min_price_ticks), asks_.upper_bound(max_price_ticks), events);
+        }
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::cancel_participant(ParticipantId participant)
+    {
+        std::vector<Event> events;
+
+        auto chain_it = participants_.find(participant);
+        if (participant == 0 || chain_it == participants_.end())
+        {
+            return events;
+        }
+
+        events.reserve(chain_it->second.count);
+
+        // walk the chain head first, erase_order drops the chain with its last order
+        Order* o = chain_it->second.head;
+        while (o != nullptr)
+        {
+            Order* next = o->participant_next;
+
+            Event e {};
+            e.type = EventType::OrderCancelled;
+            e.id = o->id;
+            e.seq = o->seq;
+            e.side = o->side;
+            e.price_ticks = o->price_ticks;
+            e.qty = o->qty;
+            e.remaining_qty = 0;
+            e.reason = "participant_cancel";
+            events.push_back(e);
+
+            auto idx_it = index_.find(o->id);
+            assert(idx_it != index_.end());
+            erase_order(idx_it);
+
+            o = next;
+        }
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::advance_time(LogicalTime now)
+    {
+        std::vector<Event> events;
+
+        if (now <= wheel_.now())
+        {
+            return events;
+        }
+
+        std::vector<TimingWheel::Entry> due;
+        wheel_.advance(now, due);
+        events.reserve(due.size());
+
+        for (const auto& d : due)
+        {
+            // an entry only counts while its id is still live with the same deadline
+            auto idx_it = index_.find(d.id);
+            if (idx_it != index_.end())
+            {
+                const Order snapshot = *idx_it->second.it;
+                if (snapshot.expire_at != d.deadline)
+                {
+                    continue;
+                }
+
+                erase_order(idx_it);
+
+                Event e {};
+                e.type = EventType::OrderCancelled;
+                e.id = snapshot.id;
+                e.seq = snapshot.seq;
+                e.side = snapshot.side;
+                e.price_ticks = snapshot.price_ticks;
+                e.qty = snapshot.qty;
+                e.remaining_qty = 0;
+                e.reason = "expired";
+                events.push_back(e);
+                continue;
+            }
+
+            auto stop_it = stop_index_.find(d.id);
+            if (stop_it != stop_index_.end() && stop_it->second.it->opts.expire_at == d.deadline)
+            {
+                const StopOrder so = *stop_it->second.it;
+                erase_stop(stop_it);
+
+                Event e {};
+                e.type = EventType::OrderCancelled;
+                e.id = so.id;
+                e.side = so.side;
+                e.price_ticks = so.stop_price_ticks;
+                e.qty = so.qty;
+                e.reason = "expired";
+                events.push_back(e);
+            }
+        }
+
+        assert_invariants();
+        return events;
+    }
+
+    template <typename I, typename P>
+    std::uint64_t BasicOrderBook<I, P>::state_hash() const
+    {
+        return state_hash_;
+    }
+
+    template <typename I, typename P>
+    LogicalTime BasicOrderBook<I, P>::now() const
+    {
+        return wheel_.now();
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::begin_auction()
+    {
+        auction_ = true;
+    }
+
+    template <typename I, typename P>
+    bool BasicOrderBook<I, P>::in_auction() const
+    {
+        return auction_;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::allocate_uncross(std::vector<Event>& events, PriceTicks price_ticks, Qty volume)
+    {
+        // eligible orders are exactly the best prefix of each side, so both walks start at the top
+        while (volume > 0)
+        {
+            auto bid_lvl = bids_.begin();
+            auto ask_lvl = asks_.begin();
+            assert(bid_lvl != bids_.end() && ask_lvl != asks_.end());
+
+            Order& b = bid_lvl->second.orders.front();
+            Order& a = ask_lvl->second.orders.front();
+
+            const Qty fill = std::min<Qty>({ volume, b.qty, a.qty });
+
+            // no aggressor in an auction, the order that rested first is reported as maker
+            const bool bid_first = b.seq < a.seq;
+            const Order& maker = bid_first ? b : a;
+            const Order& taker = bid_first ? a : b;
+
+            Event trade {};
+            trade.type = EventType::Trade;
+            trade.maker_id = maker.id;
+            trade.maker_seq = maker.seq;
+            trade.taker_id = taker.id;
+            trade.taker_seq = taker.seq;
+            trade.trade_price_ticks = price_ticks;
+            trade.trade_qty = fill;
+            trade.reason = "uncross";
+            events.push_back(trade);
+
+            // keys follow the qty, erase_order then drops the zero qty key of a completed order
+            volume -= fill;
+            state_hash_ ^= order_key(b) ^ order_key(a);
+            b.qty -= fill;
+            a.qty -= fill;
+            state_hash_ ^= order_key(b) ^ order_key(a);
+            bid_lvl->second.total_qty -= fill;
+            ask_lvl->second.total_qty -= fill;
+            queue_reduce(bid_lvl->second, queue_head_slot(bid_lvl->second), fill);
+            queue_reduce(ask_lvl->second, queue_head_slot(ask_lvl->second), fill);
+
+            // both sides can complete on the same fill, bid first
+            if (b.qty == 0)
+            {
+                const Order filled = b;
+                erase_order(index_.find(filled.id));
+                remove_filled_maker(events, filled);
+            }
+            if (a.qty == 0)
+            {
+                const Order filled = a;
+                erase_order(index_.find(filled.id));
+                remove_filled_maker(events, filled);
+            }
         }
-        else
-        {
-            // taker fully filled immediately
-            Event e {};
-            e.type = EventType::OrderCompleted;
-            e.id = id;
-            e.seq = taker_seq;
-            e.side = side;
-            e.price_ticks = price_ticks;
-            e.qty = qty;
-            e.remaining_qty = 0;
-            e.reason = "filled";
-            events.push_back(e);
-        }
 
-        assert_invariants();
-        return events;
+        last_trade_px_ = price_ticks;
     }
 
-    std::vector<Event> OrderBook::cancel(OrderId id)
+    template <typename I, typename P>
+    std::vector<Event> BasicOrderBook<I, P>::uncross()
     {
         std::vector<Event> events;
+        auction_ = false;
 
-        // id zero is invalid input
-        if (id == 0)
+        if (bids_.empty() || asks_.empty() || bids_.begin()->first < asks_.begin()->first)
         {
-            Event e {};
-            e.type = EventType::CancelRejected;
-            e.id = id;
-            e.reason = "invalid";
-            events.push_back(e);
+            assert_invariants();
             return events;
         }
 
-        auto idx_it = index_.find(id);
-        if (idx_it == index_.end())
-        {
-            Event e {};
-            e.type = EventType::CancelRejected;
-            e.id = id;
-            e.reason = "not_found";
-            events.push_back(e);
-            return events;
-        }
+        // level grid over the crossed range only, merged low to high from both sides
+        const PriceTicks low = asks_.begin()->first;
+        const PriceTicks high = bids_.begin()->first;
 
-        const Locator loc = idx_it->second;
+        std::vector<PriceTicks> prices;
+        std::vector<Qty> bid_qty;
+        std::vector<Qty> ask_qty;
 
-        // capture state before erase
-        const Order snapshot = *loc.it;
+        auto bid_it = std::make_reverse_iterator(bids_.upper_bound(low));
+        const auto bid_end = bids_.rend();
+        auto ask_it = asks_.begin();
+        const auto ask_end = asks_.upper_bound(high);
 
-        if (loc.side == Side::Buy)
+        while (bid_it != bid_end || ask_it != ask_end)
         {
-            auto lvl_it = bids_.find(loc.price_ticks);
-            assert(lvl_it != bids_.end());
+            const bool take_bid = bid_it != bid_end && (ask_it == ask_end || bid_it->first <= ask_it->first);
+            const bool take_ask = ask_it != ask_end && (bid_it == bid_end || ask_it->first <= bid_it->first);
 
-            PriceLevel& level = lvl_it->second;
-            level.erase(loc.it);
+            prices.push_back(take_bid ? bid_it->first : ask_it->first);
+            bid_qty.push_back(take_bid ? bid_it->second.total_qty : 0);
+            ask_qty.push_back(take_ask ? ask_it->second.total_qty : 0);
 
-            if (level.empty())
+            if (take_bid)
             {
-                bids_.erase(lvl_it);
+                ++bid_it;
             }
-        }
-        else
-        {
-            auto lvl_it = asks_.find(loc.price_ticks);
-            assert(lvl_it != asks_.end());
-
-            PriceLevel& level = lvl_it->second;
-            level.erase(loc.it);
-
-            if (level.empty())
+            if (take_ask)
             {
-                asks_.erase(lvl_it);
+                ++ask_it;
             }
         }
 
-        index_.erase(idx_it);
+        // bids below low and asks above high can never trade, so the grid is the whole curve
+        const auto eq = find_equilibrium(prices, bid_qty, ask_qty, last_trade_px_);
+        assert(eq.has_value());
 
-        // cancellation event reports remaining qty that was removed
-        Event e {};
-        e.type = EventType::OrderCancelled;
-        e.id = snapshot.id;
-        e.seq = snapshot.seq;
-        e.side = snapshot.side;
-        e.price_ticks = snapshot.price_ticks;
-        e.qty = snapshot.qty;
-        e.remaining_qty = 0;
-        e.reason = "cancelled";
-        events.push_back(e);
+        allocate_uncross(events, eq->price_ticks, eq->volume);
+        run_stop_cascade(events);
 
         assert_invariants();
         return events;
     }
 
-    std::size_t OrderBook::live_order_count() const
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::live_order_count() const
     {
         return index_.size();
     }
 
-    bool OrderBook::has_order(OrderId id) const
+    template <typename I, typename P>
+    bool BasicOrderBook<I, P>::has_order(OrderId id) const
     {
         return index_.find(id) != index_.end();
     }
 
-    std::optional<PriceTicks> OrderBook::best_bid_price() const
+    template <typename I, typename P>
+    const typename BasicOrderBook<I, P>::Order* BasicOrderBook<I, P>::find_order(OrderId id) const
+    {
+        auto it = index_.find(id);
+        if (it == index_.end())
+        {
+            return nullptr;
+        }
+        return &*it->second.it;
+    }
+
+    template <typename I, typename P>
+    std::optional<QueuePosition> BasicOrderBook<I, P>::queue_position(OrderId id) const
+    {
+        const auto idx_it = index_.find(id);
+        if (idx_it == index_.end())
+        {
+            return std::nullopt;
+        }
+
+        const Locator& loc = idx_it->second;
+        if constexpr (Queue::kTracked)
+        {
+            return loc.level->queue.ahead(loc.slot);
+        }
+        else
+        {
+            // without a tree the level is walked from its head up to the order
+            QueuePosition pos {};
+            for (auto it = loc.level->orders.begin(); it != loc.it; ++it)
+            {
+                pos.qty_ahead += it->qty;
+                ++pos.orders_ahead;
+            }
+            return pos;
+        }
+    }
+
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::participant_order_count(ParticipantId participant) const
+    {
+        auto it = participants_.find(participant);
+        if (it == participants_.end())
+        {
+            return 0;
+        }
+        return it->second.count;
+    }
+
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::pending_stop_count() const
+    {
+        return stop_index_.size();
+    }
+
+    template <typename I, typename P>
+    bool BasicOrderBook<I, P>::has_stop(OrderId id) const
+    {
+        return stop_index_.find(id) != stop_index_.end();
+    }
+
+    template <typename I, typename P>
+    std::optional<PriceTicks> BasicOrderBook<I, P>::last_trade_price() const
+    {
+        return last_trade_px_;
+    }
+
+    template <typename I, typename P>
+    std::optional<PriceTicks> BasicOrderBook<I, P>::best_bid_price() const
     {
         // best bid is first key in bids map
         if (bids_.empty())
@@ -423,7 +1899,8 @@ namespace ob
         return bids_.begin()->first;
     }
 
-    std::optional<PriceTicks> OrderBook::best_ask_price() const
+    template <typename I, typename P>
+    std::optional<PriceTicks> BasicOrderBook<I, P>::best_ask_price() const
     {
         // best ask is first key in asks map
         if (asks_.empty())
@@ -433,75 +1910,545 @@ namespace ob
         return asks_.begin()->first;
     }
 
-    std::vector<OrderId> OrderBook::order_ids_at(Side side, PriceTicks price_ticks) const
+    template <typename I, typename P>
+    const typename BasicOrderBook<I, P>::PriceLevel* BasicOrderBook<I, P>::find_level(Side side, PriceTicks price_ticks) const
+    {
+        if (side == Side::Buy)
+        {
+            const auto it = bids_.find(price_ticks);
+            return (it == bids_.end()) ? nullptr : &it->second;
+        }
+        const auto it = asks_.find(price_ticks);
+        return (it == asks_.end()) ? nullptr : &it->second;
+    }
+
+    template <typename I, typename P>
+    std::vector<OrderId> BasicOrderBook<I, P>::order_ids_at(Side side, PriceTicks price_ticks) const
     {
         // returns ids in fifo order at the exact level
         std::vector<OrderId> out_ids;
+        if (const PriceLevel* level = find_level(side, price_ticks))
+        {
+            out_ids.resize(level->orders.size());
+            copy_order_ids_at(side, price_ticks, out_ids);
+        }
+        return out_ids;
+    }
 
-        if (side == Side::Buy)
+    template <typename I, typename P>
+    Qty BasicOrderBook<I, P>::total_qty_at(Side side, PriceTicks price_ticks) const
+    {
+        // reads the cached level aggregate
+        const PriceLevel* level = find_level(side, price_ticks);
+        return (level == nullptr) ? 0 : level->total_qty;
+    }
+
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::copy_depth(Side side, std::span<DepthLevel> out) const
+    {
+        std::size_t n = 0;
+        visit_depth(side, out.size(), [&](const DepthLevel& d) { out[n++] = d; });
+        return n;
+    }
+
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::copy_order_ids_at(Side side, PriceTicks price_ticks, std::span<OrderId> out) const
+    {
+        const PriceLevel* level = find_level(side, price_ticks);
+        if (level == nullptr)
+        {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        for (auto it = level->orders.begin(); it != level->orders.end() && n < out.size(); ++it)
+        {
+            out[n++] = it->id;
+        }
+        return n;
+    }
+
+    template <typename I, typename P>
+    Qty BasicOrderBook<I, P>::available_qty(Side taker_side, PriceTicks limit_px, Qty qty) const
+    {
+        // buy takers draw on asks and sell takers on bids
+        if (taker_side == Side::Buy)
+        {
+            return crossing_qty(asks_, taker_side, limit_px, qty);
+        }
+        return crossing_qty(bids_, taker_side, limit_px, qty);
+    }
+
+    template <typename I, typename P>
+    FillEstimate BasicOrderBook<I, P>::estimate_fill(Side taker_side, Qty qty) const
+    {
+        FillEstimate e {};
+        estimate_fills(taker_side, std::span<const Qty>(&qty, 1), std::span<FillEstimate>(&e, 1));
+        return e;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::estimate_fills(Side taker_side, std::span<const Qty> qtys, std::span<FillEstimate> out) const
+    {
+        // buy takers draw on asks and sell takers on bids
+        if (taker_side == Side::Buy)
+        {
+            estimate_fills_on(asks_, qtys, out);
+            return;
+        }
+        estimate_fills_on(bids_, qtys, out);
+    }
+
+    // snapshot image header, bumped whenever the layout changes
+    static constexpr std::uint32_t kStateMagic = 0x5353424f; // "OBSS"
+    static constexpr std::uint32_t kStateVersion = 1;
+
+    static void put_options(std::vector<char>& out, const OrderOptions& opts)
+    {
+        put_u8(out, static_cast<std::uint8_t>(opts.tif));
+        put_u32(out, opts.participant);
+        put_u32(out, opts.stp_group);
+        put_u8(out, static_cast<std::uint8_t>(opts.stp_mode));
+        put_u64(out, opts.expire_at);
+    }
+
+    static bool get_options(ByteReader& r, OrderOptions& opts)
+    {
+        const std::uint8_t tif = r.u8();
+        opts.participant = r.u32();
+        opts.stp_group = r.u32();
+        const std::uint8_t stp = r.u8();
+        opts.expire_at = r.u64();
+
+        if (tif > static_cast<std::uint8_t>(TimeInForce::Fok) || stp > static_cast<std::uint8_t>(StpMode::Decrement))
+        {
+            return false;
+        }
+        opts.tif = static_cast<TimeInForce>(tif);
+        opts.stp_mode = static_cast<StpMode>(stp);
+        return true;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::save_state(std::vector<char>& out) const
+    {
+        put_u32(out, kStateMagic);
+        put_u32(out, kStateVersion);
+        put_u64(out, next_seq_);
+        put_u8(out, auction_ ? 1 : 0);
+        put_u8(out, last_trade_px_.has_value() ? 1 : 0);
+        put_i64(out, last_trade_px_.value_or(0));
+
+        // seq order is fifo within every level and chain order for every participant,
+        // so resting them again in this order rebuilds both exactly
+        std::vector<const Order*> orders;
+        orders.reserve(index_.size());
+        for (const auto& kv : index_)
+        {
+            orders.push_back(&*kv.second.it);
+        }
+        std::sort(orders.begin(), orders.end(), [](const Order* a, const Order* b) { return a->seq < b->seq; });
+
+        put_u64(out, orders.size());
+        for (const Order* o : orders)
+        {
+            put_u64(out, o->id);
+            put_u64(out, o->seq);
+            put_u8(out, static_cast<std::uint8_t>(o->side));
+            put_i64(out, o->price_ticks);
+            put_i64(out, o->qty);
+
+            OrderOptions opts {};
+            opts.participant = o->participant;
+            opts.stp_group = o->stp_group;
+            opts.stp_mode = o->stp_mode;
+            opts.expire_at = o->expire_at;
+            put_options(out, opts);
+        }
+
+        // stops in trigger then fifo order, buys before sells
+        put_u64(out, stop_index_.size());
+        auto put_stops = [&out](const auto& stops)
+        {
+            for (const auto& [px, list] : stops)
+            {
+                for (const StopOrder& so : list)
+                {
+                    put_u64(out, so.id);
+                    put_u8(out, static_cast<std::uint8_t>(so.side));
+                    put_i64(out, so.stop_price_ticks);
+                    put_i64(out, so.price_ticks);
+                    put_i64(out, so.qty);
+                    put_options(out, so.opts);
+                }
+            }
+        };
+        put_stops(buy_stops_);
+        put_stops(sell_stops_);
+
+        // stale entries are kept too, an old entry for a reused id decides where its expiry lands in a tie
+        LogicalTime now { 0 };
+        std::uint64_t next_order { 0 };
+        std::vector<TimingWheel::Entry> entries;
+        wheel_.save(now, next_order, entries);
+
+        put_u64(out, now);
+        put_u64(out, next_order);
+        put_u64(out, entries.size());
+        for (const auto& e : entries)
+        {
+            put_u64(out, e.deadline);
+            put_u64(out, e.id);
+            put_u64(out, e.order);
+        }
+    }
+
+    template <typename I, typename P>
+    bool BasicOrderBook<I, P>::load_state(const char* data, std::size_t size)
+    {
+        ByteReader r { reinterpret_cast<const unsigned char*>(data), size };
+        if (r.u32() != kStateMagic || r.u32() != kStateVersion)
+        {
+            return false;
+        }
+
+        // built aside so a bad image never leaves this book half loaded
+        BasicOrderBook b(resource_);
+        b.spec_ = spec_;
+        b.reserve(reserved_orders_, reserved_levels_);
+        b.next_seq_ = r.u64();
+        b.auction_ = r.u8() != 0;
+        const bool has_last = r.u8() != 0;
+        const PriceTicks last = r.i64();
+        if (has_last)
         {
-            auto it = bids_.find(price_ticks);
-            if (it == bids_.end())
+            b.last_trade_px_ = last;
+        }
+
+        const std::uint64_t order_count = r.u64();
+        std::uint64_t prev_seq { 0 };
+        for (std::uint64_t i = 0; i < order_count && r.ok; ++i)
+        {
+            Order o {};
+            o.id = r.u64();
+            o.seq = r.u64();
+            const std::uint8_t side = r.u8();
+            const PriceTicks price_ticks = r.i64();
+            const Qty qty = r.i64();
+
+            OrderOptions opts {};
+            if (!get_options(r, opts) || side > 1 || !is_valid_input(o.id, price_ticks, qty)
+                || o.seq <= prev_seq || o.seq >= b.next_seq_ || b.index_.count(o.id) != 0)
+            {
+                return false;
+            }
+
+            // a fixed instrument stores narrow values, anything outside its spec would not fit
+            if constexpr (I::kFixed)
+            {
+                if (spec_violation(price_ticks, qty) != nullptr)
+                {
+                    return false;
+                }
+            }
+            prev_seq = o.seq;
+            o.price_ticks = price_ticks;
+            o.qty = qty;
+
+            o.side = static_cast<Side>(side);
+            o.participant = opts.participant;
+            o.stp_group = opts.stp_group;
+            o.stp_mode = opts.stp_mode;
+            o.expire_at = opts.expire_at;
+
+            if (o.side == Side::Buy)
+            {
+                b.rest_order(b.bids_, o);
+            }
+            else
+            {
+                b.rest_order(b.asks_, o);
+            }
+        }
+
+        const std::uint64_t stop_count = r.u64();
+        for (std::uint64_t i = 0; i < stop_count && r.ok; ++i)
+        {
+            StopOrder so {};
+            so.id = r.u64();
+            const std::uint8_t side = r.u8();
+            so.stop_price_ticks = r.i64();
+            so.price_ticks = r.i64();
+            so.qty = r.i64();
+            if (!get_options(r, so.opts) || side > 1 || so.id == 0 || so.qty <= 0 || so.stop_price_ticks <= 0
+                || so.price_ticks < 0 || b.stop_index_.count(so.id) != 0)
             {
-                return out_ids;
+                return false;
             }
+            so.side = static_cast<Side>(side);
+
+            StopList& list = (so.side == Side::Buy) ? b.buy_stops_[so.stop_price_ticks] : b.sell_stops_[so.stop_price_ticks];
+            list.push_back(so);
+            b.stop_index_.emplace(so.id, StopLocator { so.side, so.stop_price_ticks, std::prev(list.end()) });
+        }
 
-            const PriceLevel& level = it->second;
-            out_ids.reserve(level.size());
+        const LogicalTime now = r.u64();
+        const std::uint64_t next_order = r.u64();
+        const std::uint64_t entry_count = r.u64();
 
-            for (const auto& o : level)
+        std::vector<TimingWheel::Entry> entries;
+        for (std::uint64_t i = 0; i < entry_count && r.ok; ++i)
+        {
+            TimingWheel::Entry e {};
+            e.deadline = r.u64();
+            e.id = r.u64();
+            e.order = r.u64();
+            if (e.deadline <= now || e.order >= next_order)
             {
-                out_ids.push_back(o.id);
+                return false;
             }
-            return out_ids;
+            entries.push_back(e);
         }
 
-        auto it = asks_.find(price_ticks);
-        if (it == asks_.end())
+        if (!r.ok || r.left != 0)
         {
-            return out_ids;
+            return false;
         }
 
-        const PriceLevel& level = it->second;
-        out_ids.reserve(level.size());
+        // the image must satisfy the same invariants the live book keeps
+        const bool crossed = !b.bids_.empty() && !b.asks_.empty() && b.bids_.begin()->first >= b.asks_.begin()->first;
+        if (crossed && !b.auction_)
+        {
+            return false;
+        }
 
-        for (const auto& o : level)
+        std::size_t expiring { 0 };
+        for (const auto& kv : b.index_)
         {
-            out_ids.push_back(o.id);
+            expiring += (kv.second.it->expire_at != 0) ? 1 : 0;
         }
-        return out_ids;
+        for (const auto& kv : b.stop_index_)
+        {
+            expiring += (kv.second.it->opts.expire_at != 0) ? 1 : 0;
+        }
+        if (expiring > entries.size())
+        {
+            return false;
+        }
+
+        b.wheel_.restore(now, next_order, entries);
+
+        *this = std::move(b);
+        assert_invariants();
+        return true;
     }
 
-    Qty OrderBook::total_qty_at(Side side, PriceTicks price_ticks) const
+    // glibc chunk for one allocation: an 8 byte header, 16 byte rounding, 32 byte minimum
+    static std::size_t chunk_bytes(std::size_t payload)
     {
-        // sums remaining qty at a level
-        Qty total { 0 };
+        return std::max<std::size_t>(32, (payload + 8 + 15) & ~std::size_t { 15 });
+    }
 
-        if (side == Side::Buy)
-        {
-            auto it = bids_.find(price_ticks);
-            if (it == bids_.end())
-            {
-                return 0;
-            }
+    // libstdc++ node layouts: two links before a list value, color and three links before a tree value,
+    // one link before a hash value since integer keys do not cache their hash
+    template <typename T>
+    static std::size_t list_node_bytes()
+    {
+        return chunk_bytes(2 * sizeof(void*) + sizeof(T));
+    }
+
+    template <typename K, typename V>
+    static std::size_t tree_node_bytes()
+    {
+        return chunk_bytes(4 * sizeof(void*) + sizeof(std::pair<const K, V>));
+    }
+
+    template <typename K, typename V>
+    static std::size_t hash_node_bytes()
+    {
+        return chunk_bytes(sizeof(void*) + sizeof(std::pair<const K, V>));
+    }
+
+    // std containers are estimated from those layouts, the policy containers report their own bytes
+    template <typename T>
+    static void container_usage(const std::pmr::list<T>& c, std::size_t& used, std::size_t& reserved)
+    {
+        used = c.size() * list_node_bytes<T>();
+        reserved = 0;
+    }
+
+    template <typename K, typename V, typename Compare>
+    static void container_usage(const std::pmr::map<K, V, Compare>& c, std::size_t& used, std::size_t& reserved)
+    {
+        used = c.size() * tree_node_bytes<K, V>();
+        reserved = 0;
+    }
+
+    // a bucket per entry is used, the empty ones are reserved
+    template <typename K, typename V>
+    static void container_usage(const std::pmr::unordered_map<K, V>& c, std::size_t& used, std::size_t& reserved)
+    {
+        used = c.size() * (hash_node_bytes<K, V>() + sizeof(void*));
+        reserved = (c.bucket_count() - std::min(c.bucket_count(), c.size())) * sizeof(void*);
+    }
+
+    template <typename C>
+    static void container_usage(const C& c, std::size_t& used, std::size_t& reserved)
+    {
+        c.memory_usage(used, reserved);
+    }
+
+    // bytes one more entry adds, what the peak counts are multiplied by
+    template <typename T>
+    static std::size_t entry_bytes(const std::pmr::list<T>*)
+    {
+        return list_node_bytes<T>();
+    }
 
-            for (const auto& o : it->second)
+    template <typename K, typename V, typename Compare>
+    static std::size_t entry_bytes(const std::pmr::map<K, V, Compare>*)
+    {
+        return tree_node_bytes<K, V>();
+    }
+
+    template <typename K, typename V>
+    static std::size_t entry_bytes(const std::pmr::unordered_map<K, V>*)
+    {
+        return hash_node_bytes<K, V>() + sizeof(void*);
+    }
+
+    template <typename C>
+    static std::size_t entry_bytes(const C*)
+    {
+        return C::kEntryBytes;
+    }
+
+    template <typename I, typename P>
+    MemoryUsage BasicOrderBook<I, P>::memory_usage() const
+    {
+        MemoryUsage m {};
+        std::size_t used { 0 };
+        std::size_t reserved { 0 };
+
+        // each level owns its order storage and queue tree, so levels are walked but orders never are
+        const auto add_side = [&](const auto& side) {
+            container_usage(side, used, reserved);
+            m.levels += used;
+            m.slack += reserved;
+            for (const auto& kv : side)
             {
-                total += o.qty;
+                container_usage(kv.second.orders, used, reserved);
+                m.orders += used;
+                m.slack += reserved;
+                if constexpr (Queue::kTracked)
+                {
+                    kv.second.queue.memory_usage(used, reserved);
+                    m.levels += used;
+                    m.slack += reserved;
+                }
             }
-            return total;
+        };
+        add_side(bids_);
+        add_side(asks_);
+
+        container_usage(index_, used, reserved);
+        m.index = used;
+        m.slack += reserved;
+
+        m.stops = stop_index_.size() * (list_node_bytes<StopOrder>() + hash_node_bytes<OrderId, StopLocator>())
+            + (buy_stops_.size() + sell_stops_.size()) * tree_node_bytes<PriceTicks, StopList>()
+            + stop_index_.bucket_count() * sizeof(void*);
+
+        std::size_t wheel_used { 0 };
+        std::size_t wheel_reserved { 0 };
+        wheel_.memory_usage(wheel_used, wheel_reserved);
+
+        m.other = sizeof(BasicOrderBook) + wheel_used + participants_.size() * hash_node_bytes<ParticipantId, ParticipantOrders>()
+            + participants_.bucket_count() * sizeof(void*);
+        m.slack += wheel_reserved;
+
+        std::size_t order_bytes = entry_bytes(static_cast<const OrderList*>(nullptr)) + entry_bytes(&index_);
+        std::size_t level_bytes = entry_bytes(&bids_);
+        if constexpr (Queue::kTracked)
+        {
+            // a tree is reset to at least 16 slots and four per live order
+            order_bytes += 4 * Queue::kSlotBytes;
+            level_bytes += 16 * Queue::kSlotBytes;
         }
 
-        auto it = asks_.find(price_ticks);
-        if (it == asks_.end())
+        // bucket arrays and id tables never shrink, so today's slack is counted at the peak too
+        m.peak_live_orders = peak_live_orders_;
+        m.peak_levels = peak_levels_;
+        m.peak_bytes = peak_live_orders_ * order_bytes + peak_levels_ * level_bytes + m.stops + m.other + m.slack;
+        return m;
+    }
+
+    template <typename I, typename P>
+    void BasicOrderBook<I, P>::reserve(std::size_t max_live_orders, std::size_t expected_levels)
+    {
+        reserved_orders_ = max_live_orders;
+        reserved_levels_ = expected_levels;
+        index_.reserve(max_live_orders);
+        if constexpr (requires { bids_.reserve(expected_levels); })
         {
-            return 0;
+            // either side may end up holding every level
+            bids_.reserve(expected_levels);
+            asks_.reserve(expected_levels);
         }
+    }
+
+    static std::size_t arena_node(std::size_t payload)
+    {
+        return (payload + 15) & ~std::size_t { 15 };
+    }
 
-        for (const auto& o : it->second)
+    template <typename I, typename P>
+    std::size_t BasicOrderBook<I, P>::reserve_bytes(std::size_t max_live_orders, std::size_t expected_levels)
+    {
+        const std::size_t order_node = arena_node(2 * sizeof(void*) + sizeof(Order));
+        const std::size_t index_node = arena_node(sizeof(void*) + sizeof(std::pair<const OrderId, Locator>));
+        const std::size_t level_node = arena_node(4 * sizeof(void*) + sizeof(std::pair<const PriceTicks, PriceLevel>));
+
+        // the reserved bucket array is at most twice the count, plus the empty one it replaced
+        const std::size_t buckets = 2 * max_live_orders * sizeof(void*) + 64;
+        std::size_t total = max_live_orders * (order_node + index_node) + expected_levels * level_node + buckets;
+        if constexpr (std::is_same_v<typename P::sides, FlatSides>)
+        {
+            // the key vector of each side, sized for every level
+            total += 2 * arena_node(expected_levels * (sizeof(PriceTicks) + sizeof(void*)));
+        }
+        else if constexpr (std::is_same_v<typename P::sides, BitsetSides>)
+        {
+            // per side the id map of level nodes, the dense bitset tiers, and a table in each of the eight
+            // sparse tiers that holds up to four slots of key and word per level counting the ones outgrown
+            total += 2 * (arena_node(2 * expected_levels * 2 * sizeof(void*)) + 8 * 1024 + 8 * arena_node(4 * expected_levels * 2 * sizeof(std::uint64_t)));
+        }
+        if constexpr (Queue::kTracked)
         {
-            total += o.qty;
+            // a tree per level of 16 byte nodes, at least 16 of them and at most eight per order, plus the
+            // smaller trees each one outgrew
+            total += 2 * (expected_levels * arena_node(16 * 16) + max_live_orders * 8 * 16);
         }
         return total;
     }
+
+    // every instrument a book may be built for, add a line here for a new FixedInstrument
+    template class BasicOrderBook<GenericInstrument>;
+    template class BasicOrderBook<EquityInstrument>;
+    template class BasicOrderBook<FuturesInstrument>;
+
+    // container combinations, kept in step with the extern list in order_book.h
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, TreeSides, FlatIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, FlatSides, HashIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, FlatSides, FlatIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, TreeSides, HashIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, TreeSides, FlatIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, HashIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, FlatIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, BitsetSides, FlatIndex>>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, BitsetSides, FlatIndex>>;
+
+    // queue trees on the default containers, and on chunk levels whose orders move
+    template class BasicOrderBook<GenericInstrument, QueueTrackedPolicy>;
+    template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, FlatIndex, FenwickQueues>>;
 }
@@ -1,68 +1,452 @@
 #pragma once
 
+#include "book_policy.h"
 #include "event.h"
+#include "instrument.h"
 #include "order.h"
+#include "timing_wheel.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
 namespace ob
 {
+    // estimated heap bytes behind a book, each node counted at its allocator chunk size
+    struct MemoryUsage
+    {
+        std::size_t orders { 0 }; // resting order nodes or chunk slots
+        std::size_t levels { 0 }; // price level map entries and queue trees
+        std::size_t index { 0 };  // id index entries and the buckets they sit in
+        std::size_t stops { 0 };  // pending stop nodes, trigger levels and stop index
+        std::size_t other { 0 };  // participant chains, expiry entries and the book object itself
+        std::size_t slack { 0 };  // reserved but unused, empty buckets and slots, chunk holes and spare capacity
+
+        // high water marks since construction, bytes are estimated from the peak counts
+        std::size_t peak_live_orders { 0 };
+        std::size_t peak_levels { 0 };
+        std::size_t peak_bytes { 0 };
+
+        std::size_t total() const
+        {
+            return orders + levels + index + stops + other + slack;
+        }
+    };
+
+    // one price level as a depth query reports it
+    struct DepthLevel
+    {
+        PriceTicks price_ticks { 0 };
+        Qty total_qty { 0 };
+        std::size_t order_count { 0 };
+    };
+
+    // what a taker of some qty would fill against the book as it stands, stp and stops left out
+    struct FillEstimate
+    {
+        Qty filled_qty { 0 };
+        std::int64_t notional { 0 };        // sum of price_ticks * qty over the fills
+        double vwap { 0.0 };                // notional / filled_qty, zero when nothing fills
+        PriceTicks worst_price_ticks { 0 }; // deepest level reached, zero when nothing fills
+        std::size_t levels { 0 };           // levels the fill reaches into
+    };
+
     // order book stores resting orders grouped by side and price
-    class OrderBook
+    // the instrument fixes tick, lot, band and max qty checks and the stored price and qty widths
+    // the policy picks the level, side and index containers, see book_policy.h
+    // member definitions live in order_book.cpp, which instantiates every combination it lists
+    template <typename Instrument, typename Policy = DefaultBookPolicy>
+    class BasicOrderBook
     {
     public:
+        using Order = BasicOrder<typename Instrument::price_type, typename Instrument::qty_type>;
+
+        // every node the book allocates comes from mr, which must outlive the book
+        explicit BasicOrderBook(std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+        std::pmr::memory_resource* resource() const
+        {
+            return resource_;
+        }
+
+        // runtime spec for the generic instrument, checked after the basic positive value checks
+        // orders already resting are not revalidated, a spec that fails valid_spec is refused and the old one kept
+        bool set_instrument(const InstrumentSpec& spec)
+            requires(!Instrument::kFixed)
+        {
+            if (!valid_spec(spec))
+            {
+                return false;
+            }
+            spec_ = spec;
+            return true;
+        }
+
+        const InstrumentSpec& instrument() const
+        {
+            if constexpr (Instrument::kFixed)
+            {
+                return Instrument::spec;
+            }
+            else
+            {
+                return spec_;
+            }
+        }
+
         // applies an add limit and emits events for accept trades and final state
-        std::vector<Event> add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty);
+        // fok is decided before anything changes, from level totals alone when the taker has no stp group
+        // and by walking the orders of the crossing levels when it has one
+        std::vector<Event> add_limit(OrderId id, Side side, PriceTicks price_ticks, Qty qty, const OrderOptions& opts = {});
 
-        // applies a cancel and emits cancelled or rejected
+        // holds a stop until a trade at or through its trigger, price_ticks zero means stop market
+        // a buy stop triggers on a trade at or above its trigger and a sell stop at or below
+        std::vector<Event> add_stop(OrderId id, Side side, PriceTicks stop_price_ticks, PriceTicks price_ticks, Qty qty, const OrderOptions& opts = {});
+
+        // applies a cancel and emits cancelled or rejected, resting orders and pending stops
         std::vector<Event> cancel(OrderId id);
 
+        // amends a resting order, a qty reduction at the same price keeps queue position
+        // while a price change or qty increase moves the order to the tail with a new seq
+        std::vector<Event> modify(OrderId id, PriceTicks price_ticks, Qty qty);
+
+        // mass cancels tear down whole levels and emit cancelled events in price then fifo order
+        // cancel_all does bids before asks, each side from its best price outward
+        // all and side also drop pending stops on the affected sides after the resting orders
+        std::vector<Event> cancel_all();
+        std::vector<Event> cancel_side(Side side);
+        std::vector<Event> cancel_range(Side side, PriceTicks min_price_ticks, PriceTicks max_price_ticks);
+
+        // cancels every order of one participant by walking its chain, never the book
+        std::vector<Event> cancel_participant(ParticipantId participant);
+
+        // moves the logical clock forward and cancels every order and stop whose expiry is due
+        // events come out in deadline then arrival order with reason expired, the book is never scanned
+        std::vector<Event> advance_time(LogicalTime now);
+
+        // current logical time, orders must expire after it
+        LogicalTime now() const;
+
+        // auction phase, adds and requeues rest without matching and stops do not trigger
+        // ioc and fok are rejected because nothing can fill until the uncross
+        void begin_auction();
+        bool in_auction() const;
+
+        // ends the auction and crosses the book at the single price with the most volume
+        // fills go in price then time priority on both sides as ordinary trades, then stops run
+        std::vector<Event> uncross();
+
+        // xor of a per order key over every resting order (id, side, price, qty, seq), kept up to date
+        // in o(1) on every rest, fill, reduce and removal, so equal books hash equal without a walk
+        std::uint64_t state_hash() const;
+
         // number of live resting orders
         std::size_t live_order_count() const;
 
+        // footprint by component plus high water marks, walks only container sizes, never orders
+        // bytes per element assume the default containers whatever the policy
+        MemoryUsage memory_usage() const;
+
+        // sizes the id index so up to max_live_orders never rehash, and with flat sides each side's key
+        // vector for expected_levels, it does not make the book allocation free: order, level and tree
+        // nodes still come from the resource as they are used, cheap once a reserve_bytes arena is prefaulted
+        void reserve(std::size_t max_live_orders, std::size_t expected_levels);
+
+        // bytes an arena needs for a reserved book of that shape, nodes rounded to 16 bytes
+        static std::size_t reserve_bytes(std::size_t max_live_orders, std::size_t expected_levels);
+
         // quick membership check
         bool has_order(OrderId id) const;
 
+        // resting order by id, null when not live, valid until the next mutation
+        const Order* find_order(OrderId id) const;
+
+        // qty and orders ahead of a resting order at its price, nullopt when not live
+        // o(log n) when the policy keeps queue trees, otherwise a walk from the head of the level
+        std::optional<QueuePosition> queue_position(OrderId id) const;
+
+        // open orders owned by a participant
+        std::size_t participant_order_count(ParticipantId participant) const;
+
+        // pending stops that have not triggered yet
+        std::size_t pending_stop_count() const;
+        bool has_stop(OrderId id) const;
+
+        // price of the most recent trade if any
+        std::optional<PriceTicks> last_trade_price() const;
+
         // best bid and ask prices if present
         std::optional<PriceTicks> best_bid_price() const;
         std::optional<PriceTicks> best_ask_price() const;
 
-        // ids at a specific level in fifo order
+        // ids at a specific level in fifo order, allocates, copy_order_ids_at does not
         std::vector<OrderId> order_ids_at(Side side, PriceTicks price_ticks) const;
 
         // total qty at a level
         Qty total_qty_at(Side side, PriceTicks price_ticks) const;
 
+        // the visit and copy queries below never allocate and only read, so they can run on the matching
+        // thread between commands, a visitor must not touch the book
+
+        // calls f(const DepthLevel&) from the best price outward for up to max_levels levels, returns how many
+        template <typename F>
+        std::size_t visit_depth(Side side, std::size_t max_levels, F&& f) const
+        {
+            return (side == Side::Buy) ? visit_levels(bids_, max_levels, f) : visit_levels(asks_, max_levels, f);
+        }
+
+        // calls f(const Order&) for each order at one level in fifo order, returns how many
+        template <typename F>
+        std::size_t visit_orders_at(Side side, PriceTicks price_ticks, F&& f) const
+        {
+            const PriceLevel* level = find_level(side, price_ticks);
+            if (level == nullptr)
+            {
+                return 0;
+            }
+            for (const Order& o : level->orders)
+            {
+                f(o);
+            }
+            return level->orders.size();
+        }
+
+        // fills out from the best price outward, returns levels written
+        std::size_t copy_depth(Side side, std::span<DepthLevel> out) const;
+
+        // fills out with ids at one level in fifo order, returns ids written
+        // a level deeper than out is cut short, its order_count in copy_depth says by how much
+        std::size_t copy_order_ids_at(Side side, PriceTicks price_ticks, std::span<OrderId> out) const;
+
+        // qty a taker could fill against the opposite side, stops once qty is reached
+        Qty available_qty(Side taker_side, PriceTicks limit_px, Qty qty) const;
+
+        // cost of taking qty with no limit price, one read of the cached total per level reached
+        FillEstimate estimate_fill(Side taker_side, Qty qty) const;
+
+        // out[i] answers qtys[i], a qty not below the one before picks up where its walk stopped
+        // so ascending qtys cost one pass over the deepest of them, a smaller one walks again from the touch
+        void estimate_fills(Side taker_side, std::span<const Qty> qtys, std::span<FillEstimate> out) const;
+
+        // appends a binary image of everything that shapes future events: resting orders with their seqs,
+        // pending stops, expiry entries, the clock, auction phase and last trade price
+        void save_state(std::vector<char>& out) const;
+
+        // replaces the book with a saved image, false leaves it untouched when the image is malformed
+        bool load_state(const char* data, std::size_t size);
+
     private:
-        // a price level holds fifo orders
-        using PriceLevel = std::list<Order>;
+        // fifo orders at one price
+        using OrderList = typename Policy::levels::template type<Order>;
+
+        // per level queue index, empty unless the policy tracks queue positions
+        using Queue = typename Policy::queue::type;
+
+        // a price level holds fifo orders and their qty sum
+        // allocator aware so the level map builds its order list on the book resource
+        struct PriceLevel
+        {
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            explicit PriceLevel(const allocator_type& alloc = {})
+                : orders(alloc), queue(alloc)
+            {
+            }
+
+            PriceLevel(const PriceLevel& other, const allocator_type& alloc)
+                : orders(other.orders, alloc), total_qty(other.total_qty), queue(other.queue, alloc)
+            {
+            }
+
+            PriceLevel(PriceLevel&& other, const allocator_type& alloc)
+                : orders(std::move(other.orders), alloc), total_qty(other.total_qty), queue(std::move(other.queue), alloc)
+            {
+            }
+
+            PriceLevel(const PriceLevel&) = default;
+            PriceLevel(PriceLevel&&) = default;
+            PriceLevel& operator=(const PriceLevel&) = default;
+            PriceLevel& operator=(PriceLevel&&) = default;
+
+            OrderList orders;
+            Qty total_qty { 0 };
+            [[no_unique_address]] Queue queue;
+        };
 
         // locator points to an exact stored order
         struct Locator
         {
             Side side { Side::Buy };
+
+            // slot in the level's queue tree, unused when the policy keeps none, fills the gap after side
+            std::uint32_t slot { 0 };
+
             PriceTicks price_ticks { 0 };
-            PriceLevel::iterator it {};
+            OrderList::iterator it {};
+
+            // owning level, map nodes are stable until the level empties
+            PriceLevel* level { nullptr };
         };
 
+        // source of every node below, kept for load_state and engine resets
+        std::pmr::memory_resource* resource_;
+
+        // only read by the generic instrument, a fixed one checks against constants
+        InstrumentSpec spec_ {};
+
+        // reason token when a price or qty breaks the instrument spec, null when both fit
+        const char* spec_violation(PriceTicks price_ticks, Qty qty) const
+        {
+            const char* bad = price_violation(instrument(), price_ticks);
+            return (bad != nullptr) ? bad : qty_violation(instrument(), qty);
+        }
+
         // assigns the next seq value
         std::uint64_t next_seq_ { 1 };
 
+        template <typename Compare>
+        using SideLevels = typename Policy::sides::template type<PriceTicks, PriceLevel, Compare>;
+
+        // level at an exact price, null when the side has none there
+        const PriceLevel* find_level(Side side, PriceTicks price_ticks) const;
+
+        template <typename Levels, typename F>
+        static std::size_t visit_levels(const Levels& levels, std::size_t max_levels, F& f)
+        {
+            std::size_t n = 0;
+            for (auto it = levels.begin(); it != levels.end() && n < max_levels; ++it, ++n)
+            {
+                f(DepthLevel { it->first, it->second.total_qty, it->second.orders.size() });
+            }
+            return n;
+        }
+
         // bids sorted by highest price first
-        std::map<PriceTicks, PriceLevel, std::greater<PriceTicks>> bids_;
+        SideLevels<std::greater<PriceTicks>> bids_;
 
         // asks sorted by lowest price first
-        std::map<PriceTicks, PriceLevel, std::less<PriceTicks>> asks_;
+        SideLevels<std::less<PriceTicks>> asks_;
 
         // id index for fast cancel and direct access
-        std::unordered_map<OrderId, Locator> index_;
+        using Index = typename Policy::index::template type<OrderId, Locator>;
+        Index index_;
+
+        // a stop waiting in the trigger index
+        struct StopOrder
+        {
+            OrderId id { 0 };
+            Side side { Side::Buy };
+            PriceTicks stop_price_ticks { 0 };
+            PriceTicks price_ticks { 0 }; // zero for stop market
+            Qty qty { 0 };
+            OrderOptions opts {};
+        };
+
+        using StopList = std::pmr::list<StopOrder>;
+
+        // buy stops fire as price rises so lowest trigger first, sell stops the reverse
+        std::pmr::map<PriceTicks, StopList, std::less<PriceTicks>> buy_stops_;
+        std::pmr::map<PriceTicks, StopList, std::greater<PriceTicks>> sell_stops_;
+
+        struct StopLocator
+        {
+            Side side { Side::Buy };
+            PriceTicks stop_price_ticks { 0 };
+            StopList::iterator it {};
+        };
+
+        using StopIndex = std::pmr::unordered_map<OrderId, StopLocator>;
+        StopIndex stop_index_;
+
+        // removes an indexed stop from its trigger level and the index
+        void erase_stop(StopIndex::iterator stop_it);
+
+        // expiry deadlines by id, entries for orders that already left are skipped when they fire
+        TimingWheel wheel_;
+
+        // true between begin_auction and uncross
+        bool auction_ { false };
+
+        // last trade price drives stop triggers
+        std::optional<PriceTicks> last_trade_px_;
+
+        // head of each participant chain in resting order
+        struct ParticipantOrders
+        {
+            Order* head { nullptr };
+            Order* tail { nullptr };
+            std::size_t count { 0 };
+        };
+
+        std::pmr::unordered_map<ParticipantId, ParticipantOrders> participants_;
+
+        // largest live order and level counts seen, updated where orders rest
+        std::size_t peak_live_orders_ { 0 };
+        std::size_t peak_levels_ { 0 };
+
+        // last reserve, a loaded image is rebuilt with the same reservation
+        std::size_t reserved_orders_ { 0 };
+        std::size_t reserved_levels_ { 0 };
+
+        // running xor of order_key over the resting orders
+        std::uint64_t state_hash_ { 0 };
+
+        // pseudo random key of one resting order state, toggled in and out of state_hash_
+        static std::uint64_t order_key(const Order& o);
+
+        // chain maintenance for owned orders, no op for participant zero
+        void link_participant(Order& o);
+        void unlink_participant(Order& o);
+
+        // removes an indexed order from its level, chain and the index
+        void erase_order(Index::iterator idx_it);
+
+        // points the participant chain at to, a copy of from that replaces it in the book
+        void relocate_order(const Order& from, Order& to);
+
+        // moves an order to the tail of a level, a list splices the node and other levels copy it
+        OrderList::iterator move_to_tail(OrderList& from, OrderList& to, OrderList::iterator it);
+
+        // squeezes cancel holes out of a level once they outnumber its orders, a no op for lists
+        void compact_level(PriceLevel& level);
+
+        // queue tree upkeep, each one compiles away when the policy keeps no trees
+        // queue_push gives the order at the tail its slot, a full tree doubles when mostly live or else resets and
+        // renumbers the others first
+        // reduce takes qty off an order that stays, remove drops the order with whatever qty the tree still has
+        // the caller passes the slot, from the locator it holds or from queue_head_slot when it works the head
+        void queue_push(PriceLevel& level, Locator& loc);
+        void queue_reduce(PriceLevel& level, std::uint32_t slot, Qty by);
+        void queue_remove(PriceLevel& level, std::uint32_t slot, Qty qty);
+
+        // slot of the first live order at the level, one descent of its tree and no index lookup, zero when no
+        // tree is kept
+        std::uint32_t queue_head_slot(const PriceLevel& level) const;
+
+        // stp key no resting order can carry, so takers without stp never match it
+        static constexpr StpGroup kNoStpKey = ~StpGroup { 0 };
+
+        static StpGroup stp_key_for(StpGroup group, StpMode mode)
+        {
+            return (mode != StpMode::None && group != 0) ? group : kNoStpKey;
+        }
+
+        // incoming order carried through the matching loop, order.qty is the remaining qty
+        struct Taker
+        {
+            Order order {};
+            Qty qty { 0 };
+            StpGroup stp_key { kNoStpKey };
+            bool stp_stopped { false };
+        };
 
         // helper for matching cross condition
         bool crosses(Side taker_side, PriceTicks taker_px, PriceTicks maker_px) const;
@@ -70,8 +454,80 @@ namespace ob
         // maker completion event helper
         void remove_filled_maker(std::vector<Event>& events, const Order& maker);
 
+        // walks maker levels from the best price and reduces the taker qty
+        template <typename Levels>
+        void match_against(Levels& levels, std::vector<Event>& events, Taker& t);
+
+        // applies the taker stp mode to a same group maker and returns the next maker
+        OrderList::iterator prevent_self_trade(PriceLevel& level, OrderList::iterator it, std::vector<Event>& events, Taker& t);
+
+        // rests, completes or cancels the taker after matching and emits its final event
+        void finish_taker(std::vector<Event>& events, Taker& t, TimeInForce tif);
+
+        // assigns seq and emits acceptance, then matches and finishes the taker
+        void execute_taker(std::vector<Event>& events, Taker& t, TimeInForce tif);
+
+        // pops stops crossed by the last trade and feeds them back in as takers until none fire
+        void run_stop_cascade(std::vector<Event>& events);
+
+        // moves every stop at or through the trigger into the pending queue in trigger then fifo order
+        template <typename Stops>
+        void pop_triggered(Stops& stops, Side side, PriceTicks trade_px, std::deque<StopOrder>& pending);
+
+        // sums level aggregates while they cross, never walks orders
+        template <typename Levels>
+        Qty crossing_qty(const Levels& levels, Side taker_side, PriceTicks limit_px, Qty qty) const;
+
+        template <typename Levels>
+        static void estimate_fills_on(const Levels& levels, std::span<const Qty> qtys, std::span<FillEstimate> out);
+
+        // fillable qty for a taker with stp, same group makers contribute nothing and, outside cancel resting,
+        // the first one ends the count, so unlike crossing_qty this walks orders, o(orders) up to the fill
+        template <typename Levels>
+        Qty stp_crossing_qty(const Levels& levels, const Taker& t, Qty qty) const;
+
+        // appends an order to the tail of its level and indexes it
+        template <typename Levels>
+        void rest_order(Levels& levels, const Order& o);
+
+        // cancels every order in [first, last) then drops those levels in one erase
+        template <typename Levels>
+        void cancel_levels(Levels& levels, typename Levels::iterator first, typename Levels::iterator last, std::vector<Event>& events);
+
+        // cancels every pending stop in one trigger map
+        template <typename Stops>
+        void cancel_stops(Stops& stops, std::vector<Event>& events);
+
+        // moves a resting order to the tail of a new level, matching first if it now crosses
+        template <typename Own, typename Opposite>
+        void requeue_order(Own& own, Opposite& opposite, std::vector<Event>& events, Index::iterator idx_it, PriceTicks price_ticks, Qty qty);
+
+        // walks both sides from the best price and fills volume at one price
+        void allocate_uncross(std::vector<Event>& events, PriceTicks price_ticks, Qty volume);
+
         // invariants and sanity checks
         std::size_t recompute_live_count() const;
         void assert_invariants() const;
     };
+
+    // runtime configured book, what the engine and tools use, with a queue tree per level so queue_position
+    // answers in o(log n)
+    using OrderBook = BasicOrderBook<GenericInstrument, QueueTrackedPolicy>;
+
+    extern template class BasicOrderBook<GenericInstrument>;
+    extern template class BasicOrderBook<EquityInstrument>;
+    extern template class BasicOrderBook<FuturesInstrument>;
+
+    // every other container combination for the generic instrument, for the policy harness
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, TreeSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, FlatSides, HashIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, FlatSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, TreeSides, HashIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, TreeSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, HashIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ListLevels, BitsetSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, BitsetSides, FlatIndex>>;
+    extern template class BasicOrderBook<GenericInstrument, QueueTrackedPolicy>;
+    extern template class BasicOrderBook<GenericInstrument, BookPolicy<ChunkLevels, FlatSides, FlatIndex, FenwickQueues>>;
 }
@@ -0,0 +1,304 @@
+#include "price_bitset.h"
+
+#include <bit>
+#include <algorithm>
+#include <cassert>
+
+namespace ob
+{
+    static constexpr std::uint64_t kNoKey = ~std::uint64_t { 0 };
+
+    // tiers up to this many words are plain arrays, 32 KiB
+    static constexpr std::uint64_t kDenseWords = 4096;
+
+    static std::size_t home_slot(std::uint64_t idx, std::size_t mask)
+    {
+        return static_cast<std::size_t>((idx * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    }
+
+    PriceBitset::PriceBitset(PriceTicks lo, PriceTicks hi, const allocator_type& alloc)
+        : lo_(lo), hi_(hi), tiers_(alloc)
+    {
+        assert(lo <= hi);
+        const std::uint64_t keys = static_cast<std::uint64_t>(hi) - static_cast<std::uint64_t>(lo) + 1;
+
+        // six bits of the key per tier, so 64 bit keys need at most eleven
+        tiers_.reserve(11);
+        std::uint64_t words = (keys + 63) / 64;
+        while (true)
+        {
+            Tier& t = tiers_.emplace_back();
+            if (words <= kDenseWords)
+            {
+                t.dense.assign(words, 0);
+            }
+            if (words == 1)
+            {
+                break;
+            }
+            words = (words + 63) / 64;
+        }
+    }
+
+    std::size_t PriceBitset::Tier::slot_of(std::uint64_t idx) const
+    {
+        const std::size_t mask = keys.size() - 1;
+        std::size_t s = home_slot(idx, mask);
+        while (keys[s] != 0 && keys[s] != idx + 1)
+        {
+            s = (s + 1) & mask;
+        }
+        return s;
+    }
+
+    std::uint64_t PriceBitset::Tier::get(std::uint64_t idx) const
+    {
+        if (!dense.empty())
+        {
+            return dense[idx];
+        }
+        if (keys.empty())
+        {
+            return 0;
+        }
+        const std::size_t s = slot_of(idx);
+        return (keys[s] != 0) ? words[s] : 0;
+    }
+
+    void PriceBitset::Tier::grow()
+    {
+        const std::size_t n = std::max<std::size_t>(64, keys.size() * 2);
+        std::pmr::vector<std::uint64_t> old_keys(n, 0, keys.get_allocator());
+        std::pmr::vector<std::uint64_t> old_words(n, 0, words.get_allocator());
+        old_keys.swap(keys);
+        old_words.swap(words);
+        for (std::size_t i = 0; i < old_keys.size(); ++i)
+        {
+            if (old_keys[i] != 0)
+            {
+                const std::size_t s = slot_of(old_keys[i] - 1);
+                keys[s] = old_keys[i];
+                words[s] = old_words[i];
+            }
+        }
+    }
+
+    std::uint64_t PriceBitset::Tier::set(std::uint64_t idx, std::uint64_t bit)
+    {
+        if (!dense.empty())
+        {
+            const std::uint64_t before = dense[idx];
+            dense[idx] = before | bit;
+            return before;
+        }
+
+        // at most half full keeps probes short
+        if (keys.empty())
+        {
+            grow();
+        }
+        std::size_t s = slot_of(idx);
+        if (keys[s] == 0)
+        {
+            if (2 * (used + 1) > keys.size())
+            {
+                grow();
+                s = slot_of(idx);
+            }
+            keys[s] = idx + 1;
+            words[s] = 0;
+            ++used;
+        }
+        const std::uint64_t before = words[s];
+        words[s] = before | bit;
+        return before;
+    }
+
+    std::uint64_t PriceBitset::Tier::clear(std::uint64_t idx, std::uint64_t bit)
+    {
+        if (!dense.empty())
+        {
+            dense[idx] &= ~bit;
+            return dense[idx];
+        }
+
+        const std::size_t s = slot_of(idx);
+        assert(keys[s] != 0);
+        words[s] &= ~bit;
+        if (words[s] != 0)
+        {
+            return words[s];
+        }
+
+        // backward shift delete, later entries of the probe run move up so no tombstones are needed
+        const std::size_t mask = keys.size() - 1;
+        std::size_t hole = s;
+        std::size_t next = (s + 1) & mask;
+        while (keys[next] != 0)
+        {
+            const std::size_t home = home_slot(keys[next] - 1, mask);
+            // move when home is not cyclically within (hole, next]
+            const bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+            if (!stays)
+            {
+                keys[hole] = keys[next];
+                words[hole] = words[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        keys[hole] = 0;
+        words[hole] = 0;
+        --used;
+        return 0;
+    }
+
+    bool PriceBitset::insert(PriceTicks p)
+    {
+        if (p < lo_ || p > hi_)
+        {
+            return false;
+        }
+        const std::uint64_t key = static_cast<std::uint64_t>(p) - static_cast<std::uint64_t>(lo_);
+        std::uint64_t idx = key >> 6;
+        const std::uint64_t bit = std::uint64_t { 1 } << (key & 63);
+        std::uint64_t before = tiers_[0].set(idx, bit);
+        if ((before & bit) != 0)
+        {
+            return false;
+        }
+        ++size_;
+
+        // a word that went from empty to not tells the tier above, until one already knew
+        for (std::size_t t = 1; before == 0 && t < tiers_.size(); ++t)
+        {
+            before = tiers_[t].set(idx >> 6, std::uint64_t { 1 } << (idx & 63));
+            idx >>= 6;
+        }
+        return true;
+    }
+
+    bool PriceBitset::erase(PriceTicks p)
+    {
+        if (!contains(p))
+        {
+            return false;
+        }
+        const std::uint64_t key = static_cast<std::uint64_t>(p) - static_cast<std::uint64_t>(lo_);
+        std::uint64_t idx = key >> 6;
+
+        --size_;
+        std::uint64_t after = tiers_[0].clear(idx, std::uint64_t { 1 } << (key & 63));
+        for (std::size_t t = 1; after == 0 && t < tiers_.size(); ++t)
+        {
+            after = tiers_[t].clear(idx >> 6, std::uint64_t { 1 } << (idx & 63));
+            idx >>= 6;
+        }
+        return true;
+    }
+
+    bool PriceBitset::contains(PriceTicks p) const
+    {
+        if (p < lo_ || p > hi_)
+        {
+            return false;
+        }
+        const std::uint64_t key = static_cast<std::uint64_t>(p) - static_cast<std::uint64_t>(lo_);
+        return (tiers_[0].get(key >> 6) >> (key & 63)) & 1;
+    }
+
+    std::uint64_t PriceBitset::next_key(std::uint64_t key) const
+    {
+        std::uint64_t idx = key >> 6;
+        const std::uint64_t here = tiers_[0].get(idx) & (~std::uint64_t { 0 } << (key & 63));
+        if (here != 0)
+        {
+            return (idx << 6) + static_cast<std::uint64_t>(std::countr_zero(here));
+        }
+
+        // climb until a tier has a set bit after ours, then take the lowest path back down
+        for (std::size_t t = 1; t < tiers_.size(); ++t)
+        {
+            const std::uint64_t pos = idx & 63;
+            idx >>= 6;
+            const std::uint64_t after = (pos == 63) ? 0 : (tiers_[t].get(idx) & (~std::uint64_t { 0 } << (pos + 1)));
+            if (after != 0)
+            {
+                idx = (idx << 6) + static_cast<std::uint64_t>(std::countr_zero(after));
+                for (std::size_t d = t - 1; d > 0; --d)
+                {
+                    idx = (idx << 6) + static_cast<std::uint64_t>(std::countr_zero(tiers_[d].get(idx)));
+                }
+                return (idx << 6) + static_cast<std::uint64_t>(std::countr_zero(tiers_[0].get(idx)));
+            }
+        }
+        return kNoKey;
+    }
+
+    std::uint64_t PriceBitset::prev_key(std::uint64_t key) const
+    {
+        std::uint64_t idx = key >> 6;
+        const std::uint64_t b = key & 63;
+        const std::uint64_t upto = (b == 63) ? ~std::uint64_t { 0 } : ((std::uint64_t { 2 } << b) - 1);
+        const std::uint64_t here = tiers_[0].get(idx) & upto;
+        if (here != 0)
+        {
+            return (idx << 6) + 63 - static_cast<std::uint64_t>(std::countl_zero(here));
+        }
+
+        for (std::size_t t = 1; t < tiers_.size(); ++t)
+        {
+            const std::uint64_t pos = idx & 63;
+            idx >>= 6;
+            const std::uint64_t before = tiers_[t].get(idx) & ((std::uint64_t { 1 } << pos) - 1);
+            if (before != 0)
+            {
+                idx = (idx << 6) + 63 - static_cast<std::uint64_t>(std::countl_zero(before));
+                for (std::size_t d = t - 1; d > 0; --d)
+                {
+                    idx = (idx << 6) + 63 - static_cast<std::uint64_t>(std::countl_zero(tiers_[d].get(idx)));
+                }
+                return (idx << 6) + 63 - static_cast<std::uint64_t>(std::countl_zero(tiers_[0].get(idx)));
+            }
+        }
+        return kNoKey;
+    }
+
+    std::optional<PriceTicks> PriceBitset::next_at_or_above(PriceTicks p) const
+    {
+        if (p > hi_ || size_ == 0)
+        {
+            return std::nullopt;
+        }
+        const std::uint64_t k = next_key(static_cast<std::uint64_t>(std::max(p, lo_)) - static_cast<std::uint64_t>(lo_));
+        if (k == kNoKey)
+        {
+            return std::nullopt;
+        }
+        return static_cast<PriceTicks>(static_cast<std::uint64_t>(lo_) + k);
+    }
+
+    std::optional<PriceTicks> PriceBitset::prev_at_or_below(PriceTicks p) const
+    {
+        if (p < lo_ || size_ == 0)
+        {
+            return std::nullopt;
+        }
+        const std::uint64_t k = prev_key(static_cast<std::uint64_t>(std::min(p, hi_)) - static_cast<std::uint64_t>(lo_));
+        if (k == kNoKey)
+        {
+            return std::nullopt;
+        }
+        return static_cast<PriceTicks>(static_cast<std::uint64_t>(lo_) + k);
+    }
+
+    std::size_t PriceBitset::memory_bytes() const
+    {
+        std::size_t bytes = tiers_.capacity() * sizeof(Tier);
+        for (const auto& t : tiers_)
+        {
+            bytes += (t.dense.capacity() + t.keys.capacity() + t.words.capacity()) * sizeof(std::uint64_t);
+        }
+        return bytes;
+    }
+}
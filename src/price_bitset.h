@@ -0,0 +1,170 @@
+#pragma once
+
+#include "order.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ob
+{
+    // set of prices in a fixed range as a tree of 64 bit words: each bit of a tier says whether the word
+    // below it has anything set, so next and previous searches touch one word per tier
+    // a tier small enough is a plain array, a bigger one keeps only its non zero words in an open addressed
+    // table, so even the whole positive price range costs memory per price in use and not per price covered
+    class PriceBitset
+    {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        // covers [lo, hi], both inclusive
+        PriceBitset(PriceTicks lo, PriceTicks hi, const allocator_type& alloc = {});
+
+        PriceTicks lo() const
+        {
+            return lo_;
+        }
+        PriceTicks hi() const
+        {
+            return hi_;
+        }
+
+        // false when p is outside the range or already present
+        bool insert(PriceTicks p);
+
+        // false when p was not present
+        bool erase(PriceTicks p);
+
+        bool contains(PriceTicks p) const;
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        // lowest present price at or above p, and highest at or below p
+        std::optional<PriceTicks> next_at_or_above(PriceTicks p) const;
+        std::optional<PriceTicks> prev_at_or_below(PriceTicks p) const;
+
+        // bytes held by every tier
+        std::size_t memory_bytes() const;
+
+    private:
+        // one tier of words, dense holds all of them, or else the table holds the non zero ones
+        struct Tier
+        {
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            explicit Tier(const allocator_type& alloc = {})
+                : dense(alloc), keys(alloc), words(alloc)
+            {
+            }
+            Tier(const Tier& other, const allocator_type& alloc)
+                : dense(other.dense, alloc), keys(other.keys, alloc), words(other.words, alloc), used(other.used)
+            {
+            }
+            Tier(Tier&& other, const allocator_type& alloc)
+                : dense(std::move(other.dense), alloc), keys(std::move(other.keys), alloc), words(std::move(other.words), alloc), used(other.used)
+            {
+            }
+            Tier(const Tier&) = default;
+            Tier(Tier&&) = default;
+            Tier& operator=(const Tier&) = default;
+            Tier& operator=(Tier&&) = default;
+
+            std::uint64_t get(std::uint64_t idx) const;
+
+            // sets one bit and returns the word as it was before
+            std::uint64_t set(std::uint64_t idx, std::uint64_t bit);
+
+            // clears one bit that is set and returns the word as it is after
+            std::uint64_t clear(std::uint64_t idx, std::uint64_t bit);
+
+            // slot of idx in the table, or the empty slot where it would go
+            std::size_t slot_of(std::uint64_t idx) const;
+            void grow();
+
+            std::pmr::vector<std::uint64_t> dense;
+
+            // word index plus one as key so zero marks an empty slot, sized on the first set
+            std::pmr::vector<std::uint64_t> keys;
+            std::pmr::vector<std::uint64_t> words;
+            std::size_t used { 0 };
+        };
+
+        // next set bit at or after key across the tiers, npos when none
+        std::uint64_t next_key(std::uint64_t key) const;
+        std::uint64_t prev_key(std::uint64_t key) const;
+
+        PriceTicks lo_;
+        PriceTicks hi_;
+        std::size_t size_ { 0 };
+
+        // tiers_[0] holds a bit per price, the last tier is a single word
+        std::pmr::vector<Tier> tiers_;
+    };
+
+    // price keyed level storage for a wide sparse range: the bitset orders prices, a hash holds payloads
+    template <typename T>
+    class SparsePriceMap
+    {
+    public:
+        SparsePriceMap(PriceTicks lo, PriceTicks hi)
+            : prices_(lo, hi)
+        {
+        }
+
+        // payload at p, default built when p is new, null when p is outside the range
+        T* get_or_create(PriceTicks p)
+        {
+            if (!prices_.contains(p) && !prices_.insert(p))
+            {
+                return nullptr;
+            }
+            return &payloads_[p];
+        }
+
+        T* find(PriceTicks p)
+        {
+            const auto it = payloads_.find(p);
+            return (it == payloads_.end()) ? nullptr : &it->second;
+        }
+
+        bool erase(PriceTicks p)
+        {
+            if (!prices_.erase(p))
+            {
+                return false;
+            }
+            payloads_.erase(p);
+            return true;
+        }
+
+        const PriceBitset& prices() const
+        {
+            return prices_;
+        }
+
+        std::size_t size() const
+        {
+            return prices_.size();
+        }
+
+        void reserve(std::size_t levels)
+        {
+            payloads_.reserve(levels);
+        }
+
+    private:
+        PriceBitset prices_;
+        std::unordered_map<PriceTicks, T> payloads_;
+    };
+}
@@ -1,6 +1,7 @@
 #include "script.h"
 
 #include <cctype>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -50,6 +51,136 @@ namespace ob
         return true;
     }
 
+    static std::optional<Side> parse_side(const std::string& raw)
+    {
+        // accepts full names and single letter forms
+        const std::string side_s = to_lower_ascii(raw);
+        if (side_s == "buy" || side_s == "b")
+        {
+            return Side::Buy;
+        }
+        if (side_s == "sell" || side_s == "s")
+        {
+            return Side::Sell;
+        }
+        return std::nullopt;
+    }
+
+    static std::optional<StpMode> parse_stp_mode(const std::string& s)
+    {
+        if (s == "cancel_resting")
+        {
+            return StpMode::CancelResting;
+        }
+        if (s == "cancel_taking")
+        {
+            return StpMode::CancelTaking;
+        }
+        if (s == "cancel_both")
+        {
+            return StpMode::CancelBoth;
+        }
+        if (s == "decrement")
+        {
+            return StpMode::Decrement;
+        }
+        if (s == "none")
+        {
+            return StpMode::None;
+        }
+        return std::nullopt;
+    }
+
+    static bool parse_option(const std::string& token, const std::string& key, std::uint64_t& out)
+    {
+        // matches key=<unsigned> exactly
+        if (token.size() <= key.size() + 1 || token.compare(0, key.size(), key) != 0 || token[key.size()] != '=')
+        {
+            return false;
+        }
+
+        const std::string value = token.substr(key.size() + 1);
+        for (char c : value)
+        {
+            if (!std::isdigit(static_cast<unsigned char>(c)))
+            {
+                return false;
+            }
+        }
+
+        try
+        {
+            out = static_cast<std::uint64_t>(std::stoull(value));
+            return true;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    static bool parse_order_options(std::istringstream& iss, Command& c)
+    {
+        // optional trailing tokens, a time in force keyword and key=value options
+        bool seen_tif = false;
+        bool seen_participant = false;
+        bool seen_stp_group = false;
+        bool seen_stp = false;
+        bool seen_expire = false;
+
+        std::string opt;
+        while (iss >> opt)
+        {
+            opt = to_lower_ascii(opt);
+
+            if (!seen_tif && (opt == "gtc" || opt == "ioc" || opt == "fok"))
+            {
+                seen_tif = true;
+                c.tif = (opt == "ioc") ? TimeInForce::Ioc : (opt == "fok") ? TimeInForce::Fok : TimeInForce::Gtc;
+                continue;
+            }
+
+            std::uint64_t value {};
+            if (!seen_participant && parse_option(opt, "participant", value) && value <= UINT32_MAX)
+            {
+                seen_participant = true;
+                c.participant = static_cast<ParticipantId>(value);
+                continue;
+            }
+
+            if (!seen_stp_group && parse_option(opt, "stp_group", value) && value <= UINT32_MAX)
+            {
+                seen_stp_group = true;
+                c.stp_group = static_cast<StpGroup>(value);
+                continue;
+            }
+
+            if (!seen_expire && parse_option(opt, "expire", value))
+            {
+                seen_expire = true;
+                c.expire_at = value;
+                continue;
+            }
+
+            if (!seen_stp && opt.rfind("stp=", 0) == 0)
+            {
+                const auto mode = parse_stp_mode(opt.substr(4));
+                if (!mode.has_value())
+                {
+                    return false;
+                }
+                seen_stp = true;
+                c.stp_mode = *mode;
+                continue;
+            }
+
+            // unknown or repeated tokens keep scripts strict
+            return false;
+        }
+
+        return true;
+    }
+
     std::optional<Command> parse_script_line(const std::string& raw_line)
     {
         // parse one logical line into a command
@@ -81,30 +212,88 @@ namespace ob
                 return std::nullopt;
             }
 
-            // reject extra tokens to keep scripts strict
-            std::string extra;
-            if (iss >> extra)
+            Command c {};
+            if (!parse_order_options(iss, c))
+            {
+                return std::nullopt;
+            }
+
+            const auto side = parse_side(side_s);
+            if (!side.has_value())
+            {
+                return std::nullopt;
+            }
+
+            return Command::add_limit(static_cast<OrderId>(id_u), *side, px, qty, c.tif, c.participant).with_stp(c.stp_group, c.stp_mode).with_expiry(c.expire_at);
+        }
+
+        if (kind == "stop" || kind == "stop_limit")
+        {
+            // stop <id> <side> <stop_px> <qty>, stop_limit also takes the limit price before qty
+            std::uint64_t id_u {};
+            std::string side_s;
+            std::int64_t stop_px {};
+            std::int64_t px { 0 };
+            std::int64_t qty {};
+
+            if (!(iss >> id_u >> side_s >> stop_px))
+            {
+                return std::nullopt;
+            }
+            if (kind == "stop_limit" && !(iss >> px))
+            {
+                return std::nullopt;
+            }
+            if (!(iss >> qty))
             {
                 return std::nullopt;
             }
 
-            side_s = to_lower_ascii(side_s);
+            Command c {};
+            if (!parse_order_options(iss, c))
+            {
+                return std::nullopt;
+            }
 
-            Side side {};
-            if (side_s == "buy" || side_s == "b")
+            const auto side = parse_side(side_s);
+            if (!side.has_value())
             {
-                side = Side::Buy;
+                return std::nullopt;
             }
-            else if (side_s == "sell" || side_s == "s")
+
+            Command out = (kind == "stop")
+                ? Command::stop(static_cast<OrderId>(id_u), *side, stop_px, qty)
+                : Command::stop_limit(static_cast<OrderId>(id_u), *side, stop_px, px, qty, c.tif);
+            out.participant = c.participant;
+            return out.with_stp(c.stp_group, c.stp_mode).with_expiry(c.expire_at);
+        }
+
+        if (kind == "time")
+        {
+            std::uint64_t ts {};
+            if (!(iss >> ts))
             {
-                side = Side::Sell;
+                return std::nullopt;
             }
-            else
+
+            std::string extra;
+            if (iss >> extra)
             {
                 return std::nullopt;
             }
 
-            return Command::add_limit(static_cast<OrderId>(id_u), side, px, qty);
+            return Command::advance_time(ts);
+        }
+
+        if (kind == "auction" || kind == "uncross")
+        {
+            std::string extra;
+            if (iss >> extra)
+            {
+                return std::nullopt;
+            }
+
+            return (kind == "auction") ? Command::begin_auction() : Command::uncross();
         }
 
         if (kind == "cancel")
@@ -124,6 +313,92 @@ namespace ob
             return Command::cancel(static_cast<OrderId>(id_u));
         }
 
+        if (kind == "modify")
+        {
+            std::uint64_t id_u {};
+            std::int64_t px {};
+            std::int64_t qty {};
+
+            if (!(iss >> id_u >> px >> qty))
+            {
+                return std::nullopt;
+            }
+
+            std::string extra;
+            if (iss >> extra)
+            {
+                return std::nullopt;
+            }
+
+            return Command::modify(static_cast<OrderId>(id_u), px, qty);
+        }
+
+        if (kind == "mass_cancel")
+        {
+            std::string target;
+            if (!(iss >> target))
+            {
+                return std::nullopt;
+            }
+
+            if (to_lower_ascii(target) == "participant")
+            {
+                std::uint64_t p {};
+                if (!(iss >> p) || p > UINT32_MAX)
+                {
+                    return std::nullopt;
+                }
+
+                std::string extra;
+                if (iss >> extra)
+                {
+                    return std::nullopt;
+                }
+                return Command::mass_cancel_participant(static_cast<ParticipantId>(p));
+            }
+
+            if (to_lower_ascii(target) == "all")
+            {
+                std::string extra;
+                if (iss >> extra)
+                {
+                    return std::nullopt;
+                }
+                return Command::mass_cancel_all();
+            }
+
+            const auto side = parse_side(target);
+            if (!side.has_value())
+            {
+                return std::nullopt;
+            }
+
+            // a side alone or a side with an inclusive price range
+            std::int64_t min_px {};
+            if (!(iss >> min_px))
+            {
+                if (!iss.eof())
+                {
+                    return std::nullopt;
+                }
+                return Command::mass_cancel_side(*side);
+            }
+
+            std::int64_t max_px {};
+            if (!(iss >> max_px))
+            {
+                return std::nullopt;
+            }
+
+            std::string extra;
+            if (iss >> extra)
+            {
+                return std::nullopt;
+            }
+
+            return Command::mass_cancel_range(*side, min_px, max_px);
+        }
+
         return std::nullopt;
     }
 
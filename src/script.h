@@ -10,8 +10,19 @@ namespace ob
 {
     // parses a script file into commands
     // format:
-    //   add <id> <buy|sell> <price_ticks> <qty>
+    //   add <id> <buy|sell> <price_ticks> <qty> [options]
+    //   stop <id> <buy|sell> <stop_price_ticks> <qty> [options]
+    //   stop_limit <id> <buy|sell> <stop_price_ticks> <price_ticks> <qty> [options]
     //   cancel <id>
+    //   modify <id> <price_ticks> <qty>
+    //   mass_cancel <all|buy|sell> [<min_price_ticks> <max_price_ticks>]
+    //   mass_cancel participant <n>
+    //   time <logical_time>
+    //   auction
+    //   uncross
+    // options, any order, each at most once:
+    //   gtc|ioc|fok  participant=<n>  stp_group=<n>  expire=<logical_time>
+    //   stp=<none|cancel_resting|cancel_taking|cancel_both|decrement>
     std::optional<std::vector<Command>> load_script(const std::string& path);
 
     // parses a single script line
@@ -0,0 +1,266 @@
+#include "soa_level.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define OB_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace ob
+{
+    Qty sum_qty_scalar(const Qty* qty, std::size_t n)
+    {
+        Qty s { 0 };
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            s += qty[i];
+        }
+        return s;
+    }
+
+    std::size_t fill_index_scalar(const Qty* qty, std::size_t n, Qty target)
+    {
+        Qty s { 0 };
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            s += qty[i];
+            if (s >= target)
+            {
+                return i;
+            }
+        }
+        return n;
+    }
+
+#if defined(OB_HAVE_AVX2_KERNELS)
+    __attribute__((target("avx2"))) static Qty hsum(__m256i v)
+    {
+        const __m128i lo = _mm256_castsi256_si128(v);
+        const __m128i hi = _mm256_extracti128_si256(v, 1);
+        const __m128i s = _mm_add_epi64(lo, hi);
+        return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+    }
+
+    // four accumulators so the adds do not wait on each other
+    __attribute__((target("avx2"))) static Qty sum_qty_avx2(const Qty* qty, std::size_t n)
+    {
+        __m256i a0 = _mm256_setzero_si256();
+        __m256i a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256();
+        __m256i a3 = _mm256_setzero_si256();
+
+        std::size_t i { 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i)));
+            a1 = _mm256_add_epi64(a1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 4)));
+            a2 = _mm256_add_epi64(a2, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 8)));
+            a3 = _mm256_add_epi64(a3, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 12)));
+        }
+        for (; i + 4 <= n; i += 4)
+        {
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i)));
+        }
+
+        Qty s = hsum(_mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3)));
+        for (; i < n; ++i)
+        {
+            s += qty[i];
+        }
+        return s;
+    }
+
+    // sums blocks of 16 until one would reach the target, then finds the slot inside it by hand
+    __attribute__((target("avx2"))) static std::size_t fill_index_avx2(const Qty* qty, std::size_t n, Qty target)
+    {
+        Qty s { 0 };
+        std::size_t i { 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i));
+            const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 4));
+            const __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 8));
+            const __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qty + i + 12));
+            const Qty block = hsum(_mm256_add_epi64(_mm256_add_epi64(v0, v1), _mm256_add_epi64(v2, v3)));
+            if (s + block >= target)
+            {
+                break;
+            }
+            s += block;
+        }
+        for (; i < n; ++i)
+        {
+            s += qty[i];
+            if (s >= target)
+            {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    static bool use_avx2()
+    {
+        static const bool yes = __builtin_cpu_supports("avx2");
+        return yes;
+    }
+#endif
+
+    Qty sum_qty(const Qty* qty, std::size_t n)
+    {
+#if defined(OB_HAVE_AVX2_KERNELS)
+        if (use_avx2())
+        {
+            return sum_qty_avx2(qty, n);
+        }
+#endif
+        return sum_qty_scalar(qty, n);
+    }
+
+    std::size_t fill_index(const Qty* qty, std::size_t n, Qty target)
+    {
+#if defined(OB_HAVE_AVX2_KERNELS)
+        if (use_avx2())
+        {
+            return fill_index_avx2(qty, n, target);
+        }
+#endif
+        return fill_index_scalar(qty, n, target);
+    }
+
+    const char* qty_kernels()
+    {
+#if defined(OB_HAVE_AVX2_KERNELS)
+        if (use_avx2())
+        {
+            return "avx2";
+        }
+#endif
+        return "scalar";
+    }
+
+    void SoaLevel::push_back(OrderId id, std::uint64_t seq, Qty qty)
+    {
+        assert(qty > 0);
+        assert(seq_.size() == head_ || seq_.back() < seq);
+        qty_.push_back(qty);
+        seq_.push_back(seq);
+        id_.push_back(id);
+        ++live_;
+        total_ += qty;
+    }
+
+    OrderId SoaLevel::front_id() const
+    {
+        assert(live_ > 0 && qty_[head_] > 0);
+        return id_[head_];
+    }
+
+    Qty SoaLevel::front_qty() const
+    {
+        assert(live_ > 0 && qty_[head_] > 0);
+        return qty_[head_];
+    }
+
+    void SoaLevel::fill_front(Qty qty)
+    {
+        assert(qty > 0 && qty <= front_qty());
+        qty_[head_] -= qty;
+        total_ -= qty;
+        if (qty_[head_] == 0)
+        {
+            --live_;
+            settle();
+        }
+    }
+
+    std::size_t SoaLevel::find(std::uint64_t seq) const
+    {
+        const auto first = seq_.begin() + static_cast<std::ptrdiff_t>(head_);
+        const auto it = std::lower_bound(first, seq_.end(), seq);
+        if (it == seq_.end() || *it != seq)
+        {
+            return static_cast<std::size_t>(-1);
+        }
+        const std::size_t i = static_cast<std::size_t>(it - seq_.begin());
+        return (qty_[i] > 0) ? i : static_cast<std::size_t>(-1);
+    }
+
+    bool SoaLevel::erase(std::uint64_t seq)
+    {
+        const std::size_t i = find(seq);
+        if (i == static_cast<std::size_t>(-1))
+        {
+            return false;
+        }
+        total_ -= qty_[i];
+        qty_[i] = 0;
+        --live_;
+        settle();
+        return true;
+    }
+
+    bool SoaLevel::reduce(std::uint64_t seq, Qty new_qty)
+    {
+        const std::size_t i = find(seq);
+        if (i == static_cast<std::size_t>(-1) || new_qty <= 0 || new_qty > qty_[i])
+        {
+            return false;
+        }
+        total_ -= qty_[i] - new_qty;
+        qty_[i] = new_qty;
+        return true;
+    }
+
+    void SoaLevel::settle()
+    {
+        while (head_ < qty_.size() && qty_[head_] == 0)
+        {
+            ++head_;
+        }
+
+        if (live_ == 0)
+        {
+            qty_.clear();
+            seq_.clear();
+            id_.clear();
+            head_ = 0;
+            return;
+        }
+
+        // compaction is linear but happens after at least as many removals as slots it keeps
+        if (qty_.size() - live_ < qty_.size() / 2 || qty_.size() < 32)
+        {
+            return;
+        }
+
+        std::size_t out { 0 };
+        for (std::size_t i = head_; i < qty_.size(); ++i)
+        {
+            if (qty_[i] == 0)
+            {
+                continue;
+            }
+            qty_[out] = qty_[i];
+            seq_[out] = seq_[i];
+            id_[out] = id_[i];
+            ++out;
+        }
+        qty_.resize(out);
+        seq_.resize(out);
+        id_.resize(out);
+        head_ = 0;
+    }
+
+    Qty SoaLevel::sum() const
+    {
+        return sum_qty(qty_data(), span());
+    }
+
+    std::size_t SoaLevel::fill_slot(Qty qty) const
+    {
+        return fill_index(qty_data(), span(), qty);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "order.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ob
+{
+    // sum of n quantities
+    Qty sum_qty(const Qty* qty, std::size_t n);
+
+    // first index whose running sum from the start reaches target, n when the whole range falls short
+    std::size_t fill_index(const Qty* qty, std::size_t n, Qty target);
+
+    // portable versions, always scalar, the dispatched ones above use avx2 when the cpu has it
+    Qty sum_qty_scalar(const Qty* qty, std::size_t n);
+    std::size_t fill_index_scalar(const Qty* qty, std::size_t n, Qty target);
+
+    // "avx2" or "scalar", what sum_qty and fill_index picked at startup
+    const char* qty_kernels();
+
+    // one price level as parallel arrays of qty, seq and id in fifo order
+    // the front is a head offset, removed orders leave a zero qty hole, and the arrays are compacted
+    // once holes and the consumed head make up half of them, so positions are only stable between compactions
+    // seqs rise along the fifo, so an order is found by binary search on its seq
+    class SoaLevel
+    {
+    public:
+        void push_back(OrderId id, std::uint64_t seq, Qty qty);
+
+        // live orders and their qty sum
+        std::size_t size() const
+        {
+            return live_;
+        }
+        Qty total_qty() const
+        {
+            return total_;
+        }
+
+        bool empty() const
+        {
+            return live_ == 0;
+        }
+
+        // oldest live order, level must not be empty
+        OrderId front_id() const;
+        Qty front_qty() const;
+
+        // takes qty off the front order and drops it once it reaches zero
+        void fill_front(Qty qty);
+
+        // removes the order with this seq, false when it is not here
+        bool erase(std::uint64_t seq);
+
+        // reduces the order with this seq in place, it keeps its fifo slot
+        bool reduce(std::uint64_t seq, Qty new_qty);
+
+        // recomputes the qty sum with the vector kernel, equal to total_qty
+        Qty sum() const;
+
+        // slot from the front where a taker of qty is done, span() when the level falls short
+        std::size_t fill_slot(Qty qty) const;
+
+        // raw fifo view from the head, holes included, for kernels and tests
+        const Qty* qty_data() const
+        {
+            return qty_.data() + head_;
+        }
+        const OrderId* id_data() const
+        {
+            return id_.data() + head_;
+        }
+        std::size_t span() const
+        {
+            return qty_.size() - head_;
+        }
+
+    private:
+        // index of seq in the arrays, npos when absent or already removed
+        std::size_t find(std::uint64_t seq) const;
+
+        // skips holes at the head, then compacts when dead slots dominate
+        void settle();
+
+        std::vector<Qty> qty_;
+        std::vector<std::uint64_t> seq_;
+        std::vector<OrderId> id_;
+
+        std::size_t head_ { 0 };
+        std::size_t live_ { 0 };
+        Qty total_ { 0 };
+    };
+}
@@ -0,0 +1,213 @@
+#include "timing_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+
+namespace ob
+{
+    TimingWheel::TimingWheel(std::pmr::memory_resource* mr)
+        : overflow_(mr)
+    {
+        // slots are default built on the global heap, rebuild each empty one on mr
+        for (auto& level : levels_)
+        {
+            for (auto& slot : level)
+            {
+                std::destroy_at(&slot);
+                std::construct_at(&slot, mr);
+            }
+        }
+    }
+
+    void TimingWheel::schedule(LogicalTime deadline, OrderId id)
+    {
+        assert(deadline > now_);
+
+        place(Entry { deadline, id, next_order_ });
+        ++next_order_;
+        ++size_;
+    }
+
+    void TimingWheel::place(const Entry& e)
+    {
+        // lowest level whose span covers the distance to the deadline
+        const LogicalTime delta = e.deadline - now_;
+
+        for (std::size_t k = 0; k < kLevels; ++k)
+        {
+            if (delta < (LogicalTime { 1 } << (kBits * (k + 1))))
+            {
+                levels_[k][(e.deadline >> (kBits * k)) & (kSlots - 1)].push_back(e);
+                ++level_counts_[k];
+                return;
+            }
+        }
+
+        overflow_.push_back(e);
+    }
+
+    void TimingWheel::cascade()
+    {
+        // overflow first so anything it drops into the top level cascades below in the same pass
+        constexpr LogicalTime top_span = LogicalTime { 1 } << (kBits * kLevels);
+        if ((now_ & (top_span - 1)) == 0 && !overflow_.empty())
+        {
+            Slot moved(overflow_.get_allocator());
+            moved.swap(overflow_);
+            for (const auto& e : moved)
+            {
+                place(e);
+            }
+        }
+
+        // highest level first, each re placed entry lands strictly lower
+        for (std::size_t k = kLevels - 1; k >= 1; --k)
+        {
+            const LogicalTime span = LogicalTime { 1 } << (kBits * k);
+            if ((now_ & (span - 1)) != 0)
+            {
+                continue;
+            }
+
+            Slot& from = levels_[k][(now_ >> (kBits * k)) & (kSlots - 1)];
+            Slot moved(from.get_allocator());
+            moved.swap(from);
+            level_counts_[k] -= moved.size();
+
+            for (const auto& e : moved)
+            {
+                place(e);
+            }
+        }
+    }
+
+    void TimingWheel::fire(std::vector<Entry>& due)
+    {
+        // every level zero entry in this slot is due exactly now
+        Slot& slot = levels_[0][now_ & (kSlots - 1)];
+        if (slot.empty())
+        {
+            return;
+        }
+
+        // cascades can interleave entries, insertion order keeps ties deterministic
+        std::sort(slot.begin(), slot.end(), [](const Entry& a, const Entry& b) { return a.order < b.order; });
+
+        level_counts_[0] -= slot.size();
+        size_ -= slot.size();
+
+        due.insert(due.end(), slot.begin(), slot.end());
+        slot.clear();
+    }
+
+    void TimingWheel::advance(LogicalTime t, std::vector<Entry>& due)
+    {
+        while (now_ < t)
+        {
+            if (size_ == 0)
+            {
+                now_ = t;
+                return;
+            }
+
+            // lowest populated level bounds how far the clock can jump
+            std::size_t k = 0;
+            while (k < kLevels && level_counts_[k] == 0)
+            {
+                ++k;
+            }
+
+            if (k == 0)
+            {
+                ++now_;
+                cascade();
+                fire(due);
+                continue;
+            }
+
+            // nothing is due before the next level k boundary
+            const LogicalTime span = LogicalTime { 1 } << (kBits * k);
+            const LogicalTime next = (now_ / span + 1) * span;
+            if (next > t)
+            {
+                now_ = t;
+                return;
+            }
+
+            now_ = next;
+            cascade();
+            fire(due);
+        }
+    }
+
+    LogicalTime TimingWheel::now() const
+    {
+        return now_;
+    }
+
+    std::size_t TimingWheel::size() const
+    {
+        return size_;
+    }
+
+    void TimingWheel::memory_usage(std::size_t& used, std::size_t& reserved) const
+    {
+        std::size_t capacity = overflow_.capacity();
+        for (const auto& level : levels_)
+        {
+            for (const auto& slot : level)
+            {
+                capacity += slot.capacity();
+            }
+        }
+
+        // fired slots are cleared but keep their capacity for the next lap
+        used = size_ * sizeof(Entry);
+        reserved = capacity * sizeof(Entry) - used;
+    }
+
+    void TimingWheel::save(LogicalTime& now, std::uint64_t& next_order, std::vector<Entry>& entries) const
+    {
+        now = now_;
+        next_order = next_order_;
+
+        for (const auto& level : levels_)
+        {
+            for (const auto& slot : level)
+            {
+                entries.insert(entries.end(), slot.begin(), slot.end());
+            }
+        }
+        entries.insert(entries.end(), overflow_.begin(), overflow_.end());
+
+        // insertion order makes the image independent of which level an entry happens to sit in
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.order < b.order; });
+    }
+
+    void TimingWheel::restore(LogicalTime now, std::uint64_t next_order, const std::vector<Entry>& entries)
+    {
+        // emptied in place so the slots keep their memory resource
+        for (auto& level : levels_)
+        {
+            for (auto& slot : level)
+            {
+                slot.clear();
+            }
+        }
+        overflow_.clear();
+        level_counts_ = {};
+
+        now_ = now;
+        next_order_ = next_order;
+
+        // placing relative to the restored clock may pick other levels than the original did,
+        // which is fine because firing only depends on deadline and insertion counter
+        for (const auto& e : entries)
+        {
+            assert(e.deadline > now_);
+            place(e);
+        }
+        size_ = entries.size();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "order.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace ob
+{
+    // hierarchical timing wheel keyed by deadline
+    // level k slots are 256^k ticks wide, deadlines past the top level wait in an overflow list
+    // advancing only visits populated levels so a long jump costs a few slot scans, not the gap
+    class TimingWheel
+    {
+    public:
+        // one scheduled deadline
+        struct Entry
+        {
+            LogicalTime deadline { 0 };
+            OrderId id { 0 };
+            std::uint64_t order { 0 }; // insertion counter, breaks ties inside one tick
+        };
+
+        // slot storage comes from mr, an arena backed book keeps its wheel there too
+        explicit TimingWheel(std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+        // schedules id at a deadline after now
+        void schedule(LogicalTime deadline, OrderId id);
+
+        // moves the clock to t and appends due entries in deadline then insertion order
+        void advance(LogicalTime t, std::vector<Entry>& due);
+
+        LogicalTime now() const;
+
+        // scheduled entries not yet fired
+        std::size_t size() const;
+
+        // bytes held by pending entries and by slot storage that is reserved but empty
+        void memory_usage(std::size_t& used, std::size_t& reserved) const;
+
+        // every pending entry in insertion order plus the counters, for snapshots
+        void save(LogicalTime& now, std::uint64_t& next_order, std::vector<Entry>& entries) const;
+
+        // replaces the wheel with saved state, entries keep their insertion counters so ties fire as before
+        void restore(LogicalTime now, std::uint64_t next_order, const std::vector<Entry>& entries);
+
+    private:
+        static constexpr unsigned kBits = 8;
+        static constexpr std::size_t kSlots = std::size_t { 1 } << kBits;
+        static constexpr std::size_t kLevels = 5;
+
+        using Slot = std::pmr::vector<Entry>;
+
+        // places an entry relative to now_ in the lowest level that can hold it
+        void place(const Entry& e);
+
+        // pulls the slot that now_ just entered down from every level whose boundary it crossed
+        void cascade();
+
+        // fires the level zero slot for now_
+        void fire(std::vector<Entry>& due);
+
+        LogicalTime now_ { 0 };
+        std::uint64_t next_order_ { 0 };
+        std::size_t size_ { 0 };
+
+        std::array<std::array<Slot, kSlots>, kLevels> levels_ {};
+        std::array<std::size_t, kLevels> level_counts_ {};
+
+        // deadlines beyond the top level, re placed each time the top level wraps
+        Slot overflow_;
+    };
+}
@@ -0,0 +1,222 @@
+#include "wal.h"
+
+#include "byte_io.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ob
+{
+    static constexpr std::size_t kWalReadChunk = 1 << 20;
+
+    // one table lookup per byte, built once
+    static const std::array<std::uint32_t, 256>& crc32c_table()
+    {
+        static const std::array<std::uint32_t, 256> table = []
+        {
+            std::array<std::uint32_t, 256> t {};
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : (c >> 1);
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    std::uint32_t crc32c(const char* data, std::size_t size, std::uint32_t crc)
+    {
+        const auto& t = crc32c_table();
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            crc = t[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void encode_wal_record(const Command& cmd, std::uint64_t seq, std::vector<char>& out)
+    {
+        const std::size_t at = out.size();
+        put_u32(out, 0);
+        encode_command(cmd, seq, out);
+
+        const std::uint32_t crc = crc32c(out.data() + at + 4, out.size() - at - 4);
+        for (int i = 0; i < 4; ++i)
+        {
+            out[at + i] = static_cast<char>((crc >> (8 * i)) & 0xff);
+        }
+    }
+
+    // flushes a written file or a directory's entries to disk, a no op where there is no fsync
+    static bool sync_file(const std::string& path)
+    {
+#if defined(__linux__)
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        const bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#else
+        (void)path;
+        return true;
+#endif
+    }
+
+    // directory holding path, where a rename into it has to be made durable
+    static std::string parent_dir(const std::string& path)
+    {
+        const std::size_t slash = path.find_last_of('/');
+        if (slash == std::string::npos)
+        {
+            return ".";
+        }
+        return (slash == 0) ? "/" : path.substr(0, slash);
+    }
+
+    bool write_snapshot_file(const std::string& path, std::uint64_t seq, const std::vector<char>& image)
+    {
+        std::vector<char> head;
+        put_u64(head, seq);
+        put_u64(head, image.size());
+        put_u32(head, crc32c(image.data(), image.size()));
+
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                return false;
+            }
+            out.write(head.data(), static_cast<std::streamsize>(head.size()));
+            out.write(image.data(), static_cast<std::streamsize>(image.size()));
+            if (!out.flush())
+            {
+                return false;
+            }
+        }
+
+        // the rename only survives a crash once the directory entry is on disk, before that the
+        // journal may already be cut past a snapshot that is not there
+        return sync_file(tmp) && std::rename(tmp.c_str(), path.c_str()) == 0 && sync_file(parent_dir(path));
+    }
+
+    bool read_snapshot_file(const std::string& path, std::uint64_t& seq, std::vector<char>& image)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        const std::streamoff file_size = in ? static_cast<std::streamoff>(in.tellg()) : 0;
+        char head_bytes[20] {};
+        if (file_size < 20 || !in.seekg(0) || !in.read(head_bytes, sizeof(head_bytes)))
+        {
+            return false;
+        }
+
+        ByteReader head { reinterpret_cast<const unsigned char*>(head_bytes), sizeof(head_bytes) };
+        seq = head.u64();
+        const std::uint64_t size = head.u64();
+        const std::uint32_t crc = head.u32();
+
+        // the size is checked against the file before trusting it for an allocation
+        if (size != static_cast<std::uint64_t>(file_size - 20))
+        {
+            return false;
+        }
+        image.resize(static_cast<std::size_t>(size));
+        if (!in.read(image.data(), static_cast<std::streamsize>(size)))
+        {
+            return false;
+        }
+        return crc32c(image.data(), image.size()) == crc;
+    }
+
+    bool WalReader::open(const std::string& path)
+    {
+        in_.open(path, std::ios::binary);
+        buf_.assign(kWalReadChunk, 0);
+        off_ = 0;
+        end_ = 0;
+        consumed_ = 0;
+        last_seq_ = 0;
+        return static_cast<bool>(in_);
+    }
+
+    bool WalReader::fill(std::size_t need)
+    {
+        if (end_ - off_ >= need)
+        {
+            return true;
+        }
+
+        // slide the unread tail to the front and top up from the file
+        std::memmove(buf_.data(), buf_.data() + off_, end_ - off_);
+        end_ -= off_;
+        off_ = 0;
+        if (buf_.size() < need)
+        {
+            buf_.resize(need);
+        }
+
+        while (end_ < need && in_)
+        {
+            in_.read(buf_.data() + end_, static_cast<std::streamsize>(buf_.size() - end_));
+            end_ += static_cast<std::size_t>(in_.gcount());
+        }
+        return end_ >= need;
+    }
+
+    WalStatus WalReader::next(Command& cmd, std::uint64_t& seq)
+    {
+        // crc plus the frame length prefix
+        if (!fill(8))
+        {
+            return (end_ == off_) ? WalStatus::End : WalStatus::Torn;
+        }
+
+        ByteReader head { reinterpret_cast<const unsigned char*>(buf_.data() + off_), 8 };
+        const std::uint32_t crc = head.u32();
+        const std::size_t len = head.u32();
+        if (len == 0 || len > kWireMaxPayload || !fill(8 + len))
+        {
+            return WalStatus::Torn;
+        }
+
+        const char* frame = buf_.data() + off_ + 4;
+        if (crc32c(frame, 4 + len) != crc)
+        {
+            return WalStatus::Torn;
+        }
+
+        std::size_t used { 0 };
+        if (decode_frame(frame, 4 + len, msg_, used) != WireStatus::Ok || msg_.kind != WireKind::Command || (last_seq_ != 0 && msg_.tag != last_seq_ + 1))
+        {
+            return WalStatus::Torn;
+        }
+
+        off_ += 8 + len;
+        consumed_ += 8 + len;
+        last_seq_ = msg_.tag;
+
+        cmd = msg_.command;
+        seq = msg_.tag;
+        return WalStatus::Ok;
+    }
+
+    std::uint64_t WalReader::valid_bytes() const
+    {
+        return consumed_;
+    }
+}
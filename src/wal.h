@@ -0,0 +1,60 @@
+#pragma once
+
+#include "command.h"
+#include "wire.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ob
+{
+    // crc32c (castagnoli), pass the previous result to continue over more bytes
+    std::uint32_t crc32c(const char* data, std::size_t size, std::uint32_t crc = 0);
+
+    // appends one command journal record: a u32 crc32c of the frame that follows,
+    // then the command as a wire frame whose tag is the command seq
+    void encode_wal_record(const Command& cmd, std::uint64_t seq, std::vector<char>& out);
+
+    // snapshot file: u64 command seq it covers, u64 image size, u32 crc32c of the image, then the image
+    // written to a temporary name, synced, renamed and its directory synced, so a crash leaves either the old
+    // or the new one, false when any step fails
+    bool write_snapshot_file(const std::string& path, std::uint64_t seq, const std::vector<char>& image);
+
+    // false when the file is missing, short or fails its crc
+    bool read_snapshot_file(const std::string& path, std::uint64_t& seq, std::vector<char>& image);
+
+    enum class WalStatus
+    {
+        Ok,
+        End,  // clean end of file
+        Torn  // a partial or corrupt record, nothing from here on is trusted
+    };
+
+    // streams command journal records in file order
+    class WalReader
+    {
+    public:
+        bool open(const std::string& path);
+
+        // reads the next record, seqs must rise by one from the first and a gap counts as torn
+        WalStatus next(Command& cmd, std::uint64_t& seq);
+
+        // file offset just past the last good record, appending resumes here
+        std::uint64_t valid_bytes() const;
+
+    private:
+        // keeps at least need bytes after off_ unless the file runs out first
+        bool fill(std::size_t need);
+
+        std::ifstream in_;
+        std::vector<char> buf_;
+        std::size_t off_ { 0 };
+        std::size_t end_ { 0 };
+        std::uint64_t consumed_ { 0 };
+        std::uint64_t last_seq_ { 0 };
+        WireMessage msg_ {};
+    };
+}
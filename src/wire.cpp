@@ -0,0 +1,211 @@
+#include "wire.h"
+
+#include "byte_io.h"
+
+#include <algorithm>
+
+namespace ob
+{
+    // reserves the length prefix and returns where it starts
+    static std::size_t begin_frame(std::vector<char>& out, WireKind kind)
+    {
+        const std::size_t at = out.size();
+        put_u32(out, 0);
+        put_u8(out, static_cast<std::uint8_t>(kind));
+        return at;
+    }
+
+    static void end_frame(std::vector<char>& out, std::size_t at)
+    {
+        const std::uint32_t len = static_cast<std::uint32_t>(out.size() - at - 4);
+        for (int i = 0; i < 4; ++i)
+        {
+            out[at + i] = static_cast<char>((len >> (8 * i)) & 0xff);
+        }
+    }
+
+    void encode_command(const Command& cmd, std::uint64_t tag, std::vector<char>& out)
+    {
+        const std::size_t at = begin_frame(out, WireKind::Command);
+
+        put_u64(out, tag);
+        put_u8(out, static_cast<std::uint8_t>(cmd.type));
+        put_u8(out, static_cast<std::uint8_t>(cmd.side));
+        put_u8(out, static_cast<std::uint8_t>(cmd.tif));
+        put_u8(out, static_cast<std::uint8_t>(cmd.stp_mode));
+        put_u8(out, static_cast<std::uint8_t>(cmd.scope));
+        put_u64(out, cmd.id);
+        put_i64(out, cmd.price_ticks);
+        put_i64(out, cmd.qty);
+        put_i64(out, cmd.stop_price_ticks);
+        put_i64(out, cmd.max_price_ticks);
+        put_u32(out, cmd.participant);
+        put_u32(out, cmd.stp_group);
+        put_u64(out, cmd.timestamp);
+        put_u64(out, cmd.expire_at);
+
+        end_frame(out, at);
+    }
+
+    void encode_event(const Event& e, std::vector<char>& out)
+    {
+        const std::size_t at = begin_frame(out, WireKind::Event);
+
+        put_u8(out, static_cast<std::uint8_t>(e.type));
+        put_u8(out, static_cast<std::uint8_t>(e.side));
+        put_u64(out, e.id);
+        put_u64(out, e.seq);
+        put_i64(out, e.price_ticks);
+        put_i64(out, e.qty);
+        put_i64(out, e.remaining_qty);
+        put_u64(out, e.maker_id);
+        put_u64(out, e.maker_seq);
+        put_u64(out, e.taker_id);
+        put_u64(out, e.taker_seq);
+        put_i64(out, e.trade_price_ticks);
+        put_i64(out, e.trade_qty);
+
+        // reasons are short tokens, anything longer is cut at 255 bytes
+        const std::size_t n = std::min<std::size_t>(e.reason.size(), 255);
+        put_u8(out, static_cast<std::uint8_t>(n));
+        out.insert(out.end(), e.reason.begin(), e.reason.begin() + static_cast<std::ptrdiff_t>(n));
+
+        end_frame(out, at);
+    }
+
+    void encode_ack(std::uint64_t tag, std::uint32_t event_count, std::vector<char>& out)
+    {
+        const std::size_t at = begin_frame(out, WireKind::Ack);
+
+        put_u64(out, tag);
+        put_u32(out, event_count);
+
+        end_frame(out, at);
+    }
+
+    static bool decode_command(ByteReader& r, WireMessage& msg)
+    {
+        Command& c = msg.command;
+
+        msg.tag = r.u64();
+
+        const std::uint8_t type = r.u8();
+        const std::uint8_t side = r.u8();
+        const std::uint8_t tif = r.u8();
+        const std::uint8_t stp = r.u8();
+        const std::uint8_t scope = r.u8();
+
+        // enums are range checked so a bad peer cannot inject unnamed values
+        if (type > static_cast<std::uint8_t>(CommandType::Uncross) || side > 1 || tif > static_cast<std::uint8_t>(TimeInForce::Fok)
+            || stp > static_cast<std::uint8_t>(StpMode::Decrement) || scope > static_cast<std::uint8_t>(MassCancelScope::Participant))
+        {
+            return false;
+        }
+
+        c.type = static_cast<CommandType>(type);
+        c.side = static_cast<Side>(side);
+        c.tif = static_cast<TimeInForce>(tif);
+        c.stp_mode = static_cast<StpMode>(stp);
+        c.scope = static_cast<MassCancelScope>(scope);
+        c.id = r.u64();
+        c.price_ticks = r.i64();
+        c.qty = r.i64();
+        c.stop_price_ticks = r.i64();
+        c.max_price_ticks = r.i64();
+        c.participant = r.u32();
+        c.stp_group = r.u32();
+        c.timestamp = r.u64();
+        c.expire_at = r.u64();
+
+        return true;
+    }
+
+    static bool decode_event(ByteReader& r, WireMessage& msg)
+    {
+        Event& e = msg.event;
+
+        const std::uint8_t type = r.u8();
+        const std::uint8_t side = r.u8();
+        if (type > static_cast<std::uint8_t>(EventType::StateCheckpoint) || side > 1)
+        {
+            return false;
+        }
+
+        e.type = static_cast<EventType>(type);
+        e.side = static_cast<Side>(side);
+        e.id = r.u64();
+        e.seq = r.u64();
+        e.price_ticks = r.i64();
+        e.qty = r.i64();
+        e.remaining_qty = r.i64();
+        e.maker_id = r.u64();
+        e.maker_seq = r.u64();
+        e.taker_id = r.u64();
+        e.taker_seq = r.u64();
+        e.trade_price_ticks = r.i64();
+        e.trade_qty = r.i64();
+
+        const std::size_t n = r.u8();
+        if (!r.ok || n > r.left)
+        {
+            return false;
+        }
+        e.reason.assign(reinterpret_cast<const char*>(r.p), n);
+        r.p += n;
+        r.left -= n;
+
+        return true;
+    }
+
+    WireStatus decode_frame(const char* data, std::size_t size, WireMessage& msg, std::size_t& consumed)
+    {
+        consumed = 0;
+
+        if (size < 4)
+        {
+            return WireStatus::Incomplete;
+        }
+
+        ByteReader head { reinterpret_cast<const unsigned char*>(data), 4 };
+        const std::size_t len = head.u32();
+        if (len == 0 || len > kWireMaxPayload)
+        {
+            return WireStatus::Malformed;
+        }
+        if (size < 4 + len)
+        {
+            return WireStatus::Incomplete;
+        }
+
+        ByteReader r { reinterpret_cast<const unsigned char*>(data) + 4, len };
+        const std::uint8_t kind = r.u8();
+
+        bool ok = false;
+        if (kind == static_cast<std::uint8_t>(WireKind::Command))
+        {
+            msg.kind = WireKind::Command;
+            ok = decode_command(r, msg);
+        }
+        else if (kind == static_cast<std::uint8_t>(WireKind::Event))
+        {
+            msg.kind = WireKind::Event;
+            ok = decode_event(r, msg);
+        }
+        else if (kind == static_cast<std::uint8_t>(WireKind::Ack))
+        {
+            msg.kind = WireKind::Ack;
+            msg.tag = r.u64();
+            msg.event_count = r.u32();
+            ok = true;
+        }
+
+        // a frame must be consumed exactly, trailing bytes mean the peer disagrees on the layout
+        if (!ok || !r.ok || r.left != 0)
+        {
+            return WireStatus::Malformed;
+        }
+
+        consumed = 4 + len;
+        return WireStatus::Ok;
+    }
+}
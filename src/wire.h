@@ -0,0 +1,50 @@
+#pragma once
+
+#include "command.h"
+#include "event.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ob
+{
+    // compact binary protocol used by the gateway and its load client
+    // every frame is a u32 little endian payload length followed by the payload
+    // the first payload byte is the frame kind, integers are little endian and fixed width
+    enum class WireKind : std::uint8_t
+    {
+        Command = 1, // client to gateway, one command tagged by the client
+        Event = 2,   // gateway to client, one event produced by a command
+        Ack = 3      // gateway to client, closes the events of one tagged command
+    };
+
+    // largest payload a peer may send, anything bigger is malformed
+    constexpr std::size_t kWireMaxPayload = 1024;
+
+    // one decoded frame, only the fields of its kind are set
+    struct WireMessage
+    {
+        WireKind kind { WireKind::Command };
+        std::uint64_t tag { 0 };
+        Command command {};
+        Event event {};
+        std::uint32_t event_count { 0 };
+    };
+
+    enum class WireStatus
+    {
+        Ok,
+        Incomplete,
+        Malformed
+    };
+
+    // appends one frame to out
+    void encode_command(const Command& cmd, std::uint64_t tag, std::vector<char>& out);
+    void encode_event(const Event& e, std::vector<char>& out);
+    void encode_ack(std::uint64_t tag, std::uint32_t event_count, std::vector<char>& out);
+
+    // decodes the frame at the front of data and sets consumed to its full size
+    // incomplete leaves consumed at zero so the caller can wait for more bytes
+    WireStatus decode_frame(const char* data, std::size_t size, WireMessage& msg, std::size_t& consumed);
+}
@@ -0,0 +1,287 @@
+#include "workload.h"
+
+#include <algorithm>
+
+namespace ob
+{
+    namespace
+    {
+        // splitmix64 so streams are identical on every platform
+        struct Rng
+        {
+            std::uint64_t state { 0x9e3779b97f4a7c15ULL };
+
+            std::uint64_t next()
+            {
+                std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+            // uniform enough value in [0, n)
+            std::uint64_t below(std::uint64_t n)
+            {
+                return next() % n;
+            }
+        };
+
+        // a quote the generator believes is resting
+        struct Quote
+        {
+            OrderId id { 0 };
+            Side side { Side::Buy };
+            PriceTicks price_ticks { 0 };
+            Qty qty { 0 };
+        };
+    }
+
+    static constexpr PriceTicks kMid = 10'000;
+    static constexpr PriceTicks kBand = 50;
+
+    // buys live below mid and sells above so quotes never cross each other
+    static PriceTicks clamp_to_side(Side side, PriceTicks px)
+    {
+        if (side == Side::Buy)
+        {
+            return std::clamp(px, kMid - kBand, kMid - 1);
+        }
+        return std::clamp(px, kMid + 1, kMid + kBand);
+    }
+
+    static std::vector<Command> make_amend(std::uint64_t size)
+    {
+        std::vector<Command> out;
+        out.reserve(size);
+
+        Rng rng {};
+        OrderId next_id { 1 };
+
+        // seed the book with one quote per ten commands
+        const std::uint64_t quote_count = std::max<std::uint64_t>(size / 10, 2);
+        std::vector<Quote> quotes;
+        quotes.reserve(quote_count);
+
+        for (std::uint64_t i = 0; i < quote_count && out.size() < size; ++i)
+        {
+            Quote q {};
+            q.id = next_id++;
+            q.side = (i % 2 == 0) ? Side::Buy : Side::Sell;
+            const PriceTicks offset = 1 + static_cast<PriceTicks>(rng.below(kBand));
+            q.price_ticks = (q.side == Side::Buy) ? kMid - offset : kMid + offset;
+            q.qty = 50 + static_cast<Qty>(rng.below(50));
+
+            out.push_back(Command::add_limit(q.id, q.side, q.price_ticks, q.qty));
+            quotes.push_back(q);
+        }
+
+        while (out.size() < size)
+        {
+            Quote& q = quotes[rng.below(quotes.size())];
+            const std::uint64_t roll = rng.below(100);
+
+            if (roll < 60 && q.qty > 1)
+            {
+                // qty reduction keeps queue position
+                q.qty -= 1 + static_cast<Qty>(rng.below(static_cast<std::uint64_t>(std::min<Qty>(q.qty - 1, 5))));
+                out.push_back(Command::modify(q.id, q.price_ticks, q.qty));
+            }
+            else if (roll < 85)
+            {
+                // reprice a few ticks and top the qty back up
+                const PriceTicks shift = static_cast<PriceTicks>(rng.below(7)) - 3;
+                q.price_ticks = clamp_to_side(q.side, q.price_ticks + shift);
+                q.qty = 50 + static_cast<Qty>(rng.below(50));
+                out.push_back(Command::modify(q.id, q.price_ticks, q.qty));
+            }
+            else
+            {
+                // pull and replace under a new id
+                out.push_back(Command::cancel(q.id));
+                if (out.size() == size)
+                {
+                    break;
+                }
+
+                q.id = next_id++;
+                q.qty = 50 + static_cast<Qty>(rng.below(50));
+                out.push_back(Command::add_limit(q.id, q.side, q.price_ticks, q.qty));
+            }
+        }
+
+        return out;
+    }
+
+    static std::vector<Command> make_mass_cancel(std::uint64_t size)
+    {
+        std::vector<Command> out;
+        out.reserve(size + 3);
+
+        Rng rng {};
+
+        // spread orders over a thousand levels per side
+        constexpr PriceTicks kDepth = 1'000;
+        for (std::uint64_t i = 0; i < size; ++i)
+        {
+            const Side side = (i % 2 == 0) ? Side::Buy : Side::Sell;
+            const PriceTicks offset = 1 + static_cast<PriceTicks>(rng.below(kDepth));
+            const PriceTicks px = (side == Side::Buy) ? kMid - offset : kMid + offset;
+            out.push_back(Command::add_limit(static_cast<OrderId>(i + 1), side, px, 1 + static_cast<Qty>(rng.below(100))));
+        }
+
+        // inner half of the bids, then every ask, then what is left
+        out.push_back(Command::mass_cancel_range(Side::Buy, kMid - kDepth / 2, kMid - 1));
+        out.push_back(Command::mass_cancel_side(Side::Sell));
+        out.push_back(Command::mass_cancel_all());
+
+        return out;
+    }
+
+    static std::vector<Command> make_match(std::uint64_t size, bool with_stp)
+    {
+        std::vector<Command> out;
+        out.reserve(size);
+
+        Rng rng {};
+        OrderId next_id { 1 };
+
+        // three quotes per taker keeps the book populated while takers cross a few levels
+        while (out.size() < size)
+        {
+            const std::uint64_t roll = rng.below(4);
+            const Side side = (rng.below(2) == 0) ? Side::Buy : Side::Sell;
+            const PriceTicks offset = static_cast<PriceTicks>(rng.below(10));
+
+            if (roll < 3)
+            {
+                const PriceTicks px = (side == Side::Buy) ? kMid - 1 - offset : kMid + 1 + offset;
+                out.push_back(Command::add_limit(next_id++, side, px, 1 + static_cast<Qty>(rng.below(20))));
+            }
+            else
+            {
+                const PriceTicks px = (side == Side::Buy) ? kMid + 1 + offset : kMid - 1 - offset;
+                out.push_back(Command::add_limit(next_id++, side, px, 1 + static_cast<Qty>(rng.below(60)), TimeInForce::Ioc));
+            }
+
+            // makers and takers sit in different groups so the check runs but never fires
+            if (with_stp)
+            {
+                const StpGroup group = (roll < 3) ? 1 : 2;
+                out.back() = out.back().with_stp(group, StpMode::CancelResting);
+            }
+        }
+
+        return out;
+    }
+
+    static std::vector<Command> make_stop_cascade(std::uint64_t size)
+    {
+        std::vector<Command> out;
+
+        Rng rng {};
+        OrderId next_id { 1 };
+
+        // asks hold twice the stop qty so the cascade walks every level without emptying the book
+        constexpr PriceTicks kDepth = 1'000;
+        const Qty level_qty = std::max<Qty>(static_cast<Qty>(2 * size / kDepth), 1);
+
+        out.reserve(static_cast<std::size_t>(kDepth) + size + 1);
+
+        for (PriceTicks i = 1; i <= kDepth; ++i)
+        {
+            out.push_back(Command::add_limit(next_id++, Side::Sell, kMid + i, level_qty));
+        }
+
+        // stop markets spread over the ask range, each one lifts a single lot
+        for (std::uint64_t i = 0; i < size; ++i)
+        {
+            const PriceTicks trigger = kMid + 1 + static_cast<PriceTicks>(rng.below(kDepth));
+            out.push_back(Command::stop(next_id++, Side::Buy, trigger, 1));
+        }
+
+        // first trade at the touch starts the run
+        out.push_back(Command::add_limit(next_id++, Side::Buy, kMid + 1, 1, TimeInForce::Ioc));
+
+        return out;
+    }
+
+    static std::vector<Command> make_expiry(std::uint64_t size)
+    {
+        std::vector<Command> out;
+        out.reserve(size + 1);
+
+        Rng rng {};
+
+        // eight arrivals per tick, each good for up to four thousand ticks, so expiry runs all along
+        constexpr std::uint64_t kHorizon = 4'096;
+        for (std::uint64_t i = 0; i < size; ++i)
+        {
+            const LogicalTime now = 1 + i / 8;
+            const Side side = (i % 2 == 0) ? Side::Buy : Side::Sell;
+            const PriceTicks offset = 1 + static_cast<PriceTicks>(rng.below(kBand));
+            const PriceTicks px = (side == Side::Buy) ? kMid - offset : kMid + offset;
+
+            out.push_back(Command::add_limit(static_cast<OrderId>(i + 1), side, px, 1 + static_cast<Qty>(rng.below(100)))
+                              .with_expiry(now + 1 + rng.below(kHorizon))
+                              .at(now));
+        }
+
+        // the session end sweeps whatever is still live
+        out.push_back(Command::advance_time(1 + size / 8 + kHorizon + 1));
+
+        return out;
+    }
+
+    static std::vector<Command> make_auction(std::uint64_t size)
+    {
+        std::vector<Command> out;
+        out.reserve(size + 2);
+
+        Rng rng {};
+
+        // both sides overlap by the whole band so the uncross walks a deep crossed range
+        out.push_back(Command::begin_auction());
+        for (std::uint64_t i = 0; i < size; ++i)
+        {
+            const Side side = (i % 2 == 0) ? Side::Buy : Side::Sell;
+            const PriceTicks px = kMid - kBand + static_cast<PriceTicks>(rng.below(2 * kBand + 1));
+            out.push_back(Command::add_limit(static_cast<OrderId>(i + 1), side, px, 1 + static_cast<Qty>(rng.below(100))));
+        }
+        out.push_back(Command::uncross());
+
+        return out;
+    }
+
+    std::optional<std::vector<Command>> make_workload(const std::string& name, std::uint64_t size)
+    {
+        if (name == "amend")
+        {
+            return make_amend(size);
+        }
+        if (name == "mass_cancel")
+        {
+            return make_mass_cancel(size);
+        }
+        if (name == "match")
+        {
+            return make_match(size, false);
+        }
+        if (name == "match_stp")
+        {
+            return make_match(size, true);
+        }
+        if (name == "stop_cascade")
+        {
+            return make_stop_cascade(size);
+        }
+        if (name == "expiry")
+        {
+            return make_expiry(size);
+        }
+        if (name == "auction")
+        {
+            return make_auction(size);
+        }
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "command.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ob
+{
+    // builds a deterministic synthetic command stream for benchmarks
+    // names:
+    //   amend         resting market maker quotes that are mostly reduced or repriced
+    //   mass_cancel   a book of size orders torn down by range, side and whole book kill switches
+    //   match         alternating passive quotes and aggressive takers that sweep a few levels
+    //   match_stp     match with every order in an stp group that never collides, prices stp checks
+    //   stop_cascade  size buy stops over a thousand ask levels, one small buy sets off the whole run
+    //   expiry        timestamped gtd quotes that expire as the clock moves, then a final session sweep
+    //   auction       size crossing orders gathered in an auction then one uncross
+    std::optional<std::vector<Command>> make_workload(const std::string& name, std::uint64_t size);
+}
@@ -1,9 +1,32 @@
 #include "engine.h"
 
+#include "arena.h"
+#include "auction.h"
+#include "book_commands.h"
+#include "event_hash.h"
 #include "event_io.h"
+#include "journal.h"
+#include "md_ring.h"
+#include "order_book.h"
+#include "price_bitset.h"
+#include "script.h"
+#include "soa_level.h"
+#include "wal.h"
+#include "wire.h"
+#include "workload.h"
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
 static std::vector<std::string> to_lines(const std::vector<ob::Event>& es)
 {
     std::vector<std::string> out;
@@ -228,3 +251,2559 @@ TEST(EventIO, RoundTripTradeEvent)
     EXPECT_EQ(parsed->trade_qty, 4);
     EXPECT_EQ(parsed->reason, "trade");
 }
+
+TEST(TimeInForce, IocCancelsRemainderInsteadOfResting)
+{
+    // ioc fills what crosses and drops the rest
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 3));
+    const auto ev = eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 5, ob::TimeInForce::Ioc));
+
+    ASSERT_FALSE(ev.empty());
+    EXPECT_EQ(ev.back().type, ob::EventType::RemainderCancelled);
+    EXPECT_EQ(ev.back().remaining_qty, 2);
+    EXPECT_EQ(ev.back().reason, "ioc");
+
+    EXPECT_FALSE(eng.book().has_order(2));
+    EXPECT_FALSE(eng.book().best_bid_price().has_value());
+    EXPECT_EQ(eng.book().live_order_count(), 0u);
+}
+
+TEST(TimeInForce, FokKilledWithoutTouchingBook)
+{
+    // fok that cannot fully fill leaves makers and seq untouched
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 3));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 3));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 105, 10));
+
+    const auto ev = eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 101, 7, ob::TimeInForce::Fok));
+    ASSERT_EQ(ev.size(), 1u);
+    EXPECT_EQ(ev[0].type, ob::EventType::OrderKilled);
+    EXPECT_EQ(ev[0].reason, "fok_unfilled");
+
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Sell, 100), 3);
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Sell, 101), 3);
+    EXPECT_EQ(eng.book().available_qty(ob::Side::Buy, 101, 100), 6);
+
+    // the killed order consumed no seq
+    const auto next = eng.apply(ob::Command::add_limit(5, ob::Side::Buy, 50, 1));
+    EXPECT_EQ(next[0].seq, 4u);
+}
+
+TEST(TimeInForce, FokFillsAcrossLevels)
+{
+    // fok with enough crossing liquidity behaves like a full fill
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 4));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 99, 4));
+
+    const auto ev = eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 99, 6, ob::TimeInForce::Fok));
+    ASSERT_FALSE(ev.empty());
+    EXPECT_EQ(ev.back().type, ob::EventType::OrderCompleted);
+
+    EXPECT_FALSE(eng.book().has_order(1));
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 99), 2);
+}
+
+TEST(Script, ParsesTimeInForceSuffix)
+{
+    // add accepts an optional gtc ioc or fok token
+    const auto ioc = ob::parse_script_line("add 7 buy 100 5 ioc");
+    const auto fok = ob::parse_script_line("add 8 sell 100 5 FOK");
+    const auto gtc = ob::parse_script_line("add 9 sell 100 5");
+
+    ASSERT_TRUE(ioc.has_value());
+    ASSERT_TRUE(fok.has_value());
+    ASSERT_TRUE(gtc.has_value());
+
+    EXPECT_EQ(ioc->tif, ob::TimeInForce::Ioc);
+    EXPECT_EQ(fok->tif, ob::TimeInForce::Fok);
+    EXPECT_EQ(gtc->tif, ob::TimeInForce::Gtc);
+
+    EXPECT_FALSE(ob::parse_script_line("add 9 sell 100 5 day").has_value());
+}
+
+TEST(Modify, QtyDownKeepsQueuePosition)
+{
+    // reducing qty at the same price keeps fifo slot and seq
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 5));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 5));
+
+    const auto ev = eng.apply(ob::Command::modify(1, 100, 2));
+    ASSERT_EQ(ev.size(), 1u);
+    EXPECT_EQ(ev[0].type, ob::EventType::OrderModified);
+    EXPECT_EQ(ev[0].reason, "reduced");
+    EXPECT_EQ(ev[0].seq, 1u);
+
+    const auto ids = eng.book().order_ids_at(ob::Side::Buy, 100);
+    ASSERT_EQ(ids.size(), 2u);
+    EXPECT_EQ(ids[0], 1u);
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 100), 7);
+}
+
+TEST(Modify, QtyUpAndPriceChangeRequeue)
+{
+    // a qty increase goes to the tail and a price change moves levels
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 200, 5));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 200, 5));
+
+    const auto up = eng.apply(ob::Command::modify(1, 200, 8));
+    ASSERT_EQ(up.size(), 1u);
+    EXPECT_EQ(up[0].reason, "requeued");
+    EXPECT_EQ(up[0].seq, 3u);
+
+    auto ids = eng.book().order_ids_at(ob::Side::Sell, 200);
+    ASSERT_EQ(ids.size(), 2u);
+    EXPECT_EQ(ids[0], 2u);
+    EXPECT_EQ(ids[1], 1u);
+
+    eng.apply(ob::Command::modify(2, 210, 5));
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Sell, 200), 8);
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Sell, 210), 5);
+    EXPECT_EQ(*eng.book().best_ask_price(), 200);
+}
+
+TEST(Modify, CrossingPriceMatchesAsTaker)
+{
+    // repricing through the spread trades before resting the rest
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 105, 3));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 5));
+
+    const auto ev = eng.apply(ob::Command::modify(2, 105, 5));
+
+    bool saw_trade = false;
+    for (const auto& e : ev)
+    {
+        if (e.type == ob::EventType::Trade)
+        {
+            saw_trade = true;
+            EXPECT_EQ(e.maker_id, 1u);
+            EXPECT_EQ(e.taker_id, 2u);
+            EXPECT_EQ(e.trade_qty, 3);
+        }
+    }
+    EXPECT_TRUE(saw_trade);
+    EXPECT_EQ(ev.back().type, ob::EventType::OrderResting);
+
+    EXPECT_FALSE(eng.book().best_ask_price().has_value());
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 105), 2);
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 100), 0);
+}
+
+TEST(Modify, RejectsUnknownAndInvalid)
+{
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 5));
+
+    const auto missing = eng.apply(ob::Command::modify(9, 100, 1));
+    const auto zero = eng.apply(ob::Command::modify(1, 100, 0));
+
+    ASSERT_EQ(missing.size(), 1u);
+    ASSERT_EQ(zero.size(), 1u);
+    EXPECT_EQ(missing[0].type, ob::EventType::ModifyRejected);
+    EXPECT_EQ(missing[0].reason, "not_found");
+    EXPECT_EQ(zero[0].reason, "invalid");
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 100), 5);
+}
+
+TEST(MassCancel, RangeOnOneSideInPriceThenFifoOrder)
+{
+    // only bids inside the range go, best price first then fifo
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 1));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 102, 1));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 101, 1));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 102, 1));
+    eng.apply(ob::Command::add_limit(5, ob::Side::Buy, 99, 1));
+    eng.apply(ob::Command::add_limit(6, ob::Side::Sell, 101'000, 1));
+
+    const auto ev = eng.apply(ob::Command::mass_cancel_range(ob::Side::Buy, 100, 102));
+    ASSERT_EQ(ev.size(), 4u);
+
+    EXPECT_EQ(ev[0].id, 2u);
+    EXPECT_EQ(ev[1].id, 4u);
+    EXPECT_EQ(ev[2].id, 3u);
+    EXPECT_EQ(ev[3].id, 1u);
+    for (const auto& e : ev)
+    {
+        EXPECT_EQ(e.type, ob::EventType::OrderCancelled);
+        EXPECT_EQ(e.reason, "mass_cancel");
+    }
+
+    EXPECT_EQ(eng.book().live_order_count(), 2u);
+    EXPECT_EQ(*eng.book().best_bid_price(), 99);
+    EXPECT_TRUE(eng.book().has_order(6));
+}
+
+TEST(MassCancel, SideAndAll)
+{
+    // side clears one side, all clears bids then asks
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 1));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 110, 1));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 105, 1));
+
+    const auto sells = eng.apply(ob::Command::mass_cancel_side(ob::Side::Sell));
+    ASSERT_EQ(sells.size(), 2u);
+    EXPECT_EQ(sells[0].id, 3u);
+    EXPECT_EQ(sells[1].id, 2u);
+    EXPECT_FALSE(eng.book().best_ask_price().has_value());
+
+    eng.apply(ob::Command::add_limit(4, ob::Side::Sell, 120, 1));
+    const auto all = eng.apply(ob::Command::mass_cancel_all());
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(all[0].id, 1u);
+    EXPECT_EQ(all[1].id, 4u);
+    EXPECT_EQ(eng.book().live_order_count(), 0u);
+
+    // ids are free again once cancelled
+    const auto again = eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 1));
+    EXPECT_EQ(again[0].type, ob::EventType::OrderAccepted);
+}
+
+TEST(Script, ParsesMassCancelForms)
+{
+    const auto all = ob::parse_script_line("mass_cancel all");
+    const auto side = ob::parse_script_line("mass_cancel sell");
+    const auto range = ob::parse_script_line("mass_cancel b 100 105");
+
+    ASSERT_TRUE(all.has_value());
+    ASSERT_TRUE(side.has_value());
+    ASSERT_TRUE(range.has_value());
+
+    EXPECT_EQ(all->scope, ob::MassCancelScope::All);
+    EXPECT_EQ(side->scope, ob::MassCancelScope::Side);
+    EXPECT_EQ(side->side, ob::Side::Sell);
+    EXPECT_EQ(range->scope, ob::MassCancelScope::PriceRange);
+    EXPECT_EQ(range->price_ticks, 100);
+    EXPECT_EQ(range->max_price_ticks, 105);
+
+    EXPECT_FALSE(ob::parse_script_line("mass_cancel buy 100").has_value());
+    EXPECT_FALSE(ob::parse_script_line("mass_cancel all 1").has_value());
+}
+
+TEST(Participant, CountsTrackRestFillAndCancel)
+{
+    // open order counts follow resting, fills and cancels
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 2, ob::TimeInForce::Gtc, 7));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 2, ob::TimeInForce::Gtc, 7));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 102, 2, ob::TimeInForce::Gtc, 8));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 90, 2));
+
+    EXPECT_EQ(eng.book().participant_order_count(7), 2u);
+    EXPECT_EQ(eng.book().participant_order_count(8), 1u);
+    EXPECT_EQ(eng.book().participant_order_count(0), 0u);
+
+    // taker fills order 1 fully
+    eng.apply(ob::Command::add_limit(5, ob::Side::Buy, 100, 2));
+    EXPECT_EQ(eng.book().participant_order_count(7), 1u);
+
+    eng.apply(ob::Command::cancel(3));
+    EXPECT_EQ(eng.book().participant_order_count(8), 0u);
+}
+
+TEST(Participant, CancelOnDisconnectOnlyTouchesOwner)
+{
+    // participant cancel removes that owner's orders in chain order
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 1, ob::TimeInForce::Gtc, 3));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 1, ob::TimeInForce::Gtc, 4));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 120, 1, ob::TimeInForce::Gtc, 3));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 99, 1, ob::TimeInForce::Gtc, 3));
+
+    // a passive requeue keeps the order on its chain, behind the orders it now trails in seq
+    eng.apply(ob::Command::modify(1, 98, 1));
+
+    const auto ev = eng.apply(ob::Command::mass_cancel_participant(3));
+    ASSERT_EQ(ev.size(), 3u);
+    EXPECT_EQ(ev[0].id, 3u);
+    EXPECT_EQ(ev[1].id, 4u);
+    EXPECT_EQ(ev[2].id, 1u);
+    EXPECT_EQ(ev[0].reason, "participant_cancel");
+
+    EXPECT_EQ(eng.book().participant_order_count(3), 0u);
+    EXPECT_EQ(eng.book().live_order_count(), 1u);
+    EXPECT_TRUE(eng.book().has_order(2));
+
+    const auto none = eng.apply(ob::Command::mass_cancel_participant(3));
+    EXPECT_TRUE(none.empty());
+}
+
+TEST(Script, ParsesParticipantOptions)
+{
+    const auto add = ob::parse_script_line("add 1 buy 100 5 participant=42 ioc");
+    const auto mc = ob::parse_script_line("mass_cancel participant 42");
+
+    ASSERT_TRUE(add.has_value());
+    ASSERT_TRUE(mc.has_value());
+
+    EXPECT_EQ(add->participant, 42u);
+    EXPECT_EQ(add->tif, ob::TimeInForce::Ioc);
+    EXPECT_EQ(mc->scope, ob::MassCancelScope::Participant);
+    EXPECT_EQ(mc->participant, 42u);
+
+    EXPECT_FALSE(ob::parse_script_line("add 1 buy 100 5 participant=").has_value());
+    EXPECT_FALSE(ob::parse_script_line("add 1 buy 100 5 ioc fok").has_value());
+}
+
+static std::vector<ob::Event> of_type(const std::vector<ob::Event>& es, ob::EventType t)
+{
+    std::vector<ob::Event> out;
+    for (const auto& e : es)
+    {
+        if (e.type == t)
+        {
+            out.push_back(e);
+        }
+    }
+    return out;
+}
+
+TEST(SelfTrade, CancelRestingSkipsOwnMakerAndKeepsMatching)
+{
+    // own maker is cancelled and the taker trades with the next maker
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 5).with_stp(9, ob::StpMode::None));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 100, 5));
+
+    const auto ev = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 100, 5).with_stp(9, ob::StpMode::CancelResting));
+
+    const auto stp = of_type(ev, ob::EventType::SelfTradePrevented);
+    ASSERT_EQ(stp.size(), 1u);
+    EXPECT_EQ(stp[0].id, 1u);
+    EXPECT_EQ(stp[0].qty, 5);
+    EXPECT_EQ(stp[0].reason, "stp_cancel_resting");
+
+    const auto trades = of_type(ev, ob::EventType::Trade);
+    ASSERT_EQ(trades.size(), 1u);
+    EXPECT_EQ(trades[0].maker_id, 2u);
+    EXPECT_EQ(ev.back().type, ob::EventType::OrderCompleted);
+    EXPECT_EQ(eng.book().live_order_count(), 0u);
+}
+
+TEST(SelfTrade, CancelTakingAndBoth)
+{
+    // cancel taking leaves the maker, cancel both removes both
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 5).with_stp(4, ob::StpMode::None));
+
+    const auto taking = eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 3).with_stp(4, ob::StpMode::CancelTaking));
+    ASSERT_EQ(taking.back().type, ob::EventType::SelfTradePrevented);
+    EXPECT_EQ(taking.back().id, 2u);
+    EXPECT_EQ(taking.back().qty, 3);
+    EXPECT_EQ(taking.back().reason, "stp_cancel_taking");
+    EXPECT_TRUE(eng.book().has_order(1));
+    EXPECT_FALSE(eng.book().has_order(2));
+
+    const auto both = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 100, 3).with_stp(4, ob::StpMode::CancelBoth));
+    const auto stp = of_type(both, ob::EventType::SelfTradePrevented);
+    ASSERT_EQ(stp.size(), 2u);
+    EXPECT_EQ(stp[0].id, 1u);
+    EXPECT_EQ(stp[1].id, 3u);
+    EXPECT_EQ(stp[1].reason, "stp_cancel_both");
+    EXPECT_EQ(eng.book().live_order_count(), 0u);
+}
+
+TEST(SelfTrade, DecrementReducesBothSides)
+{
+    // overlap is removed from both without a trade
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 8).with_stp(2, ob::StpMode::None));
+
+    const auto ev = eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 100, 3).with_stp(2, ob::StpMode::Decrement));
+    EXPECT_TRUE(of_type(ev, ob::EventType::Trade).empty());
+
+    const auto stp = of_type(ev, ob::EventType::SelfTradePrevented);
+    ASSERT_EQ(stp.size(), 2u);
+    EXPECT_EQ(stp[0].id, 1u);
+    EXPECT_EQ(stp[0].remaining_qty, 5);
+    EXPECT_EQ(stp[1].id, 2u);
+    EXPECT_EQ(stp[1].remaining_qty, 0);
+    EXPECT_EQ(ev.back().reason, "stp_decrement");
+
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 100), 5);
+    EXPECT_FALSE(eng.book().has_order(2));
+}
+
+TEST(SelfTrade, FokCountsOnlyForeignLiquidity)
+{
+    // own group makers do not make a fok fillable
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 5).with_stp(6, ob::StpMode::None));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 5));
+
+    const auto killed = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 101, 8, ob::TimeInForce::Fok).with_stp(6, ob::StpMode::CancelResting));
+    ASSERT_EQ(killed.size(), 1u);
+    EXPECT_EQ(killed[0].type, ob::EventType::OrderKilled);
+    EXPECT_EQ(eng.book().live_order_count(), 2u);
+
+    const auto filled = eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 101, 5, ob::TimeInForce::Fok).with_stp(6, ob::StpMode::CancelResting));
+    EXPECT_EQ(filled.back().type, ob::EventType::OrderCompleted);
+    EXPECT_EQ(eng.book().live_order_count(), 0u);
+}
+
+TEST(Script, ParsesStpOptions)
+{
+    const auto c = ob::parse_script_line("add 1 sell 100 5 stp_group=3 stp=decrement");
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->stp_group, 3u);
+    EXPECT_EQ(c->stp_mode, ob::StpMode::Decrement);
+
+    EXPECT_FALSE(ob::parse_script_line("add 1 sell 100 5 stp=sometimes").has_value());
+}
+
+TEST(Stops, TriggerOnTradeThroughAndEnterAsTaker)
+{
+    // a buy stop waits until a trade prints at or above its trigger
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 1));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 5));
+
+    const auto acc = eng.apply(ob::Command::stop(10, ob::Side::Buy, 100, 3));
+    ASSERT_EQ(acc.size(), 1u);
+    EXPECT_EQ(acc[0].type, ob::EventType::StopAccepted);
+    EXPECT_EQ(eng.book().pending_stop_count(), 1u);
+
+    const auto ev = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 100, 1));
+
+    const auto fired = of_type(ev, ob::EventType::StopTriggered);
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0].id, 10u);
+    EXPECT_EQ(fired[0].trade_price_ticks, 100);
+
+    // the stop market lifted 3 from the next level
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Sell, 101), 2);
+    EXPECT_EQ(*eng.book().last_trade_price(), 101);
+    EXPECT_EQ(eng.book().pending_stop_count(), 0u);
+    EXPECT_FALSE(eng.book().has_order(10));
+}
+
+TEST(Stops, CascadeRunsInTriggerOrder)
+{
+    // each stop's trades can fire the next, lowest buy trigger first
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 1));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 1));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 102, 1));
+
+    eng.apply(ob::Command::stop(21, ob::Side::Buy, 101, 1));
+    eng.apply(ob::Command::stop(20, ob::Side::Buy, 100, 1));
+    eng.apply(ob::Command::stop_limit(22, ob::Side::Buy, 102, 105, 2));
+
+    const auto ev = eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 100, 1));
+
+    const auto fired = of_type(ev, ob::EventType::StopTriggered);
+    ASSERT_EQ(fired.size(), 3u);
+    EXPECT_EQ(fired[0].id, 20u);
+    EXPECT_EQ(fired[1].id, 21u);
+    EXPECT_EQ(fired[2].id, 22u);
+
+    // stop limit found nothing left at or below 105 and rested
+    EXPECT_FALSE(eng.book().best_ask_price().has_value());
+    EXPECT_TRUE(eng.book().has_order(22));
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 105), 2);
+}
+
+TEST(Stops, SellStopAndCancel)
+{
+    // sell stops fire on trades at or below trigger and can be cancelled while pending
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 99, 5));
+    eng.apply(ob::Command::stop(30, ob::Side::Sell, 99, 2));
+    eng.apply(ob::Command::stop(31, ob::Side::Sell, 95, 2));
+
+    const auto c = eng.apply(ob::Command::cancel(31));
+    ASSERT_EQ(c.size(), 1u);
+    EXPECT_EQ(c[0].type, ob::EventType::OrderCancelled);
+    EXPECT_EQ(c[0].price_ticks, 95);
+
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 99, 1));
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 99), 2);
+    EXPECT_EQ(eng.book().pending_stop_count(), 0u);
+
+    // ids of pending stops are reserved
+    eng.apply(ob::Command::stop(40, ob::Side::Sell, 10, 1));
+    const auto dup = eng.apply(ob::Command::add_limit(40, ob::Side::Buy, 10, 1));
+    EXPECT_EQ(dup[0].reason, "duplicate_id");
+}
+
+TEST(Script, ParsesStops)
+{
+    const auto s = ob::parse_script_line("stop 5 sell 95 3 participant=2");
+    const auto sl = ob::parse_script_line("stop_limit 6 buy 105 106 4 ioc");
+
+    ASSERT_TRUE(s.has_value());
+    ASSERT_TRUE(sl.has_value());
+
+    EXPECT_EQ(s->type, ob::CommandType::AddStop);
+    EXPECT_EQ(s->stop_price_ticks, 95);
+    EXPECT_EQ(s->price_ticks, 0);
+    EXPECT_EQ(s->participant, 2u);
+    EXPECT_EQ(sl->price_ticks, 106);
+    EXPECT_EQ(sl->qty, 4);
+    EXPECT_EQ(sl->tif, ob::TimeInForce::Ioc);
+}
+
+TEST(Expiry, OrdersExpireInDeadlineThenArrivalOrder)
+{
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 99, 5).with_expiry(300));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 98, 5).with_expiry(100));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 101, 5).with_expiry(100));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Sell, 102, 5));
+
+    // one tick before the deadline nothing moves
+    EXPECT_TRUE(eng.apply(ob::Command::advance_time(99)).empty());
+    EXPECT_EQ(eng.book().live_order_count(), 4u);
+
+    const auto ev = eng.apply(ob::Command::advance_time(300));
+    ASSERT_EQ(ev.size(), 3u);
+    EXPECT_EQ(ev[0].id, 2u);
+    EXPECT_EQ(ev[1].id, 3u);
+    EXPECT_EQ(ev[2].id, 1u);
+    for (const auto& e : ev)
+    {
+        EXPECT_EQ(e.type, ob::EventType::OrderCancelled);
+        EXPECT_EQ(e.reason, "expired");
+        EXPECT_EQ(e.qty, 5);
+    }
+
+    EXPECT_EQ(eng.book().live_order_count(), 1u);
+    EXPECT_TRUE(eng.book().has_order(4));
+    EXPECT_EQ(eng.book().now(), 300u);
+}
+
+TEST(Expiry, TimestampedCommandSeesExpiryFirst)
+{
+    // the ask expires at 10 so a buy stamped 10 finds an empty side and rests
+    ob::Engine eng;
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 5).with_expiry(10));
+    const auto ev = eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 5).at(10));
+
+    ASSERT_GE(ev.size(), 3u);
+    EXPECT_EQ(ev[0].type, ob::EventType::OrderCancelled);
+    EXPECT_EQ(ev[0].reason, "expired");
+    EXPECT_EQ(ev[1].type, ob::EventType::OrderAccepted);
+    EXPECT_TRUE(of_type(ev, ob::EventType::Trade).empty());
+    EXPECT_TRUE(eng.book().has_order(2));
+
+    // an expiry the clock already reached is rejected
+    const auto late = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 90, 1).with_expiry(10));
+    ASSERT_EQ(late.size(), 1u);
+    EXPECT_EQ(late[0].type, ob::EventType::OrderRejected);
+    EXPECT_EQ(late[0].reason, "expired");
+}
+
+TEST(Expiry, StaleDeadlinesAreSkipped)
+{
+    ob::Engine eng;
+
+    // cancelled then the id reused without expiry, the old deadline must not touch it
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 99, 5).with_expiry(50));
+    eng.apply(ob::Command::cancel(1));
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 99, 5));
+
+    // a requeued order keeps its deadline
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 97, 5).with_expiry(60));
+    eng.apply(ob::Command::modify(2, 98, 8));
+
+    // pending stops expire too
+    eng.apply(ob::Command::stop(3, ob::Side::Buy, 150, 1).with_expiry(70));
+
+    const auto ev = eng.apply(ob::Command::advance_time(1'000'000));
+    ASSERT_EQ(ev.size(), 2u);
+    EXPECT_EQ(ev[0].id, 2u);
+    EXPECT_EQ(ev[0].qty, 8);
+    EXPECT_EQ(ev[1].id, 3u);
+    EXPECT_EQ(ev[1].price_ticks, 150);
+
+    EXPECT_TRUE(eng.book().has_order(1));
+    EXPECT_EQ(eng.book().pending_stop_count(), 0u);
+}
+
+TEST(Expiry, WheelHandlesLongJumpsAndOverflow)
+{
+    ob::TimingWheel wheel;
+
+    const std::uint64_t far = std::uint64_t { 1 } << 42;
+    wheel.schedule(far + 7, 6);
+    wheel.schedule(70'000, 4);
+    wheel.schedule(255, 2);
+    wheel.schedule(1, 1);
+    wheel.schedule(256, 3);
+    wheel.schedule(70'000, 5);
+
+    std::vector<ob::TimingWheel::Entry> due;
+    wheel.advance(256, due);
+    ASSERT_EQ(due.size(), 3u);
+    EXPECT_EQ(due[0].id, 1u);
+    EXPECT_EQ(due[1].id, 2u);
+    EXPECT_EQ(due[2].id, 3u);
+
+    due.clear();
+    wheel.advance(69'999, due);
+    EXPECT_TRUE(due.empty());
+
+    wheel.advance(far + 6, due);
+    ASSERT_EQ(due.size(), 2u);
+    EXPECT_EQ(due[0].id, 4u);
+    EXPECT_EQ(due[1].id, 5u);
+
+    due.clear();
+    wheel.advance(far + 7, due);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0].deadline, far + 7);
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(Script, ParsesTimeAndExpiry)
+{
+    const auto t = ob::parse_script_line("time 500");
+    const auto a = ob::parse_script_line("add 7 buy 99 3 expire=900");
+
+    ASSERT_TRUE(t.has_value());
+    ASSERT_TRUE(a.has_value());
+
+    EXPECT_EQ(t->type, ob::CommandType::AdvanceTime);
+    EXPECT_EQ(t->timestamp, 500u);
+    EXPECT_EQ(a->expire_at, 900u);
+    EXPECT_FALSE(ob::parse_script_line("time").has_value());
+    EXPECT_FALSE(ob::parse_script_line("add 7 buy 99 3 expire=1 expire=2").has_value());
+}
+
+TEST(Auction, AccumulatesWithoutMatching)
+{
+    ob::Engine eng;
+    eng.apply(ob::Command::begin_auction());
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 100, 5));
+    const auto ev = eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 105, 5));
+
+    // crossed orders just rest while the auction runs
+    EXPECT_TRUE(of_type(ev, ob::EventType::Trade).empty());
+    EXPECT_EQ(*eng.book().best_bid_price(), 105);
+    EXPECT_EQ(*eng.book().best_ask_price(), 100);
+
+    const auto ioc = eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 105, 1, ob::TimeInForce::Ioc));
+    ASSERT_EQ(ioc.size(), 1u);
+    EXPECT_EQ(ioc[0].reason, "auction");
+
+    // a crossing requeue also just moves
+    eng.apply(ob::Command::modify(1, 99, 5));
+    EXPECT_EQ(*eng.book().best_ask_price(), 99);
+}
+
+TEST(Auction, UncrossAtMaxVolumePriceInPriceTimeOrder)
+{
+    ob::Engine eng;
+    eng.apply(ob::Command::begin_auction());
+
+    // demand 10@102 14@101 20@100 against supply 8@99 14@100 30@101, 14 trades at 100 or 101
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 102, 10));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 101, 4));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 100, 6));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Sell, 99, 8));
+    eng.apply(ob::Command::add_limit(5, ob::Side::Sell, 100, 6));
+    eng.apply(ob::Command::add_limit(6, ob::Side::Sell, 101, 16));
+
+    const auto ev = eng.apply(ob::Command::uncross());
+    const auto trades = of_type(ev, ob::EventType::Trade);
+
+    // 100 leaves an imbalance of 6 and 101 one of 16, so 100 wins
+    ob::Qty volume { 0 };
+    for (const auto& t : trades)
+    {
+        EXPECT_EQ(t.trade_price_ticks, 100);
+        volume += t.trade_qty;
+    }
+    EXPECT_EQ(volume, 14);
+
+    // highest bid and lowest ask fill first
+    ASSERT_FALSE(trades.empty());
+    EXPECT_EQ(trades[0].maker_id, 1u);
+    EXPECT_EQ(trades[0].taker_id, 4u);
+
+    EXPECT_FALSE(eng.book().in_auction());
+    EXPECT_FALSE(eng.book().has_order(1));
+    EXPECT_FALSE(eng.book().has_order(2));
+    EXPECT_EQ(eng.book().total_qty_at(ob::Side::Buy, 100), 6);
+    EXPECT_EQ(*eng.book().best_ask_price(), 101);
+    EXPECT_EQ(*eng.book().last_trade_price(), 100);
+}
+
+TEST(Auction, EquilibriumTieBreaks)
+{
+    // equal volume and imbalance at 100 and 101, the reference picks the nearer one
+    const std::vector<ob::PriceTicks> prices { 100, 101 };
+    const std::vector<ob::Qty> bids { 0, 5 };
+    const std::vector<ob::Qty> asks { 5, 0 };
+
+    const auto none = ob::find_equilibrium(prices, bids, asks, std::nullopt);
+    const auto high = ob::find_equilibrium(prices, bids, asks, 150);
+
+    ASSERT_TRUE(none.has_value());
+    ASSERT_TRUE(high.has_value());
+    EXPECT_EQ(none->price_ticks, 100);
+    EXPECT_EQ(high->price_ticks, 101);
+    EXPECT_EQ(high->volume, 5);
+    EXPECT_EQ(high->imbalance, 0);
+
+    EXPECT_FALSE(ob::find_equilibrium(prices, { 5, 0 }, { 0, 5 }, std::nullopt).has_value());
+}
+
+TEST(Script, ParsesAuction)
+{
+    const auto a = ob::parse_script_line("auction");
+    const auto u = ob::parse_script_line("uncross");
+
+    ASSERT_TRUE(a.has_value());
+    ASSERT_TRUE(u.has_value());
+    EXPECT_EQ(a->type, ob::CommandType::BeginAuction);
+    EXPECT_EQ(u->type, ob::CommandType::Uncross);
+    EXPECT_FALSE(ob::parse_script_line("uncross now").has_value());
+}
+
+TEST(Wire, CommandAndEventRoundTrip)
+{
+    const auto cmd = ob::Command::stop_limit(9, ob::Side::Sell, 95, 94, 7, ob::TimeInForce::Ioc).with_stp(3, ob::StpMode::Decrement).with_expiry(1'000).at(50);
+
+    ob::Event ev {};
+    ev.type = ob::EventType::Trade;
+    ev.maker_id = 1;
+    ev.taker_id = 2;
+    ev.trade_price_ticks = 100;
+    ev.trade_qty = 4;
+    ev.reason = "trade";
+
+    std::vector<char> buf;
+    ob::encode_command(cmd, 42, buf);
+    ob::encode_event(ev, buf);
+    ob::encode_ack(42, 1, buf);
+
+    ob::WireMessage msg {};
+    std::size_t off { 0 };
+    std::size_t used { 0 };
+
+    ASSERT_EQ(ob::decode_frame(buf.data(), buf.size(), msg, used), ob::WireStatus::Ok);
+    EXPECT_EQ(msg.kind, ob::WireKind::Command);
+    EXPECT_EQ(msg.tag, 42u);
+    EXPECT_EQ(msg.command.type, ob::CommandType::AddStop);
+    EXPECT_EQ(msg.command.side, ob::Side::Sell);
+    EXPECT_EQ(msg.command.stop_price_ticks, 95);
+    EXPECT_EQ(msg.command.price_ticks, 94);
+    EXPECT_EQ(msg.command.tif, ob::TimeInForce::Ioc);
+    EXPECT_EQ(msg.command.stp_mode, ob::StpMode::Decrement);
+    EXPECT_EQ(msg.command.expire_at, 1'000u);
+    EXPECT_EQ(msg.command.timestamp, 50u);
+    off += used;
+
+    ASSERT_EQ(ob::decode_frame(buf.data() + off, buf.size() - off, msg, used), ob::WireStatus::Ok);
+    EXPECT_EQ(msg.kind, ob::WireKind::Event);
+    EXPECT_EQ(ob::event_to_line(msg.event), ob::event_to_line(ev));
+    off += used;
+
+    ASSERT_EQ(ob::decode_frame(buf.data() + off, buf.size() - off, msg, used), ob::WireStatus::Ok);
+    EXPECT_EQ(msg.kind, ob::WireKind::Ack);
+    EXPECT_EQ(msg.event_count, 1u);
+    EXPECT_EQ(off + used, buf.size());
+}
+
+TEST(Wire, PartialAndMalformedFrames)
+{
+    std::vector<char> buf;
+    ob::encode_command(ob::Command::cancel(5), 1, buf);
+
+    ob::WireMessage msg {};
+    std::size_t used { 0 };
+
+    // every strict prefix waits for more bytes
+    for (std::size_t n = 0; n < buf.size(); ++n)
+    {
+        EXPECT_EQ(ob::decode_frame(buf.data(), n, msg, used), ob::WireStatus::Incomplete);
+        EXPECT_EQ(used, 0u);
+    }
+
+    // an out of range command type is rejected, not cast
+    std::vector<char> bad = buf;
+    bad[4 + 1 + 8] = 99;
+    EXPECT_EQ(ob::decode_frame(bad.data(), bad.size(), msg, used), ob::WireStatus::Malformed);
+
+    // a length beyond the cap is rejected before any wait
+    const char huge[4] = { 0, 0, 0, 1 };
+    EXPECT_EQ(ob::decode_frame(huge, sizeof(huge), msg, used), ob::WireStatus::Malformed);
+}
+
+// heap backing for an in process ring, aligned like a mapping would be
+struct TestRing
+{
+    explicit TestRing(std::size_t slots)
+        : words((ob::md_ring_bytes(slots) + 63) / 64 * 8 + 8)
+    {
+        void* p = words.data();
+        std::size_t space = words.size() * sizeof(std::uint64_t);
+        region = std::align(64, ob::md_ring_bytes(slots), p, space);
+    }
+
+    std::vector<std::uint64_t> words;
+    void* region { nullptr };
+};
+
+TEST(MarketData, ReaderSeesRecordsInOrderThenEmpty)
+{
+    TestRing ring(8);
+    ob::MdWriter writer(ring.region, 8);
+    ob::MdReader reader(ring.region);
+    ASSERT_TRUE(reader.valid());
+
+    for (ob::OrderId id = 1; id <= 3; ++id)
+    {
+        ob::MdRecord r {};
+        r.id = id;
+        r.price_ticks = 100 + static_cast<ob::PriceTicks>(id);
+        writer.publish(r);
+    }
+
+    ob::MdRecord out {};
+    std::uint64_t lost { 0 };
+    for (ob::OrderId id = 1; id <= 3; ++id)
+    {
+        ASSERT_EQ(reader.next(out, lost), ob::MdReadStatus::Ok);
+        EXPECT_EQ(out.id, id);
+        EXPECT_EQ(out.seq, id);
+        EXPECT_EQ(out.price_ticks, 100 + static_cast<ob::PriceTicks>(id));
+    }
+    EXPECT_EQ(reader.next(out, lost), ob::MdReadStatus::Empty);
+}
+
+TEST(MarketData, SlowReaderDetectsOverrun)
+{
+    TestRing ring(8);
+    ob::MdWriter writer(ring.region, 8);
+    ob::MdReader reader(ring.region);
+
+    // the writer laps the reader and never waits for it
+    for (ob::OrderId id = 1; id <= 20; ++id)
+    {
+        ob::MdRecord r {};
+        r.id = id;
+        writer.publish(r);
+    }
+
+    ob::MdRecord out {};
+    std::uint64_t lost { 0 };
+    ASSERT_EQ(reader.next(out, lost), ob::MdReadStatus::Overrun);
+    EXPECT_GT(lost, 0u);
+
+    // after resyncing the reader continues in order up to the newest record
+    ASSERT_EQ(reader.next(out, lost), ob::MdReadStatus::Ok);
+    ob::OrderId last = out.id;
+    while (reader.next(out, lost) == ob::MdReadStatus::Ok)
+    {
+        EXPECT_EQ(out.id, last + 1);
+        last = out.id;
+    }
+    EXPECT_EQ(last, 20u);
+}
+
+TEST(MarketData, LevelRecordsRebuildTheBook)
+{
+    TestRing ring(1024);
+    ob::MdWriter writer(ring.region, 1024);
+    ob::MdReader reader(ring.region);
+
+    ob::Engine eng;
+    eng.attach_market_data(&writer);
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Sell, 101, 5));
+    eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 102, 5));
+    eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 99, 5));
+    eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 101, 7));
+    eng.apply(ob::Command::modify(3, 98, 5));
+
+    std::map<std::pair<ob::Side, ob::PriceTicks>, ob::Qty> levels;
+    ob::MdRecord out {};
+    std::uint64_t lost { 0 };
+    std::size_t trades { 0 };
+    while (reader.next(out, lost) == ob::MdReadStatus::Ok)
+    {
+        if (out.kind == ob::MdKind::Level)
+        {
+            levels[{ out.side, out.price_ticks }] = out.qty;
+        }
+        else if (out.type == ob::EventType::Trade)
+        {
+            ++trades;
+        }
+    }
+
+    // the buy lifts 101 and rests its remainder there, the requeue empties 99
+    EXPECT_EQ(trades, 1u);
+    EXPECT_EQ((levels[{ ob::Side::Sell, 101 }]), 0);
+    EXPECT_EQ((levels[{ ob::Side::Sell, 102 }]), 5);
+    EXPECT_EQ((levels[{ ob::Side::Buy, 101 }]), 2);
+    EXPECT_EQ((levels[{ ob::Side::Buy, 99 }]), 0);
+    EXPECT_EQ((levels[{ ob::Side::Buy, 98 }]), 5);
+    eng.attach_market_data(nullptr);
+}
+
+TEST(MarketData, MassCancelPublishesEachLevelOnce)
+{
+    TestRing ring(4096);
+    ob::MdWriter writer(ring.region, 4096);
+    ob::MdReader reader(ring.region);
+
+    ob::Engine eng;
+    for (ob::OrderId id = 1; id <= 600; ++id)
+    {
+        eng.apply(ob::Command::add_limit(id, ob::Side::Buy, 1000 - static_cast<ob::PriceTicks>(id % 200), 1));
+    }
+    eng.attach_market_data(&writer);
+    eng.apply(ob::Command::mass_cancel_all());
+
+    std::map<std::pair<ob::Side, ob::PriceTicks>, int> levels;
+    ob::MdRecord out {};
+    std::uint64_t lost { 0 };
+    while (reader.next(out, lost) == ob::MdReadStatus::Ok)
+    {
+        if (out.kind == ob::MdKind::Level)
+        {
+            EXPECT_EQ(out.qty, 0);
+            ++levels[{ out.side, out.price_ticks }];
+        }
+    }
+    EXPECT_EQ(lost, 0u);
+    EXPECT_EQ(levels.size(), 200u);
+    for (const auto& [level, count] : levels)
+    {
+        EXPECT_EQ(count, 1);
+    }
+    eng.attach_market_data(nullptr);
+}
+
+static std::vector<std::string> read_lines(const std::string& path)
+{
+    std::ifstream in(path);
+    std::vector<std::string> out;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        out.push_back(line);
+    }
+    return out;
+}
+
+static std::vector<std::string> run_journaled(const ob::JournalOptions& opts, const std::string& path, std::uint64_t& durable)
+{
+    ob::Engine eng;
+    EXPECT_TRUE(eng.start_journal(path, opts));
+
+    std::vector<std::string> expected;
+    for (std::uint64_t i = 0; i < 200; ++i)
+    {
+        const ob::Side side = (i % 2 == 0) ? ob::Side::Buy : ob::Side::Sell;
+        const auto events = eng.apply(ob::Command::add_limit(i + 1, side, 100 + static_cast<std::int64_t>(i % 3), 5));
+        for (const auto& line : to_lines(events))
+        {
+            expected.push_back(line);
+        }
+    }
+
+    eng.sync_journal();
+    durable = eng.journal_durable_seq();
+    eng.stop_journal();
+    return expected;
+}
+
+TEST(Journal, RingWritesTheSameLinesAsTheEventLog)
+{
+    const std::string path = ::testing::TempDir() + "ob_journal_ring.log";
+
+    ob::JournalOptions opts {};
+    opts.buffer_bytes = 4096;
+    opts.group_bytes = 1024;
+
+    std::uint64_t durable { 0 };
+    const auto expected = run_journaled(opts, path, durable);
+
+    EXPECT_EQ(durable, 200u);
+    EXPECT_EQ(read_lines(path), expected);
+}
+
+TEST(Journal, PwriteFallbackMatches)
+{
+    const std::string path = ::testing::TempDir() + "ob_journal_pwrite.log";
+
+    ob::JournalOptions opts {};
+    opts.buffer_bytes = 4096;
+    opts.group_bytes = 512;
+    opts.use_io_uring = false;
+
+    std::uint64_t durable { 0 };
+    const auto expected = run_journaled(opts, path, durable);
+
+    EXPECT_EQ(durable, 200u);
+    EXPECT_EQ(read_lines(path), expected);
+}
+
+TEST(Journal, WatermarkOnlyMovesOnSync)
+{
+    const std::string path = ::testing::TempDir() + "ob_journal_watermark.log";
+
+    ob::Journal j;
+    ASSERT_TRUE(j.open(path));
+
+    // large groups mean nothing is handed to the disk until asked
+    const std::string rec = "record\n";
+    j.append(rec.data(), rec.size(), 1);
+    j.append(rec.data(), rec.size(), 2);
+    j.poll();
+    EXPECT_EQ(j.durable_seq(), 0u);
+    EXPECT_EQ(j.sync_count(), 0u);
+
+    // a record with no bytes still becomes durable behind the ones before it
+    j.append(nullptr, 0, 3);
+    j.sync();
+    EXPECT_EQ(j.durable_seq(), 3u);
+    EXPECT_EQ(j.sync_count(), 1u);
+    EXPECT_TRUE(j.healthy());
+
+    j.close();
+    EXPECT_EQ(read_lines(path).size(), 2u);
+}
+
+TEST(Journal, RecordLargerThanBufferSpansGroups)
+{
+    const std::string path = ::testing::TempDir() + "ob_journal_large.log";
+
+    ob::JournalOptions opts {};
+    opts.buffer_bytes = 4096;
+
+    ob::Journal j;
+    ASSERT_TRUE(j.open(path, opts));
+
+    const std::string big(10000, 'x');
+    j.append(big.data(), big.size(), 7);
+    j.sync();
+    EXPECT_EQ(j.durable_seq(), 7u);
+    EXPECT_GE(j.sync_count(), 3u);
+    j.close();
+
+    const auto lines = read_lines(path);
+    ASSERT_EQ(lines.size(), 1u);
+    EXPECT_EQ(lines[0], big);
+}
+
+// a mix that leaves stops, expiring orders, participants and stale wheel entries in the book
+static std::vector<ob::Command> recovery_commands()
+{
+    std::vector<ob::Command> cmds = *ob::make_workload("expiry", 3000);
+    cmds.resize(cmds.size() / 2);
+
+    const auto stops = *ob::make_workload("stop_cascade", 2000);
+    for (auto c : stops)
+    {
+        c.id += 1'000'000;
+        cmds.push_back(c);
+    }
+    return cmds;
+}
+
+TEST(Recovery, SnapshotImageRoundTrips)
+{
+    const auto cmds = recovery_commands();
+    const std::size_t cut = cmds.size() / 2;
+
+    ob::Engine a;
+    for (std::size_t i = 0; i < cut; ++i)
+    {
+        a.apply(cmds[i]);
+    }
+
+    std::vector<char> image;
+    a.book().save_state(image);
+
+    ob::OrderBook restored;
+    ASSERT_TRUE(restored.load_state(image.data(), image.size()));
+    EXPECT_EQ(restored.live_order_count(), a.book().live_order_count());
+    EXPECT_EQ(restored.pending_stop_count(), a.book().pending_stop_count());
+    EXPECT_EQ(restored.now(), a.book().now());
+
+    // a second image of the restored book is byte for byte the same
+    std::vector<char> again;
+    restored.save_state(again);
+    EXPECT_EQ(again, image);
+
+    // a cut image is refused and leaves the target alone
+    ob::OrderBook untouched;
+    EXPECT_FALSE(untouched.load_state(image.data(), image.size() - 1));
+    EXPECT_EQ(untouched.live_order_count(), 0u);
+}
+
+TEST(Recovery, SnapshotKeepsParticipantOrderAfterRequeue)
+{
+    ob::OrderBook live;
+    ob::OrderOptions opts {};
+    opts.participant = 7;
+    live.add_limit(1, ob::Side::Buy, 100, 10, opts);
+    live.add_limit(2, ob::Side::Buy, 100, 10, opts);
+    live.modify(1, 99, 10);
+
+    std::vector<char> image;
+    live.save_state(image);
+    ob::OrderBook restored;
+    ASSERT_TRUE(restored.load_state(image.data(), image.size()));
+    EXPECT_EQ(restored.state_hash(), live.state_hash());
+
+    // a replica rebuilt from the image cancels in the same order as the book it was taken from
+    const auto expected = to_lines(live.cancel_participant(7));
+    ASSERT_EQ(expected.size(), 2u);
+    EXPECT_EQ(to_lines(restored.cancel_participant(7)), expected);
+}
+
+TEST(Recovery, SnapshotFileReplacesTheOldOneDurably)
+{
+    const std::string path = ::testing::TempDir() + "ob_snapshot_file.snap";
+    const std::vector<char> first(100, 'a');
+    const std::vector<char> second(50, 'b');
+
+    ASSERT_TRUE(ob::write_snapshot_file(path, 1, first));
+    ASSERT_TRUE(ob::write_snapshot_file(path, 2, second));
+    EXPECT_FALSE(std::ifstream(path + ".tmp").good());
+
+    std::uint64_t seq { 0 };
+    std::vector<char> image;
+    ASSERT_TRUE(ob::read_snapshot_file(path, seq, image));
+    EXPECT_EQ(seq, 2u);
+    EXPECT_EQ(image, second);
+
+    // no directory to rename into or sync, so no snapshot
+    EXPECT_FALSE(ob::write_snapshot_file(::testing::TempDir() + "ob_missing_dir/x.snap", 3, second));
+}
+
+TEST(Recovery, ReaderStopsAtTornTail)
+{
+    std::vector<char> bytes;
+    for (std::uint64_t seq = 1; seq <= 3; ++seq)
+    {
+        ob::encode_wal_record(ob::Command::add_limit(seq, ob::Side::Buy, 100, 1), seq, bytes);
+    }
+    const std::size_t good = bytes.size();
+
+    // half of a fourth record is what a crash mid write leaves
+    std::vector<char> fourth;
+    ob::encode_wal_record(ob::Command::cancel(1), 4, fourth);
+    bytes.insert(bytes.end(), fourth.begin(), fourth.begin() + static_cast<std::ptrdiff_t>(fourth.size() / 2));
+
+    const std::string path = ::testing::TempDir() + "ob_wal_torn.wal";
+    std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+    ob::WalReader r;
+    ASSERT_TRUE(r.open(path));
+    ob::Command c {};
+    std::uint64_t seq { 0 };
+    for (std::uint64_t want = 1; want <= 3; ++want)
+    {
+        ASSERT_EQ(r.next(c, seq), ob::WalStatus::Ok);
+        EXPECT_EQ(seq, want);
+        EXPECT_EQ(c.id, want);
+    }
+    EXPECT_EQ(r.next(c, seq), ob::WalStatus::Torn);
+    EXPECT_EQ(r.valid_bytes(), good);
+}
+
+TEST(Recovery, CorruptRecordFailsCrc)
+{
+    std::vector<char> bytes;
+    ob::encode_wal_record(ob::Command::add_limit(1, ob::Side::Buy, 100, 1), 1, bytes);
+    ob::encode_wal_record(ob::Command::add_limit(2, ob::Side::Buy, 100, 1), 2, bytes);
+    bytes[bytes.size() - 3] ^= 0x40;
+
+    const std::string path = ::testing::TempDir() + "ob_wal_crc.wal";
+    std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+    ob::WalReader r;
+    ASSERT_TRUE(r.open(path));
+    ob::Command c {};
+    std::uint64_t seq { 0 };
+    EXPECT_EQ(r.next(c, seq), ob::WalStatus::Ok);
+    EXPECT_EQ(r.next(c, seq), ob::WalStatus::Torn);
+}
+
+TEST(Recovery, SnapshotPlusJournalTailMatchesUninterruptedRun)
+{
+    const auto cmds = recovery_commands();
+    const std::size_t snap_at = cmds.size() / 3;
+    const std::size_t crash_at = (cmds.size() * 2) / 3;
+
+    const std::string wal = ::testing::TempDir() + "ob_recover.wal";
+    const std::string snap = ::testing::TempDir() + "ob_recover.snap";
+
+    ob::Engine live;
+    ASSERT_TRUE(live.start_command_journal(wal));
+    for (std::size_t i = 0; i < crash_at; ++i)
+    {
+        live.apply(cmds[i]);
+        if (i + 1 == snap_at)
+        {
+            ASSERT_TRUE(live.save_snapshot(snap));
+        }
+    }
+    live.sync_command_journal();
+    EXPECT_EQ(live.command_journal_durable_seq(), crash_at);
+
+    ob::Engine recovered;
+    ob::RecoveryResult res {};
+    ASSERT_TRUE(recovered.recover(snap, wal, res));
+    EXPECT_EQ(res.snapshot_seq, snap_at);
+    EXPECT_EQ(res.replayed, crash_at - snap_at);
+    EXPECT_EQ(res.last_seq, crash_at);
+    EXPECT_FALSE(res.torn);
+
+    // both continue with the rest of the stream and must say exactly the same things
+    for (std::size_t i = crash_at; i < cmds.size(); ++i)
+    {
+        ASSERT_EQ(to_lines(recovered.apply(cmds[i])), to_lines(live.apply(cmds[i]))) << "command " << i;
+    }
+    EXPECT_EQ(recovered.book().live_order_count(), live.book().live_order_count());
+}
+
+TEST(Recovery, KeepsTheInstrumentSpec)
+{
+    const std::string wal = ::testing::TempDir() + "ob_recover_spec.wal";
+    const std::string snap = ::testing::TempDir() + "ob_recover_spec.snap";
+
+    ob::InstrumentSpec spec {};
+    spec.tick = 5;
+
+    ob::Engine live;
+    live.set_instrument(spec);
+    ASSERT_TRUE(live.start_command_journal(wal));
+    live.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 10));
+    ASSERT_TRUE(live.save_snapshot(snap));
+    live.apply(ob::Command::add_limit(2, ob::Side::Buy, 7, 10)); // off tick, rejected
+    live.apply(ob::Command::add_limit(3, ob::Side::Sell, 105, 4));
+    live.stop_command_journal();
+    ASSERT_EQ(live.book().live_order_count(), 2u);
+
+    for (const std::string& from : { std::string(), snap })
+    {
+        ob::Engine recovered;
+        recovered.set_instrument(spec);
+        ob::RecoveryResult res {};
+        ASSERT_TRUE(recovered.recover(from, wal, res));
+        EXPECT_EQ(recovered.book().instrument().tick, 5);
+        EXPECT_EQ(recovered.book().state_hash(), live.book().state_hash());
+        EXPECT_FALSE(recovered.book().has_order(2));
+    }
+}
+
+TEST(Recovery, ResumedJournalCutsTornTail)
+{
+    const std::string wal = ::testing::TempDir() + "ob_resume.wal";
+
+    {
+        ob::Engine eng;
+        ASSERT_TRUE(eng.start_command_journal(wal));
+        eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 5));
+        eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 105, 5));
+        eng.stop_command_journal();
+    }
+    std::ofstream(wal, std::ios::binary | std::ios::app) << "garbage";
+
+    ob::Engine eng;
+    ob::RecoveryResult res {};
+    ASSERT_TRUE(eng.recover("", wal, res));
+    EXPECT_TRUE(res.torn);
+    EXPECT_EQ(res.last_seq, 2u);
+
+    ob::JournalOptions opts {};
+    opts.resume_at = res.valid_bytes;
+    ASSERT_TRUE(eng.start_command_journal(wal, opts));
+    EXPECT_EQ(eng.command_journal_durable_seq(), 2u);
+    eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 101, 5));
+    eng.stop_command_journal();
+
+    ob::Engine again;
+    ASSERT_TRUE(again.recover("", wal, res));
+    EXPECT_FALSE(res.torn);
+    EXPECT_EQ(res.replayed, 3u);
+    EXPECT_EQ(again.book().best_bid_price(), std::optional<ob::PriceTicks>(101));
+}
+
+static std::vector<ob::HashCheckpoint> hash_run(const std::vector<ob::Command>& cmds, std::uint64_t every)
+{
+    ob::Engine eng;
+    eng.start_event_hash(every);
+    for (const auto& c : cmds)
+    {
+        eng.apply(c);
+    }
+    eng.checkpoint_event_hash();
+    return eng.hash_checkpoints();
+}
+
+TEST(EventHash, SameStreamSameCheckpoints)
+{
+    const auto cmds = *ob::make_workload("match", 500);
+    const auto a = hash_run(cmds, 100);
+    const auto b = hash_run(cmds, 100);
+
+    ASSERT_EQ(a.size(), cmds.size() / 100 + ((cmds.size() % 100) ? 1 : 0));
+    EXPECT_EQ(ob::first_divergent_checkpoint(a, b), a.size());
+    EXPECT_EQ(a.back().command, cmds.size());
+    EXPECT_GT(a.back().events, cmds.size());
+}
+
+TEST(EventHash, DivergenceFoundAtFirstAffectedCheckpoint)
+{
+    auto cmds = *ob::make_workload("match", 500);
+    const auto expected = hash_run(cmds, 50);
+
+    // a changed qty at command 321 leaves checkpoints up to 300 alone and breaks every later one
+    cmds[320].qty += 1;
+    const auto actual = hash_run(cmds, 50);
+
+    const std::size_t k = ob::first_divergent_checkpoint(expected, actual);
+    ASSERT_LT(k, expected.size());
+    EXPECT_EQ(expected[k].command, 350u);
+    EXPECT_EQ(ob::first_divergent_command(expected[k], actual[k]), 321u);
+    for (std::size_t i = k; i < expected.size(); ++i)
+    {
+        EXPECT_NE(expected[i].hash, actual[i].hash);
+    }
+}
+
+TEST(EventHash, OrderOfEventsMatters)
+{
+    ob::Event a {};
+    a.type = ob::EventType::OrderAccepted;
+    a.id = 1;
+    ob::Event b = a;
+    b.id = 2;
+
+    ob::EventHasher ab;
+    ab.add(a);
+    ab.add(b);
+    ob::EventHasher ba;
+    ba.add(b);
+    ba.add(a);
+
+    EXPECT_NE(ab.value(), ba.value());
+    EXPECT_EQ(ab.count(), 2u);
+}
+
+TEST(EventHash, SidecarRoundTrip)
+{
+    const auto cps = hash_run(*ob::make_workload("match", 300), 64);
+    const std::string path = ::testing::TempDir() + "ob_hash.txt";
+    ASSERT_TRUE(ob::write_hash_checkpoints(path, 64, 0, cps));
+
+    std::uint64_t every { 0 };
+    std::uint64_t state_every { 1 };
+    std::vector<ob::HashCheckpoint> back;
+    ASSERT_TRUE(ob::read_hash_checkpoints(path, every, state_every, back));
+    EXPECT_EQ(every, 64u);
+    EXPECT_EQ(state_every, 0u);
+    EXPECT_EQ(ob::first_divergent_checkpoint(cps, back), cps.size());
+    ASSERT_EQ(back.size(), cps.size());
+    for (std::size_t i = 0; i < cps.size(); ++i)
+    {
+        EXPECT_EQ(back[i].digests, cps[i].digests);
+    }
+    EXPECT_EQ(back[0].digests.size(), 64u);
+}
+
+TEST(EventHash, SidecarCarriesTheStateCheckpointInterval)
+{
+    const auto cmds = *ob::make_workload("match", 300);
+    auto run = [&](std::uint64_t state_every)
+    {
+        ob::Engine eng;
+        eng.start_event_hash(16);
+        eng.set_state_checkpoints(state_every);
+        for (const auto& c : cmds)
+        {
+            eng.apply(c);
+        }
+        eng.checkpoint_event_hash();
+        return eng.hash_checkpoints();
+    };
+
+    const auto cps = run(10);
+    const std::string path = ::testing::TempDir() + "ob_hash_state.txt";
+    ASSERT_TRUE(ob::write_hash_checkpoints(path, 16, 10, cps));
+
+    std::uint64_t every { 0 };
+    std::uint64_t state_every { 0 };
+    std::vector<ob::HashCheckpoint> back;
+    ASSERT_TRUE(ob::read_hash_checkpoints(path, every, state_every, back));
+    EXPECT_EQ(every, 16u);
+    EXPECT_EQ(state_every, 10u);
+
+    // the state checkpoint events are hashed, a rerun only agrees with the same interval
+    EXPECT_EQ(ob::first_divergent_checkpoint(back, run(state_every)), back.size());
+    EXPECT_EQ(ob::first_divergent_checkpoint(back, run(0)), 0u);
+}
+
+TEST(StateHash, ReturnsToEmptyAfterEverythingLeaves)
+{
+    ob::Engine eng;
+    EXPECT_EQ(eng.book().state_hash(), 0u);
+
+    eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 10));
+    const std::uint64_t one = eng.book().state_hash();
+    EXPECT_NE(one, 0u);
+
+    eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 99, 5));
+    EXPECT_NE(eng.book().state_hash(), one);
+
+    eng.apply(ob::Command::cancel(2));
+    EXPECT_EQ(eng.book().state_hash(), one);
+
+    // a partial fill is a qty change, the full fill removes the key
+    eng.apply(ob::Command::add_limit(3, ob::Side::Sell, 100, 4));
+    EXPECT_NE(eng.book().state_hash(), one);
+    eng.apply(ob::Command::add_limit(4, ob::Side::Sell, 100, 6));
+    EXPECT_EQ(eng.book().state_hash(), 0u);
+}
+
+TEST(StateHash, EqualBooksHashEqualAcrossPaths)
+{
+    // a reduction in place and an order that simply rested with that qty leave identical books
+    ob::Engine a;
+    a.apply(ob::Command::add_limit(1, ob::Side::Sell, 105, 10));
+    a.apply(ob::Command::modify(1, 105, 6));
+
+    ob::Engine b;
+    b.apply(ob::Command::add_limit(1, ob::Side::Sell, 105, 6));
+
+    EXPECT_EQ(a.book().state_hash(), b.book().state_hash());
+
+    // a requeue takes a new seq so priority differences show up
+    a.apply(ob::Command::modify(1, 105, 7));
+    b.apply(ob::Command::modify(1, 105, 7));
+    EXPECT_EQ(a.book().state_hash(), b.book().state_hash());
+    a.apply(ob::Command::add_limit(2, ob::Side::Sell, 105, 1));
+    EXPECT_NE(a.book().state_hash(), b.book().state_hash());
+}
+
+TEST(StateHash, SnapshotRestoreKeepsHash)
+{
+    ob::Engine eng;
+    for (const auto& c : recovery_commands())
+    {
+        eng.apply(c);
+    }
+
+    std::vector<char> image;
+    eng.book().save_state(image);
+    ob::OrderBook restored;
+    ASSERT_TRUE(restored.load_state(image.data(), image.size()));
+    EXPECT_EQ(restored.state_hash(), eng.book().state_hash());
+}
+
+TEST(StateHash, CheckpointEventsCarryHash)
+{
+    ob::Engine eng;
+    eng.set_state_checkpoints(2);
+
+    EXPECT_TRUE(of_type(eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 100, 10)), ob::EventType::StateCheckpoint).empty());
+
+    const auto ev = eng.apply(ob::Command::add_limit(2, ob::Side::Sell, 101, 3));
+    const auto cps = of_type(ev, ob::EventType::StateCheckpoint);
+    ASSERT_EQ(cps.size(), 1u);
+    EXPECT_EQ(ev.back().type, ob::EventType::StateCheckpoint);
+    EXPECT_EQ(cps[0].id, 2u);
+    EXPECT_EQ(cps[0].seq, eng.book().state_hash());
+    EXPECT_EQ(cps[0].qty, 2);
+
+    // the line format round trips like any other event
+    const auto back = ob::line_to_event(ob::event_to_line(cps[0]));
+    ASSERT_TRUE(back.has_value());
+    EXPECT_EQ(back->type, ob::EventType::StateCheckpoint);
+    EXPECT_EQ(back->seq, cps[0].seq);
+}
+
+TEST(Memory, ComponentsScaleWithTheBook)
+{
+    ob::Engine eng;
+    const ob::MemoryUsage empty = eng.book().memory_usage();
+    EXPECT_EQ(empty.orders, 0u);
+    EXPECT_EQ(empty.levels, 0u);
+    EXPECT_GE(empty.other, sizeof(ob::OrderBook));
+
+    for (ob::OrderId id = 1; id <= 1000; ++id)
+    {
+        eng.apply(ob::Command::add_limit(id, ob::Side::Buy, 100 - static_cast<ob::PriceTicks>(id % 10), 5));
+    }
+
+    // every order costs at least its own struct plus list links, the hidden part the estimate exists for
+    const ob::MemoryUsage m = eng.book().memory_usage();
+    EXPECT_GE(m.orders, 1000 * (sizeof(ob::Order) + 2 * sizeof(void*)));
+    EXPECT_GT(m.levels, 0u);
+    EXPECT_LT(m.levels, m.orders);
+    EXPECT_GE(m.index, 1000 * sizeof(ob::OrderId));
+    EXPECT_EQ(m.total(), m.orders + m.levels + m.index + m.stops + m.other + m.slack);
+}
+
+TEST(Memory, HighWaterMarksSurviveCancels)
+{
+    ob::Engine eng;
+    for (ob::OrderId id = 1; id <= 300; ++id)
+    {
+        eng.apply(ob::Command::add_limit(id, ob::Side::Sell, 100 + static_cast<ob::PriceTicks>(id % 30), 1));
+    }
+    const ob::MemoryUsage full = eng.book().memory_usage();
+
+    eng.apply(ob::Command::mass_cancel_all());
+    const ob::MemoryUsage after = eng.book().memory_usage();
+
+    EXPECT_EQ(after.orders, 0u);
+    EXPECT_EQ(after.peak_live_orders, 300u);
+    EXPECT_EQ(after.peak_levels, 30u);
+    EXPECT_GE(after.peak_bytes, full.orders + full.levels);
+
+    // the id index keeps a bucket for each order it held, they now show up as slack
+    EXPECT_EQ(after.index, 0u);
+    EXPECT_GE(after.slack, 300 * sizeof(void*));
+    EXPECT_GT(full.index, 0u);
+}
+
+// counts what the book asks of its resource and forwards to the heap
+struct CountingResource : std::pmr::memory_resource
+{
+    std::size_t allocations { 0 };
+    std::size_t outstanding { 0 };
+
+    void* do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        ++allocations;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override
+    {
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+TEST(Arena, EveryBookNodeComesFromTheResource)
+{
+    CountingResource counting;
+    {
+        ob::Engine eng(&counting);
+        eng.apply_all(recovery_commands());
+        EXPECT_GT(eng.book().live_order_count(), 0u);
+        EXPECT_GT(counting.allocations, eng.book().live_order_count());
+    }
+
+    // nothing the book allocated leaked to or from another resource
+    EXPECT_EQ(counting.outstanding, 0u);
+}
+
+TEST(Arena, RunsOnAResetArenaMatchTheHeap)
+{
+    const auto cmds = recovery_commands();
+
+    ob::Engine heap;
+    const auto expected = to_lines(heap.apply_all(cmds));
+
+    ob::Arena arena(std::size_t { 64 } << 10);
+    for (int run = 0; run < 3; ++run)
+    {
+        arena.reset();
+        ob::Engine eng(arena.resource());
+        EXPECT_EQ(to_lines(eng.apply_all(cmds)), expected);
+        EXPECT_EQ(eng.book().state_hash(), heap.book().state_hash());
+    }
+}
+
+TEST(Arena, LoadStateStaysOnTheResource)
+{
+    CountingResource counting;
+    ob::OrderBook src;
+    src.add_limit(1, ob::Side::Buy, 100, 10);
+    src.add_limit(2, ob::Side::Sell, 105, 4);
+
+    std::vector<char> image;
+    src.save_state(image);
+
+    ob::OrderBook book(&counting);
+    ASSERT_TRUE(book.load_state(image.data(), image.size()));
+    EXPECT_EQ(book.resource(), &counting);
+
+    const std::size_t before = counting.allocations;
+    book.add_limit(3, ob::Side::Buy, 99, 1);
+    EXPECT_GT(counting.allocations, before);
+}
+
+TEST(Arena, LockedArenaBacksEnginesOnSeveralThreads)
+{
+    const auto cmds = *ob::make_workload("match", 2000);
+
+    ob::Engine heap;
+    const auto expected = to_lines(heap.apply_all(cmds));
+
+    ob::Arena arena(std::size_t { 16 } << 20);
+    ob::LockedResource locked(arena.resource());
+
+    std::vector<std::vector<std::string>> got(4);
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < got.size(); ++t)
+    {
+        pool.emplace_back([&, t]
+        {
+            for (int run = 0; run < 3; ++run)
+            {
+                ob::Engine eng(&locked);
+                got[t] = to_lines(eng.apply_all(cmds));
+            }
+        });
+    }
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+
+    for (const auto& lines : got)
+    {
+        EXPECT_EQ(lines, expected);
+    }
+}
+
+TEST(Capacity, ReservedEngineMatchesHeapWithinItsArena)
+{
+    const auto cmds = recovery_commands();
+
+    ob::Engine heap;
+    const auto expected = to_lines(heap.apply_all(cmds));
+
+    ob::CapacityOptions cap {};
+    cap.max_live_orders = 10000;
+    cap.expected_levels = 200;
+    ob::Engine eng(cap);
+    ASSERT_NE(eng.arena(), nullptr);
+    EXPECT_EQ(to_lines(eng.apply_all(cmds)), expected);
+
+    // the estimate held, nothing spilled into a heap chunk
+    EXPECT_EQ(eng.arena()->overflow_chunks(), 0u);
+    EXPECT_LE(eng.arena()->used_bytes(), eng.arena()->reserved_bytes());
+#if defined(__linux__)
+    EXPECT_NE(eng.arena()->pages(), ob::ArenaPages::Heap);
+#endif
+}
+
+TEST(Capacity, ReserveSizesTheIndexUpFront)
+{
+    ob::OrderBook book;
+    book.reserve(50000, 10);
+
+    // the buckets exist before any order, so they count as slack on an empty book
+    const ob::MemoryUsage m = book.memory_usage();
+    EXPECT_GE(m.slack, 50000 * sizeof(void*));
+    EXPECT_EQ(m.orders, 0u);
+}
+
+TEST(Capacity, ReserveSizesFlatSidesUpFront)
+{
+    using FlatBook = ob::BasicOrderBook<ob::GenericInstrument, ob::BookPolicy<ob::ListLevels, ob::FlatSides, ob::FlatIndex>>;
+    const std::size_t levels = 500;
+
+    // a new level costs its value and its first list node, the side vectors only grow without the reserve
+    auto allocations_for_levels = [&](bool reserve)
+    {
+        CountingResource counting;
+        FlatBook book(&counting);
+        if (reserve)
+        {
+            book.reserve(2 * levels, levels);
+        }
+        const std::size_t before = counting.allocations;
+        for (std::size_t i = 0; i < levels; ++i)
+        {
+            book.add_limit(static_cast<ob::OrderId>(i + 1), ob::Side::Buy, static_cast<ob::PriceTicks>(1000 - i), 10);
+            book.add_limit(static_cast<ob::OrderId>(levels + i + 1), ob::Side::Sell, static_cast<ob::PriceTicks>(2000 + i), 10);
+        }
+        return counting.allocations - before;
+    };
+
+    EXPECT_EQ(allocations_for_levels(true), 2 * 2 * levels);
+    EXPECT_GT(allocations_for_levels(false), 2 * 2 * levels);
+}
+
+TEST(Capacity, LoadStateKeepsTheReservation)
+{
+    ob::OrderBook src;
+    src.add_limit(1, ob::Side::Buy, 100, 10);
+    std::vector<char> image;
+    src.save_state(image);
+
+    ob::OrderBook book;
+    book.reserve(50000, 10);
+    ASSERT_TRUE(book.load_state(image.data(), image.size()));
+    EXPECT_GE(book.memory_usage().slack, 49999 * sizeof(void*));
+    EXPECT_TRUE(book.has_order(1));
+}
+
+// the estimate of a book that is not all std nodes, checked against what it asked its resource for
+template <typename Policy>
+void expect_estimate_covers_the_resource()
+{
+    CountingResource counting;
+    ob::BasicOrderBook<ob::GenericInstrument, Policy> book(&counting);
+
+    // deep levels, cancels in the middle that leave holes, partial fills at the touch
+    for (ob::OrderId id = 1; id <= 2000; ++id)
+    {
+        const auto offset = static_cast<ob::PriceTicks>(id % 40);
+        book.add_limit(id, (id % 2 == 0) ? ob::Side::Buy : ob::Side::Sell, (id % 2 == 0) ? 1000 - offset : 1001 + offset, 10);
+    }
+    for (ob::OrderId id = 3; id <= 2000; id += 3)
+    {
+        book.cancel(id);
+    }
+    book.add_limit(5000, ob::Side::Buy, 1001, 25);
+
+    const ob::MemoryUsage m = book.memory_usage();
+    const std::size_t estimate = m.total() - sizeof(book);
+    EXPECT_GE(estimate, counting.outstanding);
+    EXPECT_LE(estimate, 2 * counting.outstanding);
+    EXPECT_GT(m.orders, 0u);
+    EXPECT_GT(m.slack, 0u);
+}
+
+TEST(Memory, PolicyContainersReportTheirOwnBytes)
+{
+    expect_estimate_covers_the_resource<ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex, ob::FenwickQueues>>();
+    expect_estimate_covers_the_resource<ob::BookPolicy<ob::ListLevels, ob::BitsetSides, ob::FlatIndex>>();
+    expect_estimate_covers_the_resource<ob::BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::HashIndex>>();
+}
+
+TEST(Instrument, GenericSpecRejectsWithReasons)
+{
+    ob::Engine eng;
+    ob::InstrumentSpec spec {};
+    spec.tick = 5;
+    spec.lot = 10;
+    spec.min_price = 50;
+    spec.max_price = 500;
+    spec.max_qty = 1000;
+    eng.set_instrument(spec);
+
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 102, 10))[0].reason, "tick_size");
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 15))[0].reason, "lot_size");
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(3, ob::Side::Buy, 505, 10))[0].reason, "price_band");
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(4, ob::Side::Buy, 100, 2000))[0].reason, "max_qty");
+    EXPECT_EQ(eng.apply(ob::Command::stop_limit(5, ob::Side::Buy, 110, 103, 10))[0].reason, "tick_size");
+
+    // the basic checks still come first
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(6, ob::Side::Buy, 0, 10))[0].reason, "invalid");
+
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(7, ob::Side::Buy, 100, 20))[0].type, ob::EventType::OrderAccepted);
+    const auto mod = eng.apply(ob::Command::modify(7, 101, 20));
+    ASSERT_EQ(mod.size(), 1u);
+    EXPECT_EQ(mod[0].type, ob::EventType::ModifyRejected);
+    EXPECT_EQ(mod[0].reason, "tick_size");
+    EXPECT_EQ(eng.book().live_order_count(), 1u);
+}
+
+TEST(Instrument, InvalidSpecIsRefused)
+{
+    ob::Engine eng;
+    ob::InstrumentSpec good {};
+    good.tick = 5;
+    ASSERT_TRUE(eng.set_instrument(good));
+
+    // each of these would divide by zero or reject everything, the book keeps the spec it had
+    std::vector<ob::InstrumentSpec> bad(6, good);
+    bad[0].tick = 0;
+    bad[1].lot = 0;
+    bad[2].min_price = 0;
+    bad[3].min_price = 200;
+    bad[3].max_price = 100;
+    bad[4].max_qty = 0;
+    bad[5].tick = -5;
+    for (const auto& spec : bad)
+    {
+        EXPECT_FALSE(eng.set_instrument(spec));
+        EXPECT_EQ(eng.book().instrument().tick, 5);
+    }
+
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(1, ob::Side::Buy, 102, 10))[0].reason, "tick_size");
+    EXPECT_EQ(eng.apply(ob::Command::add_limit(2, ob::Side::Buy, 100, 10))[0].type, ob::EventType::OrderAccepted);
+}
+
+TEST(Instrument, FixedBookMatchesGenericWithinItsSpec)
+{
+    ob::OrderBook wide;
+    ob::BasicOrderBook<ob::EquityInstrument> narrow;
+    std::vector<ob::Event> a;
+    std::vector<ob::Event> b;
+
+    auto both = [&](auto&& op)
+    {
+        const auto ea = op(wide);
+        const auto eb = op(narrow);
+        a.insert(a.end(), ea.begin(), ea.end());
+        b.insert(b.end(), eb.begin(), eb.end());
+    };
+
+    // adds, stop limits, amends, cancels and expiry around a mid price, fixed seed so both see the same stream
+    // stop markets are left out, their accepted event carries the instrument's top price
+    std::uint64_t x = 12345;
+    for (ob::OrderId id = 1; id <= 4000; ++id)
+    {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        const std::uint64_t r = x >> 33;
+        const ob::Side side = (r & 1) ? ob::Side::Buy : ob::Side::Sell;
+        const ob::PriceTicks px = 1000 + static_cast<ob::PriceTicks>(r % 21) - 10;
+        const ob::Qty qty = 1 + static_cast<ob::Qty>((r >> 8) % 50);
+
+        ob::OrderOptions opts {};
+        opts.expire_at = (r % 7 == 0) ? id + 50 : 0;
+
+        switch ((r >> 16) % 6)
+        {
+        case 0:
+            both([&](auto& book) { return book.add_stop(id, side, px, px, qty, opts); });
+            break;
+        case 1:
+            both([&](auto& book) { return book.cancel(id - (r >> 20) % id); });
+            break;
+        case 2:
+            both([&](auto& book) { return book.modify(id - (r >> 20) % id, px, qty); });
+            break;
+        default:
+            both([&](auto& book) { return book.add_limit(id, side, px, qty, opts); });
+            break;
+        }
+        if (id % 10 == 0)
+        {
+            both([&](auto& book) { return book.advance_time(id); });
+        }
+    }
+
+    EXPECT_EQ(to_lines(b), to_lines(a));
+    EXPECT_EQ(narrow.state_hash(), wide.state_hash());
+    EXPECT_GT(narrow.live_order_count(), 0u);
+    EXPECT_LT(sizeof(ob::BasicOrderBook<ob::EquityInstrument>::Order), sizeof(ob::Order));
+}
+
+TEST(Instrument, FixedBookRefusesImagesOutsideItsSpec)
+{
+    ob::OrderBook wide;
+    wide.add_limit(1, ob::Side::Sell, 20'000'000, 5);
+    std::vector<char> image;
+    wide.save_state(image);
+
+    ob::BasicOrderBook<ob::EquityInstrument> narrow;
+    EXPECT_FALSE(narrow.load_state(image.data(), image.size()));
+
+    ob::OrderBook ok;
+    ok.add_limit(1, ob::Side::Sell, 20'000, 5);
+    image.clear();
+    ok.save_state(image);
+    ASSERT_TRUE(narrow.load_state(image.data(), image.size()));
+    EXPECT_EQ(narrow.total_qty_at(ob::Side::Sell, 20'000), 5);
+}
+
+TEST(SoaLevel, KernelsAgreeWithScalarAtEveryLength)
+{
+    std::vector<ob::Qty> q;
+    for (std::size_t n = 0; n < 70; ++n)
+    {
+        EXPECT_EQ(ob::sum_qty(q.data(), q.size()), ob::sum_qty_scalar(q.data(), q.size()));
+        const ob::Qty total = ob::sum_qty_scalar(q.data(), q.size());
+        for (ob::Qty target = 1; target <= total + 1; target += 7)
+        {
+            EXPECT_EQ(ob::fill_index(q.data(), q.size(), target), ob::fill_index_scalar(q.data(), q.size(), target));
+        }
+        q.push_back(static_cast<ob::Qty>(n % 5)); // zeros included, they are holes in a level
+    }
+}
+
+TEST(SoaLevel, FifoEraseAndCompaction)
+{
+    ob::SoaLevel level;
+    for (std::uint64_t i = 1; i <= 100; ++i)
+    {
+        level.push_back(1000 + i, i * 2, 10);
+    }
+    EXPECT_EQ(level.total_qty(), 1000);
+
+    // every other order leaves, then the front fills, holes never show to the caller
+    for (std::uint64_t i = 1; i <= 100; i += 2)
+    {
+        EXPECT_TRUE(level.erase(i * 2));
+    }
+    EXPECT_FALSE(level.erase(2));
+    EXPECT_FALSE(level.erase(3));
+    EXPECT_EQ(level.size(), 50u);
+    EXPECT_EQ(level.front_id(), 1002u);
+    EXPECT_EQ(level.sum(), level.total_qty());
+
+    level.fill_front(4);
+    EXPECT_EQ(level.front_qty(), 6);
+    level.fill_front(6);
+    EXPECT_EQ(level.front_id(), 1004u);
+
+    // compaction ran, the view is mostly live slots now
+    EXPECT_LT(level.span(), 2 * level.size());
+    EXPECT_TRUE(level.reduce(8, 3));
+    EXPECT_EQ(level.total_qty(), 48 * 10 + 3);
+    EXPECT_EQ(level.sum(), level.total_qty());
+
+    // seq 8 is order 1004 at the front, its 3 plus 10 from 1006 make exactly 13
+    EXPECT_EQ(level.id_data()[level.fill_slot(13)], 1006u);
+    EXPECT_EQ(level.id_data()[level.fill_slot(14)], 1008u);
+    EXPECT_EQ(level.fill_slot(level.total_qty() + 1), level.span());
+}
+
+TEST(PriceBitset, NextAndPrevMatchAnOrderedSet)
+{
+    const ob::PriceTicks lo = -5'000;
+    const ob::PriceTicks hi = 1'000'000'000;
+    ob::PriceBitset bits(lo, hi);
+    std::set<ob::PriceTicks> ref;
+
+    EXPECT_FALSE(bits.next_at_or_above(lo).has_value());
+    EXPECT_FALSE(bits.insert(lo - 1));
+    EXPECT_FALSE(bits.insert(hi + 1));
+
+    // clustered prices share leaf words, scattered ones make the table grow
+    std::uint64_t r = 7;
+    for (int i = 0; i < 20'000; ++i)
+    {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        const bool near = (r >> 60) < 8;
+        const ob::PriceTicks p = near ? lo + static_cast<ob::PriceTicks>((r >> 20) % 4096)
+                                      : lo + static_cast<ob::PriceTicks>((r >> 20) % static_cast<std::uint64_t>(hi - lo + 1));
+        if ((r >> 58) % 3 == 0)
+        {
+            EXPECT_EQ(bits.erase(p), ref.erase(p) == 1);
+        }
+        else
+        {
+            EXPECT_EQ(bits.insert(p), ref.insert(p).second);
+        }
+    }
+    // the range edges themselves
+    EXPECT_EQ(bits.insert(lo), ref.insert(lo).second);
+    EXPECT_EQ(bits.insert(hi), ref.insert(hi).second);
+    EXPECT_EQ(bits.size(), ref.size());
+
+    for (int i = 0; i < 5'000; ++i)
+    {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        const ob::PriceTicks q = lo + static_cast<ob::PriceTicks>((r >> 20) % static_cast<std::uint64_t>(hi - lo + 1));
+
+        const auto up = ref.lower_bound(q);
+        ASSERT_EQ(bits.next_at_or_above(q), up == ref.end() ? std::nullopt : std::optional<ob::PriceTicks>(*up));
+
+        auto down = ref.upper_bound(q);
+        ASSERT_EQ(bits.prev_at_or_below(q), down == ref.begin() ? std::nullopt : std::optional<ob::PriceTicks>(*--down));
+    }
+
+    // walking the successors visits the set in order
+    std::vector<ob::PriceTicks> walked;
+    for (auto p = bits.next_at_or_above(lo); p.has_value(); p = (*p == hi) ? std::nullopt : bits.next_at_or_above(*p + 1))
+    {
+        walked.push_back(*p);
+    }
+    EXPECT_TRUE(std::equal(walked.begin(), walked.end(), ref.begin(), ref.end()));
+}
+
+TEST(PriceBitset, EmptiesCleanlyAfterDeletes)
+{
+    ob::PriceBitset bits(0, 1LL << 40);
+    std::vector<ob::PriceTicks> prices;
+    for (ob::PriceTicks i = 0; i < 3'000; ++i)
+    {
+        prices.push_back(i * 977'777'777LL % (1LL << 40));
+        EXPECT_TRUE(bits.insert(prices.back()));
+    }
+
+    // deleting out of order exercises the backward shift in the leaf table
+    for (std::size_t i = 0; i < prices.size(); i += 2)
+    {
+        EXPECT_TRUE(bits.erase(prices[i]));
+    }
+    for (std::size_t i = 1; i < prices.size(); i += 2)
+    {
+        EXPECT_TRUE(bits.contains(prices[i]));
+    }
+    for (std::size_t i = 1; i < prices.size(); i += 2)
+    {
+        EXPECT_TRUE(bits.erase(prices[i]));
+    }
+
+    EXPECT_TRUE(bits.empty());
+    EXPECT_FALSE(bits.next_at_or_above(0).has_value());
+    EXPECT_FALSE(bits.prev_at_or_below(1LL << 40).has_value());
+    EXPECT_TRUE(bits.insert(42));
+    EXPECT_EQ(bits.prev_at_or_below(1LL << 40), 42);
+}
+
+TEST(PriceBitset, SparseMapKeepsPayloadsWithPrices)
+{
+    ob::SparsePriceMap<ob::Qty> levels(100, 1'000'000);
+    *levels.get_or_create(5'000) += 10;
+    *levels.get_or_create(5'000) += 5;
+    *levels.get_or_create(700) += 1;
+    EXPECT_EQ(levels.get_or_create(99), nullptr);
+
+    EXPECT_EQ(levels.size(), 2u);
+    EXPECT_EQ(*levels.find(5'000), 15);
+    EXPECT_EQ(levels.prices().next_at_or_above(701), 5'000);
+
+    EXPECT_TRUE(levels.erase(700));
+    EXPECT_FALSE(levels.erase(700));
+    EXPECT_EQ(levels.find(700), nullptr);
+    EXPECT_EQ(levels.prices().next_at_or_above(0), 5'000);
+}
+
+// events of a whole command list on one book type, plus its state hash at the end
+template <typename Book>
+static std::vector<std::string> run_policy(const std::vector<ob::Command>& cmds, std::uint64_t& state_hash)
+{
+    Book book;
+    std::vector<std::string> lines;
+    for (const auto& c : cmds)
+    {
+        const auto more = to_lines(ob::execute_command(book, c));
+        lines.insert(lines.end(), more.begin(), more.end());
+    }
+    state_hash = book.state_hash();
+    return lines;
+}
+
+template <typename Policy>
+static void expect_same_as_default(const std::vector<ob::Command>& cmds)
+{
+    std::uint64_t want_hash { 0 };
+    std::uint64_t got_hash { 0 };
+    const auto want = run_policy<ob::OrderBook>(cmds, want_hash);
+    const auto got = run_policy<ob::BasicOrderBook<ob::GenericInstrument, Policy>>(cmds, got_hash);
+    ASSERT_EQ(got.size(), want.size());
+    EXPECT_EQ(got, want);
+    EXPECT_EQ(got_hash, want_hash);
+}
+
+TEST(BookPolicy, EveryCombinationMatchesTheDefaultOnEveryWorkload)
+{
+    for (const char* name : { "amend", "mass_cancel", "match", "match_stp", "stop_cascade", "expiry", "auction" })
+    {
+        SCOPED_TRACE(name);
+        const auto cmds = *ob::make_workload(name, 2000);
+        expect_same_as_default<ob::BookPolicy<ob::ListLevels, ob::TreeSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ListLevels, ob::FlatSides, ob::HashIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ListLevels, ob::FlatSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::HashIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::HashIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ListLevels, ob::BitsetSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::BitsetSides, ob::FlatIndex>>(cmds);
+        expect_same_as_default<ob::QueueTrackedPolicy>(cmds);
+        expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex, ob::FenwickQueues>>(cmds);
+    }
+}
+
+TEST(BookPolicy, ChunkLevelCompactionKeepsChainsAndLocators)
+{
+    // one old order holds the front while a participant churns behind it, so holes pile up and get compacted
+    std::vector<ob::Command> cmds;
+    cmds.push_back(ob::Command::add_limit(1, ob::Side::Buy, 100, 5, ob::TimeInForce::Gtc, 7));
+    ob::OrderId id = 10;
+    for (int round = 0; round < 20; ++round)
+    {
+        for (int k = 0; k < 10; ++k)
+        {
+            cmds.push_back(ob::Command::add_limit(id + k, ob::Side::Buy, 100, 1 + k, ob::TimeInForce::Gtc, 7 + k % 2));
+        }
+        // the newest order of each round stays, so the holes sit between live orders and never trim off an end
+        for (int k = 0; k < 9; k += (round % 4 == 3) ? 2 : 1)
+        {
+            ob::Command c {};
+            c.type = ob::CommandType::Cancel;
+            c.id = id + k;
+            cmds.push_back(c);
+        }
+        id += 10;
+    }
+
+    // a requeue within the level and across levels, then a partial fill through the front
+    ob::Command m {};
+    m.type = ob::CommandType::Modify;
+    m.id = id - 9;
+    m.price_ticks = 100;
+    m.qty = 50;
+    cmds.push_back(m);
+    m.id = id - 7;
+    m.price_ticks = 99;
+    cmds.push_back(m);
+    cmds.push_back(ob::Command::add_limit(id + 1, ob::Side::Sell, 100, 12));
+
+    ob::Command mass {};
+    mass.type = ob::CommandType::MassCancel;
+    mass.scope = ob::MassCancelScope::Participant;
+    mass.participant = 8;
+    cmds.push_back(mass);
+    mass.participant = 7;
+    cmds.push_back(mass);
+
+    expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::TreeSides, ob::HashIndex>>(cmds);
+    expect_same_as_default<ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex>>(cmds);
+}
+
+TEST(BookPolicy, FlatContainersBehaveLikeTheStandardOnes)
+{
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource();
+    ob::FlatLevelMap<ob::PriceTicks, int, std::greater<ob::PriceTicks>> flat(mr);
+    std::map<ob::PriceTicks, int, std::greater<ob::PriceTicks>> tree;
+    ob::FlatIdMap<ob::OrderId, int> ids(mr);
+    std::unordered_map<ob::OrderId, int> ref_ids;
+
+    std::uint64_t r = 11;
+    for (int i = 0; i < 5'000; ++i)
+    {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        const ob::PriceTicks px = static_cast<ob::PriceTicks>((r >> 33) % 300);
+        const ob::OrderId key = 1 + (r >> 40) % 2'000;
+        if ((r >> 20) % 3 == 0)
+        {
+            EXPECT_EQ(flat.erase(px), tree.erase(px));
+            EXPECT_EQ(ids.erase(key), ref_ids.erase(key));
+        }
+        else
+        {
+            flat[px] += 1;
+            tree[px] += 1;
+            EXPECT_EQ(ids.emplace(key, i).second, ref_ids.emplace(key, i).second);
+        }
+
+        const auto lb = flat.lower_bound(px);
+        const auto tlb = tree.lower_bound(px);
+        ASSERT_EQ(lb == flat.end(), tlb == tree.end());
+        if (tlb != tree.end())
+        {
+            EXPECT_EQ(lb->first, tlb->first);
+        }
+    }
+
+    ASSERT_EQ(flat.size(), tree.size());
+    auto t = tree.begin();
+    for (const auto& kv : flat)
+    {
+        EXPECT_EQ(kv.first, t->first);
+        EXPECT_EQ(kv.second, t->second);
+        ++t;
+    }
+
+    ASSERT_EQ(ids.size(), ref_ids.size());
+    for (const auto& kv : ref_ids)
+    {
+        ASSERT_NE(ids.find(kv.first), ids.end());
+        EXPECT_EQ(ids.find(kv.first)->second, kv.second);
+    }
+
+    // a range erase from the best price down
+    flat.erase(flat.begin(), flat.upper_bound(150));
+    tree.erase(tree.begin(), tree.upper_bound(150));
+    ASSERT_EQ(flat.size(), tree.size());
+    EXPECT_EQ(flat.begin()->first, tree.begin()->first);
+}
+
+template <typename Compare>
+static void expect_bitset_sides_like_a_tree()
+{
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource();
+    ob::BitsetLevelMap<ob::PriceTicks, int, Compare> bits(mr);
+    std::map<ob::PriceTicks, int, Compare> tree;
+
+    // clustered prices plus a few far out ones, so both the dense and the hashed tiers are walked
+    std::uint64_t r = 17;
+    for (int i = 0; i < 5'000; ++i)
+    {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        ob::PriceTicks px = 1 + static_cast<ob::PriceTicks>((r >> 33) % 300);
+        if ((r >> 12) % 16 == 0)
+        {
+            px = static_cast<ob::PriceTicks>((r >> 24) % 4) << (20 + (r >> 30) % 40);
+            px = std::max<ob::PriceTicks>(px, 1);
+        }
+        if ((r >> 20) % 3 == 0)
+        {
+            EXPECT_EQ(bits.erase(px), tree.erase(px));
+        }
+        else
+        {
+            bits[px] += 1;
+            tree[px] += 1;
+        }
+
+        ASSERT_EQ(bits.lower_bound(px) == bits.end(), tree.lower_bound(px) == tree.end());
+        if (tree.lower_bound(px) != tree.end())
+        {
+            EXPECT_EQ(bits.lower_bound(px)->first, tree.lower_bound(px)->first);
+        }
+        ASSERT_EQ(bits.upper_bound(px) == bits.end(), tree.upper_bound(px) == tree.end());
+        if (tree.upper_bound(px) != tree.end())
+        {
+            EXPECT_EQ(bits.upper_bound(px)->first, tree.upper_bound(px)->first);
+        }
+    }
+
+    ASSERT_EQ(bits.size(), tree.size());
+    auto t = tree.begin();
+    for (const auto& kv : bits)
+    {
+        EXPECT_EQ(kv.first, t->first);
+        EXPECT_EQ(kv.second, t->second);
+        ++t;
+    }
+    auto rt = tree.rbegin();
+    for (auto it = bits.rbegin(); it != bits.rend(); ++it, ++rt)
+    {
+        EXPECT_EQ(it->first, rt->first);
+    }
+
+    // a range erase from the best price, then a move keeps every value
+    bits.erase(bits.begin(), bits.upper_bound(150));
+    tree.erase(tree.begin(), tree.upper_bound(150));
+    ob::BitsetLevelMap<ob::PriceTicks, int, Compare> moved(mr);
+    moved = std::move(bits);
+    ASSERT_EQ(moved.size(), tree.size());
+    EXPECT_TRUE(bits.empty());
+    EXPECT_EQ(moved.begin()->first, tree.begin()->first);
+    EXPECT_EQ(std::prev(moved.end())->first, tree.rbegin()->first);
+}
+
+TEST(BookPolicy, BitsetSidesBehaveLikeATree)
+{
+    expect_bitset_sides_like_a_tree<std::less<ob::PriceTicks>>();
+    expect_bitset_sides_like_a_tree<std::greater<ob::PriceTicks>>();
+}
+
+// the depth queries must agree with the per price calls whatever the side container
+template <typename Book>
+static void expect_depth_matches_levels(const Book& book, ob::Side side)
+{
+    std::vector<ob::DepthLevel> visited;
+    book.visit_depth(side, 1000, [&](const ob::DepthLevel& d) { visited.push_back(d); });
+    ASSERT_FALSE(visited.empty());
+
+    for (std::size_t i = 0; i < visited.size(); ++i)
+    {
+        const auto& d = visited[i];
+        EXPECT_EQ(d.total_qty, book.total_qty_at(side, d.price_ticks));
+        EXPECT_EQ(d.order_count, book.order_ids_at(side, d.price_ticks).size());
+        if (i > 0)
+        {
+            EXPECT_TRUE((side == ob::Side::Buy) ? d.price_ticks < visited[i - 1].price_ticks : d.price_ticks > visited[i - 1].price_ticks);
+        }
+    }
+
+    // a short buffer takes the best levels and stops
+    std::array<ob::DepthLevel, 3> top {};
+    const std::size_t n = book.copy_depth(side, top);
+    ASSERT_EQ(n, std::min<std::size_t>(3, visited.size()));
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        EXPECT_EQ(top[i].price_ticks, visited[i].price_ticks);
+        EXPECT_EQ(top[i].total_qty, visited[i].total_qty);
+    }
+}
+
+TEST(DepthQuery, CopyAndVisitAgreeWithPerPriceCalls)
+{
+    const auto cmds = *ob::make_workload("amend", 3000);
+
+    ob::OrderBook book;
+    ob::BasicOrderBook<ob::GenericInstrument, ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex>> flat;
+    for (const auto& c : cmds)
+    {
+        ob::execute_command(book, c);
+        ob::execute_command(flat, c);
+    }
+
+    for (const ob::Side side : { ob::Side::Buy, ob::Side::Sell })
+    {
+        expect_depth_matches_levels(book, side);
+        expect_depth_matches_levels(flat, side);
+    }
+}
+
+TEST(DepthQuery, OrdersAtALevelComeInFifoOrder)
+{
+    ob::OrderBook book;
+    book.add_limit(1, ob::Side::Sell, 100, 5);
+    book.add_limit(2, ob::Side::Sell, 100, 3);
+    book.add_limit(3, ob::Side::Sell, 101, 1);
+    book.add_limit(4, ob::Side::Sell, 100, 2);
+    book.modify(1, 100, 7); // requeues behind 4
+
+    std::vector<ob::OrderId> seen;
+    ob::Qty qty = 0;
+    EXPECT_EQ(book.visit_orders_at(ob::Side::Sell, 100, [&](const ob::OrderBook::Order& o)
+    {
+        seen.push_back(o.id);
+        qty += o.qty;
+    }), 3u);
+    EXPECT_EQ(seen, (std::vector<ob::OrderId> { 2, 4, 1 }));
+    EXPECT_EQ(qty, book.total_qty_at(ob::Side::Sell, 100));
+    EXPECT_EQ(seen, book.order_ids_at(ob::Side::Sell, 100));
+
+    // a buffer shorter than the level keeps the front of the queue
+    std::array<ob::OrderId, 2> ids {};
+    EXPECT_EQ(book.copy_order_ids_at(ob::Side::Sell, 100, ids), 2u);
+    EXPECT_EQ(ids[0], 2u);
+    EXPECT_EQ(ids[1], 4u);
+
+    EXPECT_EQ(book.visit_orders_at(ob::Side::Buy, 100, [](const ob::OrderBook::Order&) { FAIL(); }), 0u);
+    EXPECT_EQ(book.copy_order_ids_at(ob::Side::Sell, 99, ids), 0u);
+    EXPECT_EQ(book.visit_depth(ob::Side::Buy, 10, [](const ob::DepthLevel&) { FAIL(); }), 0u);
+}
+
+TEST(FillEstimate, MatchesWhatATakerWouldFill)
+{
+    ob::OrderBook book;
+    book.add_limit(1, ob::Side::Sell, 100, 5);
+    book.add_limit(2, ob::Side::Sell, 100, 3);
+    book.add_limit(3, ob::Side::Sell, 102, 4);
+    book.add_limit(4, ob::Side::Sell, 105, 10);
+    const std::uint64_t hash = book.state_hash();
+
+    const auto e = book.estimate_fill(ob::Side::Buy, 14);
+    EXPECT_EQ(e.filled_qty, 14);
+    EXPECT_EQ(e.notional, 8 * 100 + 4 * 102 + 2 * 105);
+    EXPECT_DOUBLE_EQ(e.vwap, 1418.0 / 14.0);
+    EXPECT_EQ(e.worst_price_ticks, 105);
+    EXPECT_EQ(e.levels, 3u);
+    EXPECT_EQ(book.state_hash(), hash);
+
+    // the same qty sent as a taker trades exactly that
+    ob::OrderBook taker;
+    taker.add_limit(1, ob::Side::Sell, 100, 5);
+    taker.add_limit(2, ob::Side::Sell, 100, 3);
+    taker.add_limit(3, ob::Side::Sell, 102, 4);
+    taker.add_limit(4, ob::Side::Sell, 105, 10);
+    ob::Qty traded = 0;
+    std::int64_t notional = 0;
+    for (const auto& ev : taker.add_limit(9, ob::Side::Buy, 1'000, 14, ob::OrderOptions { ob::TimeInForce::Ioc }))
+    {
+        if (ev.type == ob::EventType::Trade)
+        {
+            traded += ev.trade_qty;
+            notional += ev.trade_price_ticks * ev.trade_qty;
+        }
+    }
+    EXPECT_EQ(traded, e.filled_qty);
+    EXPECT_EQ(notional, e.notional);
+
+    // more than the side holds fills what there is, an exact level boundary stops on that level
+    const auto all = book.estimate_fill(ob::Side::Buy, 100);
+    EXPECT_EQ(all.filled_qty, 22);
+    EXPECT_EQ(all.worst_price_ticks, 105);
+    const auto edge = book.estimate_fill(ob::Side::Buy, 8);
+    EXPECT_EQ(edge.worst_price_ticks, 100);
+    EXPECT_EQ(edge.levels, 1u);
+
+    const auto none = book.estimate_fill(ob::Side::Sell, 5);
+    EXPECT_EQ(none.filled_qty, 0);
+    EXPECT_EQ(none.worst_price_ticks, 0);
+    EXPECT_EQ(none.vwap, 0.0);
+}
+
+TEST(FillEstimate, BatchAnswersEveryQtyInAnyOrder)
+{
+    const auto cmds = *ob::make_workload("match", 3000);
+    ob::OrderBook book;
+    for (const auto& c : cmds)
+    {
+        ob::execute_command(book, c);
+    }
+
+    const std::vector<ob::Qty> qtys { 0, 1, 10, 50, 50, 200, 1'000, 5, 100'000, 30 };
+    std::vector<ob::FillEstimate> out(qtys.size());
+    for (const ob::Side side : { ob::Side::Buy, ob::Side::Sell })
+    {
+        book.estimate_fills(side, qtys, out);
+        for (std::size_t i = 0; i < qtys.size(); ++i)
+        {
+            const auto one = book.estimate_fill(side, qtys[i]);
+            EXPECT_EQ(out[i].filled_qty, one.filled_qty);
+            EXPECT_EQ(out[i].notional, one.notional);
+            EXPECT_EQ(out[i].worst_price_ticks, one.worst_price_ticks);
+            EXPECT_EQ(out[i].levels, one.levels);
+
+            // a walk over the orders themselves
+            ob::Qty filled = 0;
+            std::int64_t notional = 0;
+            book.visit_depth(side == ob::Side::Buy ? ob::Side::Sell : ob::Side::Buy, 100'000, [&](const ob::DepthLevel& d)
+            {
+                book.visit_orders_at(side == ob::Side::Buy ? ob::Side::Sell : ob::Side::Buy, d.price_ticks, [&](const ob::OrderBook::Order& o)
+                {
+                    const ob::Qty take = std::min(o.qty, qtys[i] - filled);
+                    filled += take;
+                    notional += take * d.price_ticks;
+                });
+            });
+            EXPECT_EQ(one.filled_qty, filled);
+            EXPECT_EQ(one.notional, notional);
+        }
+    }
+}
+
+using TrackedBook = ob::BasicOrderBook<ob::GenericInstrument, ob::QueueTrackedPolicy>;
+using WalkBook = ob::BasicOrderBook<ob::GenericInstrument, ob::DefaultBookPolicy>;
+using TrackedChunkBook = ob::BasicOrderBook<ob::GenericInstrument, ob::BookPolicy<ob::ChunkLevels, ob::FlatSides, ob::FlatIndex, ob::FenwickQueues>>;
+
+// every live order of book against the walk the default book does
+template <typename Book>
+static void expect_positions_match_walk(const Book& book, const WalkBook& walk)
+{
+    for (const ob::Side side : { ob::Side::Buy, ob::Side::Sell })
+    {
+        book.visit_depth(side, ~std::size_t { 0 }, [&](const ob::DepthLevel& d)
+        {
+            book.visit_orders_at(side, d.price_ticks, [&](const typename Book::Order& o)
+            {
+                const auto got = book.queue_position(o.id);
+                const auto want = walk.queue_position(o.id);
+                ASSERT_TRUE(got.has_value() && want.has_value());
+                EXPECT_EQ(got->qty_ahead, want->qty_ahead);
+                EXPECT_EQ(got->orders_ahead, want->orders_ahead);
+            });
+        });
+    }
+}
+
+TEST(QueuePosition, TracksFillsCancelsReductionsAndRequeues)
+{
+    TrackedBook book;
+    for (ob::OrderId id = 1; id <= 5; ++id)
+    {
+        book.add_limit(id, ob::Side::Sell, 100, static_cast<ob::Qty>(id));
+    }
+    EXPECT_EQ(book.queue_position(5)->qty_ahead, 10);
+    EXPECT_EQ(book.queue_position(5)->orders_ahead, 4u);
+    EXPECT_EQ(book.queue_position(1)->qty_ahead, 0);
+
+    book.add_limit(10, ob::Side::Buy, 100, 2); // fills 1 and one of 2
+    book.cancel(3);
+    book.modify(4, 100, 1); // reduction keeps its place
+    EXPECT_EQ(book.queue_position(5)->qty_ahead, 1 + 1);
+    EXPECT_EQ(book.queue_position(5)->orders_ahead, 2u);
+
+    book.modify(2, 100, 6); // increase requeues behind 5
+    EXPECT_EQ(book.queue_position(2)->qty_ahead, 1 + 5);
+    EXPECT_EQ(book.queue_position(2)->orders_ahead, 2u);
+    EXPECT_EQ(book.queue_position(4)->qty_ahead, 0);
+    EXPECT_FALSE(book.queue_position(3).has_value());
+
+    // enough churn at one price to reset the tree several times
+    WalkBook walk;
+    TrackedChunkBook chunk;
+    for (ob::OrderId id = 100; id < 1100; ++id)
+    {
+        const auto add = ob::Command::add_limit(id, ob::Side::Buy, 90, 1 + static_cast<ob::Qty>(id % 7));
+        ob::execute_command(walk, add);
+        ob::execute_command(chunk, add);
+        if (id % 4 != 0)
+        {
+            ob::execute_command(walk, ob::Command::cancel(id - 50));
+            ob::execute_command(chunk, ob::Command::cancel(id - 50));
+        }
+    }
+    expect_positions_match_walk(chunk, walk);
+
+    // a level that only grows doubles its tree in place, then fills take their slots from the head
+    WalkBook deep_walk;
+    TrackedBook deep;
+    for (ob::OrderId id = 2000; id < 2300; ++id)
+    {
+        const auto add = ob::Command::add_limit(id, ob::Side::Sell, 120, 1 + static_cast<ob::Qty>(id % 5));
+        ob::execute_command(deep_walk, add);
+        ob::execute_command(deep, add);
+    }
+    const auto take = ob::Command::add_limit(3000, ob::Side::Buy, 120, 40);
+    ob::execute_command(deep_walk, take);
+    ob::execute_command(deep, take);
+    expect_positions_match_walk(deep, deep_walk);
+}
+
+TEST(QueuePosition, TreesAgreeWithTheWalkOnEveryWorkload)
+{
+    for (const char* name : { "amend", "mass_cancel", "match", "match_stp", "stop_cascade", "expiry", "auction" })
+    {
+        SCOPED_TRACE(name);
+        const auto cmds = *ob::make_workload(name, 2000);
+
+        WalkBook walk;
+        TrackedBook tracked;
+        TrackedChunkBook chunk;
+        for (std::size_t i = 0; i < cmds.size(); ++i)
+        {
+            ob::execute_command(walk, cmds[i]);
+            ob::execute_command(tracked, cmds[i]);
+            ob::execute_command(chunk, cmds[i]);
+            if (i % 100 == 99)
+            {
+                expect_positions_match_walk(tracked, walk);
+                expect_positions_match_walk(chunk, walk);
+            }
+        }
+    }
+}
+
+TEST(QueuePosition, EngineBookKeepsQueueTrees)
+{
+    // the engine's book answers from a tree per level, with fills taking the head slot from the tree
+    static_assert(std::is_same_v<ob::OrderBook, TrackedBook>);
+
+    ob::Engine eng;
+    WalkBook walk;
+    const auto cmds = *ob::make_workload("match_stp", 3000);
+    for (std::size_t i = 0; i < cmds.size(); ++i)
+    {
+        eng.apply(cmds[i]);
+        ob::execute_command(walk, cmds[i]);
+        if (i % 250 == 249)
+        {
+            expect_positions_match_walk(eng.book(), walk);
+        }
+    }
+}